@@ -0,0 +1,18 @@
+TARGET = jupii-contentid-bench
+
+TEMPLATE = app
+
+QT = core
+CONFIG += c++11 console object_parallel_to_source
+CONFIG -= app_bundle
+
+PROJECTDIR = $$PWD/..
+
+INCLUDEPATH += $$PROJECTDIR/core
+
+HEADERS += \
+    $$PROJECTDIR/core/contentid.h
+
+SOURCES += \
+    src/contentidbench.cpp \
+    $$PROJECTDIR/core/contentid.cpp
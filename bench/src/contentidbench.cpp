@@ -0,0 +1,252 @@
+/* Copyright (C) 2017 Michal Kosciesza <michal@mkiol.net>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <getopt.h>
+
+#include <cstdlib>
+#include <iostream>
+
+#include <QString>
+#include <QStringList>
+#include <QUrl>
+#include <QUrlQuery>
+#include <QList>
+#include <QElapsedTimer>
+
+#include "contentid.h"
+#include "utils.h"
+
+// Keys are defined in utils.cpp, which pulls whole app with it. Bench
+// links only contentid.cpp, so keys are defined here with the same values.
+const QString Utils::typeKey = "jupii_type";
+const QString Utils::cookieKey = "jupii_cookie";
+const QString Utils::nameKey = "jupii_name";
+const QString Utils::authorKey = "jupii_author";
+const QString Utils::iconKey = "jupii_icon";
+const QString Utils::descKey = "jupii_desc";
+
+namespace {
+const char* usage =
+        "Usage: jupii-contentid-bench [options]\n"
+        "Compares ContentId with parsing of id query on every call, like\n"
+        "Utils::pathTypeNameCookieIconFromId did before ContentId. Playlist\n"
+        "and content server look up the same ids over and over, so every id\n"
+        "from the set is looked up many times.\n\n"
+        "  -n, --ids N       number of distinct ids (default 500)\n"
+        "  -r, --rounds N    lookups of every id (default 200)\n"
+        "  -h, --help        this help\n";
+
+struct Options {
+    int ids = 500;
+    int rounds = 200;
+};
+
+struct Meta {
+    QString path;
+    int type = 0;
+    QString name;
+    QString cookie;
+    QUrl icon;
+    QString desc;
+    QString author;
+};
+
+bool parse(int argc, char *argv[], Options &opts)
+{
+    static const struct option longOpts[] = {
+        {"ids", required_argument, nullptr, 'n'},
+        {"rounds", required_argument, nullptr, 'r'},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0}
+    };
+
+    int c;
+    while ((c = getopt_long(argc, argv, "n:r:h", longOpts, nullptr)) != -1) {
+        switch (c) {
+        case 'n': opts.ids = atoi(optarg); break;
+        case 'r': opts.rounds = atoi(optarg); break;
+        case 'h':
+            std::cout << usage;
+            exit(0);
+        default:
+            return false;
+        }
+    }
+
+    return optind == argc && opts.ids > 0 && opts.rounds > 0;
+}
+
+QString randString(int len)
+{
+    static const QString pc("ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789");
+    QString rs;
+    for (int i = 0; i < len; ++i)
+        rs.append(pc.at(qrand() % pc.length()));
+    return rs;
+}
+
+// Mix of ids as they appear in playlist: local music and video files,
+// internet radio streams with name and icon, and mic/pulse items
+QStringList makeIds(int count)
+{
+    QStringList ids;
+
+    for (int i = 0; i < count; ++i) {
+        QUrl url;
+        QUrlQuery q;
+
+        switch (i % 4) {
+        case 0:
+            url = QUrl::fromLocalFile(
+                        QString("/home/nemo/Music/Artist %1/Album %2/%3 - Track %3.mp3")
+                        .arg(i / 40).arg(i / 10).arg(i % 10 + 1));
+            q.addQueryItem(Utils::typeKey, "2");
+            break;
+        case 1:
+            url = QUrl::fromLocalFile(
+                        QString("/home/nemo/Videos/Camera/VID_2019%1_1204.mp4")
+                        .arg(i, 4, 10, QChar('0')));
+            q.addQueryItem(Utils::typeKey, "3");
+            break;
+        case 2:
+            url = QUrl(QString("http://stream%1.radio.example.com:8000/live.aac")
+                       .arg(i));
+            q.addQueryItem(Utils::typeKey, "2");
+            q.addQueryItem(Utils::nameKey, QString("Radio Station %1").arg(i));
+            q.addQueryItem(Utils::iconKey, QString(
+                           "http://radio.example.com/logos/%1.png").arg(i));
+            q.addQueryItem(Utils::descKey, "Jazz, Blues & Soul");
+            break;
+        default:
+            url = QUrl(i % 8 == 3 ? "jupii://mic" : "jupii://pulse");
+            q.addQueryItem(Utils::nameKey, QString("Capture %1").arg(i));
+            q.addQueryItem(Utils::authorKey, "Jupii");
+            break;
+        }
+
+        q.addQueryItem(Utils::cookieKey, randString(5));
+        url.setQuery(q);
+        ids << url.toString();
+    }
+
+    return ids;
+}
+
+// Body of Utils::pathTypeNameCookieIconFromId before ContentId
+bool parseEveryCall(const QUrl &id, Meta &m)
+{
+    if (!id.isValid())
+        return false;
+
+    if (id.isLocalFile())
+        m.path = id.toLocalFile();
+    else
+        m.path.clear();
+
+    QUrlQuery q(id);
+    if (q.hasQueryItem(Utils::typeKey))
+        m.type = q.queryItemValue(Utils::typeKey).toInt();
+    if (q.hasQueryItem(Utils::cookieKey))
+        m.cookie = q.queryItemValue(Utils::cookieKey);
+    if (q.hasQueryItem(Utils::nameKey))
+        m.name = q.queryItemValue(Utils::nameKey);
+    if (q.hasQueryItem(Utils::iconKey))
+        m.icon = QUrl(q.queryItemValue(Utils::iconKey));
+    if (q.hasQueryItem(Utils::descKey))
+        m.desc = q.queryItemValue(Utils::descKey);
+    if (q.hasQueryItem(Utils::authorKey))
+        m.author = q.queryItemValue(Utils::authorKey);
+
+    return true;
+}
+
+// Current Utils::pathTypeNameCookieIconFromId
+template<typename T>
+bool viaContentId(const T &str, Meta &m)
+{
+    ContentId id(str);
+    if (!id.id().isValid())
+        return false;
+
+    m.path = id.path();
+    if (id.hasType())
+        m.type = id.type();
+    m.cookie = id.cookie();
+    m.name = id.name();
+    m.icon = id.icon();
+    m.desc = id.desc();
+    m.author = id.author();
+
+    return true;
+}
+
+template<typename T, typename F>
+qint64 run(const QList<T> &ids, int rounds, F lookup, int *checksum)
+{
+    int sum = 0;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    for (int r = 0; r < rounds; ++r) {
+        for (const auto &id : ids) {
+            Meta m;
+            if (lookup(id, m))
+                sum += m.type + m.cookie.size() + m.name.size() +
+                        m.path.size();
+        }
+    }
+
+    qint64 ns = timer.nsecsElapsed();
+    *checksum = sum;
+    return ns;
+}
+}
+
+int main(int argc, char *argv[])
+{
+    Options opts;
+    if (!parse(argc, argv, opts)) {
+        std::cerr << usage;
+        return 1;
+    }
+
+    const auto ids = makeIds(opts.ids);
+    QList<QUrl> urls;
+    for (const auto &id : ids)
+        urls << QUrl(id);
+
+    // Playlist keeps its items alive, so lookups hit already interned data
+    QElapsedTimer timer;
+    timer.start();
+    QList<ContentId> playlist;
+    for (const auto &url : urls)
+        playlist << ContentId(url);
+    const qint64 internNs = timer.nsecsElapsed();
+
+    const qint64 calls = qint64(opts.ids) * opts.rounds;
+
+    int parseSum, urlSum, strSum;
+    qint64 parseNs = run(urls, opts.rounds, parseEveryCall, &parseSum);
+    qint64 urlNs = run(urls, opts.rounds, viaContentId<QUrl>, &urlSum);
+    qint64 strNs = run(ids, opts.rounds, viaContentId<QString>, &strSum);
+
+    if (parseSum != urlSum || parseSum != strSum) {
+        std::cerr << "Results differ: " << parseSum << ", " << urlSum
+                  << ", " << strSum << "\n";
+        return 1;
+    }
+
+    std::cout << "ids: " << opts.ids << ", lookups: " << calls
+              << ", interned: " << ContentId::internedCount() << "\n"
+              << "first ContentId:       " << internNs / opts.ids << " ns/id\n"
+              << "parse every call:      " << parseNs / calls << " ns/lookup\n"
+              << "ContentId from QUrl:   " << urlNs / calls << " ns/lookup\n"
+              << "ContentId from string: " << strNs / calls << " ns/lookup\n";
+
+    return 0;
+}
@@ -10,6 +10,11 @@
 #include <QThread>
 #include <QGuiApplication>
 #include <QTime>
+#include <QMutexLocker>
+#include <QElapsedTimer>
+
+#include <future>
+#include <memory>
 
 #include "avtransport.h"
 #include "directory.h"
@@ -17,6 +22,46 @@
 #include "utils.h"
 #include "taskexecutor.h"
 #include "contentserver.h"
+#include "devicecaps.h"
+#include "renderergroup.h"
+
+namespace {
+// Result of an asynchronous action for the thread waiting on it. If the
+// action is dropped without completion (e.g. service was destroyed), wait()
+// reports UPNP_E_CANCELED.
+template<typename T>
+class ActionReply
+{
+public:
+    T value = T();
+
+    std::function<void(int, const T&)> callback()
+    {
+        auto done = std::make_shared<std::promise<int>>();
+        m_ret = done->get_future();
+        T* v = &value;
+        return [done, v](int ret, const T &val) {
+            *v = val;
+            done->set_value(ret);
+        };
+    }
+
+    // id is value returned by async action call
+    int wait(int id)
+    {
+        if (id < 0)
+            return id;
+        try {
+            return m_ret.get();
+        } catch (const std::future_error&) {
+            return UPNP_E_CANCELED;
+        }
+    }
+
+private:
+    std::future<int> m_ret;
+};
+}
 
 
 AVTransport::AVTransport(QObject *parent) :
@@ -35,6 +80,11 @@ AVTransport::AVTransport(QObject *parent) :
     QObject::connect(&m_seekTimer, &QTimer::timeout, this, &AVTransport::seekTimeout);
 }
 
+AVTransport::~AVTransport()
+{
+    shutdownTasks();
+}
+
 QUrl AVTransport::getCurrentId()
 {
     auto cs = ContentServer::instance();
@@ -53,9 +103,8 @@ void AVTransport::changed(const QString& name, const QVariant& _value)
         int value = _value.toInt();
 
         if (name == "TransportState") {
-            if (m_transportState != value) {
-                m_oldTransportState = m_transportState;
-                m_transportState = value;
+            m_eventedVars |= EV_TransportState;
+            if (setTransportState(value, true)) {
                 emit transportStateChanged();
                 emit preControlableChanged();
             }
@@ -81,18 +130,25 @@ void AVTransport::changed(const QString& name, const QVariant& _value)
                 emit currentTrackDurationChanged();
             }
         } else if (name == "RelativeTimePosition") {
-            if (!m_seekTimer.isActive()) {
-                if (m_relativeTimePosition != value) {
-                    m_relativeTimePosition = value;
-                    m_oldTimePosition = value;
-                    emit relativeTimePositionChanged();
-                }
-            }
+            if (!m_seekTimer.isActive())
+                syncPosition(value);
         } else if (name == "AbsoluteTimePosition") {
             if (m_absoluteTimePosition != value) {
                 m_absoluteTimePosition = value;
                 emit absoluteTimePositionChanged();
             }
+        } else if (name == "CurrentTransportActions") {
+            m_eventedVars |= EV_TransportActions;
+            if (m_currentTransportActions != value) {
+                m_currentTransportActions = value;
+                emit transportActionsChanged();
+                emit preControlableChanged();
+            }
+        } else if (name == "CurrentPlayMode") {
+            if (m_playmode != value) {
+                m_playmode = value;
+                emit playModeChanged();
+            }
         }
     }
 
@@ -100,6 +156,7 @@ void AVTransport::changed(const QString& name, const QVariant& _value)
         QString value = _value.toString();
 
         if (name == "AVTransportURI" || name == "CurrentTrackURI") {
+            m_eventedVars |= EV_CurrentURI;
             if (m_currentURI != value) {
 
                 if (m_blockEmitUriChanged) {
@@ -125,6 +182,8 @@ void AVTransport::changed(const QString& name, const QVariant& _value)
                         emit currentURIChanged();
                         emit preControlableChanged();
                     }
+                }, PriorityRefresh, QString(), [this]() {
+                    m_emitCurrentUriChanged = false;
                 });
             }
         }
@@ -160,12 +219,27 @@ void AVTransport::changed(const QString& name, const QVariant& _value)
                         emit transportActionsChanged();
                         //emit preControlableChanged();
                     }
+                }, PriorityRefresh, QString(), [this]() {
+                    m_emitNextUriChanged = false;
                 });
             }
         }
     }
 }
 
+void AVTransport::metaChanged(const QString &name, const UPnPClient::UPnPDirObject &meta)
+{
+    if (!getInited()) {
+        qWarning() << "AVTransport service is not inited";
+        return;
+    }
+
+    if (name == "CurrentTrackMetaData" || name == "AVTransportURIMetaData") {
+        m_eventedVars |= EV_TrackMeta;
+        updateTrackMeta(meta);
+    }
+}
+
 UPnPClient::Service* AVTransport::createUpnpService(const UPnPClient::UPnPDeviceDesc &ddesc,
                                                     const UPnPClient::UPnPServiceDesc &sdesc)
 {
@@ -174,6 +248,36 @@ UPnPClient::Service* AVTransport::createUpnpService(const UPnPClient::UPnPDevice
 
 void AVTransport::postInit()
 {
+    // Known renderer is not probed again, its capabilities are taken
+    // from the cache
+    const auto did = QString::fromStdString(m_ser->getDeviceId());
+
+    // Renderer that became active leads the group, so it can't follow it
+    RendererGroup::instance()->setMember(did, false);
+
+    UPnPClient::UPnPDeviceDesc ddesc;
+    if (Directory::instance()->getDeviceDesc(did, ddesc)) {
+        auto caps = DeviceCaps::instance()->caps(ddesc);
+
+        setNextURISupported(caps.nextURISupported);
+
+        if (caps.settleQuirk)
+            m_settleQuirks.insert(did);
+        else
+            m_settleQuirks.remove(did);
+
+        // Other services of the renderer are on the same host and port,
+        // so this covers them too
+        UpnpSetSoapKeepAlive(m_ser->getActionURL().c_str(),
+                             caps.keepAliveQuirk ? 0 : 1);
+
+        m_seekMode = !caps.seekModes.isEmpty() &&
+                !caps.seekModes.contains("REL_TIME") &&
+                caps.seekModes.contains("ABS_TIME") ?
+                    UPnPClient::AVTransport::SEEK_ABS_TIME :
+                    UPnPClient::AVTransport::SEEK_REL_TIME;
+    }
+
     qDebug() << "--> UPDATE postInit";
     update();
 }
@@ -184,12 +288,16 @@ void AVTransport::reset()
 
     m_currentURI.clear();
     m_nextURI.clear();
-    m_transportState = Unknown;
+    {
+        QMutexLocker locker(&m_stateMutex);
+        m_transportState = Unknown;
+        m_stateEvents = 0;
+    }
     m_transportStatus = TPS_Unknown;
     m_numberOfTracks = 0;
     m_currentTrack = 0;
     m_currentTrackDuration = 0;
-    m_relativeTimePosition  = 0;
+    anchorPosition(0);
     m_absoluteTimePosition = 0;
     m_speed = 1;
     m_currentClass.clear();
@@ -200,7 +308,12 @@ void AVTransport::reset()
     m_currentAlbum.clear();
     m_currentTransportActions = 0;
     m_futureSeek = 0;
+    m_pollClock.invalidate();
+    m_tickClock.invalidate();
+    m_pollBackoff = 1;
+    m_eventedVars = 0;
     m_nextURISupported = true;
+    m_seekMode = UPnPClient::AVTransport::SEEK_REL_TIME;
     updateMeta();
 
     emit currentURIChanged();
@@ -228,7 +341,7 @@ std::string AVTransport::type() const
 void AVTransport::timerEvent()
 {
     if (!m_seekTimer.isActive()) {
-        fakeUpdateRelativeTimePosition();
+        tickPosition();
     }
 }
 
@@ -248,6 +361,10 @@ void AVTransport::transportStateHandler()
     emit transportActionsChanged();
     emit preControlableChanged();
 
+    // Timer is not running when not playing, so a gap in ticks across
+    // state change is expected
+    m_tickClock.invalidate();
+
     if (!getInited()) {
         qWarning() << "AVTransport service is not inited";
         return;
@@ -275,6 +392,7 @@ void AVTransport::handleApplicationStateChanged(Qt::ApplicationState state)
         return;
     }
 
+    m_tickClock.invalidate();
     asyncUpdate();
 }
 
@@ -303,14 +421,14 @@ void AVTransport::controlableChangedHandler()
     qDebug() << "New pending controlable signal";
     m_pendingControlableSignal = true;
 
-    if (!startTask([this]() {
+    startTask([this]() {
         tsleep(2000);
         m_pendingControlableSignal = false;
         qDebug() << "Emit delayed controlable signal";
         emit controlableChanged();
-    })) {
+    }, PriorityRefresh, QString(), [this]() {
         m_pendingControlableSignal = false;
-    }
+    });
 }
 
 int AVTransport::getTransportState()
@@ -345,7 +463,13 @@ int AVTransport::getCurrentTrackDuration()
 
 int AVTransport::getRelativeTimePosition()
 {
-    return m_relativeTimePosition > 0 ? m_relativeTimePosition : 0;
+    return getRelativeTimePositionMs() / 1000;
+}
+
+int AVTransport::getRelativeTimePositionMs()
+{
+    QMutexLocker locker(&m_positionMutex);
+    return modelPosition();
 }
 
 int AVTransport::getSpeed()
@@ -524,6 +648,7 @@ void AVTransport::setNextURISupported(bool value)
 {
     if (m_nextURISupported != value) {
         m_nextURISupported = value;
+        DeviceCaps::instance()->setNextURISupported(getDeviceId(), value);
         emit nextURISupportedChanged();
     }
 }
@@ -543,12 +668,18 @@ void AVTransport::setLocalContent(const QString &cid, const QString &nid)
 
     //qDebug() << ">>> setLocalContent thread:" << QThread::currentThreadId();
 
+    // Play and next-only updates are coalesced separately, so next-only
+    // update following a play doesn't replace it
+
     startTask([this, cid, nid](){
         auto cs = ContentServer::instance();
 
         bool do_current = !cid.isEmpty();
         bool do_play = false;
-        bool do_next = m_nextURISupported && !nid.isEmpty();
+        // Group members can't follow gapless switch to next URI, so
+        // in group each track is set explicitly
+        bool do_next = m_nextURISupported && !nid.isEmpty() &&
+                !RendererGroup::instance()->isActive();
         bool do_clearNext = m_nextURISupported && !do_next;
         QUrl cURL, nURL;
         QString cmeta, nmeta, s_cURI, s_nURI;
@@ -565,6 +696,12 @@ void AVTransport::setLocalContent(const QString &cid, const QString &nid)
 
             s_cURI = cURL.toString();
 
+            auto meta = cs->getMetaForId(QUrl(cid), false);
+            // Sink info is only a hint, renderers often play more than
+            // they declare, so content is tried anyway
+            if (meta && !DeviceCaps::instance()->canPlay(getDeviceId(), meta->mime))
+                qWarning() << "Renderer doesn't declare support for" << meta->mime;
+
             do_current = s_cURI != m_currentURI;
             if (!do_current) {
                 qWarning() << "Content URL is the same as currentURI";
@@ -593,19 +730,18 @@ void AVTransport::setLocalContent(const QString &cid, const QString &nid)
             }*/
         }
 
-        if (do_next || do_current || do_play || do_clearNext) {
-            blockUriChanged(1500);
-        } else {
+        if (!do_next && !do_current && !do_play && !do_clearNext) {
             qWarning() << "Nothing to update";
             return;
         }
 
         m_updateMutex.lock();
+        m_blockEmitUriChanged = true;
 
         auto srv = s();
 
         if (!getInited() || !srv) {
-            m_updateMutex.unlock();
+            endSequence();
             qWarning() << "AVTransport service is not inited";
             return;
         }
@@ -614,12 +750,11 @@ void AVTransport::setLocalContent(const QString &cid, const QString &nid)
             if (!handleError(srv->stop())) {
                 qWarning() << "Error response for stop()";
                 if (!getInited()) {
-                    m_updateMutex.unlock();
+                    endSequence();
                     qWarning() << "AVTransport service is not inited";
                     return;
                 }
             }
-            tsleep();
         }
 
         if (do_next) {
@@ -627,7 +762,7 @@ void AVTransport::setLocalContent(const QString &cid, const QString &nid)
             if (!handleError(srv->setNextAVTransportURI(s_nURI.toStdString(), nmeta.toStdString()))) {
                 qWarning() << "Error response for setNextAVTransportURI()";
                 if (!getInited()) {
-                    m_updateMutex.unlock();
+                    endSequence();
                     qWarning() << "AVTransport service is not inited";
                     return;
                 }
@@ -639,7 +774,7 @@ void AVTransport::setLocalContent(const QString &cid, const QString &nid)
             if (!handleError(srv->setNextAVTransportURI("", ""))) {
                 qWarning() << "Error response for setNextAVTransportURI()";
                 if (!getInited()) {
-                    m_updateMutex.unlock();
+                    endSequence();
                     qWarning() << "AVTransport service is not inited";
                     return;
                 }
@@ -653,7 +788,7 @@ void AVTransport::setLocalContent(const QString &cid, const QString &nid)
                 if (!handleError(srv->setNextAVTransportURI("", ""))) {
                     qWarning() << "Error response for setNextAVTransportURI()";
                     if (!getInited()) {
-                        m_updateMutex.unlock();
+                        endSequence();
                         qWarning() << "AVTransport service is not inited";
                         return;
                     }
@@ -661,42 +796,51 @@ void AVTransport::setLocalContent(const QString &cid, const QString &nid)
             }
 
             qDebug() << "Calling setAVTransportURI with id:" << cid;
-            if (!handleError(srv->setAVTransportURI(s_cURI.toStdString(),cmeta.toStdString()))) {
+            if (!handleError(runSettled([srv, &s_cURI, &cmeta]() {
+                return srv->setAVTransportURI(s_cURI.toStdString(), cmeta.toStdString());
+            }))) {
                 qWarning() << "Error response for setAVTransportURI()";
                 if (!getInited()) {
-                    m_updateMutex.unlock();
+                    endSequence();
                     qWarning() << "AVTransport service is not inited";
                     return;
                 }
+            } else {
+                RendererGroup::instance()->setURI(s_cURI, cmeta);
             }
-            tsleep();
             do_play = true;
         }
 
         if (do_play) {
-            if (!handleError(srv->play())) {
+            // Play of the group is timed for all members at once, so
+            // it is not sent again like Play of single renderer
+            auto group = RendererGroup::instance();
+            if (!handleError(group->isActive() ? group->playTogether(srv) :
+                             runSettled([srv]() { return srv->play(); }))) {
                 qWarning() << "Error response for play()";
                 if (!getInited()) {
-                    m_updateMutex.unlock();
+                    endSequence();
                     qWarning() << "AVTransport service is not inited";
                     return;
                 }
             }
         }
 
-        tsleep();
-
-        m_updateMutex.unlock();
+        endSequence();
 
         //qDebug() << "--> UPDATE setLocalContent";
 
+        // URI events were blocked during the sequence
+        if (do_current)
+            updateMediaInfo();
         update();
-    });
+    }, PriorityUser, cid.isEmpty() ? "setNextURI" : "setLocalContent");
 }
 
 void AVTransport::setSpeed(int value)
 {
     if (m_speed != value) {
+        reanchorPosition();
         m_speed = value;
         emit speedChanged();
     }
@@ -722,7 +866,7 @@ void AVTransport::play()
             return;
         }
 
-        if (!handleError(srv->play(m_speed))) {
+        if (!handleError(RendererGroup::instance()->playTogether(srv, m_speed))) {
             qWarning() << "Error response for play()";
             if (!getInited()) {
                 m_updateMutex.unlock();
@@ -731,7 +875,6 @@ void AVTransport::play()
             }
         }
 
-        tsleep();
         m_updateMutex.unlock();
 
         //qDebug() << "--> UPDATE play";
@@ -767,6 +910,8 @@ void AVTransport::pause()
 
         qDebug() << "Calling: pause";
 
+        RendererGroup::instance()->pause();
+
         if (!handleError(srv->pause())) {
             qWarning() << "Error response for pause()";
             if (!getInited()) {
@@ -776,7 +921,6 @@ void AVTransport::pause()
             }
         }
 
-        tsleep();
         m_updateMutex.unlock();
 
         //qDebug() << "--> UPDATE pause";
@@ -792,7 +936,7 @@ void AVTransport::stop()
         return;
     }
 
-    m_relativeTimePosition = 0;
+    anchorPosition(0);
     m_absoluteTimePosition = 0;
     emit relativeTimePositionChanged();
     emit absoluteTimePositionChanged();
@@ -810,6 +954,8 @@ void AVTransport::stop()
 
         qDebug() << "Calling: stop";
 
+        RendererGroup::instance()->stop();
+
         if (!handleError(srv->stop())) {
             qWarning() << "Error response for stop()";
             if (!getInited()) {
@@ -819,7 +965,6 @@ void AVTransport::stop()
             }
         }
 
-        tsleep();
         m_updateMutex.unlock();
 
         //qDebug() << "--> UPDATE stop";
@@ -856,7 +1001,6 @@ void AVTransport::next()
             }
         }
 
-        tsleep();
         m_updateMutex.unlock();
 
         //qDebug() << "--> UPDATE next";
@@ -893,7 +1037,6 @@ void AVTransport::previous()
             }
         }
 
-        tsleep();
         m_updateMutex.unlock();
 
         //qDebug() << "--> UPDATE previous";
@@ -931,7 +1074,7 @@ void AVTransport::setPlayMode(int value)
             qWarning() << "Error response for setPlayMode(" << value << ")";
             m_updateMutex.unlock();
         }
-    });
+    }, PriorityUser, "setPlayMode");
 }
 
 void AVTransport::seek(int value)
@@ -974,11 +1117,10 @@ void AVTransport::seekTimeout()
 
         qDebug() << "Calling: seek";
 
-        if (handleError(srv->seek(UPnPClient::AVTransport::SEEK_REL_TIME,
-                                  m_futureSeek))) {
-            m_relativeTimePosition = m_futureSeek;
-            m_oldTimePosition = m_futureSeek - 5;
-            tsleep();
+        if (handleError(srv->seek(m_seekMode, m_futureSeek))) {
+            RendererGroup::instance()->seek(m_futureSeek);
+            anchorPosition(m_futureSeek);
+            emit relativeTimePositionChanged();
             m_updateMutex.unlock();
 
             //qDebug() << "--> UPDATE seekTimeout";
@@ -987,21 +1129,134 @@ void AVTransport::seekTimeout()
             qWarning() << "Error response for seek(" << m_futureSeek << ")";
             m_updateMutex.unlock();
         }
-    });
+    }, PriorityUser, "seek");
+}
+
+void AVTransport::setRendererQueue(bool value)
+{
+    if (m_rendererQueue != value) {
+        qDebug() << "Renderer queue:" << value;
+        m_rendererQueue = value;
+    }
+}
+
+bool AVTransport::eventsFlowing()
+{
+    return m_eventedVars & EV_TransportState;
+}
+
+int AVTransport::pollInterval()
+{
+    // LastChange doesn't carry position, so occasional polling is still
+    // needed to correct drift. State changes are expected to come as events,
+    // so while renderer agrees with position model, polling backs off.
+
+    if (!m_rendererQueue && m_currentTrackDuration > 0 &&
+        m_currentTrackDuration - getRelativeTimePosition() <= trackEndWindow)
+        return trackEndPollInterval;
+
+    if (eventsFlowing())
+        return eventPollInterval * m_pollBackoff;
+
+    return noEventPollInterval;
+}
+
+// Must be called with m_positionMutex locked
+int AVTransport::modelPosition()
+{
+    qint64 pos = m_positionAnchor;
+    if (m_transportState == Playing && m_positionClock.isValid())
+        pos += m_positionClock.elapsed() * (m_speed > 0 ? m_speed : 1);
+    if (m_currentTrackDuration > 0 && pos > m_currentTrackDuration * 1000)
+        pos = m_currentTrackDuration * 1000;
+    return pos > 0 ? int(pos) : 0;
 }
 
-void AVTransport::fakeUpdateRelativeTimePosition()
+void AVTransport::anchorPosition(int seconds)
 {
-    if (m_currentTrackDuration == 0 || m_relativeTimePosition < m_currentTrackDuration) {
-        if (m_oldTimePosition < m_relativeTimePosition - 5) {
+    QMutexLocker locker(&m_positionMutex);
+    m_positionAnchor = seconds * 1000;
+    m_positionClock.start();
+    m_relativeTimePosition = seconds;
+}
+
+// Freezes extrapolated position before change of state or speed
+void AVTransport::reanchorPosition()
+{
+    QMutexLocker locker(&m_positionMutex);
+    m_positionAnchor = modelPosition();
+    m_positionClock.start();
+}
+
+void AVTransport::syncPosition(int seconds)
+{
+    int pos;
+    int drift;
+
+    {
+        QMutexLocker locker(&m_positionMutex);
+
+        // Renderer reports whole seconds, so model is only moved into
+        // reported second. Otherwise position would jitter on every sync.
+        int model = modelPosition();
+        int anchor = seconds * 1000;
+        if (m_transportState == Playing)
+            anchor = qBound(anchor, model, anchor + 999);
+
+        drift = anchor - model;
+        m_lastDrift = drift;
+        m_positionAnchor = anchor;
+        m_positionClock.start();
+        m_pollClock.start();
+
+        if (qAbs(drift) > driftThreshold)
+            m_pollBackoff = 1;
+        else if (m_pollBackoff < maxPollBackoff)
+            m_pollBackoff *= 2;
+
+        pos = anchor / 1000;
+    }
+
+    if (qAbs(drift) > driftThreshold)
+        qDebug() << "Position drift:" << drift << "ms";
+
+    if (m_relativeTimePosition != pos) {
+        m_relativeTimePosition = pos;
+        emit relativeTimePositionChanged();
+    }
+}
+
+void AVTransport::tickPosition()
+{
+    // Ticks stop when app or device is suspended and renderer could have
+    // done anything in meantime
+    bool stalled = m_tickClock.isValid() && m_tickClock.elapsed() > stallGap;
+    m_tickClock.start();
+
+    int pos = getRelativeTimePosition();
+    if (m_relativeTimePosition != pos) {
+        m_relativeTimePosition = pos;
+        emit relativeTimePositionChanged();
+    }
+
+    if (stalled) {
+        qDebug() << "--> aUPDATE tickPosition after stall";
+        m_pollClock.start();
+        asyncUpdate();
+        return;
+    }
+
+    int sincePoll = m_pollClock.isValid() ? m_pollClock.elapsed() / 1000 :
+                                            pollInterval();
+
+    if (m_rendererQueue || m_currentTrackDuration == 0 ||
+            pos < m_currentTrackDuration) {
+        if (sincePoll >= pollInterval())
             asyncUpdatePositionInfo();
-        } else {
-            m_relativeTimePosition++;
-            emit relativeTimePositionChanged();
-        }
-    } else {
-        qDebug() << "--> aUPDATE fakeUpdateRelativeTimePosition";
-        asyncUpdate(1000);
+    } else if (sincePoll >= trackEndPollInterval) {
+        qDebug() << "--> aUPDATE tickPosition";
+        m_pollClock.start();
+        asyncUpdate(0);
     }
 }
 
@@ -1012,20 +1267,36 @@ void AVTransport::update(int initDelay, int postDelay)
         return;
     }
 
-    qDebug() << "Update start";
-
-    if (!m_updateMutex.tryLock()) {
-        qDebug() << "Update is locked";
-        return;
+    {
+        QMutexLocker locker(&m_refreshMutex);
+        m_refreshRequested = true;
+        if (m_refreshRunning) {
+            // Running update will refresh once more after current pass
+            qDebug() << "Update coalesced";
+            return;
+        }
+        m_refreshRunning = true;
     }
 
+    qDebug() << "Update start";
+
     tsleep(initDelay);
 
-    updatePositionInfo();
-    updateTransportInfo();
-    updateMediaInfo();
-    updateCurrentTransportActions();
-    //updateTransportSettings();
+    m_updateMutex.lock();
+
+    while (true) {
+        {
+            QMutexLocker locker(&m_refreshMutex);
+            if (!m_refreshRequested || taskCanceled()) {
+                m_refreshRequested = false;
+                m_refreshRunning = false;
+                break;
+            }
+            m_refreshRequested = false;
+        }
+
+        refreshStatus();
+    }
 
     tsleep(postDelay);
 
@@ -1047,7 +1318,6 @@ void AVTransport::update(int initDelay, int postDelay)
                 return;
             }
         }
-        tsleep();
     }
 
     qDebug() << "Update end";
@@ -1059,6 +1329,56 @@ void AVTransport::update(int initDelay, int postDelay)
     m_updateMutex.unlock();
 }
 
+void AVTransport::refreshStatus()
+{
+    auto srv = s();
+
+    if (!isInitedOrIniting() || !srv) {
+        qWarning() << "AVTransport service is not inited";
+        return;
+    }
+
+    // Variables delivered by LastChange events are not polled
+    bool doTransport = !(m_eventedVars & EV_TransportState);
+    bool doMedia = !(m_eventedVars & EV_CurrentURI) || !(m_eventedVars & EV_TrackMeta);
+    bool doActions = !(m_eventedVars & EV_TransportActions);
+
+    ActionReply<UPnPClient::AVTransport::PositionInfo> pi;
+    ActionReply<UPnPClient::AVTransport::TransportInfo> ti;
+    ActionReply<UPnPClient::AVTransport::MediaInfo> mi;
+    ActionReply<int> ac;
+
+    // Queries are independent, so they are sent at once and handled by
+    // libupnp workers. Refresh takes one round trip and doesn't hold
+    // a thread per query. Timeouts follow measured latency of
+    // the renderer, until it is known the default one is used.
+    int piId = srv->getPositionInfoAsync(pi.callback(),
+                adaptiveTimeout("GetPositionInfo", queryTimeout));
+    int tiId = doTransport ?
+                srv->getTransportInfoAsync(ti.callback(),
+                adaptiveTimeout("GetTransportInfo", queryTimeout)) : 0;
+    int miId = doMedia ?
+                srv->getMediaInfoAsync(mi.callback(),
+                adaptiveTimeout("GetMediaInfo", queryTimeout)) : 0;
+    int acId = doActions ?
+                srv->getCurrentTransportActionsAsync(ac.callback(),
+                adaptiveTimeout("GetCurrentTransportActions", queryTimeout)) : 0;
+
+    int piRet = pi.wait(piId);
+    int tiR = doTransport ? ti.wait(tiId) : 0;
+    int miR = doMedia ? mi.wait(miId) : 0;
+    int acR = doActions ? ac.wait(acId) : 0;
+
+    // Results are merged in one pass when all responses are in
+    applyPositionInfo(piRet, pi.value);
+    if (doTransport && isInitedOrIniting())
+        applyTransportInfo(tiR, ti.value);
+    if (doMedia && isInitedOrIniting())
+        applyMediaInfo(miR, mi.value);
+    if (doActions && isInitedOrIniting())
+        applyCurrentTransportActions(acR, ac.value);
+}
+
 void AVTransport::needTimerCheck()
 {
     auto app = static_cast<QGuiApplication*>(QGuiApplication::instance());
@@ -1084,7 +1404,7 @@ void AVTransport::asyncUpdate(int initDelay, int postDelay)
 
     startTask([this, initDelay, postDelay](){
         update(initDelay, postDelay);
-    });
+    }, PriorityRefresh, "update");
 }
 
 void AVTransport::asyncUpdatePositionInfo()
@@ -1094,10 +1414,17 @@ void AVTransport::asyncUpdatePositionInfo()
         return;
     }
 
+    m_pollClock.start();
+
     startTask([this](){
         updatePositionInfo();
-        updateCurrentTransportActions();
-    });
+        if (!(m_eventedVars & EV_TransportActions))
+            updateCurrentTransportActions();
+        // Without events, large drift is the only hint that playback was
+        // paused or changed by another control point
+        if (!eventsFlowing() && qAbs(m_lastDrift) > driftThreshold)
+            update();
+    }, PriorityRefresh, "positionInfo");
 }
 
 void AVTransport::updatePositionInfo()
@@ -1110,8 +1437,17 @@ void AVTransport::updatePositionInfo()
     }
 
     UPnPClient::AVTransport::PositionInfo pi;
+    int ret = srv->getPositionInfo(pi);
+    applyPositionInfo(ret, pi);
 
-    if (!handleError(srv->getPositionInfo(pi))) {
+    // Group members are kept at position of this renderer
+    if (ret == 0 && m_transportState == Playing)
+        RendererGroup::instance()->align(getRelativeTimePositionMs());
+}
+
+void AVTransport::applyPositionInfo(int ret, UPnPClient::AVTransport::PositionInfo &pi)
+{
+    if (!handleError(ret)) {
         qWarning() << "Unable to get Position Info";
         pi.abscount = 0;
         pi.abstime = 0;
@@ -1147,11 +1483,7 @@ void AVTransport::updatePositionInfo()
         emit currentTrackDurationChanged();
     }
 
-    if (m_relativeTimePosition != pi.reltime) {
-        m_relativeTimePosition = pi.reltime;
-        m_oldTimePosition = m_relativeTimePosition;
-        emit relativeTimePositionChanged();
-    }
+    syncPosition(pi.reltime);
 }
 
 void AVTransport::asyncUpdateTransportInfo()
@@ -1163,7 +1495,7 @@ void AVTransport::asyncUpdateTransportInfo()
 
     startTask([this](){
         updateTransportInfo();
-    });
+    }, PriorityRefresh, "transportInfo");
 }
 
 void AVTransport::updateTransportInfo()
@@ -1176,14 +1508,17 @@ void AVTransport::updateTransportInfo()
     }
 
     UPnPClient::AVTransport::TransportInfo ti;
-    if (handleError(srv->getTransportInfo(ti))) {
+    applyTransportInfo(srv->getTransportInfo(ti), ti);
+}
+
+void AVTransport::applyTransportInfo(int ret, const UPnPClient::AVTransport::TransportInfo &ti)
+{
+    if (handleError(ret)) {
         qDebug() << "TransportInfo:";
         qDebug() << "  tpstate:" << ti.tpstate;
         qDebug() << "  tpstatus:" << ti.tpstatus;
 
-        if (m_transportState != ti.tpstate) {
-            m_oldTransportState = m_transportState;
-            m_transportState = ti.tpstate;
+        if (setTransportState(ti.tpstate)) {
             emit transportStateChanged();
             emit transportActionsChanged();
             emit preControlableChanged();
@@ -1197,9 +1532,7 @@ void AVTransport::updateTransportInfo()
     } else {
         qWarning() << "Unable to get Transport Info";
 
-        if (m_transportState != Unknown) {
-            m_oldTransportState = m_transportState;
-            m_transportState = Unknown;
+        if (setTransportState(Unknown)) {
             emit transportStateChanged();
             emit transportActionsChanged();
             emit preControlableChanged();
@@ -1215,17 +1548,35 @@ void AVTransport::updateTransportInfo()
 
 void AVTransport::updateTrackMeta(const UPnPClient::UPnPDirObject &trackmeta)
 {
-    m_id = QString::fromStdString(trackmeta.m_id);
-    m_currentTitle = QString::fromStdString(trackmeta.m_title);
-    m_currentClass = QString::fromStdString(trackmeta.getprop("upnp:class"));
-    m_currentAuthor = QString::fromStdString(trackmeta.getprop("upnp:artist")).split(",").first();
-    m_currentDescription  = QString::fromStdString(trackmeta.getprop("upnp:longDescription"));
-    m_currentAlbum = QString::fromStdString(trackmeta.getprop("upnp:album"));
-    emit currentMetaDataChanged();
+    auto id = QString::fromStdString(trackmeta.m_id);
+    auto title = QString::fromStdString(trackmeta.m_title);
+    auto cls = QString::fromStdString(trackmeta.getprop("upnp:class"));
+    auto author = QString::fromStdString(trackmeta.getprop("upnp:artist")).split(",").first();
+    auto description = QString::fromStdString(trackmeta.getprop("upnp:longDescription"));
+    auto album = QString::fromStdString(trackmeta.getprop("upnp:album"));
+    auto albumArtURI = QUrl(QString::fromStdString(trackmeta.getprop("upnp:albumArtURI")));
+
+    // Same metadata is delivered with every poll and most events
+    bool textChanged = m_id != id || m_currentTitle != title ||
+            m_currentClass != cls || m_currentAuthor != author ||
+            m_currentDescription != description || m_currentAlbum != album;
+    bool artChanged = m_currentAlbumArtURI != albumArtURI;
+
+    if (!textChanged && !artChanged)
+        return;
+
+    if (textChanged) {
+        m_id = id;
+        m_currentTitle = title;
+        m_currentClass = cls;
+        m_currentAuthor = author;
+        m_currentDescription = description;
+        m_currentAlbum = album;
+        emit currentMetaDataChanged();
+    }
 
-    auto new_albumArtURI = QUrl(QString::fromStdString(trackmeta.getprop("upnp:albumArtURI")));
-    if (m_currentAlbumArtURI != new_albumArtURI) {
-        m_currentAlbumArtURI = new_albumArtURI;
+    if (artChanged) {
+        m_currentAlbumArtURI = albumArtURI;
         emit currentAlbumArtChanged();
     }
 
@@ -1265,7 +1616,7 @@ void AVTransport::asyncUpdateMediaInfo()
 
     startTask([this](){
         updateMediaInfo();
-    });
+    }, PriorityRefresh, "mediaInfo");
 }
 
 void AVTransport::updateMediaInfo()
@@ -1278,7 +1629,12 @@ void AVTransport::updateMediaInfo()
     }
 
     UPnPClient::AVTransport::MediaInfo mi;
-    if (handleError(srv->getMediaInfo(mi))) {
+    applyMediaInfo(srv->getMediaInfo(mi), mi);
+}
+
+void AVTransport::applyMediaInfo(int ret, const UPnPClient::AVTransport::MediaInfo &mi)
+{
+    if (handleError(ret)) {
         qDebug() << "MediaInfo:";
         qDebug() << "  nrtracks:" << mi.nrtracks;
         qDebug() << "  mduration:" << mi.mduration;
@@ -1343,18 +1699,7 @@ void AVTransport::updateMediaInfo()
             emit transportActionsChanged();
         }
 
-        m_id.clear();
-        m_currentTitle.clear();
-        m_currentClass.clear();
-        m_currentAuthor.clear();
-        m_currentDescription.clear();
-        m_currentAlbum.clear();
-        emit currentMetaDataChanged();
-
-        if (!m_currentAlbumArtURI.isEmpty()) {
-            m_currentAlbumArtURI.clear();
-            emit currentAlbumArtChanged();
-        }
+        updateTrackMeta(UPnPClient::UPnPDirObject());
     }
 }
 
@@ -1367,7 +1712,7 @@ void AVTransport::asyncUpdateCurrentTransportActions()
 
     startTask([this](){
         updateCurrentTransportActions();
-    });
+    }, PriorityRefresh, "transportActions");
 }
 
 void AVTransport::updateCurrentTransportActions()
@@ -1380,7 +1725,12 @@ void AVTransport::updateCurrentTransportActions()
     }
 
     int ac = 0;
-    if (handleError(srv->getCurrentTransportActions(ac))) {
+    applyCurrentTransportActions(srv->getCurrentTransportActions(ac), ac);
+}
+
+void AVTransport::applyCurrentTransportActions(int ret, int ac)
+{
+    if (handleError(ret)) {
         qDebug() << "CurrentTransportActions:";
         qDebug() << "  actions:" << ac;
         qDebug() << "  Next:" << (ac & UPnPClient::AVTransport::TPA_Next);
@@ -1434,20 +1784,108 @@ void AVTransport::asyncUpdateTransportSettings()
 
     startTask([this](){
         updateTransportSettings();
-    });
+    }, PriorityRefresh, "transportSettings");
 }
 
-void AVTransport::blockUriChanged(int time)
+void AVTransport::endSequence()
 {
-    m_blockEmitUriChanged = true;
+    m_blockEmitUriChanged = false;
+    m_updateMutex.unlock();
+}
 
-    qDebug() << "URIChanged blocked";
+bool AVTransport::setTransportState(int state, bool evented)
+{
+    bool changed;
 
-    startTask([this, time]() {
-        tsleep(time);
-        m_blockEmitUriChanged = false;
-        qDebug() << "URIChanged unblocked";
-    });
+    {
+        QMutexLocker locker(&m_stateMutex);
+        if (evented)
+            ++m_stateEvents;
+        changed = m_transportState != state;
+        if (changed) {
+            reanchorPosition();
+            m_oldTransportState = m_transportState;
+            m_transportState = state;
+        }
+    }
+
+    if (changed || evented)
+        m_stateChanged.wakeAll();
+
+    return changed;
+}
+
+bool AVTransport::waitForSettle(int events)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    if (!eventsFlowing()) {
+        // Without events the only way is to ask renderer
+        auto srv = s();
+        while (srv && timer.elapsed() < settleTimeout) {
+            tsleep(settlePollInterval);
+            UPnPClient::AVTransport::TransportInfo ti;
+            if (srv->getTransportInfo(ti) == 0 && ti.tpstate != Transitioning)
+                return true;
+        }
+        qWarning() << "Renderer didn't settle in" << settleTimeout << "ms";
+        return false;
+    }
+
+    // Settled means that event that came after the rejected action
+    // reported state other than TRANSITIONING
+    QMutexLocker locker(&m_stateMutex);
+    while (m_stateEvents == events || m_transportState == Transitioning) {
+        int left = settleTimeout - timer.elapsed();
+        if (left <= 0 || !m_stateChanged.wait(&m_stateMutex, left)) {
+            qWarning() << "Renderer didn't settle in" << settleTimeout << "ms";
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int AVTransport::runSettled(const std::function<int()> &action)
+{
+    // Most renderers accept next command as soon as previous one returns.
+    // Some reject it with "transition not available" while TRANSITIONING,
+    // so the command is sent again when the transition is over. Renderer
+    // that does it repeatedly is remembered and for it each such step
+    // waits for the transition up front.
+
+    const auto did = getDeviceId();
+    bool quirk = m_settleQuirks.contains(did);
+
+    int events;
+    {
+        QMutexLocker locker(&m_stateMutex);
+        if (quirk && m_transportState == Transitioning) {
+            locker.unlock();
+            // No event count is -1, so only the state is waited for
+            waitForSettle(-1);
+            locker.relock();
+        }
+        events = m_stateEvents;
+    }
+
+    int ret = action();
+
+    if (ret == transitionNotAvailable) {
+        qWarning() << "Action rejected during transition, so waiting"
+                   << "for renderer to settle";
+        if (!quirk && ++m_settleRejects[did] >= settleQuirkRejects) {
+            qWarning() << "Renderer rejects actions during transitions,"
+                       << "so it will be waited for";
+            m_settleQuirks.insert(did);
+            DeviceCaps::instance()->setSettleQuirk(did, true);
+        }
+        if (waitForSettle(events))
+            ret = action();
+    }
+
+    return ret;
 }
 
 void AVTransport::announceMetaChanged()
@@ -11,9 +11,15 @@
 #include <QString>
 #include <QTimer>
 #include <QMutex>
+#include <QElapsedTimer>
+#include <QWaitCondition>
+#include <QSet>
+#include <QHash>
 #include <QMetaMethod>
 #include <QUrl>
 
+#include <atomic>
+
 #include <libupnpp/control/avtransport.hxx>
 #include <libupnpp/control/service.hxx>
 #include "libupnpp/control/cdircontent.hxx"
@@ -40,6 +46,7 @@ class AVTransport : public Service
     Q_PROPERTY (int currentTrack READ getCurrentTrack NOTIFY currentTrackChanged)
     Q_PROPERTY (int currentTrackDuration READ getCurrentTrackDuration NOTIFY currentTrackDurationChanged)
     Q_PROPERTY (int relativeTimePosition READ getRelativeTimePosition NOTIFY relativeTimePositionChanged)
+    Q_PROPERTY (int relativeTimePositionMs READ getRelativeTimePositionMs NOTIFY relativeTimePositionChanged)
     Q_PROPERTY (int absoluteTimePosition READ getAbsoluteTimePosition NOTIFY absoluteTimePositionChanged)
     Q_PROPERTY (int speed READ getSpeed WRITE setSpeed NOTIFY speedChanged)
 
@@ -103,6 +110,7 @@ public:
     Q_ENUM(Type)
 
     explicit AVTransport(QObject *parent = nullptr);
+    ~AVTransport();
 
     Q_INVOKABLE void play();
     Q_INVOKABLE void stop();
@@ -111,8 +119,11 @@ public:
     Q_INVOKABLE void previous();
     Q_INVOKABLE void seek(int value);
     Q_INVOKABLE void setLocalContent(const QString &cid, const QString &nid);
-    Q_INVOKABLE void asyncUpdate(int initDelay = 0, int postDelay = 500);
+    Q_INVOKABLE void asyncUpdate(int initDelay = 0, int postDelay = 0);
     Q_INVOKABLE void setPlayMode(int value);
+    // Renderer plays its own queue (OpenHome Playlist), so track changes
+    // are not driven and position is not polled near track end
+    void setRendererQueue(bool value);
 
     int getTransportState();
     int getTransportStatus();
@@ -121,6 +132,7 @@ public:
     int getCurrentTrack();
     int getCurrentTrackDuration();
     int getRelativeTimePosition();
+    int getRelativeTimePositionMs();
     int getAbsoluteTimePosition();
     int getSpeed();
 
@@ -182,6 +194,40 @@ private slots:
     void handleApplicationStateChanged(Qt::ApplicationState state);
 
 private:
+    // Variables that renderer is known to deliver in LastChange events
+    enum EventedVar {
+        EV_TransportState = 1 << 0,
+        EV_TransportActions = 1 << 1,
+        EV_CurrentURI = 1 << 2,
+        EV_TrackMeta = 1 << 3
+    };
+
+    // Position polling intervals in seconds
+    static const int eventPollInterval = 30;
+    static const int noEventPollInterval = 5;
+    static const int trackEndPollInterval = 2;
+    static const int trackEndWindow = 5;
+    static const int maxPollBackoff = 4;
+
+    // Position model differing more (ms) from renderer means that
+    // playback was paused, seeked or stalled behind our back
+    static const int driftThreshold = 2000;
+    // Timer tick gap (ms) after which app is assumed to have been suspended
+    static const int stallGap = 5000;
+
+    // Max wait (ms) for renderer that rejects commands sent too early
+    static const int settleTimeout = 1000;
+    static const int settlePollInterval = 200;
+    // Rejections after which renderer is remembered as one that needs
+    // to be waited for
+    static const int settleQuirkRejects = 2;
+    // UPnP AVTransport error "Transition not available"
+    static const int transitionNotAvailable = 701;
+
+    // Max wait (ms) for response to status query until latency of
+    // the renderer is known
+    static const int queryTimeout = 5000;
+
     int m_transportState = Unknown;
     int m_oldTransportState = Unknown;
     int m_transportStatus = TPS_Unknown;
@@ -193,7 +239,8 @@ private:
     int m_absoluteTimePosition = 0;
     int m_speed = 1;
     int m_currentTransportActions = 0;
-    int m_oldTimePosition = 0;
+    // Written from event callback, read from tasks
+    std::atomic<int> m_eventedVars{0};
     QString m_id;
     QString m_currentClass;
     QString m_currentTitle;
@@ -207,31 +254,64 @@ private:
     QString m_currentURI;
     QString m_nextURI;
     bool m_nextURISupported = true;
+    UPnPClient::AVTransport::SeekMode m_seekMode =
+            UPnPClient::AVTransport::SEEK_REL_TIME;
     bool m_emitCurrentUriChanged = false;
     bool m_emitNextUriChanged = false;
     bool m_blockEmitUriChanged = false;
     bool m_pendingControlableSignal = false;
     const ContentServer::ItemMeta* m_currentMeta = nullptr;
 
+    // Position is extrapolated from last known one (m_positionAnchor, ms)
+    // with monotonic clock, so it doesn't depend on timer accuracy
+    QMutex m_positionMutex;
+    int m_positionAnchor = 0;
+    QElapsedTimer m_positionClock;
+    QElapsedTimer m_pollClock; // since position was last requested
+    QElapsedTimer m_tickClock;
+    int m_pollBackoff = 1;
+    int m_lastDrift = 0;
+    bool m_rendererQueue = false;
+
     QTimer m_seekTimer;
     int m_futureSeek = 0;
 
     QMutex m_updateMutex;
+    QMutex m_refreshMutex;
+    bool m_refreshRunning = false;
+    bool m_refreshRequested = false;
+    QMutex m_stateMutex;
+    QWaitCondition m_stateChanged;
+    QSet<QString> m_settleQuirks;
+    QHash<QString, int> m_settleRejects;
+    int m_stateEvents = 0;
 
     void changed(const QString &name, const QVariant &value);
+    void metaChanged(const QString &name, const UPnPClient::UPnPDirObject &meta);
     UPnPClient::Service* createUpnpService(const UPnPClient::UPnPDeviceDesc &ddesc,
                                            const UPnPClient::UPnPServiceDesc &sdesc);
     void postInit();
     void reset();
 
     UPnPClient::AVTransport* s();
-    void fakeUpdateRelativeTimePosition();
+    void tickPosition();
+    int modelPosition();
+    void anchorPosition(int seconds);
+    void reanchorPosition();
+    void syncPosition(int seconds);
+    int pollInterval();
+    bool eventsFlowing();
     void updateTransportInfo();
     void updateTransportSettings();
     void updatePositionInfo();
     void updateMediaInfo();
     void updateCurrentTransportActions();
-    void update(int initDelay = 500, int postDelay = 500);
+    void update(int initDelay = 0, int postDelay = 0);
+    void refreshStatus();
+    void applyPositionInfo(int ret, UPnPClient::AVTransport::PositionInfo &pi);
+    void applyTransportInfo(int ret, const UPnPClient::AVTransport::TransportInfo &ti);
+    void applyMediaInfo(int ret, const UPnPClient::AVTransport::MediaInfo &mi);
+    void applyCurrentTransportActions(int ret, int ac);
     void asyncUpdateTransportInfo();
     void asyncUpdateTransportSettings();
     void asyncUpdatePositionInfo();
@@ -240,7 +320,10 @@ private:
     void updateTrackMeta(const UPnPClient::UPnPDirObject &trackmeta);
     void needTimerCheck();
     void controlableChangedHandler();
-    void blockUriChanged(int time = 500);
+    void endSequence();
+    bool setTransportState(int state, bool evented = false);
+    bool waitForSettle(int events);
+    int runSettled(const std::function<int()> &action);
     void setNextURISupported(bool value);
     void updateMeta();
     void announceMetaChanged();
@@ -0,0 +1,256 @@
+/* Copyright (C) 2017 Michal Kosciesza <michal@mkiol.net>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "contentid.h"
+
+#include <QUrlQuery>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QDebug>
+
+#include "utils.h"
+
+struct ContentId::PoolShard {
+    QMutex mutex;
+    QHash<QString, QWeakPointer<const ContentId::Data>> entries;
+    int purgeSize = 64;
+};
+
+ContentId::PoolShard* ContentId::shards()
+{
+    static PoolShard s[poolShards];
+    return s;
+}
+
+ContentId::PoolShard& ContentId::shard(const QString &str)
+{
+    return shards()[qHash(str) % poolShards];
+}
+
+ContentId::ContentId()
+{
+}
+
+ContentId::ContentId(const QUrl &id) :
+    d(intern(id.toString(), id))
+{
+}
+
+ContentId::ContentId(const QString &id) :
+    d(find(id))
+{
+    if (d || id.isEmpty())
+        return;
+
+    // Id is parsed only when the string wasn't seen before. It is then
+    // remembered also in the original form, if that differs from the
+    // normalized one.
+    QUrl url(id);
+    d = intern(url.toString(), url);
+    if (d && d->idStr != id)
+        insert(id, d);
+}
+
+QSharedPointer<const ContentId::Data> ContentId::find(const QString &str)
+{
+    auto& s = shard(str);
+    QMutexLocker locker(&s.mutex);
+
+    auto it = s.entries.find(str);
+    if (it == s.entries.end())
+        return QSharedPointer<const Data>();
+
+    return it.value().toStrongRef();
+}
+
+QSharedPointer<const ContentId::Data> ContentId::insert(
+        const QString &str, const QSharedPointer<const Data> &data)
+{
+    auto& s = shard(str);
+    QMutexLocker locker(&s.mutex);
+
+    auto it = s.entries.find(str);
+    if (it != s.entries.end()) {
+        auto existing = it.value().toStrongRef();
+        if (existing)
+            return existing;
+    }
+
+    s.entries.insert(str, data.toWeakRef());
+
+    if (s.entries.size() > s.purgeSize) {
+        // dropping entries that are no longer referenced by any ContentId
+        for (auto sit = s.entries.begin(); sit != s.entries.end();) {
+            if (sit.value().isNull())
+                sit = s.entries.erase(sit);
+            else
+                ++sit;
+        }
+        s.purgeSize = qMax(64, 2 * s.entries.size());
+    }
+
+    return data;
+}
+
+QSharedPointer<const ContentId::Data> ContentId::intern(const QString &idStr,
+                                                        const QUrl &id)
+{
+    if (idStr.isEmpty())
+        return QSharedPointer<const Data>();
+
+    auto data = find(idStr);
+    if (data)
+        return data;
+
+    // Parsed outside of the lock, thread that loses the race drops its copy
+    return insert(idStr, QSharedPointer<const Data>(parse(idStr, id)));
+}
+
+ContentId::Data* ContentId::parse(const QString &idStr, const QUrl &id)
+{
+    auto data = new Data;
+    data->id = id;
+    data->idStr = idStr;
+    data->key = qHash(idStr);
+    data->urlValid = id.isValid();
+
+    if (!data->urlValid)
+        return data;
+
+    if (id.isLocalFile())
+        data->path = id.toLocalFile();
+
+    QUrlQuery q(id);
+    data->hasType = q.hasQueryItem(Utils::typeKey);
+    if (data->hasType)
+        data->type = q.queryItemValue(Utils::typeKey).toInt();
+    if (q.hasQueryItem(Utils::cookieKey))
+        data->cookie = q.queryItemValue(Utils::cookieKey);
+    if (q.hasQueryItem(Utils::nameKey))
+        data->name = q.queryItemValue(Utils::nameKey);
+    if (q.hasQueryItem(Utils::iconKey))
+        data->icon = QUrl(q.queryItemValue(Utils::iconKey));
+    if (q.hasQueryItem(Utils::descKey))
+        data->desc = q.queryItemValue(Utils::descKey);
+    if (q.hasQueryItem(Utils::authorKey))
+        data->author = q.queryItemValue(Utils::authorKey);
+
+    q.removeAllQueryItems(Utils::cookieKey);
+    data->urlWithType = id;
+    data->urlWithType.setQuery(q);
+
+    q.removeAllQueryItems(Utils::typeKey);
+    q.removeAllQueryItems(Utils::nameKey);
+    q.removeAllQueryItems(Utils::iconKey);
+    q.removeAllQueryItems(Utils::descKey);
+    q.removeAllQueryItems(Utils::authorKey);
+    data->url = id;
+    data->url.setQuery(q);
+
+    return data;
+}
+
+int ContentId::internedCount()
+{
+    // Aliases of the same id are counted separately
+    int count = 0;
+    for (int i = 0; i < poolShards; ++i) {
+        auto& s = shards()[i];
+        QMutexLocker locker(&s.mutex);
+        count += s.entries.size();
+    }
+    return count;
+}
+
+bool ContentId::isNull() const
+{
+    return d.isNull();
+}
+
+bool ContentId::isValid() const
+{
+    return d && d->urlValid && !d->cookie.isEmpty();
+}
+
+uint ContentId::key() const
+{
+    return d ? d->key : 0;
+}
+
+QUrl ContentId::id() const
+{
+    return d ? d->id : QUrl();
+}
+
+QString ContentId::toString() const
+{
+    return d ? d->idStr : QString();
+}
+
+QUrl ContentId::url() const
+{
+    return d ? d->url : QUrl();
+}
+
+QUrl ContentId::urlWithType() const
+{
+    return d ? d->urlWithType : QUrl();
+}
+
+QString ContentId::path() const
+{
+    return d ? d->path : QString();
+}
+
+bool ContentId::isLocalFile() const
+{
+    return d && !d->path.isEmpty();
+}
+
+int ContentId::type() const
+{
+    return d ? d->type : 0;
+}
+
+bool ContentId::hasType() const
+{
+    return d && d->hasType;
+}
+
+QString ContentId::cookie() const
+{
+    return d ? d->cookie : QString();
+}
+
+QString ContentId::name() const
+{
+    return d ? d->name : QString();
+}
+
+QUrl ContentId::icon() const
+{
+    return d ? d->icon : QUrl();
+}
+
+QString ContentId::desc() const
+{
+    return d ? d->desc : QString();
+}
+
+QString ContentId::author() const
+{
+    return d ? d->author : QString();
+}
+
+bool ContentId::operator==(const ContentId &other) const
+{
+    if (d == other.d)
+        return true;
+    if (!d || !other.d || d->key != other.d->key)
+        return false;
+    return d->idStr == other.d->idStr;
+}
@@ -0,0 +1,89 @@
+/* Copyright (C) 2017 Michal Kosciesza <michal@mkiol.net>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef CONTENTID_H
+#define CONTENTID_H
+
+#include <QString>
+#include <QUrl>
+#include <QHash>
+#include <QSharedPointer>
+#include <QWeakPointer>
+
+// Item id (file or remote URL with jupii_* query items) parsed only once.
+// Instances are immutable and interned, so copies of the same id share
+// one parsed representation and compare/hash by a precomputed key.
+// Pool is split into shards with own locks, so threads creating ids
+// don't wait for each other.
+class ContentId
+{
+public:
+    ContentId();
+    ContentId(const QUrl &id);
+    ContentId(const QString &id);
+
+    bool isNull() const;
+    bool isValid() const; // valid URL with non-empty cookie
+    uint key() const;
+
+    QUrl id() const;
+    QString toString() const;
+    QUrl url() const; // id without jupii_* query items
+    QUrl urlWithType() const; // id without cookie
+    QString path() const;
+    bool isLocalFile() const;
+    int type() const;
+    bool hasType() const; // type query item is present
+    QString cookie() const;
+    QString name() const;
+    QUrl icon() const;
+    QString desc() const;
+    QString author() const;
+
+    bool operator==(const ContentId &other) const;
+    inline bool operator!=(const ContentId &other) const { return !(*this == other); }
+
+    static int internedCount();
+
+private:
+    struct Data {
+        QUrl id;
+        QString idStr;
+        QUrl url;
+        QUrl urlWithType;
+        QString path;
+        int type = 0;
+        bool hasType = false;
+        QString cookie;
+        QString name;
+        QUrl icon;
+        QString desc;
+        QString author;
+        bool urlValid = false;
+        uint key = 0;
+    };
+
+    struct PoolShard;
+    static const int poolShards = 16;
+
+    QSharedPointer<const Data> d;
+
+    static PoolShard* shards();
+    static PoolShard& shard(const QString &str);
+    static QSharedPointer<const Data> find(const QString &str);
+    static QSharedPointer<const Data> insert(const QString &str,
+                                             const QSharedPointer<const Data> &data);
+    static QSharedPointer<const Data> intern(const QString &idStr, const QUrl &id);
+    static Data* parse(const QString &idStr, const QUrl &id);
+};
+
+inline uint qHash(const ContentId &cid, uint seed = 0)
+{
+    return cid.key() ^ seed;
+}
+
+#endif // CONTENTID_H
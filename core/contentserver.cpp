@@ -23,14 +23,18 @@
 #include <QDomNodeList>
 #include <QDomText>
 #include <QSslConfiguration>
+#include <QCryptographicHash>
+#include <QMutexLocker>
 #include <QTextStream>
 
 #include <iomanip>
+#include <cstdint>
 #include <memory>
 
 #include "contentserver.h"
 #include "utils.h"
 #include "settings.h"
+#include "renderergroup.h"
 #include "tracker.h"
 #include "trackercursor.h"
 #include "info.h"
@@ -74,42 +78,165 @@ const QString ContentServer::queryTemplate =
         "nfo:sampleRate(?item) as sampleRate " \
         "WHERE { ?item nie:url \"%1\". }";
 
-const QHash<QString,QString> ContentServer::m_imgExtMap {
-    {"jpg", "image/jpeg"},{"jpeg", "image/jpeg"},
-    {"png", "image/png"},
-    {"gif", "image/gif"}
+namespace {
+constexpr uint32_t fnv1a(const char* s, uint32_t h = 2166136261u)
+{
+    return *s ? fnv1a(s + 1, (h ^ static_cast<uint8_t>(*s)) * 16777619u) : h;
+}
+
+// FNV-1a of ASCII-lowercased chars, so lookups need no QString::toLower()
+uint32_t fnv1aLower(const QChar* s, int len)
+{
+    uint32_t h = 2166136261u;
+    for (int i = 0; i < len; ++i) {
+        ushort c = s[i].unicode();
+        if (c >= 'A' && c <= 'Z')
+            c += 'a' - 'A';
+        h = (h ^ static_cast<uint8_t>(c)) * 16777619u;
+    }
+    return h;
+}
+
+bool equalsLower(const QChar* s, int len, const char* key)
+{
+    int i = 0;
+    for (; i < len && key[i]; ++i) {
+        ushort c = s[i].unicode();
+        if (c >= 'A' && c <= 'Z')
+            c += 'a' - 'A';
+        if (c != static_cast<uchar>(key[i]))
+            return false;
+    }
+    return i == len && !key[i];
+}
+
+/* DLNA.ORG_OP flags:
+ * 00 - no seeking allowed
+ * 01 - seek by byte
+ * 10 - seek by time
+ * 11 - seek by both*/
+#define DLNA_ORG_OP_SEEK_BYTES "DLNA.ORG_OP=01"
+#define DLNA_ORG_OP_NO_SEEK "DLNA.ORG_OP=00"
+#define DLNA_ORG_CI "DLNA.ORG_CI=0"
+// BYTE_BASED_SEEK | INTERACTIVE_TRANSFERT_MODE | BACKGROUND_TRANSFER_MODE
+#define DLNA_ORG_FLAGS_FILE "DLNA.ORG_FLAGS=20c00000000000000000000000000000"
+// S0_INCREASE | SN_INCREASE | CONNECTION_STALL | STREAMING_TRANSFER_MODE
+#define DLNA_ORG_FLAGS_STREAMING "DLNA.ORG_FLAGS=0d200000000000000000000000000000"
+
+#define DLNA_PROFILE(pn) {{ \
+    pn DLNA_ORG_OP_SEEK_BYTES ";" DLNA_ORG_CI ";" DLNA_ORG_FLAGS_FILE, \
+    pn DLNA_ORG_OP_SEEK_BYTES ";" DLNA_ORG_CI, \
+    pn DLNA_ORG_OP_NO_SEEK ";" DLNA_ORG_CI ";" DLNA_ORG_FLAGS_STREAMING, \
+    pn DLNA_ORG_OP_NO_SEEK ";" DLNA_ORG_CI }}
+
+enum DlnaProfile {
+    PnNone = 0, PnMp3, PnAacAdts, PnLpcm, PnCount
 };
 
-const QHash<QString,QString> ContentServer::m_musicExtMap {
-    {"mp3", "audio/mpeg"},
-    {"m4a", "audio/mp4"}, {"m4b","audio/mp4"},
-    {"aac", "audio/aac"},
-    {"mpc", "audio/x-musepack"},
-    {"flac", "audio/flac"},
-    {"wav", "audio/vnd.wav"},
-    {"ape", "audio/x-monkeys-audio"},
-    {"ogg", "audio/ogg"}, {"oga", "audio/ogg"},
-    {"wma", "audio/x-ms-wma"}
+struct DlnaProfileFeatures {
+    // pre-rendered contentFeatures.dlna.org values:
+    // seek+flags, seek, no seek+flags, no seek
+    const char* features[4];
 };
 
-const QHash<QString,QString> ContentServer::m_videoExtMap {
-    {"mkv", "video/x-matroska"},
-    {"webm", "video/webm"},
-    {"flv", "video/x-flv"},
-    {"ogv", "video/ogg"},
-    {"avi", "video/x-msvideo"},
-    {"mov", "video/quicktime"}, {"qt", "video/quicktime"},
-    {"wmv", "video/x-ms-wmv"},
-    {"mp4", "video/mp4"}, {"m4v", "video/mp4"},
-    {"mpg", "video/mpeg"}, {"mpeg", "video/mpeg"}, {"m2v", "video/mpeg"}
+constexpr DlnaProfileFeatures dlnaProfiles[PnCount] = {
+    DLNA_PROFILE(""),
+    DLNA_PROFILE("DLNA.ORG_PN=MP3;"),
+    DLNA_PROFILE("DLNA.ORG_PN=AAC_ADTS;"),
+    DLNA_PROFILE("DLNA.ORG_PN=LPCM;")
 };
 
-const QHash<QString,QString> ContentServer::m_playlistExtMap {
-    {"m3u", "audio/x-mpegurl"},
-    {"pls", "audio/x-scpls"},
-    {"xspf", "application/xspf+xml"}
+struct MimeProfileEntry {
+    uint32_t hash;
+    const char* mime;
+    DlnaProfile pn;
 };
 
+#define MIME_PN(mime, pn) {fnv1a(mime), mime, pn}
+
+// mime types must be lower case
+// Only types that have DLNA media format profile are listed, other types
+// (e.g. wav, avi, mkv) get OP and FLAGS without ORG_PN, because strict
+// renderers reject unknown profile names
+constexpr MimeProfileEntry mimeProfiles[] = {
+    MIME_PN("audio/mpeg", PnMp3), MIME_PN("audio/mp3", PnMp3),
+    MIME_PN("audio/aac", PnAacAdts), MIME_PN("audio/aacp", PnAacAdts),
+    MIME_PN("audio/x-aac", PnAacAdts),
+    MIME_PN("audio/l16", PnLpcm)
+};
+
+struct ExtEntry {
+    uint32_t hash;
+    const char* ext;
+    const char* mime;
+    ContentServer::Type type;
+};
+
+#define EXT(ext, mime, type) {fnv1a(ext), ext, mime, ContentServer::type}
+
+// extensions must be lower case
+constexpr ExtEntry extTypes[] = {
+    EXT("jpg", "image/jpeg", TypeImage), EXT("jpeg", "image/jpeg", TypeImage),
+    EXT("png", "image/png", TypeImage),
+    EXT("gif", "image/gif", TypeImage),
+    EXT("mp3", "audio/mpeg", TypeMusic),
+    EXT("m4a", "audio/mp4", TypeMusic), EXT("m4b", "audio/mp4", TypeMusic),
+    EXT("aac", "audio/aac", TypeMusic),
+    EXT("mpc", "audio/x-musepack", TypeMusic),
+    EXT("flac", "audio/flac", TypeMusic),
+    EXT("wav", "audio/vnd.wav", TypeMusic),
+    EXT("ape", "audio/x-monkeys-audio", TypeMusic),
+    EXT("ogg", "audio/ogg", TypeMusic), EXT("oga", "audio/ogg", TypeMusic),
+    EXT("wma", "audio/x-ms-wma", TypeMusic),
+    EXT("mkv", "video/x-matroska", TypeVideo),
+    EXT("webm", "video/webm", TypeVideo),
+    EXT("flv", "video/x-flv", TypeVideo),
+    EXT("ogv", "video/ogg", TypeVideo),
+    EXT("avi", "video/x-msvideo", TypeVideo),
+    EXT("mov", "video/quicktime", TypeVideo), EXT("qt", "video/quicktime", TypeVideo),
+    EXT("wmv", "video/x-ms-wmv", TypeVideo),
+    EXT("mp4", "video/mp4", TypeVideo), EXT("m4v", "video/mp4", TypeVideo),
+    EXT("mpg", "video/mpeg", TypeVideo), EXT("mpeg", "video/mpeg", TypeVideo),
+    EXT("m2v", "video/mpeg", TypeVideo),
+    EXT("m3u", "audio/x-mpegurl", TypePlaylist),
+    EXT("pls", "audio/x-scpls", TypePlaylist),
+    EXT("xspf", "application/xspf+xml", TypePlaylist)
+};
+
+const ExtEntry* extEntry(const QString &path)
+{
+    int start = path.lastIndexOf('.') + 1;
+    int len = path.length() - start;
+    auto ext = path.constData() + start;
+    auto hash = fnv1aLower(ext, len);
+
+    for (const auto& e : extTypes) {
+        if (e.hash == hash && equalsLower(ext, len, e.ext))
+            return &e;
+    }
+
+    return nullptr;
+}
+
+DlnaProfile dlnaProfile(const QString &mime)
+{
+    // mime parameters (e.g. audio/L16;rate=44100) are not relevant
+    int len = mime.indexOf(';');
+    if (len < 0)
+        len = mime.length();
+    while (len > 0 && mime.at(len - 1).isSpace())
+        --len;
+    auto hash = fnv1aLower(mime.constData(), len);
+
+    for (const auto& e : mimeProfiles) {
+        if (e.hash == hash && equalsLower(mime.constData(), len, e.mime))
+            return e.pn;
+    }
+
+    return PnNone;
+}
+}
+
 const QStringList ContentServer::m_m3u_mimes {
     "application/vnd.apple.mpegurl",
     "application/mpegurl",
@@ -138,15 +265,6 @@ const QString ContentServer::artCookie = "jupii_art";
 const QByteArray ContentServer::userAgent = QString("%1 %2")
         .arg(Jupii::APP_NAME, Jupii::APP_VERSION).toLatin1();
 
-/* DLNA.ORG_OP flags:
- * 00 - no seeking allowed
- * 01 - seek by byte
- * 10 - seek by time
- * 11 - seek by both*/
-const QString ContentServer::dlnaOrgOpFlagsSeekBytes = "DLNA.ORG_OP=01";
-const QString ContentServer::dlnaOrgOpFlagsNoSeek = "DLNA.ORG_OP=00";
-const QString ContentServer::dlnaOrgCiFlags = "DLNA.ORG_CI=0";
-
 ContentServerWorker* ContentServerWorker::instance(QObject *parent)
 {
     if (ContentServerWorker::m_instance == nullptr) {
@@ -190,16 +308,26 @@ void ContentServerWorker::requestHandler(QHttpRequest *req, QHttpResponse *resp)
         return;
     }
 
-    bool valid, isFile, isArt;
-    auto id = ContentServer::idUrlFromUrl(req->url(), &valid, &isFile, &isArt);
+    auto cs = ContentServer::instance();
 
-    if (!valid) {
+    ContentServer::Handle handle;
+    if (!cs->handleForUrl(req->url(), handle)) {
         qWarning() << "Unknown content requested!";
         sendEmptyResponse(resp, 404);
         return;
     }
 
-    auto cs = ContentServer::instance();
+    const auto id = handle.id.id();
+    const bool isFile = handle.id.isLocalFile();
+    const bool isArt = handle.art;
+
+    if (isFile && !isArt && !handle.mime.isEmpty() &&
+        (handle.type != ContentServer::TypeVideo ||
+         Utils::typeFromId(id) != ContentServer::TypeMusic)) {
+        // Plain file, everything needed is in the handle
+        streamFile(handle.path, handle.mime, req, resp, handle.size);
+        return;
+    }
 
     const ContentServer::ItemMeta *meta;
 
@@ -397,6 +525,8 @@ void ContentServerWorker::requestForUrlHandler(const QUrl &id,
         // Redirection mode
         qDebug() << "Redirection mode enabled => sending HTTP redirection";
         sendRedirection(resp, url.toString());
+    } else if (joinProxy(id, req, resp)) {
+        qDebug() << "Proxy mode enabled => joined existing proxy";
     } else {
         // Proxy mode
         qDebug() << "Proxy mode enabled => creating proxy";
@@ -447,6 +577,81 @@ void ContentServerWorker::requestForUrlHandler(const QUrl &id,
     }
 }
 
+bool ContentServerWorker::joinProxy(const QUrl &id, QHttpRequest *req,
+                                    QHttpResponse *resp)
+{
+    // Live stream which is already proxied (e.g. for other renderer in
+    // a group) is shared, so the source is read only once. Streams with
+    // length can be seeked, so they are not shared.
+
+    if (req->method() != QHttpRequest::HTTP_GET ||
+        req->headers().contains("range"))
+        return false;
+
+    bool meta = req->headers().contains("icy-metadata");
+
+    for (auto it = proxyItems.begin(); it != proxyItems.end(); ++it) {
+        auto &item = it.value();
+
+        if (item.id != id || item.state != 1 ||
+            item.req->method() != QHttpRequest::HTTP_GET ||
+            item.req->headers().contains("range") ||
+            it.key()->header(QNetworkRequest::ContentLengthHeader).isValid())
+            continue;
+
+        // Shoutcast metadata is interleaved at fixed interval counted
+        // from the beginning, so late client can get only clean stream
+        if (meta || item.meta)
+            continue;
+
+        for (const auto &h : item.headers)
+            resp->setHeader(h.first, h.second);
+        resp->writeHead(item.code);
+
+        SimpleProxyItem sitem;
+        sitem.id = id;
+        sitem.req = req;
+        sitem.resp = resp;
+        item.shared.append(sitem);
+
+        responseToReplyMap.insert(resp, it.key());
+        connect(resp, &QHttpResponse::done,
+                this, &ContentServerWorker::responseForUrlDone);
+
+        qDebug() << "Sharing proxy stream, clients:" << item.shared.size() + 1;
+        emit itemAdded(id);
+        return true;
+    }
+
+    return false;
+}
+
+bool ContentServerWorker::releaseProxyResponse(ProxyItem &item,
+                                               QHttpResponse *resp)
+{
+    // Returns true when reply still feeds other clients
+
+    for (int i = 0; i < item.shared.size(); ++i) {
+        if (item.shared[i].resp == resp) {
+            item.shared.removeAt(i);
+            responseToReplyMap.remove(resp);
+            emit itemRemoved(item.id);
+            return true;
+        }
+    }
+
+    if (resp == item.resp && !item.shared.isEmpty()) {
+        auto sitem = item.shared.takeFirst();
+        responseToReplyMap.remove(resp);
+        item.req = sitem.req;
+        item.resp = sitem.resp;
+        emit itemRemoved(item.id);
+        return true;
+    }
+
+    return false;
+}
+
 void ContentServerWorker::requestForMicHandler(const QUrl &id,
                                                 const ContentServer::ItemMeta *meta,
                                                 QHttpRequest *req, QHttpResponse *resp)
@@ -519,6 +724,125 @@ void ContentServerWorker::requestForPulseHandler(const QUrl &id,
 }
 
 
+bool ContentServerWorker::joinFileShare(const QString &path, QHttpResponse *resp)
+{
+    // Renderers playing in group request the same file at once, so one
+    // reader feeds all of them, like joinProxy does for streams. Reading
+    // starts when every renderer has joined or after fileShareWait.
+    // Requests coming later are served separately.
+
+    auto group = RendererGroup::instance();
+    if (!group->isActive())
+        return false;
+
+    auto it = fileShares.find(path);
+    if (it == fileShares.end()) {
+        FileShareItem item;
+        item.file = std::make_shared<QFile>(path);
+        if (!item.file->open(QFile::ReadOnly)) {
+            qWarning() << "Unable to open file" << path << "to read!";
+            return false;
+        }
+        item.serial = ++fileShareSerial;
+        it = fileShares.insert(path, item);
+
+        const int serial = item.serial;
+        QTimer::singleShot(ContentServer::fileShareWait, this,
+                           [this, path, serial] {
+            auto it = fileShares.find(path);
+            if (it != fileShares.end() && it->serial == serial)
+                startFileShare(path);
+        });
+    } else if (it->started) {
+        return false;
+    }
+
+    it->resps.append(resp);
+    responseToShareMap.insert(resp, path);
+    connect(resp, &QHttpResponse::allBytesWritten,
+            this, &ContentServerWorker::responseForShareWritten);
+    connect(resp, &QHttpResponse::done,
+            this, &ContentServerWorker::responseForShareDone);
+
+    qDebug() << "Sharing file stream, clients:" << it->resps.size();
+
+    // Leader and all members
+    if (it->resps.size() > group->getMembers().size())
+        startFileShare(path);
+
+    return true;
+}
+
+void ContentServerWorker::startFileShare(const QString &path)
+{
+    auto it = fileShares.find(path);
+    if (it == fileShares.end() || it->started)
+        return;
+
+    qDebug() << "Start of writting shared file to" << it->resps.size()
+             << "clients";
+    it->started = true;
+    writeFileShare(path);
+}
+
+void ContentServerWorker::writeFileShare(const QString &path)
+{
+    // Next chunk is read when the previous one was sent to all clients,
+    // so the group is paced by its slowest renderer
+
+    auto it = fileShares.find(path);
+    if (it == fileShares.end() || !it->started || !it->pending.isEmpty())
+        return;
+
+    const auto data = it->resps.isEmpty() ? QByteArray() :
+                                            it->file->read(ContentServer::qlen);
+
+    if (data.isEmpty()) {
+        qDebug() << "End of writting shared file";
+        const auto resps = it->resps;
+        fileShares.erase(it);
+        for (auto resp : resps) {
+            responseToShareMap.remove(resp);
+            disconnect(resp, nullptr, this, nullptr);
+            if (!resp->isFinished())
+                resp->end();
+        }
+        return;
+    }
+
+    for (auto resp : it->resps) {
+        it->pending.insert(resp);
+        resp->write(data);
+    }
+}
+
+void ContentServerWorker::responseForShareWritten()
+{
+    auto resp = static_cast<QHttpResponse*>(sender());
+    const auto path = responseToShareMap.value(resp);
+    auto it = fileShares.find(path);
+    if (it == fileShares.end())
+        return;
+
+    it->pending.remove(resp);
+    if (it->pending.isEmpty())
+        writeFileShare(path);
+}
+
+void ContentServerWorker::responseForShareDone()
+{
+    auto resp = static_cast<QHttpResponse*>(sender());
+    const auto path = responseToShareMap.take(resp);
+    auto it = fileShares.find(path);
+    if (it == fileShares.end())
+        return;
+
+    qDebug() << "Shared file client finished";
+    it->resps.removeAll(resp);
+    it->pending.remove(resp);
+    writeFileShare(path);
+}
+
 bool ContentServerWorker::seqWriteData(QFile& file, qint64 size, QHttpResponse *resp)
 {
     qint64 rlen = size;
@@ -591,7 +915,10 @@ void ContentServerWorker::responseForUrlDone()
     auto resp = dynamic_cast<QHttpResponse*>(sender());
     if (responseToReplyMap.contains(resp)) {
         auto reply = responseToReplyMap.value(resp);
-        if (reply->isFinished()) {
+        if (proxyItems.contains(reply) &&
+                releaseProxyResponse(proxyItems[reply], resp)) {
+            qDebug() << "Proxy reply still used by other clients";
+        } else if (reply->isFinished()) {
             qDebug() << "Reply already finished";
         } else {
             qDebug() << "Aborting reply";
@@ -641,18 +968,21 @@ void ContentServerWorker::proxyMetaDataChanged()
         qDebug() << "Ending request with code:" << 404;
         sendEmptyResponse(item.resp, 404);
     } else if (item.state == 0) {
-        item.resp->setHeader("transferMode.dlna.org", "Streaming");
-        item.resp->setHeader("contentFeatures.dlna.org",
-                             ContentServer::dlnaContentFeaturesHeader(mime, item.seek));
-        item.resp->setHeader("Content-Type", mime);
-        item.resp->setHeader("Connection", "close");
+        auto &hs = item.headers;
+        hs << qMakePair(QString("transferMode.dlna.org"), QString("Streaming"));
+        hs << qMakePair(QString("contentFeatures.dlna.org"),
+                        ContentServer::dlnaContentFeaturesHeader(mime, item.seek));
+        hs << qMakePair(QString("Content-Type"), mime);
+        hs << qMakePair(QString("Connection"), QString("close"));
         if (reply->header(QNetworkRequest::ContentLengthHeader).isValid())
-            item.resp->setHeader("Content-Length",
-                                 reply->header(QNetworkRequest::ContentLengthHeader).toString());
+            hs << qMakePair(QString("Content-Length"),
+                            reply->header(QNetworkRequest::ContentLengthHeader).toString());
         if (reply->hasRawHeader("Accept-Ranges"))
-            item.resp->setHeader("Accept-Ranges", reply->rawHeader("Accept-Ranges"));
+            hs << qMakePair(QString("Accept-Ranges"),
+                            QString(reply->rawHeader("Accept-Ranges")));
         if (reply->hasRawHeader("Content-Range"))
-            item.resp->setHeader("Content-Range", reply->rawHeader("Content-Range"));
+            hs << qMakePair(QString("Content-Range"),
+                            QString(reply->rawHeader("Content-Range")));
 
         if (reply->hasRawHeader("icy-metaint")) {
             item.metaint = reply->rawHeader("icy-metaint").toInt();
@@ -664,9 +994,13 @@ void ContentServerWorker::proxyMetaDataChanged()
         const auto &headers = reply->rawHeaderPairs();
         for (const auto& h : headers) {
             if (h.first.toLower().startsWith("icy-"))
-                item.resp->setHeader(h.first, h.second);
+                hs << qMakePair(QString(h.first), QString(h.second));
         }
 
+        for (const auto &h : hs)
+            item.resp->setHeader(h.first, h.second);
+
+        item.code = code;
         item.state = 1;
 
         qDebug() << "Sending head for request with code:" << code;
@@ -714,6 +1048,12 @@ void ContentServerWorker::proxyFinished()
         qDebug() << "Ending request";
         // TODO: Do not end if resp doesn't exists!
         item.resp->end();
+        for (const auto &sitem : item.shared) {
+            responseToReplyMap.remove(sitem.resp);
+            if (!sitem.resp->isFinished())
+                sitem.resp->end();
+            emit itemRemoved(sitem.id);
+        }
     }
 
     emit itemRemoved(item.id);
@@ -821,6 +1161,9 @@ void ContentServerWorker::proxyReadyRead()
 
     auto &item = proxyItems[reply];
 
+    if (item.resp->isFinished() && releaseProxyResponse(item, item.resp))
+        qDebug() << "Proxy client finished, stream continues for other clients";
+
     if (item.resp->isFinished()) {
         qWarning() << "Server request already finished, so ending client side";
         emit itemRemoved(item.id);
@@ -855,25 +1198,31 @@ void ContentServerWorker::proxyReadyRead()
                 processShoutcastMetadata(data, item);
 
             item.resp->write(data);
+            for (const auto &sitem : item.shared) {
+                if (!sitem.resp->isFinished())
+                    sitem.resp->write(data);
+            }
         }
     }
 }
 
 void ContentServerWorker::streamFile(const QString& path, const QString& mime,
-                           QHttpRequest *req, QHttpResponse *resp)
+                           QHttpRequest *req, QHttpResponse *resp, qint64 size)
 {
     QFile file(path);
 
-    if (!file.open(QFile::ReadOnly)) {
+    const auto& headers = req->headers();
+    bool isRange = headers.contains("range");
+    bool isHead = req->method() == QHttpRequest::HTTP_HEAD;
+
+    // HEAD with known size is answered without opening the file
+    if ((!isHead || size < 0) && !file.open(QFile::ReadOnly)) {
         qWarning() << "Unable to open file" << file.fileName() << "to read!";
         sendEmptyResponse(resp, 500);
         return;
     }
 
-    const auto& headers = req->headers();
-    qint64 length = file.bytesAvailable();
-    bool isRange = headers.contains("range");
-    bool isHead = req->method() == QHttpRequest::HTTP_HEAD;
+    qint64 length = file.isOpen() ? file.bytesAvailable() : size;
 
     qDebug() << "Content file name:" << file.fileName();
     qDebug() << "Content size:" << length;
@@ -952,6 +1301,11 @@ void ContentServerWorker::streamFile(const QString& path, const QString& mime,
 
     resp->writeHead(200);
 
+    if (joinFileShare(file.fileName(), resp)) {
+        file.close();
+        return;
+    }
+
     if (!seqWriteData(file, length, resp)) {
         file.close();
         return;
@@ -985,91 +1339,35 @@ ContentServer* ContentServer::instance(QObject *parent)
     return ContentServer::m_instance;
 }
 
-QString ContentServer::dlnaOrgFlagsForFile()
-{
-    char flags[448];
-    sprintf(flags, "%s=%.8x%.24x", "DLNA.ORG_FLAGS",
-            DLNA_ORG_FLAG_BYTE_BASED_SEEK |
-            DLNA_ORG_FLAG_INTERACTIVE_TRANSFERT_MODE |
-            DLNA_ORG_FLAG_BACKGROUND_TRANSFER_MODE, 0);
-    QString f(flags);
-    qDebug() << f;
-    return f;
-}
-
-QString ContentServer::dlnaOrgFlagsForStreaming()
-{
-    char flags[448];
-    sprintf(flags, "%s=%.8x%.24x", "DLNA.ORG_FLAGS",
-            DLNA_ORG_FLAG_S0_INCREASE |
-            DLNA_ORG_FLAG_SN_INCREASE |
-            DLNA_ORG_FLAG_CONNECTION_STALL |
-            DLNA_ORG_FLAG_STREAMING_TRANSFER_MODE, 0);
-    QString f(flags);
-    qDebug() << f;
-    return f;
-}
-
-QString ContentServer::dlnaOrgPnFlags(const QString &mime)
-{
-    if (mime.contains("video/x-msvideo", Qt::CaseInsensitive))
-        return "DLNA.ORG_PN=AVI";
-    /*if (mime.contains(image/jpeg"))
-        return "DLNA.ORG_PN=JPEG_LRG";*/
-    if (mime.contains("audio/aac", Qt::CaseInsensitive) ||
-            mime.contains("audio/aacp", Qt::CaseInsensitive))
-        return "DLNA.ORG_PN=AAC";
-    if (mime.contains("audio/mpeg", Qt::CaseInsensitive))
-        return "DLNA.ORG_PN=MP3";
-    if (mime.contains("audio/vnd.wav", Qt::CaseInsensitive))
-        return "DLNA.ORG_PN=LPCM";
-    if (mime.contains("audio/L16", Qt::CaseInsensitive))
-        return "DLNA.ORG_PN=LPCM";
-    if (mime.contains("video/x-matroska", Qt::CaseInsensitive))
-        return "DLNA.ORG_PN=MKV";
-    return QString();
-}
-
 QString ContentServer::dlnaContentFeaturesHeader(const QString& mime, bool seek, bool flags)
 {
-    QString pnFlags = dlnaOrgPnFlags(mime);
-    if (pnFlags.isEmpty()) {
-        if (flags)
-            return QString("%1;%2;%3").arg(
-                        seek ? dlnaOrgOpFlagsSeekBytes : dlnaOrgOpFlagsNoSeek,
-                        dlnaOrgCiFlags,
-                        seek ? dlnaOrgFlagsForFile() : dlnaOrgFlagsForStreaming());
-        else
-            return QString("%1;%2").arg(seek ?
-                                            dlnaOrgOpFlagsSeekBytes : dlnaOrgOpFlagsNoSeek,
-                                            dlnaOrgCiFlags);
-    } else {
-        if (flags)
-            return QString("%1;%2;%3;%4").arg(
-                        pnFlags, seek ? dlnaOrgOpFlagsSeekBytes : dlnaOrgOpFlagsNoSeek,
-                        dlnaOrgCiFlags,
-                        seek ? dlnaOrgFlagsForFile() : dlnaOrgFlagsForStreaming());
-        else
-            return QString("%1;%2;%3").arg(
-                        pnFlags, seek ? dlnaOrgOpFlagsSeekBytes : dlnaOrgOpFlagsNoSeek,
-                        dlnaOrgCiFlags);
-    }
+    static_assert((DLNA_ORG_FLAG_BYTE_BASED_SEEK |
+                   DLNA_ORG_FLAG_INTERACTIVE_TRANSFERT_MODE |
+                   DLNA_ORG_FLAG_BACKGROUND_TRANSFER_MODE) == 0x20c00000,
+                  "DLNA_ORG_FLAGS_FILE is out of date");
+    static_assert((DLNA_ORG_FLAG_S0_INCREASE |
+                   DLNA_ORG_FLAG_SN_INCREASE |
+                   DLNA_ORG_FLAG_CONNECTION_STALL |
+                   DLNA_ORG_FLAG_STREAMING_TRANSFER_MODE) == 0x0d200000,
+                  "DLNA_ORG_FLAGS_STREAMING is out of date");
+
+    // QString copies are shared, so headers are converted only once
+    static const QVector<QString> headers = [] {
+        QVector<QString> h;
+        for (const auto& p : dlnaProfiles)
+            for (const auto f : p.features)
+                h << QString::fromLatin1(f);
+        return h;
+    }();
+
+    return headers.at(4 * dlnaProfile(mime) + (seek ? 0 : 2) + (flags ? 0 : 1));
 }
 
 ContentServer::Type ContentServer::getContentTypeByExtension(const QString &path)
 {
-    auto ext = path.split(".").last();
-    ext = ext.toLower();
-
-    if (m_imgExtMap.contains(ext)) {
-        return ContentServer::TypeImage;
-    } else if (m_musicExtMap.contains(ext)) {
-        return ContentServer::TypeMusic;
-    } else if (m_videoExtMap.contains(ext)) {
-        return ContentServer::TypeVideo;
-    } else if (m_playlistExtMap.contains(ext)) {
-        return ContentServer::TypePlaylist;
-    }
+    auto e = extEntry(path);
+    if (e)
+        return e->type;
 
     // Default type
     return ContentServer::TypeUnknown;
@@ -1109,9 +1407,10 @@ ContentServer::PlaylistType ContentServer::playlistTypeFromMime(const QString &m
 
 ContentServer::PlaylistType ContentServer::playlistTypeFromExtension(const QString &path)
 {
-    auto ext = path.split(".").last();
-    ext = ext.toLower();
-    return playlistTypeFromMime(m_playlistExtMap.value(ext));
+    auto e = extEntry(path);
+    if (e && e->type == TypePlaylist)
+        return playlistTypeFromMime(QString::fromLatin1(e->mime));
+    return PlaylistUnknown;
 }
 
 ContentServer::Type ContentServer::typeFromMime(const QString &mime)
@@ -1128,12 +1427,11 @@ ContentServer::Type ContentServer::typeFromMime(const QString &mime)
     if (mime.contains("/ogv", Qt::CaseInsensitive))
         return ContentServer::TypeVideo;
 
-    auto name = mime.split("/").first().toLower();
-    if (name == "audio")
+    if (mime.startsWith("audio/", Qt::CaseInsensitive))
         return ContentServer::TypeMusic;
-    if (name == "video")
+    if (mime.startsWith("video/", Qt::CaseInsensitive))
         return ContentServer::TypeVideo;
-    if (name == "image")
+    if (mime.startsWith("image/", Qt::CaseInsensitive))
         return ContentServer::TypeImage;
 
     // Default type
@@ -1144,17 +1442,9 @@ QStringList ContentServer::getExtensions(int type) const
 {
     QStringList exts;
 
-    if (type & TypeImage)
-        exts << m_imgExtMap.keys();
-    if (type & TypeMusic)
-        exts << m_musicExtMap.keys();
-    if (type & TypeVideo)
-        exts << m_videoExtMap.keys();
-    if (type & TypePlaylist)
-        exts << m_playlistExtMap.keys();
-
-    for (auto& ext : exts) {
-        ext.prepend("*.");
+    for (const auto& e : extTypes) {
+        if (type & e.type)
+            exts << QLatin1String("*.") + QLatin1String(e.ext);
     }
 
     return exts;
@@ -1162,18 +1452,9 @@ QStringList ContentServer::getExtensions(int type) const
 
 QString ContentServer::getContentMimeByExtension(const QString &path)
 {
-    auto ext = path.split(".").last();
-    ext = ext.toLower();
-
-    if (m_imgExtMap.contains(ext)) {
-        return m_imgExtMap.value(ext);
-    } else if (m_musicExtMap.contains(ext)) {
-        return m_musicExtMap.value(ext);
-    } else if (m_videoExtMap.contains(ext)) {
-        return m_videoExtMap.value(ext);
-    } else if (m_playlistExtMap.contains(ext)) {
-        return m_playlistExtMap.value(ext);
-    }
+    auto e = extEntry(path);
+    if (e)
+        return QString::fromLatin1(e->mime);
 
     // Default mime
     return "application/octet-stream";
@@ -1241,15 +1522,15 @@ void ContentServer::fillCoverArt(ItemMeta& item)
 
 bool ContentServer::getContentMeta(const QString &id, const QUrl &url, QString &meta)
 {
+    const ContentId cid(id);
     QString path, name, desc, author; int t = 0; QUrl icon;
-    if (!Utils::pathTypeNameCookieIconFromId(id, &path, &t, &name, nullptr,
+    if (!Utils::pathTypeNameCookieIconFromId(cid, &path, &t, &name, nullptr,
                                              &icon, &desc, &author))
         return false;
 
     bool audioType = static_cast<Type>(t) == TypeMusic; // extract audio stream from video
-    QUrl urlFromId = Utils::urlFromId(id);
 
-    const auto item = getMeta(urlFromId);
+    const auto item = getMeta(cid.url());
     if (!item) {
         qWarning() << "No meta item found";
         return false;
@@ -1294,7 +1575,7 @@ bool ContentServer::getContentMeta(const QString &id, const QUrl &url, QString &
                                            icon,
                                        artCookie);
             QUrl artUrl;
-            if (makeUrl(id, artUrl))
+            if (makeUrl(ContentId(id), artUrl, cid))
                 m << "<upnp:albumArtURI>" << artUrl.toString() << "</upnp:albumArtURI>";
             else
                 qWarning() << "Cannot make Url form art path";
@@ -1389,11 +1670,12 @@ bool ContentServer::getContentMeta(const QString &id, const QUrl &url, QString &
 bool ContentServer::getContentUrl(const QString &id, QUrl &url, QString &meta,
                                   QString cUrl)
 {
-    if (!Utils::isIdValid(id)) {
+    const ContentId cid(id);
+    if (!cid.isValid()) {
         return false;
     }
 
-    if (!makeUrl(id, url)) {
+    if (!makeUrl(cid, url)) {
         qWarning() << "Cannot make Url form id";
         return false;
     }
@@ -1427,9 +1709,14 @@ QString ContentServer::bestName(const ContentServer::ItemMeta &meta)
     return name;
 }
 
-bool ContentServer::makeUrl(const QString& id, QUrl& url)
+bool ContentServer::makeUrl(const ContentId& id, QUrl& url,
+                            const ContentId& parent)
 {
-    QString hash = QString::fromUtf8(encrypt(id.toUtf8()));
+    QString token = issueToken(id, parent);
+    if (token.isEmpty()) {
+        qWarning() << "Cannot issue token for id";
+        return false;
+    }
 
     QString ifname, addr;
     if (!Utils::instance()->getNetworkIf(ifname, addr)) {
@@ -1440,41 +1727,100 @@ bool ContentServer::makeUrl(const QString& id, QUrl& url)
     url.setScheme("http");
     url.setHost(addr);
     url.setPort(Settings::instance()->getPort());
-    url.setPath("/" + hash);
+    url.setPath("/" + token);
 
     return true;
 }
 
-QByteArray ContentServer::encrypt(const QByteArray &data)
+QString ContentServer::makeToken(const ContentId &id)
+{
+    // Keyed hash rather than plain random value, so URLs of items
+    // restored from saved playlist are still valid after restart
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    hash.addData(Settings::instance()->getKey());
+    hash.addData(id.toString().toUtf8());
+    return QString::fromLatin1(hash.result().left(12).toBase64(
+                                   QByteArray::Base64UrlEncoding |
+                                   QByteArray::OmitTrailingEquals));
+}
+
+QString ContentServer::issueToken(const ContentId &id, const ContentId &parent)
 {
-    QByteArray _data(data);
+    if (!id.isValid()) {
+        qWarning() << "Cannot issue token for invalid id";
+        return QString();
+    }
+
+    QMutexLocker locker(&handlesMutex);
+
+    const auto it = tokens.find(id);
+    if (it != tokens.end())
+        return it.value();
+
+    locker.unlock();
+
+    Handle handle;
+    handle.id = id;
+    handle.parent = parent;
+    handle.art = id.cookie() == artCookie;
+
+    if (id.isLocalFile()) {
+        QFileInfo file(id.path());
+        if (!file.exists() || !file.isFile()) {
+            qWarning() << "Content path doesn't exist";
+            return QString();
+        }
+
+        // Request for the file is served without looking up its meta
+        handle.path = file.absoluteFilePath();
+        handle.size = file.size();
+        const auto meta = getMeta(QUrl::fromLocalFile(handle.path), false);
+        handle.mime = meta ? meta->mime :
+                             getContentMimeByExtension(handle.path);
+        handle.type = typeFromMime(handle.mime);
+    }
+
+    auto token = makeToken(id);
+
+    locker.relock();
+
+    if (!tokens.contains(id)) {
+        handles.insert(token, handle);
+        tokens.insert(id, token);
+        if (parent.isValid())
+            children.insert(parent, token);
+    }
+
+    return token;
+}
 
-    QByteArray key = Settings::instance()->getKey();
-    QByteArray tmp(key);
-    while (key.size() < _data.size())
-        key += tmp;
+void ContentServer::revokeToken(const ContentId &id)
+{
+    QMutexLocker locker(&handlesMutex);
 
-    for (int i = 0; i < _data.size(); ++i)
-        _data[i] = _data.at(i) ^ key.at(i);
+    auto token = tokens.take(id);
+    if (!token.isEmpty()) {
+        const auto handle = handles.take(token);
+        if (handle.parent.isValid())
+            children.remove(handle.parent, token);
+    }
 
-    _data = _data.toBase64(QByteArray::Base64UrlEncoding |
-                         QByteArray::OmitTrailingEquals);
-    return _data;
+    // handles published together with this item (e.g. album art)
+    for (const auto &child : children.values(id))
+        tokens.remove(handles.take(child).id);
+    children.remove(id);
 }
 
-QByteArray ContentServer::decrypt(const QByteArray& data)
+bool ContentServer::handleForUrl(const QUrl &url, Handle &handle) const
 {
-    QByteArray _data = QByteArray::fromBase64(data, QByteArray::Base64UrlEncoding |
-                                                   QByteArray::OmitTrailingEquals);
-    QByteArray key = Settings::instance()->getKey();
-    QByteArray tmp(key);
-    while (key.size() < _data.size())
-        key += tmp;
+    QMutexLocker locker(&handlesMutex);
 
-    for (int i = 0; i < _data.size(); ++i)
-        _data[i] = _data.at(i) ^ key.at(i);
+    const auto it = handles.find(url.path().mid(1));
+    if (it == handles.end())
+        return false;
 
-    return _data;
+    handle = it.value();
+    return true;
 }
 
 QString ContentServer::pathFromUrl(const QUrl &url) const
@@ -1491,54 +1837,21 @@ QString ContentServer::pathFromUrl(const QUrl &url) const
 
 QUrl ContentServer::idUrlFromUrl(const QUrl &url, bool* ok, bool* isFile, bool* isArt)
 {
-    QString hash = url.path();
-    hash = hash.right(hash.length()-1);
-
-    auto id = QUrl(QString::fromUtf8(decrypt(hash.toUtf8())));
-
-    if (!id.isValid()) {
-        //qWarning() << "Id is invalid" << id.toString();
+    Handle handle;
+    if (!instance()->handleForUrl(url, handle)) {
+        //qWarning() << "Unknown token" << url.path();
         if (ok)
             *ok = false;
         return QUrl();
     }
 
-    QUrlQuery q(id);
-    if (!q.hasQueryItem(Utils::cookieKey) ||
-            q.queryItemValue(Utils::cookieKey).isEmpty()) {
-        qWarning() << "Id has no cookie";
-        if (ok)
-            *ok = false;
-        return QUrl();
-    } else {
-        if (isArt)
-            *isArt = q.queryItemValue(Utils::cookieKey) == artCookie;
-    }
-
-    if (id.isLocalFile()) {
-        QString path = id.toLocalFile();
-        QFileInfo file(path);
-        if (!file.exists() || !file.isFile()) {
-            qWarning() << "Content path doesn't exist";
-            if (ok)
-                *ok = false;
-            if (isFile)
-                *isFile = true;
-            return QUrl();
-        }
-
-        if (ok)
-            *ok = true;
-        if (isFile)
-            *isFile = true;
-        return id.toString();
-    }
-
     if (ok)
         *ok = true;
     if (isFile)
-        *isFile = false;
-    return id;
+        *isFile = handle.id.isLocalFile();
+    if (isArt)
+        *isArt = handle.art;
+    return handle.id.id();
 }
 
 QString ContentServer::idFromUrl(const QUrl &url) const
@@ -1876,8 +2189,7 @@ const ContentServer::ItemMeta* ContentServer::getMeta(const QUrl &url, bool crea
 
 const ContentServer::ItemMeta* ContentServer::getMetaForId(const QUrl &id, bool createNew)
 {
-    auto url = Utils::urlFromId(id);
-    return getMeta(url, createNew);
+    return getMeta(ContentId(id).url(), createNew);
 }
 
 const QHash<QUrl, ContentServer::ItemMeta>::const_iterator
@@ -1899,8 +2211,7 @@ ContentServer::getMetaCacheIterator(const QUrl &url, bool createNew)
 const QHash<QUrl, ContentServer::ItemMeta>::const_iterator
 ContentServer::getMetaCacheIteratorForId(const QUrl &id, bool createNew)
 {
-    auto url = Utils::urlFromId(id);
-    return getMetaCacheIterator(url, createNew);
+    return getMetaCacheIterator(ContentId(id).url(), createNew);
 }
 
 const QHash<QUrl, ContentServer::ItemMeta>::const_iterator
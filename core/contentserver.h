@@ -12,6 +12,7 @@
 #include <QString>
 #include <QUrl>
 #include <QHash>
+#include <QSet>
 #include <QVector>
 #include <QStringList>
 #include <QFile>
@@ -28,6 +29,7 @@
 #include <qhttpresponse.h>
 
 #include "taskexecutor.h"
+#include "contentid.h"
 
 #ifdef FFMPEG
 extern "C" {
@@ -140,6 +142,8 @@ public:
     const QHash<QUrl, ItemMeta>::const_iterator metaCacheIteratorEnd();
     const ItemMeta* getMeta(const QUrl &url, bool createNew = true);
     const ItemMeta* getMetaForId(const QUrl &id, bool createNew = true);
+    QString issueToken(const ContentId &id, const ContentId &parent = ContentId());
+    void revokeToken(const ContentId &id);
     Q_INVOKABLE QString streamTitle(const QUrl &id) const;
 
 signals:
@@ -184,19 +188,23 @@ private:
         int count = 0;
     };
 
+    struct Handle {
+        ContentId id;
+        ContentId parent; // item that caused publishing, e.g. for album art
+        bool art = false;
+        // Resolved when token is issued, only for local files
+        QString path;
+        QString mime;
+        Type type = TypeUnknown;
+        qint64 size = -1;
+    };
+
     static ContentServer* m_instance;
 
-    static const QHash<QString,QString> m_imgExtMap;
-    static const QHash<QString,QString> m_musicExtMap;
-    static const QHash<QString,QString> m_videoExtMap;
-    static const QHash<QString,QString> m_playlistExtMap;
     static const QStringList m_m3u_mimes;
     static const QStringList m_pls_mimes;
     static const QStringList m_xspf_mimes;
     static const QString queryTemplate;
-    static const QString dlnaOrgOpFlagsSeekBytes;
-    static const QString dlnaOrgOpFlagsNoSeek;
-    static const QString dlnaOrgCiFlags;
     static const QString audioItemClass;
     static const QString videoItemClass;
     static const QString imageItemClass;
@@ -206,6 +214,8 @@ private:
     static const QByteArray userAgent;
     static const QString artCookie;
     static const qint64 qlen = 100000;
+    // Max wait (ms) for all renderers in group to request shared file
+    static const int fileShareWait = 2000;
     static const int threadWait = 1;
     static const int maxRedirections = 5;
     static const int httpTimeout = 10000;
@@ -213,14 +223,15 @@ private:
     QHash<QUrl, ItemMeta> metaCache; // url => ItemMeta
     QHash<QUrl, StreamData> streams; // id => StreamData
     QMutex metaCacheMutex;
+    QHash<QString, Handle> handles; // token => Handle
+    QHash<ContentId, QString> tokens; // id => token
+    QMultiHash<ContentId, QString> children; // parent id => tokens
+    mutable QMutex handlesMutex;
     QString pulseStreamName;
 
-    static QByteArray encrypt(const QByteArray& data);
-    static QByteArray decrypt(const QByteArray& data);
-    static bool makeUrl(const QString& id, QUrl& url);
-    static QString dlnaOrgFlagsForFile();
-    static QString dlnaOrgFlagsForStreaming();
-    static QString dlnaOrgPnFlags(const QString& mime);
+    static QString makeToken(const ContentId &id);
+    bool makeUrl(const ContentId& id, QUrl& url, const ContentId& parent = ContentId());
+    bool handleForUrl(const QUrl &url, Handle &handle) const;
     static QString dlnaContentFeaturesHeader(const QString& mime, bool seek = true, bool flags = true);
     static QString getContentMimeByExtension(const QString &path);
     static QString getContentMimeByExtension(const QUrl &url);
@@ -283,8 +294,16 @@ private slots:
     void responseForPulseDone();
 #endif
     void responseForUrlDone();
+    void responseForShareWritten();
+    void responseForShareDone();
 
 private:
+    struct SimpleProxyItem {
+        QUrl id;
+        QHttpRequest* req = nullptr;
+        QHttpResponse* resp = nullptr;
+    };
+
     struct ProxyItem {
         QHttpRequest* req = nullptr;
         QHttpResponse* resp = nullptr;
@@ -298,12 +317,17 @@ private:
         //int metasize = 0; // shoutcast metadata size detected
         //QByteArray metadata; // shoutcast metadata readed so far
         QByteArray data;
+        int code = 0; // status sent to client
+        QList<QPair<QString,QString>> headers; // headers sent to client
+        QList<SimpleProxyItem> shared; // other clients fed by the same reply
     };
 
-    struct SimpleProxyItem {
-        QUrl id;
-        QHttpRequest* req = nullptr;
-        QHttpResponse* resp = nullptr;
+    struct FileShareItem {
+        std::shared_ptr<QFile> file;
+        int serial = 0;
+        bool started = false;
+        QList<QHttpResponse*> resps;
+        QSet<QHttpResponse*> pending; // clients with unsent chunk
     };
 
     static ContentServerWorker* m_instance;
@@ -318,13 +342,21 @@ private:
     QHash<QHttpResponse*, QNetworkReply*> responseToReplyMap;
     QList<SimpleProxyItem> micItems;
     QList<SimpleProxyItem> pulseItems;
+    QHash<QString, FileShareItem> fileShares; // path => FileShareItem
+    QHash<QHttpResponse*, QString> responseToShareMap;
+    int fileShareSerial = 0;
 
     ContentServerWorker(QObject *parent = nullptr);
-    void streamFile(const QString& path, const QString &mime, QHttpRequest *req, QHttpResponse *resp);
+    void streamFile(const QString& path, const QString &mime, QHttpRequest *req, QHttpResponse *resp, qint64 size = -1);
     bool seqWriteData(QFile &file, qint64 size, QHttpResponse *resp);
+    bool joinFileShare(const QString &path, QHttpResponse *resp);
+    void startFileShare(const QString &path);
+    void writeFileShare(const QString &path);
     void requestHandler(QHttpRequest *req, QHttpResponse *resp);
     void requestForFileHandler(const QUrl &id, const ContentServer::ItemMeta *meta, QHttpRequest *req, QHttpResponse *resp);
     void requestForUrlHandler(const QUrl &id, const ContentServer::ItemMeta *meta, QHttpRequest *req, QHttpResponse *resp);
+    bool joinProxy(const QUrl &id, QHttpRequest *req, QHttpResponse *resp);
+    bool releaseProxyResponse(ProxyItem &item, QHttpResponse *resp);
     void requestForMicHandler(const QUrl &id, const ContentServer::ItemMeta *meta, QHttpRequest *req, QHttpResponse *resp);
     void requestForPulseHandler(const QUrl &id, const ContentServer::ItemMeta *meta, QHttpRequest *req, QHttpResponse *resp);
     void sendEmptyResponse(QHttpResponse *resp, int code);
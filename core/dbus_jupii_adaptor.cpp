@@ -63,3 +63,11 @@ void PlayerAdaptor::clearPlaylist()
     QMetaObject::invokeMethod(parent(), "clearPlaylist");
 }
 
+QString PlayerAdaptor::latencyStats()
+{
+    // handle method call org.jupii.Player.latencyStats
+    QString stats;
+    QMetaObject::invokeMethod(parent(), "latencyStats", Q_RETURN_ARG(QString, stats));
+    return stats;
+}
+
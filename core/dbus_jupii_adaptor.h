@@ -48,6 +48,9 @@ class PlayerAdaptor: public QDBusAbstractAdaptor
 "      <arg direction=\"in\" type=\"s\" name=\"name\"/>\n"
 "    </method>\n"
 "    <method name=\"clearPlaylist\"/>\n"
+"    <method name=\"latencyStats\">\n"
+"      <arg direction=\"out\" type=\"s\" name=\"stats\"/>\n"
+"    </method>\n"
 "  </interface>\n"
         "")
 public:
@@ -63,6 +66,7 @@ public Q_SLOTS: // METHODS
     void addUrl(const QString &url, const QString &name);
     void appendPath(const QString &path);
     void clearPlaylist();
+    QString latencyStats();
 Q_SIGNALS: // SIGNALS
     void CanControlPropertyChanged(bool canControl);
 };
@@ -9,6 +9,8 @@
 #include <QDBusInterface>
 #include <QDebug>
 #include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
 
 #include "dbusapp.h"
 #include "dbus_jupii_adaptor.h"
@@ -92,3 +94,19 @@ void DbusProxy::clearPlaylist()
     auto pl = PlaylistModel::instance();
     pl->clear();
 }
+
+QString DbusProxy::latencyStats()
+{
+    qDebug() << "Dbus latencyStats";
+
+    QVariantMap stats;
+    auto av = Services::instance()->avTransport;
+    if (av)
+        stats["AVTransport"] = av->latencyStats();
+    auto rc = Services::instance()->renderingControl;
+    if (rc)
+        stats["RenderingControl"] = rc->latencyStats();
+
+    return QString::fromUtf8(QJsonDocument(QJsonObject::fromVariantMap(stats))
+                             .toJson(QJsonDocument::Compact));
+}
@@ -34,6 +34,7 @@ public slots:
     void addPath(const QString& path, const QString& name);
     void addUrl(const QString& url, const QString& name);
     void clearPlaylist();
+    QString latencyStats();
 
 private:
     bool m_canControl = false;
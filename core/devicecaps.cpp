@@ -0,0 +1,312 @@
+/* Copyright (C) 2017 Michal Kosciesza <michal@mkiol.net>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <QDebug>
+#include <QRegExp>
+#include <QCryptographicHash>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QMutexLocker>
+#include <QDateTime>
+
+#include "devicecaps.h"
+#include "utils.h"
+
+#include <libupnpp/control/service.hxx>
+#include <libupnpp/soaphelp.hxx>
+
+DeviceCaps* DeviceCaps::m_instance = nullptr;
+
+// Non-standard MIME types used by renderers and files => canonical ones
+const QHash<QString, QString> DeviceCaps::m_mimeAliases {
+    {"audio/x-flac", "audio/flac"},
+    {"audio/mp3", "audio/mpeg"},
+    {"audio/x-mp3", "audio/mpeg"},
+    {"audio/mpeg3", "audio/mpeg"},
+    {"audio/x-mpeg", "audio/mpeg"},
+    {"audio/x-m4a", "audio/mp4"},
+    {"audio/m4a", "audio/mp4"},
+    {"audio/x-aac", "audio/aac"},
+    {"audio/aacp", "audio/aac"},
+    {"audio/x-ogg", "audio/ogg"},
+    {"application/ogg", "audio/ogg"},
+    {"audio/wav", "audio/vnd.wav"},
+    {"audio/x-wav", "audio/vnd.wav"},
+    {"audio/wave", "audio/vnd.wav"},
+    {"audio/x-ms-wma", "audio/wma"},
+    {"video/x-mkv", "video/x-matroska"},
+    {"video/mkv", "video/x-matroska"},
+    {"video/avi", "video/x-msvideo"},
+    {"video/msvideo", "video/x-msvideo"},
+    {"video/x-mp4", "video/mp4"},
+    {"video/x-m4v", "video/mp4"},
+    {"video/x-ms-wmv", "video/wmv"},
+    {"image/jpg", "image/jpeg"},
+    {"image/pjpeg", "image/jpeg"}
+};
+
+DeviceCaps::DeviceCaps(QObject *parent) :
+    QObject(parent)
+{
+}
+
+DeviceCaps* DeviceCaps::instance(QObject *parent)
+{
+    if (DeviceCaps::m_instance == nullptr) {
+        DeviceCaps::m_instance = new DeviceCaps(parent);
+    }
+
+    return DeviceCaps::m_instance;
+}
+
+QString DeviceCaps::fileName(const QString &id)
+{
+    QString _id(id);
+    return "caps-" + _id.replace(':','-') + ".json";
+}
+
+QString DeviceCaps::descKey(const UPnPClient::UPnPDeviceDesc &ddesc)
+{
+    const auto xml = QString::fromStdString(ddesc.XMLText);
+
+    // UPnP 1.1 devices announce description changes with configId
+    // attribute, for others whole description is hashed
+    QRegExp rx("<root[^>]*\\sconfigId\\s*=\\s*\"([^\"]*)\"");
+    if (rx.indexIn(xml) != -1)
+        return "configid:" + rx.cap(1);
+
+    return "md5:" + QString::fromLatin1(
+                QCryptographicHash::hash(xml.toUtf8(),
+                                         QCryptographicHash::Md5).toHex());
+}
+
+QString DeviceCaps::mimeFromProtocolInfo(const QString &info)
+{
+    // protocol:network:contentFormat:additionalInfo
+    return info.section(':', 2, 2).trimmed().toLower();
+}
+
+QString DeviceCaps::normalizedMime(const QString &mime)
+{
+    const auto lmime = mime.trimmed().toLower();
+    return m_mimeAliases.value(lmime, lmime);
+}
+
+bool DeviceCaps::probe(const UPnPClient::UPnPDeviceDesc &ddesc, Caps &caps)
+{
+    bool cmOk = false, avtOk = false;
+
+    for (const auto &sdesc : ddesc.services) {
+        if (sdesc.serviceType.find("ConnectionManager") != std::string::npos) {
+            UPnPClient::Service srv(ddesc, sdesc);
+            UPnPP::SoapOutgoing args(sdesc.serviceType, "GetProtocolInfo");
+            UPnPP::SoapIncoming data;
+
+            int ret = srv.runAction(args, data);
+            if (ret != UPNP_E_SUCCESS) {
+                qWarning() << "GetProtocolInfo failed with error" << ret;
+                continue;
+            }
+
+            std::string sink;
+            data.get("Sink", &sink);
+            caps.sinkProtocolInfo = QString::fromStdString(sink)
+                    .split(',', QString::SkipEmptyParts);
+            for (auto &info : caps.sinkProtocolInfo)
+                info = info.trimmed();
+            cmOk = true;
+        } else if (sdesc.serviceType.find("AVTransport") != std::string::npos) {
+            UPnPClient::UPnPServiceDesc::Parsed parsed;
+            if (!sdesc.fetchAndParseDesc(ddesc.URLBase, parsed)) {
+                qWarning() << "Can't fetch AVTransport description";
+                continue;
+            }
+
+            caps.nextURISupported =
+                    parsed.actionList.find("SetNextAVTransportURI") !=
+                    parsed.actionList.end();
+
+            caps.seekModes.clear();
+            auto it = parsed.stateTable.find("A_ARG_TYPE_SeekMode");
+            if (it != parsed.stateTable.end()) {
+                for (const auto &value : it->second.allowedValues)
+                    caps.seekModes << QString::fromStdString(value);
+            }
+            avtOk = true;
+        }
+    }
+
+    return cmOk && avtOk;
+}
+
+QByteArray DeviceCaps::toJson(const Caps &caps)
+{
+    QJsonObject obj;
+    obj["key"] = caps.key;
+    obj["sink"] = QJsonArray::fromStringList(caps.sinkProtocolInfo);
+    obj["seekmodes"] = QJsonArray::fromStringList(caps.seekModes);
+    obj["nexturi"] = caps.nextURISupported;
+    obj["settlequirk"] = caps.settleQuirk;
+    obj["settlequirktime"] = caps.settleQuirkTime;
+    obj["keepalivequirk"] = caps.keepAliveQuirk;
+    return QJsonDocument(obj).toJson(QJsonDocument::Compact);
+}
+
+bool DeviceCaps::fromJson(const QByteArray &data, Caps &caps)
+{
+    auto doc = QJsonDocument::fromJson(data);
+    if (!doc.isObject())
+        return false;
+
+    const auto obj = doc.object();
+    caps.key = obj.value("key").toString();
+    caps.sinkProtocolInfo.clear();
+    for (const auto &v : obj.value("sink").toArray())
+        caps.sinkProtocolInfo << v.toString();
+    caps.seekModes.clear();
+    for (const auto &v : obj.value("seekmodes").toArray())
+        caps.seekModes << v.toString();
+    caps.nextURISupported = obj.value("nexturi").toBool(true);
+    caps.settleQuirk = obj.value("settlequirk").toBool(false);
+    caps.settleQuirkTime = static_cast<qint64>(
+                obj.value("settlequirktime").toDouble(0));
+    caps.keepAliveQuirk = obj.value("keepalivequirk").toBool(false);
+
+    return !caps.key.isEmpty();
+}
+
+void DeviceCaps::write(const QString &id, const Caps &caps)
+{
+    if (!Utils::writeToCacheFile(fileName(id), toJson(caps), true))
+        qWarning() << "Can't write capabilities file for device" << id;
+}
+
+DeviceCaps::Caps DeviceCaps::caps(const UPnPClient::UPnPDeviceDesc &ddesc)
+{
+    const auto id = QString::fromStdString(ddesc.UDN);
+    const auto key = descKey(ddesc);
+
+    {
+        QMutexLocker locker(&m_mutex);
+        auto it = m_caps.find(id);
+        if (it != m_caps.end() && it->key == key)
+            return it.value();
+    }
+
+    Caps caps;
+    QByteArray data;
+
+    if (Utils::readFromCacheFile(fileName(id), data) &&
+            fromJson(data, caps) && caps.key == key) {
+        qDebug() << "Capabilities of" << id << "loaded from cache";
+        if (caps.settleQuirk && QDateTime::currentMSecsSinceEpoch() -
+                caps.settleQuirkTime > settleQuirkExpiry) {
+            qDebug() << "Settle quirk of" << id << "expired";
+            caps.settleQuirk = false;
+            write(id, caps);
+        }
+    } else {
+        qDebug() << "Probing capabilities of" << id;
+        caps = Caps();
+        caps.key = key;
+        if (!probe(ddesc, caps)) {
+            // Not remembered, so next connection probes again
+            qWarning() << "Unable to probe capabilities of" << id;
+            return caps;
+        }
+        write(id, caps);
+    }
+
+    QMutexLocker locker(&m_mutex);
+    m_caps.insert(id, caps);
+
+    return caps;
+}
+
+bool DeviceCaps::find(const QString &id, Caps &caps)
+{
+    QMutexLocker locker(&m_mutex);
+    auto it = m_caps.find(id);
+    if (it == m_caps.end())
+        return false;
+
+    caps = it.value();
+    return true;
+}
+
+bool DeviceCaps::canPlay(const QString &id, const QString &mime, bool *known)
+{
+    QMutexLocker locker(&m_mutex);
+    auto it = m_caps.find(id);
+
+    if (it == m_caps.end() || it->sinkProtocolInfo.isEmpty()) {
+        // Without sink info nothing is rejected
+        if (known)
+            *known = false;
+        return true;
+    }
+
+    if (known)
+        *known = true;
+
+    // Renderers and files name some types differently, e.g. audio/x-flac
+    // and audio/flac, so both sides are compared in canonical form
+    const auto lmime = normalizedMime(mime);
+    const auto type = lmime.section('/', 0, 0);
+
+    for (const auto &info : it->sinkProtocolInfo) {
+        const auto smime = normalizedMime(mimeFromProtocolInfo(info));
+        if (smime == "*" || smime == lmime || smime == type + "/*")
+            return true;
+    }
+
+    return false;
+}
+
+void DeviceCaps::setNextURISupported(const QString &id, bool value)
+{
+    QMutexLocker locker(&m_mutex);
+    auto it = m_caps.find(id);
+    if (it == m_caps.end() || it->nextURISupported == value)
+        return;
+
+    it->nextURISupported = value;
+    Caps caps = it.value();
+    locker.unlock();
+
+    write(id, caps);
+}
+
+void DeviceCaps::setSettleQuirk(const QString &id, bool value)
+{
+    QMutexLocker locker(&m_mutex);
+    auto it = m_caps.find(id);
+    if (it == m_caps.end() || it->settleQuirk == value)
+        return;
+
+    it->settleQuirk = value;
+    it->settleQuirkTime = value ? QDateTime::currentMSecsSinceEpoch() : 0;
+    Caps caps = it.value();
+    locker.unlock();
+
+    write(id, caps);
+}
+
+void DeviceCaps::setKeepAliveQuirk(const QString &id, bool value)
+{
+    QMutexLocker locker(&m_mutex);
+    auto it = m_caps.find(id);
+    if (it == m_caps.end() || it->keepAliveQuirk == value)
+        return;
+
+    it->keepAliveQuirk = value;
+    Caps caps = it.value();
+    locker.unlock();
+
+    write(id, caps);
+}
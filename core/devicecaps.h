@@ -0,0 +1,72 @@
+/* Copyright (C) 2017 Michal Kosciesza <michal@mkiol.net>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef DEVICECAPS_H
+#define DEVICECAPS_H
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QHash>
+#include <QMutex>
+#include <QByteArray>
+
+#include <libupnpp/control/description.hxx>
+
+// Capabilities of a renderer that are learned once and remembered
+// across sessions. Record is stored in the cache dir and is valid as long
+// as device description (CONFIGID or content hash) doesn't change.
+class DeviceCaps : public QObject
+{
+    Q_OBJECT
+public:
+    struct Caps {
+        QString key;
+        QStringList sinkProtocolInfo;
+        QStringList seekModes;
+        bool nextURISupported = true;
+        bool settleQuirk = false;
+        qint64 settleQuirkTime = 0; // ms since epoch
+        // Renderer breaks reused SOAP connections, so every action
+        // goes over new one
+        bool keepAliveQuirk = false;
+    };
+
+    static DeviceCaps* instance(QObject *parent = nullptr);
+
+    // Returns record for device. When there is no valid record in
+    // the cache, device is probed (ConnectionManager and AVTransport SCPD)
+    // so this should not be called from main thread.
+    Caps caps(const UPnPClient::UPnPDeviceDesc &ddesc);
+    bool find(const QString &id, Caps &caps);
+    bool canPlay(const QString &id, const QString &mime, bool *known = nullptr);
+    void setNextURISupported(const QString &id, bool value);
+    void setSettleQuirk(const QString &id, bool value);
+    void setKeepAliveQuirk(const QString &id, bool value);
+
+private:
+    // Age (ms) after which settle quirk is forgotten and has to be
+    // learned again, e.g. renderer firmware may have been updated
+    static const qint64 settleQuirkExpiry = 30LL * 24 * 3600 * 1000;
+
+    static DeviceCaps* m_instance;
+    static const QHash<QString, QString> m_mimeAliases;
+    QMutex m_mutex;
+    QHash<QString, Caps> m_caps;
+
+    explicit DeviceCaps(QObject *parent = nullptr);
+    static QString descKey(const UPnPClient::UPnPDeviceDesc &ddesc);
+    static QString fileName(const QString &id);
+    static QString mimeFromProtocolInfo(const QString &info);
+    static QString normalizedMime(const QString &mime);
+    static bool probe(const UPnPClient::UPnPDeviceDesc &ddesc, Caps &caps);
+    static QByteArray toJson(const Caps &caps);
+    static bool fromJson(const QByteArray &data, Caps &caps);
+    void write(const QString &id, const Caps &caps);
+};
+
+#endif // DEVICECAPS_H
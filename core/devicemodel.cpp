@@ -17,6 +17,7 @@
 #include "utils.h"
 #include "settings.h"
 #include "services.h"
+#include "renderergroup.h"
 
 #ifdef DESKTOP
 #include <QPixmap>
@@ -30,74 +31,116 @@ const int icon_size = 64;
 DeviceModel::DeviceModel(QObject *parent) :
     ListModel(new DeviceItem, parent)
 {
-    QObject::connect(Directory::instance(),
-                     &Directory::discoveryReady,
-                     this,
-                     &DeviceModel::updateModel);
+    auto d = Directory::instance();
+    QObject::connect(d, &Directory::discoveryReady,
+                     this, &DeviceModel::updateModel);
+    QObject::connect(d, &Directory::deviceFound,
+                     this, &DeviceModel::updateDevice);
+    QObject::connect(d, &Directory::deviceLost,
+                     this, &DeviceModel::removeDevice);
+
+    updateModel();
 }
 
 DeviceModel::~DeviceModel()
 {
 }
 
-void DeviceModel::updateModel()
+DeviceItem* DeviceModel::makeItem(const UPnPClient::UPnPDeviceDesc &ddesc)
 {
-    auto d = Directory::instance();
-    auto s = Settings::instance();
-    auto av = Services::instance()->avTransport;
-
-    auto ddescs = d->getDeviceDescs();
-    bool showAll = s->getShowAllDevices();
+    /*bool supported = ddesc.deviceType == "urn:schemas-upnp-org:device:MediaRenderer:1" ||
+                     ddesc.deviceType == "urn:schemas-upnp-org:device:MediaServer:1";*/
+    bool supported = ddesc.deviceType == "urn:schemas-upnp-org:device:MediaRenderer:1";
 
-    clear();
+    if (!supported && !Settings::instance()->getShowAllDevices())
+        return nullptr;
 
-    for (auto ddesc : ddescs) {
-        /*bool supported = ddesc.deviceType == "urn:schemas-upnp-org:device:MediaRenderer:1" ||
-                         ddesc.deviceType == "urn:schemas-upnp-org:device:MediaServer:1";*/
-        bool supported = ddesc.deviceType == "urn:schemas-upnp-org:device:MediaRenderer:1";
+    auto av = Services::instance()->avTransport;
 
-        if (supported || showAll) {
-            QString id = QString::fromStdString(ddesc.UDN);
-            QUrl iconUrl = d->getDeviceIconUrl(ddesc);
-            bool active = av && av->getDeviceId() == id;
+    QString id = QString::fromStdString(ddesc.UDN);
+    bool active = av && av->getDeviceId() == id;
 
-            appendRow(new DeviceItem(id,
-                                     QString::fromStdString(ddesc.friendlyName),
-                                     QString::fromStdString(ddesc.deviceType),
-                                     QString::fromStdString(ddesc.modelName),
+    return new DeviceItem(id,
+                          QString::fromStdString(ddesc.friendlyName),
+                          QString::fromStdString(ddesc.deviceType),
+                          QString::fromStdString(ddesc.modelName),
 #ifdef DESKTOP
-                                     QIcon(),
+                          QIcon(),
 #else
-                                     iconUrl,
+                          Directory::instance()->getDeviceIconUrl(ddesc),
 #endif
-                                     supported,
-                                     active
-                                     ));
+                          supported,
+                          active
+                          );
+}
 
 #ifdef DESKTOP
-            if (!iconUrl.isEmpty()) {
-                auto downloader = new FileDownloader(iconUrl, this);
-                connect(downloader, &FileDownloader::downloaded,
-                        [this, id, downloader](int error){
-                    //qDebug() << "Icon downloaded for:" << id;
-                    if (error == 0) {
-                        auto item = dynamic_cast<DeviceItem*>(this->find(id));
-                        if (item) {
-                            auto img = QImage::fromData(downloader->downloadedData());
-                            img = img.scaled(QSize(icon_size,icon_size));
-                            auto pix = QPixmap::fromImage(img);
-                            item->setIcon(QIcon(pix));
-                        }
-                    } else {
-                        qWarning() << "Icon downloading error";
-                    }
-
-                    downloader->deleteLater();
-                });
+void DeviceModel::downloadIcon(const QString &id, const QUrl &url)
+{
+    if (url.isEmpty())
+        return;
+
+    auto downloader = new FileDownloader(url, this);
+    connect(downloader, &FileDownloader::downloaded,
+            [this, id, downloader](int error){
+        //qDebug() << "Icon downloaded for:" << id;
+        if (error == 0) {
+            auto item = dynamic_cast<DeviceItem*>(this->find(id));
+            if (item) {
+                auto img = QImage::fromData(downloader->downloadedData());
+                img = img.scaled(QSize(icon_size,icon_size));
+                auto pix = QPixmap::fromImage(img);
+                item->setIcon(QIcon(pix));
             }
-#endif
+        } else {
+            qWarning() << "Icon downloading error";
         }
+
+        downloader->deleteLater();
+    });
+}
+#endif
+
+void DeviceModel::updateModel()
+{
+    auto ddescs = Directory::instance()->getDeviceDescs();
+
+    for (int i = rowCount() - 1; i >= 0; --i) {
+        if (!ddescs.contains(readRow(i)->id()))
+            removeRow(i);
     }
+
+    for (auto it = ddescs.cbegin(); it != ddescs.cend(); ++it)
+        updateDevice(it.key());
+}
+
+void DeviceModel::updateDevice(const QString &id)
+{
+    UPnPClient::UPnPDeviceDesc ddesc;
+    if (!Directory::instance()->getDeviceDesc(id, ddesc))
+        return;
+
+    auto item = makeItem(ddesc);
+    int row = indexFromId(id);
+
+    if (!item) {
+        removeRow(row);
+    } else if (row < 0) {
+        appendRow(item);
+#ifdef DESKTOP
+        downloadIcon(id, Directory::instance()->getDeviceIconUrl(ddesc));
+#endif
+    } else {
+        auto old = dynamic_cast<DeviceItem*>(readRow(row));
+        if (old)
+            old->update(*item);
+        delete item;
+    }
+}
+
+void DeviceModel::removeDevice(const QString &id)
+{
+    removeRow(indexFromId(id));
 }
 
 void DeviceModel::clear()
@@ -115,6 +158,22 @@ void DeviceModel::setActiveIndex(int index)
     }
 }
 
+void DeviceModel::setGrouped(int index, bool grouped)
+{
+    auto item = dynamic_cast<DeviceItem*>(readRow(index));
+    if (!item) {
+        qWarning() << "Invalid device index" << index;
+        return;
+    }
+
+    if (grouped && (!item->supported() || item->active())) {
+        qWarning() << "Device can't be added to group:" << item->id();
+        return;
+    }
+
+    RendererGroup::instance()->setMember(item->id(), grouped);
+}
+
 DeviceItem::DeviceItem(const QString &id,
                    const QString &title,
                    const QString &type,
@@ -139,6 +198,8 @@ DeviceItem::DeviceItem(const QString &id,
 
     QObject::connect(Settings::instance(), &Settings::favDevicesChanged,
                      [this](){ emit dataChanged(); });
+    QObject::connect(RendererGroup::instance(), &RendererGroup::membersChanged,
+                     this, [this](){ emit dataChanged(); });
 }
 
 QHash<int, QByteArray> DeviceItem::roleNames() const
@@ -152,6 +213,7 @@ QHash<int, QByteArray> DeviceItem::roleNames() const
     names[IconRole] = "icon";
     names[SupportedRole] = "supported";
     names[ActiveRole] = "active";
+    names[GroupRole] = "grouped";
     return names;
 }
 
@@ -174,6 +236,8 @@ QVariant DeviceItem::data(int role) const
         return supported();
     case ActiveRole:
         return active();
+    case GroupRole:
+        return isGrouped();
 #ifdef DESKTOP
     case ForegroundRole:
         return foreground();
@@ -189,6 +253,30 @@ bool DeviceItem::isFav() const
     return fd.contains(m_id);
 }
 
+bool DeviceItem::isGrouped() const
+{
+    return RendererGroup::instance()->isMember(m_id);
+}
+
+void DeviceItem::update(const DeviceItem &other)
+{
+    if (m_title != other.m_title || m_type != other.m_type ||
+            m_model != other.m_model || m_supported != other.m_supported
+#ifndef DESKTOP
+            || m_icon != other.m_icon
+#endif
+            ) {
+        m_title = other.m_title;
+        m_type = other.m_type;
+        m_model = other.m_model;
+        m_supported = other.m_supported;
+#ifndef DESKTOP
+        m_icon = other.m_icon;
+#endif
+        emit dataChanged();
+    }
+}
+
 void DeviceItem::setActive(bool value)
 {
     if (m_active != value) {
@@ -23,6 +23,8 @@
 #include <QBrush>
 #endif
 
+#include <libupnpp/control/description.hxx>
+
 #include "listmodel.h"
 
 class DeviceItem : public ListItem
@@ -38,7 +40,8 @@ public:
         ActiveRole,
         ModelRole,
         FavRole,
-        SupportedRole
+        SupportedRole,
+        GroupRole
     };
 
 public:
@@ -69,7 +72,10 @@ public:
     inline bool supported() const { return m_supported; }
     inline bool active() const { return m_active; }
     bool isFav() const;
+    bool isGrouped() const;
     void setActive(bool value);
+    // Takes description fields of other item, active state is kept
+    void update(const DeviceItem &other);
 #ifdef DESKTOP
     void setIcon(const QIcon &icon);
     QBrush foreground() const;
@@ -99,8 +105,19 @@ public:
     void clear();
 
 public slots:
+    // Rows are matched by device id, so known devices are not reset
     void updateModel();
+    void updateDevice(const QString &id);
+    void removeDevice(const QString &id);
     void setActiveIndex(int index);
+    // Adds renderer to the group of active one or removes it
+    Q_INVOKABLE void setGrouped(int index, bool grouped);
+
+private:
+    DeviceItem* makeItem(const UPnPClient::UPnPDeviceDesc &ddesc);
+#ifdef DESKTOP
+    void downloadIcon(const QString &id, const QUrl &url);
+#endif
 };
 
 #endif // DEVICEMODEL_H
@@ -12,8 +12,18 @@
 #include <QStringList>
 #include <QByteArray>
 #include <QFile>
+#include <QMutexLocker>
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QNetworkRequest>
+#include <QNetworkReply>
 
 #include <string>
+#include <vector>
 
 #include <libupnpp/control/description.hxx>
 
@@ -22,14 +32,95 @@
 #include "directory.h"
 
 Directory* Directory::m_instance = nullptr;
+const QString Directory::snapshotFile = "devices.json";
 
 Directory::Directory(QObject *parent) :
     QObject(parent),
     TaskExecutor(parent)
 {
+    connect(Utils::instance(), &Utils::networkIfChanged,
+            this, &Directory::handleNetworkIfChanged);
+    connect(Settings::instance(), &Settings::showAllDevicesChanged,
+            this, &Directory::handleShowAllDevicesChanged);
+
+    m_expireTimer.setInterval(expireInterval);
+    connect(&m_expireTimer, &QTimer::timeout, this, &Directory::expire);
+    m_expireTimer.start();
+
+    connect(QCoreApplication::instance(), &QCoreApplication::aboutToQuit,
+            this, &Directory::saveSnapshot);
+
     init();
 }
 
+Directory::~Directory()
+{
+    shutdownTasks();
+}
+
+void Directory::handleNetworkIfChanged()
+{
+    if (!Utils::instance()->checkNetworkIf()) {
+        qWarning() << "Net interface is gone";
+        setInited(false);
+        return;
+    }
+
+    if (!m_inited) {
+        init();
+        if (!m_inited)
+            return;
+    } else if (!restart()) {
+        return;
+    }
+
+    qDebug() << "Net interface changed, restarting discovery";
+
+    // Devices from previous network are not reachable anymore
+    UPnPClient::UPnPDeviceDirectory::reset();
+    clearLists();
+    emit discoveryReady();
+
+    discover();
+}
+
+bool Directory::restart()
+{
+    // libupnp is bound to address of old interface, so it is started
+    // again on the new one
+    QString ifname, addr;
+
+    if (!Utils::instance()->getNetworkIf(ifname, addr)) {
+        qWarning() << "Can't find valid network interface";
+        setInited(false);
+        emit error(1);
+        return false;
+    }
+
+    qDebug() << "Restarting UPnPP lib on" << ifname << addr;
+
+    if (!m_lib->reinit(ifname.toStdString(), addr.toStdString())) {
+        qWarning() << "Can't initialize UPnPP lib";
+        setInited(false);
+        emit error(2);
+        return false;
+    }
+
+    m_lib->setLogFileName("", UPnPP::LibUPnP::LogLevelError);
+    updateSsdpFilter();
+
+    return true;
+}
+
+void Directory::handleShowAllDevicesChanged()
+{
+    if (!m_inited)
+        return;
+
+    updateSsdpFilter();
+    discover();
+}
+
 void Directory::init()
 {
     auto u = Utils::instance();
@@ -47,6 +138,11 @@ void Directory::init()
         false, 0, ifname.toStdString(), addr.toStdString(), 0
     );
 
+    // Library started earlier may be bound to address of other interface
+    if (m_lib && m_lib->host() != addr.toStdString() &&
+            !m_lib->reinit(ifname.toStdString(), addr.toStdString()))
+        m_lib = 0;
+
     if (m_lib == 0) {
         qWarning() << "Can't initialize UPnPP lib";
         setInited(false);
@@ -60,6 +156,9 @@ void Directory::init()
 
     m_lib->setLogFileName("", UPnPP::LibUPnP::LogLevelError);
 
+    addCallbacks();
+    updateSsdpFilter();
+
     m_directory = UPnPClient::UPnPDeviceDirectory::getTheDir(4);
 
     if (m_directory == 0) {
@@ -70,6 +169,138 @@ void Directory::init()
     }
 
     setInited(true);
+
+    loadSnapshot();
+}
+
+void Directory::addCallbacks()
+{
+    if (m_callbacksAdded)
+        return;
+
+    // Devices are reported one by one when their description is parsed,
+    // so the list is filled in about one SSDP round trip
+    UPnPClient::UPnPDeviceDirectory::addCallback(
+                [this](const UPnPClient::UPnPDeviceDesc &ddesc,
+                       const UPnPClient::UPnPServiceDesc &sdesc) {
+        Q_UNUSED(sdesc)
+        addDevice(ddesc);
+        return true;
+    });
+
+    UPnPClient::UPnPDeviceDirectory::addLostCallback(
+                [this](const std::string &udn) {
+        removeDevice(QString::fromStdString(udn));
+    });
+
+    m_callbacksAdded = true;
+}
+
+void Directory::updateSsdpFilter()
+{
+    // Unsupported devices are not listed anyway, so unless all devices
+    // should be shown, their SSDP messages are dropped already by libupnp
+    std::vector<std::string> types;
+    if (!Settings::instance()->getShowAllDevices())
+        types.push_back("urn:schemas-upnp-org:device:MediaRenderer:1");
+
+    if (!UPnPClient::UPnPDeviceDirectory::setDeviceTypes(types, ssdpMaxRate))
+        qWarning() << "Can't set SSDP filter";
+}
+
+void Directory::logThreadPoolStats(const char *name, Upnp_ThreadPool pool)
+{
+    unsigned long queued, rejected, depth, maxDepth, avgWait, avgRun;
+    if (UpnpGetThreadPoolStats(pool, &queued, &rejected, &depth, &maxDepth,
+                               &avgWait, &avgRun) != UPNP_E_SUCCESS)
+        return;
+
+    qDebug() << "libupnp" << name << "pool jobs:" << queued
+             << "rejected:" << rejected
+             << "queued now:" << depth
+             << "max queued:" << maxDepth
+             << "avg wait us:" << avgWait
+             << "avg run us:" << avgRun;
+}
+
+bool Directory::addDevice(const UPnPClient::UPnPDeviceDesc &ddesc)
+{
+    auto did = QString::fromStdString(ddesc.UDN);
+
+    {
+        QMutexLocker locker(&m_mutex);
+
+        // Device is confirmed by SSDP, so its expiry is handled by libupnpp
+        m_warm.remove(did);
+
+        auto it = m_devsdesc.find(did);
+        if (it != m_devsdesc.end()) {
+            // Alive messages are repeated, only real change is reported
+            if (it->XMLText == ddesc.XMLText &&
+                    it->URLBase == ddesc.URLBase &&
+                    it->friendlyName == ddesc.friendlyName)
+                return false;
+
+            for (const auto &sdesc : it->services)
+                m_servsdesc.remove(did + QString::fromStdString(sdesc.serviceId));
+        }
+
+        m_devsdesc.insert(did, ddesc);
+        for (const auto &sdesc : ddesc.services)
+            m_servsdesc.insert(did + QString::fromStdString(sdesc.serviceId), sdesc);
+    }
+
+    emit deviceFound(did);
+
+    return true;
+}
+
+void Directory::removeDevice(const QString &id)
+{
+    {
+        QMutexLocker locker(&m_mutex);
+
+        auto it = m_devsdesc.find(id);
+        if (it == m_devsdesc.end())
+            return;
+
+        for (const auto &sdesc : it->services)
+            m_servsdesc.remove(id + QString::fromStdString(sdesc.serviceId));
+        m_devsdesc.erase(it);
+    }
+
+    qDebug() << "Device is gone:" << id;
+
+    emit deviceLost(id);
+}
+
+void Directory::expire()
+{
+    if (!m_inited || m_directory == 0)
+        return;
+
+    QStringList stale;
+    {
+        QMutexLocker locker(&m_mutex);
+        auto now = QDateTime::currentMSecsSinceEpoch();
+        for (auto it = m_warm.begin(); it != m_warm.end();) {
+            if (now - it.value() > warmMaxAge * 1000) {
+                stale << it.key();
+                it = m_warm.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+    for (const auto &id : stale)
+        removeDevice(id);
+
+    // Devices which max-age elapsed are reported via lost callback. Only
+    // expiry is done, search would send M-SEARCH at every tick.
+    startTask([this](){
+        if (m_directory != 0)
+            m_directory->dropExpired();
+    }, PriorityBackground, "expire");
 }
 
 Directory* Directory::instance(QObject *parent)
@@ -83,8 +314,162 @@ Directory* Directory::instance(QObject *parent)
 
 void Directory::clearLists()
 {
+    QMutexLocker locker(&m_mutex);
     this->m_devsdesc.clear();
     this->m_servsdesc.clear();
+    this->m_warm.clear();
+}
+
+QByteArray Directory::descHash(const std::string &xml)
+{
+    return QCryptographicHash::hash(QByteArray::fromStdString(xml),
+                                    QCryptographicHash::Md5).toHex();
+}
+
+void Directory::saveSnapshot()
+{
+    QJsonArray devices;
+    auto now = QDateTime::currentMSecsSinceEpoch();
+
+    {
+        QMutexLocker locker(&m_mutex);
+        for (const auto &ddesc : m_devsdesc) {
+            // Embedded devices are restored from description of root one
+            if (ddesc.XMLText.empty() || ddesc.location.empty())
+                continue;
+
+            auto id = QString::fromStdString(ddesc.UDN);
+            QJsonObject obj;
+            obj["udn"] = id;
+            obj["location"] = QString::fromStdString(ddesc.location);
+            obj["hash"] = QString::fromLatin1(descHash(ddesc.XMLText));
+            obj["lastseen"] = static_cast<double>(m_warm.value(id, now));
+            obj["xml"] = QString::fromStdString(ddesc.XMLText);
+            devices.append(obj);
+        }
+    }
+
+    QJsonObject root;
+    root["devices"] = devices;
+
+    if (!Utils::writeToCacheFile(snapshotFile,
+                                 QJsonDocument(root).toJson(QJsonDocument::Compact),
+                                 true))
+        qWarning() << "Can't write devices snapshot";
+}
+
+void Directory::loadSnapshot()
+{
+    if (m_snapshotLoaded)
+        return;
+
+    m_snapshotLoaded = true;
+
+    QByteArray data;
+    if (!Utils::readFromCacheFile(snapshotFile, data))
+        return;
+
+    auto now = QDateTime::currentMSecsSinceEpoch();
+    const auto devices = QJsonDocument::fromJson(data).object()
+            .value("devices").toArray();
+
+    // Devices known from previous session are shown at once and checked
+    // in the background, so known renderer is usable without waiting for
+    // M-SEARCH responses which access points often delay or drop
+    for (const auto &v : devices) {
+        const auto obj = v.toObject();
+        auto lastSeen = static_cast<qint64>(obj.value("lastseen").toDouble());
+        if (now - lastSeen > snapshotMaxAge * 1000)
+            continue;
+
+        auto location = obj.value("location").toString();
+        UPnPClient::UPnPDeviceDesc ddesc(location.toStdString(),
+                                         obj.value("xml").toString().toStdString());
+        if (!ddesc.ok) {
+            qWarning() << "Invalid description in snapshot for" << location;
+            continue;
+        }
+
+        QStringList ids;
+        ids << QString::fromStdString(ddesc.UDN);
+        addDevice(ddesc);
+        for (const auto &edesc : ddesc.embedded) {
+            ids << QString::fromStdString(edesc.UDN);
+            addDevice(edesc);
+        }
+
+        {
+            QMutexLocker locker(&m_mutex);
+            for (const auto &id : ids)
+                m_warm.insert(id, lastSeen);
+        }
+
+        revalidate(ids.first(), location, obj.value("hash").toString().toLatin1());
+    }
+
+    qDebug() << "Devices loaded from snapshot:" << devices.size();
+}
+
+void Directory::revalidate(const QString &id, const QString &location,
+                           const QByteArray &hash)
+{
+    if (!m_nam)
+        m_nam = std::unique_ptr<QNetworkAccessManager>(new QNetworkAccessManager());
+
+    auto reply = m_nam->get(QNetworkRequest(QUrl(location)));
+    QTimer::singleShot(revalidateTimeout, reply, &QNetworkReply::abort);
+    connect(reply, &QNetworkReply::finished, this, [this, reply, id, location, hash]{
+        auto code = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+        auto data = reply->readAll();
+        bool ok = reply->error() == QNetworkReply::NoError && code < 300 &&
+                  !data.isEmpty();
+        reply->deleteLater();
+
+        UPnPClient::UPnPDeviceDesc ddesc;
+        if (ok) {
+            ddesc = UPnPClient::UPnPDeviceDesc(location.toStdString(),
+                                               data.toStdString());
+            ok = ddesc.ok && QString::fromStdString(ddesc.UDN) == id;
+        }
+
+        QStringList ids;
+        ids << id;
+
+        {
+            QMutexLocker locker(&m_mutex);
+            // Already confirmed by SSDP
+            if (!m_warm.contains(id))
+                return;
+
+            auto known = ok ? ddesc : m_devsdesc.value(id);
+            for (const auto &edesc : known.embedded)
+                ids << QString::fromStdString(edesc.UDN);
+
+            if (!ok) {
+                for (const auto &did : ids)
+                    m_warm.remove(did);
+            }
+        }
+
+        if (!ok) {
+            qDebug() << "Device from snapshot is not reachable:" << id;
+            for (const auto &did : ids)
+                removeDevice(did);
+            return;
+        }
+
+        if (descHash(ddesc.XMLText) != hash) {
+            qDebug() << "Description changed for device from snapshot:" << id;
+            addDevice(ddesc);
+            for (const auto &edesc : ddesc.embedded)
+                addDevice(edesc);
+        }
+
+        QMutexLocker locker(&m_mutex);
+        auto now = QDateTime::currentMSecsSinceEpoch();
+        for (const auto &did : ids)
+            m_warm.insert(did, now);
+    });
 }
 
 void Directory::discover(const QString& ssdpIp)
@@ -105,12 +490,34 @@ void Directory::discover(const QString& ssdpIp)
         return;
     }
 
+    unsigned long processed, droppedType, droppedRate, droppedDuplicate;
+    UpnpGetSsdpFilterStats(&processed, &droppedType, &droppedRate,
+                           &droppedDuplicate);
+    qDebug() << "SSDP messages processed:" << processed
+             << "dropped by type:" << droppedType
+             << "by rate:" << droppedRate
+             << "duplicates:" << droppedDuplicate;
+
+    logThreadPoolStats("recv", UPNP_RECV_THREADPOOL);
+    logThreadPoolStats("send", UPNP_SEND_THREADPOOL);
+    logThreadPoolStats("miniserver", UPNP_MINISERVER_THREADPOOL);
+
+    auto tm = TaskExecutor::metrics();
+    qDebug() << "Tasks queued user:" << tm.queued[PriorityUser]
+             << "refresh:" << tm.queued[PriorityRefresh]
+             << "background:" << tm.queued[PriorityBackground]
+             << "running:" << tm.running
+             << "threads:" << tm.threads
+             << "started:" << tm.started
+             << "coalesced:" << tm.coalesced
+             << "canceled:" << tm.canceled;
+
     setBusy(true);
 
+    // Known devices are kept, new ones are reported via callback and gone
+    // ones are dropped on byebye or when their max-age elapsed
     startTask([this, ssdpIp](){
 
-        clearLists();
-
         if (m_directory == 0) {
             qWarning() << "Directory not initialized";
             setInited(false);
@@ -140,11 +547,9 @@ void Directory::discover(const QString& ssdpIp)
             qDebug() << "  serviceId:" << QString::fromStdString(sdesc.serviceId);
             qDebug() << "  serviceType:" << QString::fromStdString(sdesc.serviceType);*/
 
-            auto did = QString::fromStdString(ddesc.UDN);
-            auto sid = QString::fromStdString(sdesc.serviceId);
+            Q_UNUSED(sdesc)
 
-            this->m_devsdesc.insert(did, ddesc);
-            this->m_servsdesc.insert(did + sid, sdesc);
+            addDevice(ddesc);
 
             if (ssdpIp.isEmpty()) {
                 found = true;
@@ -177,6 +582,8 @@ void Directory::discover(const QString& ssdpIp)
 
         emit discoveryReady();
 
+        setBusy(false);
+    }, PriorityBackground, QString(), [this]() {
         setBusy(false);
     });
 }
@@ -216,6 +623,8 @@ void Directory::discoverFavs()
 
             auto did = QString::fromStdString(ddesc.UDN);
 
+            QMutexLocker locker(&m_mutex);
+
             for (auto& sdesc : ddesc.services) {
 
                 auto sid = QString::fromStdString(sdesc.serviceId);
@@ -238,17 +647,21 @@ void Directory::discoverFavs()
             return true;
         });
 
+    }, PriorityBackground, QString(), [this]() {
+        setBusy(false);
     });
 }
 
-const QHash<QString,UPnPClient::UPnPDeviceDesc>& Directory::getDeviceDescs()
+QHash<QString,UPnPClient::UPnPDeviceDesc> Directory::getDeviceDescs()
 {
+    QMutexLocker locker(&m_mutex);
     return m_devsdesc;
 }
 
 bool Directory::getServiceDesc(const QString& deviceId, const QString& serviceId,
                                    UPnPClient::UPnPServiceDesc& sdesc)
 {
+    QMutexLocker locker(&m_mutex);
     const auto it = m_servsdesc.find(deviceId + serviceId);
     if (it != m_servsdesc.end()) {
         sdesc = it.value();
@@ -262,6 +675,7 @@ bool Directory::getServiceDesc(const QString& deviceId, const QString& serviceId
 
 bool Directory::getDeviceDesc(const QString& deviceId, UPnPClient::UPnPDeviceDesc& ddesc)
 {
+    QMutexLocker locker(&m_mutex);
     const auto it = m_devsdesc.find(deviceId);
     if (it != m_devsdesc.end()) {
         ddesc = it.value();
@@ -14,8 +14,13 @@
 #include <QList>
 #include <QString>
 #include <QUrl>
+#include <QMutex>
+#include <QTimer>
+#include <QByteArray>
+#include <QNetworkAccessManager>
 
 #include <functional>
+#include <memory>
 
 #include <libupnpp/upnpplib.hxx>
 #include <libupnpp/control/discovery.hxx>
@@ -38,7 +43,7 @@ public:
     bool getInited();
     bool getServiceDesc(const QString& deviceId, const QString& serviceId, UPnPClient::UPnPServiceDesc& sdesc);
     bool getDeviceDesc(const QString& deviceId, UPnPClient::UPnPDeviceDesc& ddesc);
-    const QHash<QString,UPnPClient::UPnPDeviceDesc>& getDeviceDescs();
+    QHash<QString,UPnPClient::UPnPDeviceDesc> getDeviceDescs();
     QUrl getDeviceIconUrl(const UPnPClient::UPnPDeviceDesc& ddesc);
     Q_INVOKABLE void init();
     Q_INVOKABLE void discover();
@@ -47,23 +52,62 @@ public:
 
 signals:
     void discoveryReady();
+    // Emitted from discovery thread as soon as device description is
+    // parsed or changed, and when device is gone (byebye or max-age)
+    void deviceFound(const QString &id);
+    void deviceLost(const QString &id);
     void busyChanged();
     void initedChanged();
     void error(int code);
 
+private slots:
+    void handleNetworkIfChanged();
+    void handleShowAllDevicesChanged();
+    void expire();
+
 private:
     static Directory* m_instance;
+    // Devices which max-age elapsed are dropped this often
+    static const int expireInterval = 30000;
+    // Devices from snapshot are checked with GET of their location
+    static const int revalidateTimeout = 2000;
+    // Devices from snapshot not seen via SSDP for so long are dropped (s)
+    static const int warmMaxAge = 1800;
+    static const qint64 snapshotMaxAge = 7 * 24 * 3600;
+    // SSDP messages accepted per second from one address
+    static const int ssdpMaxRate = 20;
+    static const QString snapshotFile;
     bool m_busy = false;
     bool m_inited = false;
     UPnPP::LibUPnP* m_lib = 0;
-    UPnPClient::UPnPDeviceDirectory* m_directory;
+    UPnPClient::UPnPDeviceDirectory* m_directory = 0;
+    bool m_callbacksAdded = false;
+    QTimer m_expireTimer;
+    QMutex m_mutex;
     QHash<QString,UPnPClient::UPnPServiceDesc> m_servsdesc;
     QHash<QString,UPnPClient::UPnPDeviceDesc> m_devsdesc;
+    // Devices loaded from snapshot and not seen via SSDP yet, with time
+    // when they were seen last (ms since epoch)
+    QHash<QString,qint64> m_warm;
+    bool m_snapshotLoaded = false;
+    std::unique_ptr<QNetworkAccessManager> m_nam;
     explicit Directory(QObject *parent = nullptr);
+    ~Directory();
     void setBusy(bool busy);
     void setInited(bool inited);
     bool handleError(int ret);
     void clearLists();
+    bool restart();
+    void addCallbacks();
+    void updateSsdpFilter();
+    bool addDevice(const UPnPClient::UPnPDeviceDesc &ddesc);
+    void removeDevice(const QString &id);
+    void loadSnapshot();
+    void saveSnapshot();
+    void revalidate(const QString &id, const QString &location,
+                    const QByteArray &hash);
+    static QByteArray descHash(const std::string &xml);
+    static void logThreadPoolStats(const char *name, Upnp_ThreadPool pool);
 };
 
 #endif // DIRECTORY_H
@@ -15,6 +15,7 @@ HEADERS += \
     $$CORE_DIR/avtransport.h \
     $$CORE_DIR/service.h \
     $$CORE_DIR/contentserver.h \
+    $$CORE_DIR/contentid.h \
     $$CORE_DIR/filemetadata.h \
     $$CORE_DIR/settings.h \
     $$CORE_DIR/directory.h \
@@ -33,7 +34,10 @@ HEADERS += \
     $$CORE_DIR/somafmmodel.h \
     $$CORE_DIR/gpoddermodel.h \
     $$CORE_DIR/itemmodel.h \
-    $$CORE_DIR/icecastmodel.h
+    $$CORE_DIR/icecastmodel.h \
+    $$CORE_DIR/devicecaps.h \
+    $$CORE_DIR/renderergroup.h \
+    $$CORE_DIR/ohplaylist.h
 
 
 SOURCES += \
@@ -47,6 +51,7 @@ SOURCES += \
     $$CORE_DIR/avtransport.cpp \
     $$CORE_DIR/service.cpp \
     $$CORE_DIR/contentserver.cpp \
+    $$CORE_DIR/contentid.cpp \
     $$CORE_DIR/filemetadata.cpp \
     $$CORE_DIR/settings.cpp \
     $$CORE_DIR/directory.cpp \
@@ -64,7 +69,10 @@ SOURCES += \
     $$CORE_DIR/somafmmodel.cpp \
     $$CORE_DIR/gpoddermodel.cpp \
     $$CORE_DIR/itemmodel.cpp \
-    $$CORE_DIR/icecastmodel.cpp
+    $$CORE_DIR/icecastmodel.cpp \
+    $$CORE_DIR/devicecaps.cpp \
+    $$CORE_DIR/renderergroup.cpp \
+    $$CORE_DIR/ohplaylist.cpp
 
 sailfish {
     HEADERS += \
@@ -46,6 +46,7 @@
 #include "playlistmodel.h"
 #include "trackmodel.h"
 #include "services.h"
+#include "renderergroup.h"
 #include "info.h"
 #include "somafmmodel.h"
 #include "gpoddermodel.h"
@@ -134,6 +135,7 @@ int main(int argc, char *argv[])
     context->setContextProperty("rc", services->renderingControl.get());
     context->setContextProperty("av", services->avTransport.get());
     context->setContextProperty("playlist", playlist);
+    context->setContextProperty("group", RendererGroup::instance());
 
     view->setSource(SailfishApp::pathTo("qml/main.qml"));
     view->show();
@@ -0,0 +1,455 @@
+/* Copyright (C) 2017 Michal Kosciesza <michal@mkiol.net>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <QDebug>
+#include <QHash>
+#include <QSet>
+#include <QMutexLocker>
+#include <QVariantList>
+
+#include "ohplaylist.h"
+#include "directory.h"
+#include "contentserver.h"
+
+OHPlaylist::OHPlaylist(QObject *parent) : Service(parent)
+{
+}
+
+OHPlaylist::~OHPlaylist()
+{
+    shutdownTasks();
+}
+
+bool OHPlaylist::isSupported(const QString &deviceId)
+{
+    UPnPClient::UPnPDeviceDesc ddesc;
+    if (!Directory::instance()->getDeviceDesc(deviceId, ddesc))
+        return false;
+
+    for (const auto &sdesc : ddesc.services) {
+        if (UPnPClient::OHPlaylist::isOHPlService(sdesc.serviceType))
+            return true;
+    }
+
+    return false;
+}
+
+void OHPlaylist::changed(const QString &name, const QVariant &value)
+{
+    if (!isInitedOrIniting()) {
+        qWarning() << "OHPlaylist service is not inited";
+        return;
+    }
+
+    if (name == "TransportState") {
+        int state = value.toInt();
+        if (m_transportState != state) {
+            m_transportState = state;
+            emit transportStateChanged();
+        }
+    } else if (name == "Id") {
+        int id = value.toInt();
+        if (m_currentTrack != id) {
+            m_currentTrack = id;
+            emit currentIdChanged();
+        }
+    } else if (name == "TracksMax") {
+        m_tracksMax = value.toInt();
+    } else if (name == "IdArray") {
+        // Tracks removed by other control point are forgotten, so next
+        // sync inserts them again
+        QSet<int> ids;
+        for (const auto &v : value.toList())
+            ids.insert(v.toInt());
+
+        QMutexLocker locker(&m_mirrorMutex);
+        for (int i = m_mirror.size() - 1; i >= 0; --i) {
+            if (!ids.contains(m_mirror.at(i).id))
+                m_mirror.removeAt(i);
+        }
+    }
+}
+
+UPnPClient::Service* OHPlaylist::createUpnpService(const UPnPClient::UPnPDeviceDesc &ddesc,
+                                                   const UPnPClient::UPnPServiceDesc &sdesc)
+{
+    return new UPnPClient::OHPlaylist(ddesc, sdesc);
+}
+
+void OHPlaylist::postInit()
+{
+    auto srv = s();
+    if (!srv)
+        return;
+
+    int max = 0;
+    if (handleError(srv->tracksMax(&max)))
+        m_tracksMax = max;
+
+    updateTransportState();
+
+    int id = 0;
+    if (handleError(srv->id(&id)) && m_currentTrack != id) {
+        m_currentTrack = id;
+        emit currentIdChanged();
+    }
+}
+
+void OHPlaylist::reset()
+{
+    m_transportState = Unknown;
+    m_currentTrack = 0;
+    m_tracksMax = 0;
+    {
+        QMutexLocker locker(&m_mirrorMutex);
+        m_mirror.clear();
+        m_queue.clear();
+        m_synced = false;
+        m_pendingPlayId.clear();
+    }
+    emit transportStateChanged();
+    emit currentIdChanged();
+}
+
+std::string OHPlaylist::type() const
+{
+    return "urn:av-openhome-org:service:Playlist:1";
+}
+
+UPnPClient::OHPlaylist* OHPlaylist::s()
+{
+    if (!m_ser) {
+        qWarning() << "OHPlaylist service is not inited";
+        return nullptr;
+    }
+
+    return static_cast<UPnPClient::OHPlaylist*>(m_ser);
+}
+
+int OHPlaylist::getTransportState()
+{
+    return m_transportState;
+}
+
+QString OHPlaylist::getCurrentId()
+{
+    return cidForTrack(m_currentTrack);
+}
+
+QString OHPlaylist::cidForTrack(int id)
+{
+    QMutexLocker locker(&m_mirrorMutex);
+    for (const auto &t : m_mirror) {
+        if (t.id == id)
+            return t.cid;
+    }
+
+    return QString();
+}
+
+int OHPlaylist::trackForCid(const QString &cid)
+{
+    QMutexLocker locker(&m_mirrorMutex);
+    for (const auto &t : m_mirror) {
+        if (t.cid == cid)
+            return t.id;
+    }
+
+    return 0;
+}
+
+void OHPlaylist::updateTransportState()
+{
+    auto srv = s();
+    if (!srv)
+        return;
+
+    UPnPClient::OHPlaylist::TPState tps;
+    if (handleError(srv->transportState(&tps)) && m_transportState != tps) {
+        m_transportState = tps;
+        emit transportStateChanged();
+    }
+}
+
+void OHPlaylist::setQueue(const QStringList &ids, bool repeat,
+                          const QString &playId)
+{
+    if (!getInited()) {
+        qWarning() << "OHPlaylist service is not inited";
+        return;
+    }
+
+    {
+        QMutexLocker locker(&m_mirrorMutex);
+        if (m_syncsPending == 0 && m_synced && m_queue == ids &&
+                m_repeat == repeat && playId.isEmpty())
+            return;
+        if (!playId.isEmpty())
+            m_pendingPlayId = playId;
+        ++m_syncsPending;
+    }
+
+    auto done = [this]() {
+        QMutexLocker locker(&m_mirrorMutex);
+        --m_syncsPending;
+    };
+
+    // Only the latest queue is pushed if user changes it quickly
+    startTask([this, ids, repeat, done](){
+        QMutexLocker locker(&m_syncMutex);
+
+        if (!syncQueue(ids)) {
+            // Renderer's queue stays unknown, so next update retries
+            done();
+            return;
+        }
+
+        auto srv = s();
+        if (!getInited() || !srv) {
+            done();
+            return;
+        }
+
+        bool repeatChanged;
+        QString playId;
+        {
+            QMutexLocker mirrorLocker(&m_mirrorMutex);
+            // Repeat of renderer is unknown before first sync
+            repeatChanged = !m_synced || m_repeat != repeat;
+            playId = m_pendingPlayId;
+            m_pendingPlayId.clear();
+        }
+
+        bool repeatOk = !repeatChanged || handleError(srv->setRepeat(repeat));
+
+        {
+            QMutexLocker mirrorLocker(&m_mirrorMutex);
+            m_queue = ids;
+            if (repeatOk)
+                m_repeat = repeat;
+            m_synced = repeatOk;
+        }
+
+        if (!playId.isEmpty()) {
+            int tid = trackForCid(playId);
+            if (tid == 0)
+                qWarning() << "Id" << playId << "is not in renderer's playlist";
+            else if (!handleError(srv->seekId(tid)))
+                qWarning() << "Error response for seekId()";
+        }
+
+        done();
+    }, PriorityUser, "sync", done);
+}
+
+bool OHPlaylist::dropForeign(UPnPClient::OHPlaylist *srv)
+{
+    std::vector<int> remote;
+    int token = 0;
+    if (!handleError(srv->idArray(&remote, &token)))
+        return false;
+
+    QSet<int> known;
+    {
+        QMutexLocker locker(&m_mirrorMutex);
+        QSet<int> rset;
+        for (int id : remote)
+            rset.insert(id);
+        for (int i = m_mirror.size() - 1; i >= 0; --i) {
+            if (rset.contains(m_mirror.at(i).id))
+                known.insert(m_mirror.at(i).id);
+            else
+                m_mirror.removeAt(i);
+        }
+    }
+
+    // Renderer's playlist is owned by us while it is in use
+    for (int id : remote) {
+        if (!known.contains(id) && !handleError(srv->deleteId(id)))
+            return false;
+    }
+
+    return true;
+}
+
+bool OHPlaylist::syncQueue(const QStringList &ids)
+{
+    auto srv = s();
+    if (!getInited() || !srv) {
+        qWarning() << "OHPlaylist service is not inited";
+        return false;
+    }
+
+    if (!dropForeign(srv)) {
+        qWarning() << "Unable to read playlist of renderer";
+        return false;
+    }
+
+    QList<Track> mirror;
+    {
+        QMutexLocker locker(&m_mirrorMutex);
+        mirror = m_mirror;
+    }
+
+    auto publish = [this, &mirror]() {
+        QMutexLocker locker(&m_mirrorMutex);
+        m_mirror = mirror;
+    };
+
+    QHash<QString, int> wanted;
+    for (int i = 0; i < ids.size(); ++i)
+        wanted.insert(ids.at(i), i);
+
+    // Tracks that are not queued anymore or are out of order are deleted.
+    // Remaining ones keep their ids, so current track is not interrupted.
+    int last = -1;
+    for (int i = 0; i < mirror.size();) {
+        int pos = wanted.value(mirror.at(i).cid, -1);
+        if (pos > last) {
+            last = pos;
+            ++i;
+        } else if (handleError(srv->deleteId(mirror.at(i).id))) {
+            mirror.removeAt(i);
+        } else {
+            qWarning() << "Error response for deleteId()";
+            publish();
+            return false;
+        }
+    }
+
+    // Missing tracks are inserted one after another in a single task,
+    // every insert needs id returned by the previous one
+    auto cs = ContentServer::instance();
+    int inserted = 0, prevId = 0, j = 0;
+    bool ok = true;
+    for (const auto &cid : ids) {
+        if (taskCanceled() || !getInited()) {
+            ok = false;
+            break;
+        }
+
+        if (j < mirror.size() && mirror.at(j).cid == cid) {
+            prevId = mirror.at(j).id;
+            ++j;
+            continue;
+        }
+
+        if (m_tracksMax > 0 && mirror.size() >= m_tracksMax) {
+            qWarning() << "Renderer's playlist is full, max tracks:" << m_tracksMax;
+            break;
+        }
+
+        QUrl url; QString meta;
+        if (!cs->getContentUrl(cid, url, meta)) {
+            qWarning() << "Id" << cid << "can't be converted to URL";
+            continue;
+        }
+
+        int newId = 0;
+        if (!handleError(srv->insert(prevId, url.toString().toStdString(),
+                                     meta.toStdString(), &newId))) {
+            qWarning() << "Error response for insert()";
+            ok = false;
+            break;
+        }
+
+        mirror.insert(j, {cid, newId});
+        prevId = newId;
+        ++j;
+        ++inserted;
+    }
+
+    publish();
+
+    qDebug() << "Playlist synced, tracks:" << mirror.size()
+             << "inserted:" << inserted;
+
+    emit currentIdChanged();
+    if (ok)
+        emit queueSynced();
+
+    return ok;
+}
+
+void OHPlaylist::runAction(const char *name,
+                           const std::function<int(UPnPClient::OHPlaylist*)> &action,
+                           bool coalesce)
+{
+    if (!getInited()) {
+        qWarning() << "OHPlaylist service is not inited";
+        return;
+    }
+
+    QString n(name);
+    startTask([this, n, action](){
+        auto srv = s();
+        if (!getInited() || !srv) {
+            qWarning() << "OHPlaylist service is not inited";
+            return;
+        }
+
+        qDebug() << "Calling:" << n;
+
+        if (!handleError(action(srv)))
+            qWarning() << "Error response for" << n;
+    }, PriorityUser, coalesce ? n : QString());
+}
+
+void OHPlaylist::playId(const QString &id)
+{
+    runAction("seekId", [this, id](UPnPClient::OHPlaylist *srv) {
+        int tid = trackForCid(id);
+        if (tid == 0) {
+            qWarning() << "Id" << id << "is not in renderer's playlist";
+            return 0;
+        }
+        return srv->seekId(tid);
+    });
+}
+
+void OHPlaylist::play()
+{
+    runAction("play", [](UPnPClient::OHPlaylist *srv) {
+        return srv->play();
+    });
+}
+
+void OHPlaylist::pause()
+{
+    runAction("pause", [](UPnPClient::OHPlaylist *srv) {
+        return srv->pause();
+    });
+}
+
+void OHPlaylist::stop()
+{
+    runAction("stop", [](UPnPClient::OHPlaylist *srv) {
+        return srv->stop();
+    });
+}
+
+void OHPlaylist::next()
+{
+    // every press moves by one track, so it is never coalesced
+    runAction("next", [](UPnPClient::OHPlaylist *srv) {
+        return srv->next();
+    }, false);
+}
+
+void OHPlaylist::previous()
+{
+    runAction("previous", [](UPnPClient::OHPlaylist *srv) {
+        return srv->previous();
+    }, false);
+}
+
+void OHPlaylist::seek(int value)
+{
+    runAction("seek", [value](UPnPClient::OHPlaylist *srv) {
+        return srv->seekSecondAbsolute(value);
+    });
+}
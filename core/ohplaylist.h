@@ -0,0 +1,108 @@
+/* Copyright (C) 2017 Michal Kosciesza <michal@mkiol.net>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef OHPLAYLIST_H
+#define OHPLAYLIST_H
+
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <QMutex>
+
+#include <vector>
+
+#include <libupnpp/control/ohplaylist.hxx>
+#include <libupnpp/control/service.hxx>
+
+#include "service.h"
+
+// OpenHome Playlist service. Whole queue is pushed to the renderer, so it
+// plays tracks one after another by itself and state is only evented
+// back. No polling and no action per track change is needed.
+class OHPlaylist : public Service
+{
+    Q_OBJECT
+    Q_PROPERTY (int transportState READ getTransportState NOTIFY transportStateChanged)
+    Q_PROPERTY (QString currentId READ getCurrentId NOTIFY currentIdChanged)
+
+public:
+    enum TransportState {
+        Unknown = UPnPClient::OHPlaylist::TPS_Unknown,
+        Buffering = UPnPClient::OHPlaylist::TPS_Buffering,
+        Paused = UPnPClient::OHPlaylist::TPS_Paused,
+        Playing = UPnPClient::OHPlaylist::TPS_Playing,
+        Stopped = UPnPClient::OHPlaylist::TPS_Stopped
+    };
+    Q_ENUM(TransportState)
+
+    explicit OHPlaylist(QObject *parent = nullptr);
+    ~OHPlaylist();
+
+    static bool isSupported(const QString &deviceId);
+
+    int getTransportState();
+    QString getCurrentId();
+
+    // Queue is mirrored with diff against what renderer already has.
+    // When playId is set, that track is started after sync.
+    Q_INVOKABLE void setQueue(const QStringList &ids, bool repeat,
+                              const QString &playId = QString());
+    Q_INVOKABLE void playId(const QString &id);
+    Q_INVOKABLE void play();
+    Q_INVOKABLE void pause();
+    Q_INVOKABLE void stop();
+    Q_INVOKABLE void next();
+    Q_INVOKABLE void previous();
+    Q_INVOKABLE void seek(int value);
+
+signals:
+    void transportStateChanged();
+    void currentIdChanged();
+    void queueSynced();
+
+private:
+    struct Track {
+        QString cid;
+        int id;
+    };
+
+    int m_transportState = Unknown;
+    int m_currentTrack = 0;
+    int m_tracksMax = 0;
+    // Queue and repeat that renderer has, set only after successful sync
+    QStringList m_queue;
+    bool m_repeat = true;
+    bool m_synced = false;
+    // Track to start after sync, kept when sync task is superseded
+    QString m_pendingPlayId;
+    int m_syncsPending = 0;
+    // Tracks that renderer has in its playlist, in its order
+    QList<Track> m_mirror;
+    QMutex m_mirrorMutex;
+    QMutex m_syncMutex;
+
+    void changed(const QString &name, const QVariant &value);
+    UPnPClient::Service* createUpnpService(const UPnPClient::UPnPDeviceDesc &ddesc,
+                                           const UPnPClient::UPnPServiceDesc &sdesc);
+    void postInit();
+    void reset();
+    std::string type() const;
+
+    UPnPClient::OHPlaylist* s();
+
+    bool syncQueue(const QStringList &ids);
+    bool dropForeign(UPnPClient::OHPlaylist *srv);
+    QString cidForTrack(int id);
+    int trackForCid(const QString &cid);
+    void updateTransportState();
+    // Repeated call of coalesced action replaces the one not yet sent, which
+    // is fine only for actions that set absolute state (play, seek)
+    void runAction(const char *name, const std::function<int(UPnPClient::OHPlaylist*)> &action,
+                   bool coalesce = true);
+};
+
+#endif // OHPLAYLIST_H
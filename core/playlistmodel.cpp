@@ -186,6 +186,7 @@ PlaylistModel::PlaylistModel(QObject *parent) :
     auto services = Services::instance();
     auto rc = services->renderingControl;
     auto av = services->avTransport;
+    auto oh = services->ohPlaylist;
 
     connect(av.get(), &AVTransport::currentURIChanged,
             this, &PlaylistModel::onAvCurrentURIChanged);
@@ -203,6 +204,10 @@ PlaylistModel::PlaylistModel(QObject *parent) :
             this, &PlaylistModel::onSupportedChanged);
     connect(av.get(), &AVTransport::relativeTimePositionChanged,
             this, &PlaylistModel::onSupportedChanged);
+    connect(oh.get(), &OHPlaylist::initedChanged,
+            this, &PlaylistModel::onOhInitedChanged);
+    connect(oh.get(), &OHPlaylist::currentIdChanged,
+            this, &PlaylistModel::onOhCurrentIdChanged);
     connect(this, &PlaylistModel::itemsAdded,
             this, &PlaylistModel::onSupportedChanged);
     connect(this, &PlaylistModel::itemsLoaded,
@@ -217,6 +222,8 @@ PlaylistModel::PlaylistModel(QObject *parent) :
             this, &PlaylistModel::onItemsLoaded);
     connect(this, &PlaylistModel::itemsRemoved,
             this, &PlaylistModel::onItemsRemoved);
+    connect(Utils::instance(), &Utils::networkIfChanged,
+            this, &PlaylistModel::onNetworkIfChanged);
 
     if (s->getRememberPlaylist())
         load();
@@ -228,6 +235,14 @@ void PlaylistModel::onSupportedChanged()
     updatePrevSupported();
 }
 
+void PlaylistModel::onNetworkIfChanged()
+{
+    // URLs already sent to renderer contain previous address,
+    // so next item has to be published again
+    if (Utils::instance()->checkNetworkIf())
+        update();
+}
+
 void PlaylistModel::updatePrevSupported()
 {
     auto av = Services::instance()->avTransport;
@@ -271,7 +286,16 @@ void PlaylistModel::next()
 {
     auto av = Services::instance()->avTransport;
 
-    if (rowCount() > 0) {
+    if (rowCount() > 0 && isOhMode()) {
+        auto aid = activeId();
+        if (aid.isEmpty()) {
+            auto fid = firstId();
+            setToBeActiveId(fid);
+            updateOh(fid);
+        } else {
+            Services::instance()->ohPlaylist->next();
+        }
+    } else if (rowCount() > 0) {
         auto fid = firstId();
         auto aid = activeId();
         auto nid = nextActiveId();
@@ -292,7 +316,12 @@ void PlaylistModel::prev()
     auto av = Services::instance()->avTransport;
     bool seekable = av->getSeekSupported();
 
-    if (rowCount() > 0) {
+    if (rowCount() > 0 && isOhMode()) {
+        if (seekable && av->getRelativeTimePosition() > 5)
+            seek(0);
+        else
+            Services::instance()->ohPlaylist->previous();
+    } else if (rowCount() > 0) {
         auto pid = prevActiveId();
         auto aid = activeId();
 
@@ -320,6 +349,48 @@ void PlaylistModel::prev()
     }
 }
 
+void PlaylistModel::play(const QString &id)
+{
+    if (rowCount() == 0)
+        return;
+
+    setToBeActiveId(id);
+
+    if (isOhMode())
+        updateOh(id);
+    else
+        Services::instance()->avTransport->setLocalContent(id, nextId(id));
+}
+
+void PlaylistModel::togglePlay()
+{
+    auto av = Services::instance()->avTransport;
+
+    if (isOhMode()) {
+        auto oh = Services::instance()->ohPlaylist;
+        if (oh->getTransportState() != OHPlaylist::Playing)
+            oh->play();
+        else
+            oh->pause();
+    } else if (av->getTransportState() != AVTransport::Playing) {
+        av->setSpeed(1);
+        av->play();
+    } else {
+        if (av->getPauseSupported())
+            av->pause();
+        else
+            av->stop();
+    }
+}
+
+void PlaylistModel::seek(int value)
+{
+    if (isOhMode())
+        Services::instance()->ohPlaylist->seek(value);
+    else
+        Services::instance()->avTransport->seek(value);
+}
+
 void PlaylistModel::onAvCurrentURIChanged()
 {
     auto av = Services::instance()->avTransport;
@@ -354,6 +425,10 @@ void PlaylistModel::onAvTrackEnded()
 
     auto av = Services::instance()->avTransport;
 
+    // OpenHome renderer switches to next track by itself
+    if (isOhMode())
+        return;
+
     if (rowCount() > 0 && (!av->getNextURISupported() ||
         m_playMode == PlaylistModel::PM_RepeatOne))
     {
@@ -380,12 +455,60 @@ void PlaylistModel::onAvInitedChanged()
 
     qDebug() << "onAvInitedChanged:" << inited << busy;
 
+    auto oh = Services::instance()->ohPlaylist;
+
     if (inited && !busy) {
+        // Renderer with OpenHome Playlist gets whole queue at once
+        auto did = av->getDeviceId();
+        if (OHPlaylist::isSupported(did)) {
+            if (oh->getDeviceId() != did)
+                oh->init(did);
+        } else if (oh->isInitedOrIniting()) {
+            oh->deInit();
+        }
+
         setActiveUrl(av->getCurrentURI());
         update(false);
+    } else if (!inited && oh->isInitedOrIniting()) {
+        oh->deInit();
     }
 }
 
+void PlaylistModel::onOhInitedChanged()
+{
+    auto oh = Services::instance()->ohPlaylist;
+    qDebug() << "onOhInitedChanged:" << oh->getInited();
+
+    // Renderer switches tracks by itself, so AVTransport only follows it
+    Services::instance()->avTransport->setRendererQueue(oh->getInited());
+
+    if (oh->getInited())
+        update(false);
+}
+
+void PlaylistModel::onOhCurrentIdChanged()
+{
+    auto id = Services::instance()->ohPlaylist->getCurrentId();
+    if (!id.isEmpty())
+        setActiveId(id);
+}
+
+bool PlaylistModel::isOhMode() const
+{
+    return Services::instance()->ohPlaylist->getInited();
+}
+
+void PlaylistModel::updateOh(const QString &playId)
+{
+    QStringList ids;
+    for (auto item : m_list)
+        ids << item->id();
+
+    // OpenHome has no repeat of one track, so it repeats whole queue
+    Services::instance()->ohPlaylist->setQueue(
+                ids, m_playMode != PlaylistModel::PM_Normal, playId);
+}
+
 void PlaylistModel::onItemsAdded()
 {
     qDebug() << "onItemsAdded";
@@ -422,7 +545,16 @@ void PlaylistModel::update(bool play)
 {
     qDebug() << "Update playlist:" << play;
 
-    if (rowCount() > 0) {
+    if (isOhMode()) {
+        // Whole queue is mirrored, also when it gets empty
+        if (play && activeId().isEmpty() && rowCount() > 0) {
+            auto fid = firstId();
+            setToBeActiveId(fid);
+            updateOh(fid);
+        } else {
+            updateOh();
+        }
+    } else if (rowCount() > 0) {
         auto av = Services::instance()->avTransport;
         if (av->getInited()) {
             auto aid = activeId();
@@ -502,8 +634,8 @@ QByteArray PlaylistModel::makePlsData(const QString& name)
     int l = m_list.size();
     for (int i = 0; i < l; ++i) {
         auto pitem = dynamic_cast<PlaylistItem*>(m_list.at(i));
-        auto url = Utils::urlWithTypeFromId(pitem->id()).toString();
-        auto name = Utils::nameFromId(pitem->id());
+        auto url = pitem->cid().urlWithType().toString();
+        auto name = pitem->cid().name();
         sdata << "File" << i + 1 << "=" << url << endl;
         if (!name.isEmpty())
             sdata << "Title" << i + 1 << "=" << name << endl;
@@ -665,6 +797,7 @@ void PlaylistModel::workerDone()
         }
 
         if (!m_worker->items.isEmpty()) {
+            issueTokens(m_worker->items);
             appendRows(m_worker->items);
             if (m_worker->urlIsId)
                 emit itemsAdded();
@@ -692,15 +825,17 @@ PlaylistItem* PlaylistModel::makeItem(const QUrl &id)
         return nullptr;
     }*/
 
-    int t = 0; QString name, cookie, author; QUrl ficon;
-    if (!Utils::pathTypeNameCookieIconFromId(id, nullptr, &t,
-                            &name, &cookie, &ficon, nullptr, &author) ||
-            cookie.isEmpty()) {
+    const ContentId cid(id);
+    if (!cid.isValid()) {
         qWarning() << "Invalid Id";
         return nullptr;
     }
 
-    QUrl url = Utils::urlFromId(id);
+    const int t = cid.type();
+    const auto author = cid.author();
+    const auto ficon = cid.icon();
+    const auto url = cid.url();
+    auto name = cid.name();
 
     const ContentServer::ItemMeta *meta;
     meta = ContentServer::instance()->getMeta(url);
@@ -744,7 +879,7 @@ PlaylistItem* PlaylistModel::makeItem(const QUrl &id)
 #endif
 
     auto item = new PlaylistItem(meta->url == url ?
-                                   id : Utils::swapUrlInId(meta->url, id), // id
+                                   cid : ContentId(Utils::swapUrlInId(meta->url, id)), // id
                                name, // name
                                meta->url, // url
                                type, // type
@@ -766,13 +901,29 @@ PlaylistItem* PlaylistModel::makeItem(const QUrl &id)
     return item;
 }
 
+void PlaylistModel::issueTokens(const QList<ListItem*> &items)
+{
+    // Token is issued when item is added, not when it is made, so every
+    // token is revoked when its item is removed. It is still issued
+    // upfront, so URL of item that is already playing on renderer
+    // (e.g. after restart) can be matched with the playlist.
+    auto cs = ContentServer::instance();
+    for (auto li : items) {
+        auto item = dynamic_cast<PlaylistItem*>(li);
+        if (item)
+            cs->issueToken(item->cid());
+    }
+}
+
 bool PlaylistModel::addId(const QUrl &id)
 {
     auto item = makeItem(id);
-    if (item)
+    if (item) {
+        issueTokens(QList<ListItem*>() << item);
         appendRow(item);
-    else
+    } else {
         return false;
+    }
 
     return true;
 }
@@ -879,6 +1030,12 @@ void PlaylistModel::clear()
     }
 
     if(rowCount() > 0) {
+        auto cs = ContentServer::instance();
+        for (auto li : m_list) {
+            auto fi = dynamic_cast<PlaylistItem*>(li);
+            if (fi)
+                cs->revokeToken(fi->cid());
+        }
         removeRows(0, rowCount());
         emit itemsRemoved();
     }
@@ -943,9 +1100,12 @@ bool PlaylistModel::removeIndex(int index)
     if (fi->active())
         active_removed = true;
 
+    auto cid = fi->cid();
     bool ok = removeRow(index);
 
     if (ok) {
+        ContentServer::instance()->revokeToken(cid);
+
         if (m_activeItemIndex > -1) {
             if (index == m_activeItemIndex)
                 setActiveItemIndex(-1);
@@ -1043,7 +1203,7 @@ QString PlaylistModel::nextId(const QString &id) const
 
 // -----
 
-PlaylistItem::PlaylistItem(const QUrl &id,
+PlaylistItem::PlaylistItem(const ContentId &id,
                            const QString &name,
                            const QUrl &url,
                            ContentServer::Type type,
@@ -66,7 +66,7 @@ public:
 
 public:
     PlaylistItem(QObject *parent = nullptr): ListItem(parent) {}
-    explicit PlaylistItem(const QUrl &id,
+    explicit PlaylistItem(const ContentId &id,
                       const QString &name,
                       const QUrl &url,
                       ContentServer::Type type,
@@ -88,7 +88,7 @@ public:
     QHash<int, QByteArray> roleNames() const;
     QString path() const;
     inline QString id() const { return m_id.toString(); }
-    //inline QUrl idUrl() const { return m_id; }
+    inline const ContentId& cid() const { return m_id; }
     inline QString name() const { return m_name; }
     inline QUrl url() const { return m_url; }
     inline ContentServer::Type type() const { return m_type; }
@@ -112,7 +112,7 @@ public:
 #endif
 
 private:
-    QUrl m_id;
+    ContentId m_id;
     QString m_name;
     QUrl m_url;
     ContentServer::Type m_type;
@@ -196,6 +196,11 @@ public:
     Q_INVOKABLE void update(bool play = false);
     Q_INVOKABLE void next();
     Q_INVOKABLE void prev();
+    // Item selection and transport go to OpenHome Playlist when renderer
+    // has it, otherwise to AVTransport
+    Q_INVOKABLE void play(const QString &id);
+    Q_INVOKABLE void togglePlay();
+    Q_INVOKABLE void seek(int value);
     int getActiveItemIndex() const;
     int getPlayMode() const;
     void setPlayMode(int value);
@@ -244,7 +249,10 @@ private slots:
     void onAvTrackEnded();
     void onAvStateChanged();
     void onAvInitedChanged();
+    void onOhInitedChanged();
+    void onOhCurrentIdChanged();
     void onSupportedChanged();
+    void onNetworkIfChanged();
 
 private:
     static PlaylistModel* m_instance;
@@ -263,11 +271,14 @@ private:
     //bool addId(const QString& id, ContentServer::Type type = ContentServer::TypeUnknown);
     bool addId(const QUrl& id);
     PlaylistItem* makeItem(const QUrl &id);
+    void issueTokens(const QList<ListItem*> &items);
     void save();
     QByteArray makePlsData(const QString& name);
     void setBusy(bool busy);
     void updateNextSupported();
     void updatePrevSupported();
+    bool isOhMode() const;
+    void updateOh(const QString &playId = QString());
 };
 
 #endif // PLAYLISTMODEL_H
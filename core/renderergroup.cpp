@@ -0,0 +1,417 @@
+/* Copyright (C) 2017 Michal Kosciesza <michal@mkiol.net>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <QDebug>
+#include <QMutexLocker>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "renderergroup.h"
+#include "directory.h"
+#include "services.h"
+
+namespace {
+typedef std::chrono::steady_clock Clock;
+
+int msSince(Clock::time_point start)
+{
+    return static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                                Clock::now() - start).count());
+}
+
+// Waits until all asynchronous actions sent to the group complete
+class Latch
+{
+public:
+    void add()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ++m_count;
+    }
+
+    void done()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        --m_count;
+        m_cond.notify_all();
+    }
+
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cond.wait(lock, [this] { return m_count == 0; });
+    }
+
+    // Action returns id of async action or error, in the latter case
+    // its callback is never called
+    void send(const std::function<int()> &action)
+    {
+        add();
+        if (action() < 0)
+            done();
+    }
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    int m_count = 0;
+};
+}
+
+RendererGroup* RendererGroup::m_instance = nullptr;
+
+RendererGroup::RendererGroup(QObject *parent) :
+    QObject(parent),
+    TaskExecutor(parent, 1)
+{
+}
+
+RendererGroup::~RendererGroup()
+{
+    shutdownTasks();
+}
+
+RendererGroup* RendererGroup::instance(QObject *parent)
+{
+    if (RendererGroup::m_instance == nullptr) {
+        RendererGroup::m_instance = new RendererGroup(parent);
+    }
+
+    return RendererGroup::m_instance;
+}
+
+void RendererGroup::setMember(const QString &deviceId, bool member)
+{
+    if (!member) {
+        {
+            QMutexLocker locker(&m_mutex);
+            if (!m_members.remove(deviceId))
+                return;
+        }
+        emit membersChanged();
+        return;
+    }
+
+    auto av = Services::instance()->avTransport;
+    if (av && av->getDeviceId() == deviceId) {
+        qWarning() << "Active renderer can't be a member of its group";
+        return;
+    }
+
+    // Creating service subscribes to events, so it is not done
+    // in the caller's thread
+    startTask([this, deviceId](){
+        UPnPClient::UPnPDeviceDesc ddesc;
+        if (!Directory::instance()->getDeviceDesc(deviceId, ddesc)) {
+            qWarning() << "Can't find device description for" << deviceId;
+            return;
+        }
+
+        for (const auto &sdesc : ddesc.services) {
+            if (UPnPClient::AVTransport::isAVTService(sdesc.serviceType)) {
+                Member m;
+                m.id = deviceId;
+                m.srv = std::make_shared<UPnPClient::AVTransport>(ddesc, sdesc);
+
+                {
+                    QMutexLocker locker(&m_mutex);
+                    if (m_members.contains(deviceId))
+                        return;
+                    m_members.insert(deviceId, m);
+                }
+
+                qDebug() << "Renderer" << deviceId << "added to group";
+                emit membersChanged();
+                return;
+            }
+        }
+
+        qWarning() << "Device" << deviceId << "has no AVTransport service";
+    }, PriorityUser);
+}
+
+bool RendererGroup::isMember(const QString &deviceId)
+{
+    QMutexLocker locker(&m_mutex);
+    return m_members.contains(deviceId);
+}
+
+void RendererGroup::clear()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        if (m_members.isEmpty())
+            return;
+        m_members.clear();
+    }
+    emit membersChanged();
+}
+
+QStringList RendererGroup::getMembers()
+{
+    QMutexLocker locker(&m_mutex);
+    return m_members.keys();
+}
+
+bool RendererGroup::isActive()
+{
+    QMutexLocker locker(&m_mutex);
+    return !m_members.isEmpty();
+}
+
+QList<RendererGroup::Member> RendererGroup::members()
+{
+    // Copies keep services alive even if member is removed meanwhile
+    QMutexLocker locker(&m_mutex);
+    return m_members.values();
+}
+
+int RendererGroup::smoothRtt(int rtt, int sample)
+{
+    return rtt < 0 ? sample : (3 * rtt + sample) / 4;
+}
+
+void RendererGroup::updateRtt(const QString &id, int rtt)
+{
+    QMutexLocker locker(&m_mutex);
+    if (id.isEmpty()) {
+        m_leaderRtt = smoothRtt(m_leaderRtt, rtt);
+    } else {
+        auto it = m_members.find(id);
+        if (it != m_members.end())
+            it->rtt = smoothRtt(it->rtt, rtt);
+    }
+}
+
+void RendererGroup::measureRtt(UPnPClient::AVTransport *leader)
+{
+    // Cheap query sent to all renderers at once, its round trip
+    // approximates delay of next action
+    auto ms = members();
+    auto latch = std::make_shared<Latch>();
+    auto start = Clock::now();
+
+    auto ping = [this, latch, start](UPnPClient::AVTransport *srv,
+                                     const QString &id) {
+        latch->send([this, latch, start, srv, id]() {
+            return srv->getTransportInfoAsync(
+                        [this, latch, start, id](int ret,
+                        const UPnPClient::AVTransport::TransportInfo&) {
+                if (ret == 0)
+                    updateRtt(id, msSince(start));
+                latch->done();
+            }, groupTimeout);
+        });
+    };
+
+    ping(leader, QString());
+    for (const auto &m : ms)
+        ping(m.srv.get(), m.id);
+
+    latch->wait();
+}
+
+void RendererGroup::setURI(const QString &uri, const QString &meta)
+{
+    auto ms = members();
+    if (ms.isEmpty())
+        return;
+
+    auto latch = std::make_shared<Latch>();
+    const auto suri = uri.toStdString();
+    const auto smeta = meta.toStdString();
+
+    for (const auto &m : ms) {
+        auto id = m.id;
+        auto srv = m.srv;
+        latch->send([latch, id, srv, &suri, &smeta]() {
+            return srv->setAVTransportURIAsync(suri, smeta, [latch, id](int ret) {
+                if (ret != 0)
+                    qWarning() << "Group member" << id
+                               << "rejected URI with error" << ret;
+                latch->done();
+            }, groupTimeout);
+        });
+    }
+
+    latch->wait();
+}
+
+int RendererGroup::playTogether(UPnPClient::AVTransport *leader, int speed)
+{
+    if (!isActive())
+        return leader->play(speed);
+
+    measureRtt(leader);
+
+    struct Target {
+        UPnPClient::AVTransport *srv;
+        QString id;
+        int delay;
+    };
+
+    auto ms = members();
+    std::vector<Target> targets;
+    int maxDelay = 0;
+
+    {
+        QMutexLocker locker(&m_mutex);
+        targets.push_back({leader, QString(), m_leaderRtt > 0 ? m_leaderRtt / 2 : 0});
+        for (const auto &m : ms) {
+            auto it = m_members.find(m.id);
+            int rtt = it != m_members.end() ? it->rtt : m.rtt;
+            targets.push_back({m.srv.get(), m.id, rtt > 0 ? rtt / 2 : 0});
+        }
+    }
+
+    // Half of round trip is taken as delay of request, so renderers
+    // with longer delay get Play earlier and all receive it at once
+    for (const auto &t : targets)
+        maxDelay = std::max(maxDelay, t.delay);
+
+    std::sort(targets.begin(), targets.end(), [](const Target &a, const Target &b) {
+        return a.delay > b.delay;
+    });
+
+    auto latch = std::make_shared<Latch>();
+    auto leaderRet = std::make_shared<int>(0);
+    auto start = Clock::now();
+
+    for (const auto &t : targets) {
+        std::this_thread::sleep_until(
+                    start + std::chrono::milliseconds(maxDelay - t.delay));
+
+        auto srv = t.srv;
+        auto id = t.id;
+        latch->send([latch, leaderRet, srv, id, speed]() {
+            int ret = srv->playAsync([latch, leaderRet, id](int ret) {
+                if (id.isEmpty())
+                    *leaderRet = ret;
+                else if (ret != 0)
+                    qWarning() << "Group member" << id
+                               << "rejected Play with error" << ret;
+                latch->done();
+            }, groupTimeout, speed);
+            if (ret < 0 && id.isEmpty())
+                *leaderRet = ret;
+            return ret;
+        });
+    }
+
+    latch->wait();
+
+    {
+        QMutexLocker locker(&m_mutex);
+        m_alignClock.restart();
+    }
+
+    qDebug() << "Group started, max request delay:" << maxDelay << "ms";
+
+    return *leaderRet;
+}
+
+void RendererGroup::pause()
+{
+    auto ms = members();
+    auto latch = std::make_shared<Latch>();
+
+    for (const auto &m : ms) {
+        auto srv = m.srv;
+        latch->send([latch, srv]() {
+            return srv->pauseAsync([latch](int) { latch->done(); },
+                                   groupTimeout);
+        });
+    }
+
+    latch->wait();
+}
+
+void RendererGroup::stop()
+{
+    auto ms = members();
+    auto latch = std::make_shared<Latch>();
+
+    for (const auto &m : ms) {
+        auto srv = m.srv;
+        latch->send([latch, srv]() {
+            return srv->stopAsync([latch](int) { latch->done(); },
+                                  groupTimeout);
+        });
+    }
+
+    latch->wait();
+}
+
+void RendererGroup::seek(int position)
+{
+    auto ms = members();
+    auto latch = std::make_shared<Latch>();
+
+    for (const auto &m : ms) {
+        auto srv = m.srv;
+        latch->send([latch, srv, position]() {
+            return srv->seekAsync(UPnPClient::AVTransport::SEEK_REL_TIME,
+                                  position, [latch](int) { latch->done(); },
+                                  groupTimeout);
+        });
+    }
+
+    latch->wait();
+}
+
+void RendererGroup::align(int leaderPosition)
+{
+    auto ms = members();
+    if (ms.isEmpty())
+        return;
+
+    {
+        QMutexLocker locker(&m_mutex);
+        if (m_alignClock.isValid() && m_alignClock.elapsed() < alignInterval)
+            return;
+        m_alignClock.restart();
+    }
+
+    auto latch = std::make_shared<Latch>();
+    auto start = Clock::now();
+
+    for (const auto &m : ms) {
+        auto srv = m.srv;
+        auto id = m.id;
+        latch->send([this, latch, srv, id, start, leaderPosition]() {
+            return srv->getPositionInfoAsync([this, latch, srv, id, start, leaderPosition](
+                                             int ret, const UPnPClient::AVTransport::PositionInfo &pi) {
+                if (ret == 0) {
+                    int rtt = msSince(start);
+                    updateRtt(id, rtt);
+
+                    // Both positions estimated for the moment of response
+                    int leaderNow = leaderPosition + rtt;
+                    int memberNow = pi.reltime * 1000 + rtt / 2;
+                    int skew = memberNow - leaderNow;
+
+                    if (skew > maxSkew || skew < -maxSkew) {
+                        // Seek takes one request delay to arrive
+                        int target = (leaderNow + rtt / 2 + 500) / 1000;
+                        qDebug() << "Group member" << id << "skew is" << skew
+                                 << "ms, seeking to" << target;
+                        srv->seekAsync(UPnPClient::AVTransport::SEEK_REL_TIME,
+                                       target, [](int) {}, groupTimeout);
+                    }
+                }
+                latch->done();
+            }, groupTimeout);
+        });
+    }
+
+    latch->wait();
+}
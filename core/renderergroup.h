@@ -0,0 +1,86 @@
+/* Copyright (C) 2017 Michal Kosciesza <michal@mkiol.net>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef RENDERERGROUP_H
+#define RENDERERGROUP_H
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QHash>
+#include <QMutex>
+#include <QElapsedTimer>
+
+#include <memory>
+
+#include <libupnpp/control/avtransport.hxx>
+
+#include "taskexecutor.h"
+
+// Renderers that play in sync with the active one (leader). Leader is
+// driven by AVTransport service as usual and it calls group from its
+// tasks, so every command is sent to all members at once.
+class RendererGroup :
+        public QObject,
+        public TaskExecutor
+{
+    Q_OBJECT
+    Q_PROPERTY (QStringList members READ getMembers NOTIFY membersChanged)
+    Q_PROPERTY (bool active READ isActive NOTIFY membersChanged)
+
+public:
+    static RendererGroup* instance(QObject *parent = nullptr);
+
+    Q_INVOKABLE void setMember(const QString &deviceId, bool member);
+    Q_INVOKABLE bool isMember(const QString &deviceId);
+    Q_INVOKABLE void clear();
+    QStringList getMembers();
+    bool isActive();
+
+    // Called from leader tasks, block until all members respond
+    void setURI(const QString &uri, const QString &meta);
+    int playTogether(UPnPClient::AVTransport *leader, int speed = 1);
+    void pause();
+    void stop();
+    void seek(int position);
+    void align(int leaderPosition);
+
+signals:
+    void membersChanged();
+
+private:
+    // Max wait (ms) for member response
+    static const int groupTimeout = 5000;
+    // Allowed difference (ms) of member position from leader. Position
+    // is reported with 1 s resolution, so lower value would cause
+    // seek loops.
+    static const int maxSkew = 1500;
+    // Min time (ms) between position checks of members
+    static const int alignInterval = 5000;
+
+    struct Member {
+        QString id;
+        std::shared_ptr<UPnPClient::AVTransport> srv;
+        // Round trip time (ms) of action, smoothed
+        int rtt = -1;
+    };
+
+    static RendererGroup* m_instance;
+    QHash<QString, Member> m_members;
+    QMutex m_mutex;
+    QElapsedTimer m_alignClock;
+    int m_leaderRtt = -1;
+
+    explicit RendererGroup(QObject *parent = nullptr);
+    ~RendererGroup();
+    QList<Member> members();
+    void measureRtt(UPnPClient::AVTransport *leader);
+    void updateRtt(const QString &id, int rtt);
+    static int smoothRtt(int rtt, int sample);
+};
+
+#endif // RENDERERGROUP_H
@@ -21,6 +21,11 @@ RenderingControl::RenderingControl(QObject *parent) : Service(parent),
     QObject::connect(&m_volumeTimer, &QTimer::timeout, this, &RenderingControl::volumeTimeout);
 }
 
+RenderingControl::~RenderingControl()
+{
+    shutdownTasks();
+}
+
 void RenderingControl::changed(const QString &name, const QVariant &_value)
 {
     if (!isInitedOrIniting()) {
@@ -83,7 +88,7 @@ void RenderingControl::asyncUpdate()
 
     startTask([this](){
         update();
-    });
+    }, PriorityRefresh, "update");
 }
 
 std::string RenderingControl::type() const
@@ -138,7 +143,7 @@ void RenderingControl::volumeTimeout()
 
                 emit volumeChanged();
             }
-        });
+        }, PriorityUser, "setVolume");
     }
 }
 
@@ -162,7 +167,7 @@ void RenderingControl::setMute(bool value)
                 m_mute = value;
                 emit muteChanged();
             }
-        });
+        }, PriorityUser, "setMute");
     }
 }
 
@@ -181,7 +186,7 @@ void RenderingControl::asyncUpdateVolume()
 
     startTask([this](){
         updateVolume();
-    });
+    }, PriorityRefresh, "volume");
 }
 
 void RenderingControl::updateVolume()
@@ -215,7 +220,7 @@ void RenderingControl::asyncUpdateMute()
 
     startTask([this](){
         updateMute();
-    });
+    }, PriorityRefresh, "mute");
 }
 
 void RenderingControl::updateMute()
@@ -23,6 +23,7 @@ class RenderingControl : public Service
 
 public:
     explicit RenderingControl(QObject* parent = nullptr);
+    ~RenderingControl();
 
     int getVolume();
     void setVolume(int value);
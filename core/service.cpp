@@ -13,6 +13,10 @@
 #include "directory.h"
 #include "devicemodel.h"
 #include "taskexecutor.h"
+#include "devicecaps.h"
+
+const int Service::latencyBounds[] = {10, 20, 50, 100, 200, 500, 1000,
+                                      2000, 5000, 10000, 30000};
 
 Service::Service(QObject *parent) :
     QObject(parent),
@@ -22,6 +26,8 @@ Service::Service(QObject *parent) :
     QObject::connect(&m_timer, &QTimer::timeout, this, &Service::timerEvent);
     QObject::connect(this, &Service::needTimer, this, &Service::timer);
 
+    m_soapClock.start();
+
 #ifdef SAILFISH
     auto app = static_cast<QGuiApplication*>(QGuiApplication::instance());
     QObject::connect(app, &QGuiApplication::applicationStateChanged,
@@ -31,16 +37,17 @@ Service::Service(QObject *parent) :
 
 Service::~Service()
 {
+    shutdownTasks();
+
     if (m_ser) {
         m_ser->installReporter(nullptr);
+        m_ser->installObserver(nullptr);
         delete m_ser;
         m_ser = nullptr;
         qDebug() << "Service deleted";
     }
 
     setInited(false);
-
-    waitForDone();
 }
 
 void Service::changed(const char *nm, const char *value)
@@ -55,6 +62,27 @@ void Service::changed(const char *nm, int value)
     changed(QString(nm), QVariant::fromValue(value));
 }
 
+void Service::changed(const char *nm, UPnPClient::UPnPDirObject meta)
+{
+    qDebug() << "changed meta:" << nm;
+    metaChanged(QString(nm), meta);
+}
+
+void Service::changed(const char *nm, std::vector<int> ids)
+{
+    qDebug() << "changed ids:" << nm << ids.size();
+    QVariantList list;
+    for (int id : ids)
+        list << id;
+    changed(QString(nm), list);
+}
+
+void Service::metaChanged(const QString &name, const UPnPClient::UPnPDirObject &meta)
+{
+    Q_UNUSED(name)
+    Q_UNUSED(meta)
+}
+
 bool Service::getInited()
 {
     return m_inited;
@@ -114,6 +142,7 @@ void Service::deInit()
 
     setInited(false);
     m_initing = false;
+    cancelTasks();
     timer(false);
     m_deviceId.clear();
     m_deviceFriendlyName.clear();
@@ -177,6 +206,13 @@ bool Service::init(const QString &deviceId)
         if (!m_ser) {
             qWarning() << "Unable to create UPnP service";
         } else {
+            {
+                QMutexLocker locker(&m_latencyMutex);
+                m_latencyDeviceId = QString::fromStdString(ddesc.UDN);
+                // Misses from previous session are not relevant anymore
+                m_latency[m_latencyDeviceId].misses = 0;
+            }
+            m_ser->installObserver(this);
             postInit();
             m_ser->installReporter(this);
             setInited(true);
@@ -185,6 +221,9 @@ bool Service::init(const QString &deviceId)
 
         setBusy(false);
         qDebug() << "Initing task done";
+    }, PriorityUser, "init", [this]() {
+        m_initing = false;
+        setBusy(false);
     });
 
     m_deviceId = deviceId;
@@ -226,6 +265,184 @@ void Service::timer(bool start)
     }
 }
 
+void Service::purgeSoapCalls(qint64 now)
+{
+    while (!m_soapCalls.isEmpty() && now - m_soapCalls.head() > soapCallsWindow)
+        m_soapCalls.dequeue();
+}
+
+void Service::countSoapCall()
+{
+    QMutexLocker locker(&m_soapMutex);
+
+    qint64 now = m_soapClock.elapsed();
+    purgeSoapCalls(now);
+    m_soapCalls.enqueue(now);
+
+    if (now - m_soapReportTime > soapCallsWindow) {
+        m_soapReportTime = now;
+        qDebug() << "SOAP calls per minute for" << m_deviceFriendlyName
+                 << QString::fromStdString(type()) << ":" << m_soapCalls.size();
+    }
+}
+
+int Service::soapCallsPerMinute()
+{
+    QMutexLocker locker(&m_soapMutex);
+    purgeSoapCalls(m_soapClock.elapsed());
+    return m_soapCalls.size();
+}
+
+int Service::latencyPercentile(const Latency &latency, int percent)
+{
+    int rank = (latency.count * percent + 99) / 100;
+    int sum = 0;
+
+    for (int i = 0; i < latencyBucketCount - 1; ++i) {
+        sum += latency.buckets[i];
+        if (sum >= rank)
+            return latencyBounds[i] < latency.max ?
+                        latencyBounds[i] : latency.max;
+    }
+
+    return latency.max;
+}
+
+int Service::timeoutFromLatency(const Latency &latency)
+{
+    if (latency.count < latencyMinSamples)
+        return 0;
+
+    int timeout = latencyPercentile(latency, 99) * timeoutFactor;
+    if (timeout < minActionTimeout)
+        return minActionTimeout;
+    if (timeout > maxActionTimeout)
+        return maxActionTimeout;
+    return timeout;
+}
+
+void Service::actionDone(const std::string &name, int ret, int ms)
+{
+    // libupnpp reports every action here, also those whose result
+    // is not checked
+    countSoapCall();
+
+    QMutexLocker locker(&m_latencyMutex);
+
+    auto &dev = m_latency[m_latencyDeviceId];
+    auto &latency = dev.actions[QString::fromStdString(name)];
+
+    // Only timeout or transport error is a miss. Slow response is just
+    // a sample, so timeout widens toward latency of the device.
+    bool miss = ret <= UPNP_E_NETWORK_ERROR && ret >= UPNP_E_SOCKET_ERROR;
+
+    if (miss && ret != UPNP_E_TIMEDOUT) {
+        ++latency.failures;
+    } else {
+        // Timed out action is counted too, as its latency is at least
+        // the time it took
+        int i = 0;
+        while (i < latencyBucketCount - 1 && ms > latencyBounds[i])
+            ++i;
+        ++latency.buckets[i];
+        ++latency.count;
+        if (ms > latency.max)
+            latency.max = ms;
+    }
+
+    if (miss) {
+        ++dev.misses;
+        qWarning() << "Action" << QString::fromStdString(name)
+                   << "missed (" << ret << "," << ms << "ms ), misses:"
+                   << dev.misses;
+    } else {
+        dev.misses = 0;
+    }
+
+    // Connection that broke after being reused was already retried
+    // by libupnp, so the error that reaches here is repeated one
+    if (ret == UPNP_E_NETWORK_ERROR || ret == UPNP_E_SOCKET_WRITE ||
+            ret == UPNP_E_SOCKET_READ || ret == UPNP_E_SOCKET_ERROR) {
+        if (++dev.connErrors == keepAliveErrors) {
+            locker.unlock();
+            disableKeepAlive();
+        }
+    }
+}
+
+void Service::disableKeepAlive()
+{
+    DeviceCaps::Caps caps;
+    if (!m_ser || !DeviceCaps::instance()->find(m_latencyDeviceId, caps) ||
+            caps.keepAliveQuirk)
+        return;
+
+    qWarning() << "Connection to" << m_latencyDeviceId
+               << "keeps breaking, so SOAP keep-alive is disabled for it";
+    DeviceCaps::instance()->setKeepAliveQuirk(m_latencyDeviceId, true);
+    UpnpSetSoapKeepAlive(m_ser->getActionURL().c_str(), 0);
+}
+
+int Service::actionTimeout(const std::string &name)
+{
+    return adaptiveTimeout(QString::fromStdString(name));
+}
+
+int Service::adaptiveTimeout(const QString &action, int fallback)
+{
+    QMutexLocker locker(&m_latencyMutex);
+
+    auto dit = m_latency.find(m_latencyDeviceId);
+    if (dit == m_latency.end())
+        return fallback;
+
+    auto it = dit->actions.find(action);
+    if (it == dit->actions.end())
+        return fallback;
+
+    int timeout = timeoutFromLatency(it.value());
+    return timeout > 0 ? timeout : fallback;
+}
+
+bool Service::isUnresponsive()
+{
+    QMutexLocker locker(&m_latencyMutex);
+    auto it = m_latency.find(m_latencyDeviceId);
+    return it != m_latency.end() && it->misses >= deadMisses;
+}
+
+QVariantMap Service::latencyStats()
+{
+    QMutexLocker locker(&m_latencyMutex);
+
+    QVariantMap stats;
+    for (auto dit = m_latency.cbegin(); dit != m_latency.cend(); ++dit) {
+        QVariantMap actions;
+        for (auto it = dit->actions.cbegin(); it != dit->actions.cend(); ++it) {
+            const auto &latency = it.value();
+            QVariantMap action;
+            QVariantList histogram;
+            for (int i = 0; i < latencyBucketCount; ++i)
+                histogram << latency.buckets[i];
+            action["count"] = latency.count;
+            action["failures"] = latency.failures;
+            action["max"] = latency.max;
+            action["p50"] = latency.count > 0 ? latencyPercentile(latency, 50) : 0;
+            action["p99"] = latency.count > 0 ? latencyPercentile(latency, 99) : 0;
+            action["timeout"] = timeoutFromLatency(latency);
+            action["histogram"] = histogram;
+            actions[it.key()] = action;
+        }
+
+        QVariantMap dev;
+        dev["actions"] = actions;
+        dev["misses"] = dit->misses;
+        stats[dit.key()] = dev;
+    }
+
+    return stats;
+}
+
 bool Service::handleError(int ret)
 {
     //qDebug() << "handleError:" << ret;
@@ -234,6 +451,14 @@ bool Service::handleError(int ret)
         qWarning() << "Upnp request error:" << ret;
 
         switch (ret) {
+        case -207:
+            // Timeout alone means slow response, connection is
+            // considered lost after several misses in a row
+            if (!isUnresponsive()) {
+                emit error(E_ServerError);
+                break;
+            }
+            // fall through
         case -200:
         case -201:
         case -202:
@@ -241,7 +466,6 @@ bool Service::handleError(int ret)
         case -204:
         case -205:
         case -206:
-        case -207:
         case -208:
             emit error(E_LostConnection);
             deInit();
@@ -13,7 +13,13 @@
 #include <QTimer>
 #include <QString>
 #include <QVariant>
+#include <QMutex>
+#include <QQueue>
+#include <QHash>
+#include <QVariantMap>
+#include <QElapsedTimer>
 #include <functional>
+#include <vector>
 
 #include <libupnpp/control/avtransport.hxx>
 #include <libupnpp/control/service.hxx>
@@ -23,6 +29,7 @@
 class Service :
         public QObject,
         public UPnPClient::VarEventReporter,
+        public UPnPClient::ActionObserver,
         public TaskExecutor
 {
     Q_OBJECT
@@ -51,6 +58,8 @@ public:
     bool getBusy();
     QString getDeviceId();
     QString getDeviceFriendlyName();
+    Q_INVOKABLE int soapCallsPerMinute();
+    Q_INVOKABLE QVariantMap latencyStats();
 
 signals:
     void initedChanged();
@@ -72,6 +81,7 @@ protected:
     void setInited(bool inited);
 
     virtual void changed(const QString &name, const QVariant &value) = 0;
+    virtual void metaChanged(const QString &name, const UPnPClient::UPnPDirObject &meta);
     virtual UPnPClient::Service* createUpnpService(const UPnPClient::UPnPDeviceDesc &ddesc,
                                                    const UPnPClient::UPnPServiceDesc &sdesc) = 0;
     virtual void postInit();
@@ -82,14 +92,61 @@ protected:
     virtual void handleApplicationStateChanged(Qt::ApplicationState state);
 
     bool handleError(int ret);
+    int adaptiveTimeout(const QString &action, int fallback = 0);
 
 private:
+    static const int soapCallsWindow = 60000;
+    static const int latencyBucketCount = 12;
+    static const int latencyBounds[latencyBucketCount - 1];
+    static const int latencyMinSamples = 10;
+    static const int minActionTimeout = 2000;
+    static const int maxActionTimeout = 30000;
+    static const int timeoutFactor = 3;
+    static const int deadMisses = 3;
+    static const int keepAliveErrors = 2;
+
+    // Latency histogram of one action, buckets are limited by
+    // latencyBounds and the last one is open
+    struct Latency {
+        int buckets[latencyBucketCount] = {};
+        int count = 0;
+        int failures = 0;
+        int max = 0;
+    };
+
+    struct DeviceLatency {
+        QHash<QString, Latency> actions;
+        // Consecutive actions that timed out or failed on transport
+        // level
+        int misses = 0;
+        // Actions that failed on broken connection, renderer that
+        // reaches keepAliveErrors gets SOAP keep-alive disabled
+        int connErrors = 0;
+    };
+
     QString m_deviceId;
     QString m_deviceFriendlyName;
     bool m_busy = false;
     bool m_inited = false;
+    QElapsedTimer m_soapClock;
+    QQueue<qint64> m_soapCalls;
+    qint64 m_soapReportTime = 0;
+    QMutex m_soapMutex;
+    QHash<QString, DeviceLatency> m_latency;
+    QString m_latencyDeviceId;
+    QMutex m_latencyMutex;
     void changed(const char *nm, int value);
     void changed(const char *nm, const char *value);
+    void changed(const char *nm, UPnPClient::UPnPDirObject meta);
+    void changed(const char *nm, std::vector<int> ids);
+    void purgeSoapCalls(qint64 now);
+    void countSoapCall();
+    void actionDone(const std::string& name, int ret, int ms);
+    int actionTimeout(const std::string& name);
+    static int latencyPercentile(const Latency &latency, int percent);
+    static int timeoutFromLatency(const Latency &latency);
+    bool isUnresponsive();
+    void disableKeepAlive();
 };
 
 #endif // SERVICE_H
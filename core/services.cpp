@@ -14,6 +14,7 @@ Services* Services::instance(QObject *parent)
 Services::Services(QObject* parent) :
     QObject(parent),
     renderingControl(new RenderingControl(parent)),
-    avTransport(new AVTransport(parent))
+    avTransport(new AVTransport(parent)),
+    ohPlaylist(new OHPlaylist(parent))
 {
 }
@@ -11,6 +11,8 @@
 #include <QTime>
 #include <QDir>
 #include <QFileInfo>
+#include <QThread>
+#include <QMutexLocker>
 
 #include "settings.h"
 #include "directory.h"
@@ -23,8 +25,93 @@ Settings* Settings::inst = nullptr;
 Settings::Settings(QObject *parent) :
     QObject(parent),
     TaskExecutor(parent, 1),
-    settings(parent)
+    settings(parent),
+    m_snapshot(nullptr),
+    m_epoch(0)
 {
+    m_readers[0] = 0;
+    m_readers[1] = 0;
+
+    m_notifyTimer.setSingleShot(true);
+    m_notifyTimer.setInterval(notifyDelay);
+    connect(&m_notifyTimer, &QTimer::timeout,
+            this, &Settings::emitPendingSignals);
+
+    if (settings.value("key").toByteArray().isEmpty())
+        resetKey();
+    else
+        publishSnapshot();
+}
+
+Settings::~Settings()
+{
+    shutdownTasks();
+    delete m_snapshot.load();
+}
+
+void Settings::publishSnapshot()
+{
+    auto snapshot = new Snapshot;
+    snapshot->port = settings.value("port", 9092).toInt();
+    // 0 - proxy
+    // 1 - redirection
+    snapshot->remoteContentMode = settings.value("remotecontentmode", 0).toInt();
+    // 0 - 44100 stereo (default)
+    // 1 - 44100 mono
+    // 2 - 22050 stereo
+    // 3 - 22050 mono
+    snapshot->pulseMode = settings.value("pulsemode", 0).toInt();
+#ifdef SAILFISH
+    snapshot->micVolume = settings.value("micvolume", 35.0).toFloat();
+#else
+    snapshot->micVolume = settings.value("micvolume", 1.0).toFloat();
+#endif
+    snapshot->key = settings.value("key").toByteArray();
+    snapshot->cacheDir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+
+    QMutexLocker locker(&m_publishMutex);
+    auto old = m_snapshot.exchange(snapshot);
+    if (!old)
+        return;
+
+    // Reader may have taken epoch before the flip but be counted after
+    // the wait, so both counters are drained, each after its own flip.
+    // Then every reader that could see old snapshot is done.
+    for (int i = 0; i < 2; ++i) {
+        const auto epoch = m_epoch.fetch_add(1) & 1;
+        while (m_readers[epoch].load() != 0)
+            QThread::yieldCurrentThread();
+    }
+
+    delete old;
+}
+
+template<typename T>
+T Settings::read(T Snapshot::*field) const
+{
+    // Lock-free: reader never waits, only writer waits for readers
+    auto &readers = m_readers[m_epoch.load() & 1];
+    ++readers;
+    T value = m_snapshot.load()->*field;
+    --readers;
+    return value;
+}
+
+void Settings::notifyChanged(Signal signal)
+{
+    // Hot values are changed in bursts (e.g. slider), so each signal is
+    // emitted once per burst
+    if (!m_pendingSignals.contains(signal))
+        m_pendingSignals.append(signal);
+    m_notifyTimer.start();
+}
+
+void Settings::emitPendingSignals()
+{
+    const auto pending = m_pendingSignals;
+    m_pendingSignals.clear();
+    for (auto signal : pending)
+        emit (this->*signal)();
 }
 
 Settings* Settings::instance()
@@ -40,13 +127,14 @@ void Settings::setPort(int value)
 {
     if (getPort() != value) {
         settings.setValue("port", value);
-        emit portChanged();
+        publishSnapshot();
+        notifyChanged(&Settings::portChanged);
     }
 }
 
 int Settings::getPort()
 {
-    return settings.value("port", 9092).toInt();
+    return read(&Snapshot::port);
 }
 
 void Settings::setRemoteContentMode(int value)
@@ -55,15 +143,14 @@ void Settings::setRemoteContentMode(int value)
     // 1 - redirection
     if (getRemoteContentMode() != value) {
         settings.setValue("remotecontentmode", value);
-        emit remoteContentModeChanged();
+        publishSnapshot();
+        notifyChanged(&Settings::remoteContentModeChanged);
     }
 }
 
 int Settings::getRemoteContentMode()
 {
-    // 0 - proxy
-    // 1 - redirection
-    return settings.value("remotecontentmode", 0).toInt();
+    return read(&Snapshot::remoteContentMode);
 }
 
 void Settings::setForwardTime(int value)
@@ -91,7 +178,7 @@ void Settings::setFavDevices(const QHash<QString,QVariant> &devs)
 
 QString Settings::getCacheDir()
 {
-   return QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+   return read(&Snapshot::cacheDir);
 }
 
 QString Settings::getPlaylistDir()
@@ -118,16 +205,16 @@ QString Settings::getPlaylistDir()
 
 void Settings::asyncAddFavDevice(const QString &id)
 {
-    startTask([this, &id](){
+    startTask([this, id](){
         addFavDevice(id);
-    });
+    }, PriorityBackground);
 }
 
 void Settings::asyncRemoveFavDevice(const QString &id)
 {
-    startTask([this, &id](){
+    startTask([this, id](){
         removeFavDevice(id);
-    });
+    }, PriorityBackground);
 }
 
 void Settings::addFavDevice(const QString &id)
@@ -289,17 +376,14 @@ void Settings::setPulseMode(int value)
 {
     if (getPulseMode() != value) {
         settings.setValue("pulsemode", value);
-        emit pulseModeChanged();
+        publishSnapshot();
+        notifyChanged(&Settings::pulseModeChanged);
     }
 }
 
 int Settings::getPulseMode()
 {
-    // 0 - 44100 stereo (default)
-    // 1 - 44100 mono
-    // 2 - 22050 stereo
-    // 3 - 22050 mono
-    return settings.value("pulsemode", 0).toInt();
+    return read(&Snapshot::pulseMode);
 }
 
 void Settings::setUseDbusVolume(bool value)
@@ -321,17 +405,14 @@ void Settings::setMicVolume(float value)
 
     if (getMicVolume() != value) {
         settings.setValue("micvolume", value);
-        emit micVolumeChanged();
+        publishSnapshot();
+        notifyChanged(&Settings::micVolumeChanged);
     }
 }
 
 float Settings::getMicVolume()
 {
-#ifdef SAILFISH
-    return settings.value("micvolume", 35.0).toFloat();
-#else
-    return settings.value("micvolume", 1.0).toFloat();
-#endif
+    return read(&Snapshot::micVolume);
 }
 
 void Settings::setRememberPlaylist(bool value)
@@ -359,17 +440,12 @@ QByteArray Settings::resetKey()
         key.append(static_cast<char>(qrand()));
 
     settings.setValue("key", key);
+    publishSnapshot();
 
     return key;
 }
 
 QByteArray Settings::getKey()
 {
-    QByteArray key = settings.value("key").toByteArray();
-
-    if (key.isEmpty()) {
-        key = resetKey();
-    }
-
-    return key;
+    return read(&Snapshot::key);
 }
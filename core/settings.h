@@ -15,6 +15,9 @@
 #include <QVariant>
 #include <QSettings>
 #include <QByteArray>
+#include <QMutex>
+#include <QTimer>
+#include <atomic>
 
 #include "taskexecutor.h"
 
@@ -115,11 +118,39 @@ signals:
     void micVolumeChanged();
 
 private:
+    typedef void (Settings::*Signal)();
+
+    // Immutable copy of values that are read on audio and HTTP threads
+    struct Snapshot {
+        int port = 0;
+        int remoteContentMode = 0;
+        int pulseMode = 0;
+        float micVolume = 0;
+        QByteArray key;
+        QString cacheDir;
+    };
+
+    // Changes of hot values closer than that (ms) are reported once
+    static const int notifyDelay = 100;
+
     QSettings settings;
     static Settings* inst;
+    // Replaced as a whole. Readers are counted in current epoch, so
+    // replaced snapshot is deleted when no reader can use it anymore.
+    std::atomic<const Snapshot*> m_snapshot;
+    std::atomic<unsigned> m_epoch;
+    mutable std::atomic<int> m_readers[2];
+    QMutex m_publishMutex;
+    QTimer m_notifyTimer;
+    QList<Signal> m_pendingSignals;
 
     explicit Settings(QObject* parent = nullptr);
+    ~Settings();
     bool writeDeviceXML(const QString& id, QString &url);
+    void publishSnapshot();
+    template<typename T> T read(T Snapshot::*field) const;
+    void notifyChanged(Signal signal);
+    void emitPendingSignals();
 };
 
 #endif // SETTINGS_H
@@ -7,46 +7,311 @@
 
 #include <QDebug>
 #include <QThread>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QList>
+#include <QSharedPointer>
+#include <QAtomicInt>
 
 #include "taskexecutor.h"
 
-TaskExecutor::Task::Task(std::function<void()> job) : m_job(job)
+namespace {
+const int maxThreads = 12;
+const int laneCount = TaskExecutor::PriorityBackground + 1;
+const int queueWarnDepth = 16;
+}
+
+struct TaskExecutor::Task
+{
+    std::function<void()> job;
+    std::function<void()> dropped;
+    TaskExecutor* owner = nullptr;
+    QString key;
+    QAtomicInt canceled;
+};
+
+class TaskExecutor::Dispatcher
+{
+public:
+    static Dispatcher* instance();
+    static thread_local Task* currentTask;
+
+    QMutex mutex;
+
+    bool enqueue(TaskExecutor* owner, const std::function<void()> &job,
+                 Priority priority, const QString &key,
+                 const std::function<void()> &dropped);
+    void cancel(TaskExecutor* owner);
+    Metrics metrics();
+
+private:
+    class Worker : public QRunnable
+    {
+    public:
+        void run();
+    };
+
+    QList<QSharedPointer<Task>> m_lanes[laneCount];
+    QList<QSharedPointer<Task>> m_running;
+    QThreadPool m_pool;
+    int m_workers = 0;
+    quint64 m_started = 0;
+    quint64 m_coalesced = 0;
+    quint64 m_canceled = 0;
+
+    Dispatcher();
+    QSharedPointer<Task> takeNext();
+    void drain();
+};
+
+thread_local TaskExecutor::Task* TaskExecutor::Dispatcher::currentTask = nullptr;
+
+TaskExecutor::Dispatcher::Dispatcher()
 {
+    m_pool.setMaxThreadCount(maxThreads);
 }
 
-void TaskExecutor::Task::run()
+TaskExecutor::Dispatcher* TaskExecutor::Dispatcher::instance()
 {
-    m_job();
+    static Dispatcher dispatcher;
+    return &dispatcher;
+}
+
+bool TaskExecutor::Dispatcher::enqueue(TaskExecutor* owner,
+                                       const std::function<void()> &job,
+                                       Priority priority, const QString &key,
+                                       const std::function<void()> &dropped)
+{
+    QList<QSharedPointer<Task>> superseded;
+
+    {
+        QMutexLocker locker(&mutex);
+
+        if (owner->m_closed) {
+            locker.unlock();
+            qWarning() << "Executor is closed. Dropping new task";
+            if (dropped)
+                dropped();
+            return false;
+        }
+
+        if (!key.isEmpty()) {
+            for (auto& lane : m_lanes) {
+                for (auto it = lane.begin(); it != lane.end();) {
+                    if ((*it)->owner == owner && (*it)->key == key) {
+                        superseded << *it;
+                        it = lane.erase(it);
+                        --owner->m_queued;
+                        ++m_coalesced;
+                    } else {
+                        ++it;
+                    }
+                }
+            }
+        }
+
+        QSharedPointer<Task> task(new Task);
+        task->job = job;
+        task->dropped = dropped;
+        task->owner = owner;
+        task->key = key;
+
+        auto& lane = m_lanes[priority];
+        lane << task;
+        ++owner->m_queued;
+
+        if (lane.size() == queueWarnDepth)
+            qWarning() << "Task queue depth for priority" << priority
+                       << "reached" << queueWarnDepth;
+
+        if (m_workers < m_pool.maxThreadCount()) {
+            ++m_workers;
+            auto worker = new Worker;
+            worker->setAutoDelete(true);
+            m_pool.start(worker);
+        }
+    }
+
+    for (auto& task : superseded) {
+        qDebug() << "Task superseded:" << task->key;
+        if (task->dropped)
+            task->dropped();
+    }
+
+    return true;
+}
+
+void TaskExecutor::Dispatcher::cancel(TaskExecutor* owner)
+{
+    QList<QSharedPointer<Task>> canceled;
+
+    {
+        QMutexLocker locker(&mutex);
+
+        for (auto& lane : m_lanes) {
+            for (auto it = lane.begin(); it != lane.end();) {
+                if ((*it)->owner == owner) {
+                    canceled << *it;
+                    it = lane.erase(it);
+                    --owner->m_queued;
+                    ++m_canceled;
+                } else {
+                    ++it;
+                }
+            }
+        }
+
+        for (auto& task : m_running) {
+            if (task->owner == owner)
+                task->canceled.storeRelease(1);
+        }
+
+        if (owner->m_queued == 0 && owner->m_running == 0)
+            owner->m_done.wakeAll();
+    }
+
+    for (auto& task : canceled) {
+        qDebug() << "Task canceled:" << task->key;
+        if (task->dropped)
+            task->dropped();
+    }
+}
+
+TaskExecutor::Metrics TaskExecutor::Dispatcher::metrics()
+{
+    QMutexLocker locker(&mutex);
+
+    Metrics m;
+    for (int i = 0; i < laneCount; ++i)
+        m.queued[i] = m_lanes[i].size();
+    m.running = m_running.size();
+    m.threads = m_workers;
+    m.started = m_started;
+    m.coalesced = m_coalesced;
+    m.canceled = m_canceled;
+
+    return m;
+}
+
+QSharedPointer<TaskExecutor::Task> TaskExecutor::Dispatcher::takeNext()
+{
+    for (auto& lane : m_lanes) {
+        for (auto it = lane.begin(); it != lane.end(); ++it) {
+            auto owner = (*it)->owner;
+            if (owner->m_running < owner->m_maxRunning) {
+                auto task = *it;
+                lane.erase(it);
+                --owner->m_queued;
+                ++owner->m_running;
+                return task;
+            }
+        }
+    }
+
+    return QSharedPointer<Task>();
+}
+
+void TaskExecutor::Dispatcher::drain()
+{
+    QMutexLocker locker(&mutex);
+
+    while (true) {
+        auto task = takeNext();
+        if (!task) {
+            // Tasks blocked by owner's limit are picked up by the worker
+            // that finishes owner's running task
+            --m_workers;
+            return;
+        }
+
+        m_running << task;
+        ++m_started;
+
+        locker.unlock();
+
+        currentTask = task.data();
+        task->job();
+        currentTask = nullptr;
+
+        locker.relock();
+
+        m_running.removeOne(task);
+
+        auto owner = task->owner;
+        --owner->m_running;
+        if (owner->m_queued == 0 && owner->m_running == 0)
+            owner->m_done.wakeAll();
+    }
+}
+
+void TaskExecutor::Dispatcher::Worker::run()
+{
+    Dispatcher::instance()->drain();
 }
 
 TaskExecutor::TaskExecutor(QObject* parent, int threadCount) :
-    m_pool(parent)
+    m_maxRunning(threadCount > 0 ? threadCount : 1)
+{
+    Q_UNUSED(parent)
+}
+
+TaskExecutor::~TaskExecutor()
 {
-    m_pool.setMaxThreadCount(threadCount);
+    // No-op if derived class already did it
+    shutdownTasks();
 }
 
-bool TaskExecutor::startTask(const std::function<void()> &job)
+void TaskExecutor::shutdownTasks()
 {
-    if (m_pool.activeThreadCount() >= m_pool.maxThreadCount()) {
-        qWarning() << "Too many task. Droping new task";
-        return false;
+    {
+        QMutexLocker locker(&Dispatcher::instance()->mutex);
+        if (m_closed && m_queued == 0 && m_running == 0)
+            return;
+        m_closed = true;
     }
 
-    auto task = new Task(job);
-    task->setAutoDelete(true);
-    m_pool.start(task);
+    cancelTasks();
+    waitForDone();
+}
 
-    return true;
+bool TaskExecutor::startTask(const std::function<void()> &job,
+                             Priority priority, const QString &key,
+                             const std::function<void()> &dropped)
+{
+    return Dispatcher::instance()->enqueue(this, job, priority, key, dropped);
+}
+
+void TaskExecutor::cancelTasks()
+{
+    Dispatcher::instance()->cancel(this);
 }
 
 void TaskExecutor::waitForDone()
 {
-    m_pool.waitForDone();
+    auto d = Dispatcher::instance();
+    QMutexLocker locker(&d->mutex);
+
+    while (m_queued > 0 || m_running > 0)
+        m_done.wait(&d->mutex);
 }
 
 bool TaskExecutor::taskActive()
 {
-    return m_pool.activeThreadCount() > 0;
+    QMutexLocker locker(&Dispatcher::instance()->mutex);
+    return m_queued > 0 || m_running > 0;
+}
+
+TaskExecutor::Metrics TaskExecutor::metrics()
+{
+    return Dispatcher::instance()->metrics();
+}
+
+bool TaskExecutor::taskCanceled()
+{
+    auto task = Dispatcher::currentTask;
+    return task && task->canceled.loadAcquire();
 }
 
 void TaskExecutor::tsleep(int ms)
@@ -8,36 +8,69 @@
 #ifndef TASKEXECUTOR_H
 #define TASKEXECUTOR_H
 
-#include <QRunnable>
-#include <QThreadPool>
 #include <QObject>
+#include <QString>
+#include <QWaitCondition>
 
 #include <functional>
 
+// Tasks of all executors run on one process-wide bounded pool. Queued
+// tasks are picked by priority lane first, then in FIFO order. Every task
+// is either run or, when superseded or canceled, reported via its dropped
+// callback.
 class TaskExecutor
 {
 public:
-    class Task : public QRunnable
-    {
-    public:
-        Task(std::function<void()> job);
-
-    private:
-        std::function<void()> m_job;
-        void run();
+    enum Priority {
+        PriorityUser = 0, // user actions
+        PriorityRefresh, // state refresh
+        PriorityBackground // discovery, probing
     };
 
+    struct Metrics {
+        int queued[PriorityBackground + 1];
+        int running;
+        int threads;
+        quint64 started;
+        quint64 coalesced;
+        quint64 canceled;
+    };
+
+    // threadCount limits number of tasks of this executor running at once
     TaskExecutor(QObject* parent = nullptr, int threadCount = 1);
+    virtual ~TaskExecutor();
 
-    bool startTask(const std::function<void()> &job);
+    // Task with non-empty key replaces not yet started task with the same
+    // key, so only the latest one is run. Returns false only if executor
+    // doesn't accept tasks anymore.
+    bool startTask(const std::function<void()> &job,
+                   Priority priority = PriorityUser,
+                   const QString &key = QString(),
+                   const std::function<void()> &dropped = std::function<void()>());
+    void cancelTasks();
     void waitForDone();
     bool taskActive();
 
+    static Metrics metrics();
+
 protected:
+    // Stops accepting tasks, drops queued ones and waits for running ones.
+    // Must be called from destructor of the most derived class, because
+    // tasks and their dropped callbacks use the derived object.
+    void shutdownTasks();
     void tsleep(int ms = 500);
+    static bool taskCanceled();
 
 private:
-    QThreadPool m_pool;
+    struct Task;
+    class Dispatcher;
+    friend class Dispatcher;
+
+    int m_maxRunning;
+    int m_running = 0;
+    int m_queued = 0;
+    bool m_closed = false;
+    QWaitCondition m_done;
 };
 
 #endif // TASKEXECUTOR_H
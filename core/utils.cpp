@@ -21,9 +21,19 @@
 #include <QDir>
 #include <QUrlQuery>
 #include <QTime>
+#include <QMutexLocker>
+
+#ifdef Q_OS_LINUX
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <unistd.h>
+#include <cstring>
+#endif
 
 #include "settings.h"
 #include "gpoddermodel.h"
+#include "contentid.h"
 
 const QString Utils::typeKey = "jupii_type";
 const QString Utils::cookieKey = "jupii_cookie";
@@ -37,6 +47,84 @@ Utils* Utils::m_instance = nullptr;
 Utils::Utils(QObject *parent) : QObject(parent)
 {
     createCacheDir();
+
+    // bursts of link/address events are coalesced into one update
+    m_netIfTimer.setSingleShot(true);
+    m_netIfTimer.setInterval(netIfUpdateDelay);
+    connect(&m_netIfTimer, &QTimer::timeout, this, &Utils::updateNetworkIf);
+    connect(Settings::instance(), &Settings::prefNetInfChanged,
+            this, &Utils::updateNetworkIf);
+
+    initNetlink();
+    updateNetworkIf();
+}
+
+void Utils::initNetlink()
+{
+#ifdef Q_OS_LINUX
+    m_netlinkFd = ::socket(AF_NETLINK, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                           NETLINK_ROUTE);
+    if (m_netlinkFd < 0) {
+        qWarning() << "Cannot open netlink socket";
+        return;
+    }
+
+    struct sockaddr_nl addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.nl_family = AF_NETLINK;
+    addr.nl_groups = RTMGRP_LINK | RTMGRP_IPV4_IFADDR | RTMGRP_IPV6_IFADDR;
+
+    if (::bind(m_netlinkFd, reinterpret_cast<struct sockaddr*>(&addr),
+               sizeof(addr)) < 0) {
+        qWarning() << "Cannot bind netlink socket";
+        ::close(m_netlinkFd);
+        m_netlinkFd = -1;
+        return;
+    }
+
+    m_netlinkNotifier = new QSocketNotifier(m_netlinkFd, QSocketNotifier::Read, this);
+    connect(m_netlinkNotifier, &QSocketNotifier::activated,
+            this, &Utils::handleNetlinkEvent);
+#else
+    qDebug() << "Netlink is not supported, net interface will not be cached";
+#endif
+}
+
+void Utils::handleNetlinkEvent()
+{
+#ifdef Q_OS_LINUX
+    // Content of messages is not relevant, any link or address change
+    // triggers a new interface snapshot
+    char buf[4096];
+    while (::recv(m_netlinkFd, buf, sizeof(buf), 0) > 0)
+        continue;
+
+    m_netIfTimer.start();
+#endif
+}
+
+void Utils::updateNetworkIf()
+{
+    QString ifname, address;
+    bool valid = findNetworkIf(ifname, address);
+    if (!valid) {
+        ifname.clear();
+        address.clear();
+    }
+
+    m_netIfMutex.lock();
+    bool changed = valid != m_netIfValid ||
+            ifname != m_netIfName ||
+            address != m_netIfAddress;
+    m_netIfValid = valid;
+    m_netIfName = ifname;
+    m_netIfAddress = address;
+    m_netIfMutex.unlock();
+
+    if (changed) {
+        qDebug() << "Net interface changed:" << valid << ifname << address;
+        emit networkIfChanged();
+    }
 }
 
 Utils* Utils::instance(QObject *parent)
@@ -108,6 +196,19 @@ QStringList Utils::getNetworkIfs(bool onlyUp)
 }
 
 bool Utils::getNetworkIf(QString& ifname, QString& address)
+{
+    if (m_netlinkFd < 0) {
+        // no change notifications, so snapshot might be outdated
+        return findNetworkIf(ifname, address);
+    }
+
+    QMutexLocker locker(&m_netIfMutex);
+    ifname = m_netIfName;
+    address = m_netIfAddress;
+    return m_netIfValid;
+}
+
+bool Utils::findNetworkIf(QString& ifname, QString& address)
 {
     auto ifList = QNetworkInterface::allInterfaces();
 
@@ -275,9 +376,7 @@ QString Utils::hash(const QString &value)
 
 QUrl Utils::iconFromId(const QUrl &id)
 {
-    QUrl icon;
-    Utils::pathTypeNameCookieIconFromId(id,nullptr,nullptr,nullptr,nullptr,&icon);
-    return icon;
+    return ContentId(id).icon();
 }
 
 bool Utils::pathTypeNameCookieIconFromId(const QUrl& id,
@@ -289,40 +388,45 @@ bool Utils::pathTypeNameCookieIconFromId(const QUrl& id,
                                      QString* desc,
                                      QString* author)
 {
-    if (!id.isValid()) {
+    return pathTypeNameCookieIconFromId(ContentId(id), path, type, name,
+                                        cookie, icon, desc, author);
+}
+
+bool Utils::pathTypeNameCookieIconFromId(const ContentId& id,
+                                     QString* path,
+                                     int* type,
+                                     QString* name,
+                                     QString* cookie,
+                                     QUrl* icon,
+                                     QString* desc,
+                                     QString* author)
+{
+    if (!id.id().isValid()) {
         //qWarning() << "FromId: Id is invalid:" << id.toString();
         return false;
     }
 
-    if (path) {
-        if (id.isLocalFile())
-            *path = id.toLocalFile();
-        else
-            path->clear();
-    }
-
-    if (type || cookie || name || desc || author || icon) {
-        QUrlQuery q(id);
-        if (type && q.hasQueryItem(Utils::typeKey))
-            *type = q.queryItemValue(Utils::typeKey).toInt();
-        if (cookie && q.hasQueryItem(Utils::cookieKey))
-            *cookie = q.queryItemValue(Utils::cookieKey);
-        if (name && q.hasQueryItem(Utils::nameKey))
-            *name = q.queryItemValue(Utils::nameKey);
-        if (icon && q.hasQueryItem(Utils::iconKey))
-            *icon = QUrl(q.queryItemValue(Utils::iconKey));
-        if (desc && q.hasQueryItem(Utils::descKey))
-            *desc = q.queryItemValue(Utils::descKey);
-        if (author && q.hasQueryItem(Utils::authorKey))
-            *author = q.queryItemValue(Utils::authorKey);
-    }
+    if (path)
+        *path = id.path();
+    if (type && id.hasType())
+        *type = id.type();
+    if (cookie && !id.cookie().isEmpty())
+        *cookie = id.cookie();
+    if (name && !id.name().isEmpty())
+        *name = id.name();
+    if (icon && !id.icon().isEmpty())
+        *icon = id.icon();
+    if (desc && !id.desc().isEmpty())
+        *desc = id.desc();
+    if (author && !id.author().isEmpty())
+        *author = id.author();
 
     return true;
 }
 
 bool Utils::isIdValid(const QString &id)
 {
-    return isIdValid(QUrl(id));
+    return ContentId(id).isValid();
 }
 
 bool Utils::isUrlOk(const QUrl &url)
@@ -364,17 +468,7 @@ bool Utils::isUrlValid(const QUrl &url)
 
 bool Utils::isIdValid(const QUrl &id)
 {
-    if (!id.isValid()) {
-        //qWarning() << "Utils: Id is invalid:" << id.toString();
-        return false;
-    }
-
-    QUrlQuery q(id);
-    QString cookie;
-    if (q.hasQueryItem(Utils::cookieKey))
-        cookie = q.queryItemValue(Utils::cookieKey);
-
-    return !cookie.isEmpty();
+    return ContentId(id).isValid();
 }
 
 bool Utils::isUrlMic(const QUrl &url)
@@ -411,71 +505,42 @@ QUrl Utils::urlFromText(const QString &text, const QString &context)
 
 QString Utils::pathFromId(const QString &id)
 {
-    return pathFromId(QUrl(id));
+    return ContentId(id).path();
 }
 
 QString Utils::pathFromId(const QUrl &id)
 {
-    QString path;
-    bool valid = Utils::pathTypeNameCookieIconFromId(id, &path);
-
-    if (!valid) {
-        return QString();
-    }
-
-    return path;
+    return ContentId(id).path();
 }
 
 int Utils::typeFromId(const QString& id)
 {
-    return typeFromId(QUrl(id));
+    return ContentId(id).type();
 }
 
 int Utils::typeFromId(const QUrl& id)
 {
-    int type;
-    bool valid = Utils::pathTypeNameCookieIconFromId(id, nullptr, &type);
-
-    if (!valid) {
-        return 0;
-    }
-
-    return type;
+    return ContentId(id).type();
 }
 
 QString Utils::cookieFromId(const QString &id)
 {
-    return cookieFromId(QUrl(id));
+    return ContentId(id).cookie();
 }
 
 QString Utils::cookieFromId(const QUrl &id)
 {
-    QString cookie;
-    bool valid = Utils::pathTypeNameCookieIconFromId(id, nullptr, nullptr,
-                                                 nullptr, &cookie);
-
-    if (!valid) {
-        return QString();
-    }
-
-    return cookie;
+    return ContentId(id).cookie();
 }
 
 QString Utils::nameFromId(const QString &id)
 {
-    return nameFromId(QUrl(id));
+    return ContentId(id).name();
 }
 
 QString Utils::nameFromId(const QUrl &id)
 {
-    QString name;
-    bool valid = Utils::pathTypeNameCookieIconFromId(id, nullptr, nullptr, &name);
-
-    if (!valid) {
-        return QString();
-    }
-
-    return name;
+    return ContentId(id).name();
 }
 
 QUrl Utils::swapUrlInId(const QUrl &url, const QUrl &id)
@@ -533,42 +598,22 @@ QString Utils::idFromUrl(const QUrl &url, const QString &cookie)
 
 QUrl Utils::urlFromId(const QUrl &id)
 {
-    QUrlQuery q(id);
-    if (q.hasQueryItem(Utils::cookieKey))
-        q.removeAllQueryItems(Utils::cookieKey);
-    if (q.hasQueryItem(Utils::typeKey))
-        q.removeAllQueryItems(Utils::typeKey);
-    if (q.hasQueryItem(Utils::nameKey))
-        q.removeAllQueryItems(Utils::nameKey);
-    if (q.hasQueryItem(Utils::iconKey))
-        q.removeAllQueryItems(Utils::iconKey);
-    if (q.hasQueryItem(Utils::descKey))
-        q.removeAllQueryItems(Utils::descKey);
-    if (q.hasQueryItem(Utils::authorKey))
-        q.removeAllQueryItems(Utils::authorKey);
-    QUrl url(id);
-    url.setQuery(q);
-    return url;
+    return ContentId(id).url();
 }
 
 QUrl Utils::urlWithTypeFromId(const QUrl &id)
 {
-    QUrlQuery q(id);
-    if (q.hasQueryItem(Utils::cookieKey))
-        q.removeAllQueryItems(Utils::cookieKey);
-    QUrl url(id);
-    url.setQuery(q);
-    return url;
+    return ContentId(id).urlWithType();
 }
 
 QUrl Utils::urlWithTypeFromId(const QString &id)
 {
-    return urlWithTypeFromId(QUrl(id));
+    return ContentId(id).urlWithType();
 }
 
 QUrl Utils::urlFromId(const QString &id)
 {
-    return urlFromId(QUrl(id));
+    return ContentId(id).url();
 }
 
 QString Utils::randString(int len)
@@ -13,6 +13,11 @@
 #include <QObject>
 #include <QByteArray>
 #include <QStringList>
+#include <QMutex>
+#include <QTimer>
+#include <QSocketNotifier>
+
+class ContentId;
 
 class Utils : public QObject
 {
@@ -69,6 +74,14 @@ public:
                                         QUrl *icon = nullptr,
                                         QString *desc = nullptr,
                                         QString *author = nullptr);
+    static bool pathTypeNameCookieIconFromId(const ContentId &id,
+                                        QString* path = nullptr,
+                                        int* type = nullptr,
+                                        QString *name = nullptr,
+                                        QString* cookie = nullptr,
+                                        QUrl *icon = nullptr,
+                                        QString *desc = nullptr,
+                                        QString *author = nullptr);
     static QString randString(int len = 5);
     static void removeFile(const QString &path);
     static bool writeToCacheFile(const QString &filename, const QByteArray &data, bool del = false);
@@ -79,10 +92,28 @@ public:
     bool createCacheDir();
     bool createPlaylistDir();
 
+signals:
+    void networkIfChanged();
+
+private slots:
+    void handleNetlinkEvent();
+    void updateNetworkIf();
+
 private:
     static Utils* m_instance;
+    static const int netIfUpdateDelay = 1000;
+
+    int m_netlinkFd = -1;
+    QSocketNotifier* m_netlinkNotifier = nullptr;
+    QTimer m_netIfTimer;
+    QMutex m_netIfMutex;
+    bool m_netIfValid = false;
+    QString m_netIfName;
+    QString m_netIfAddress;
 
     explicit Utils(QObject *parent = nullptr);
+    bool findNetworkIf(QString &ifname, QString &address);
+    void initNetlink();
 };
 
 #endif // UTILS_H
@@ -130,19 +130,7 @@ void MainWindow::notify(const QString& message)
 
 void MainWindow::togglePlay()
 {
-    auto av = Services::instance()->avTransport;
-
-    bool playing = av->getTransportState() == AVTransport::Playing;
-
-    if (!playing) {
-        av->setSpeed(1);
-        av->play();
-    } else {
-        if (av->getPauseSupported())
-            av->pause();
-        else
-            av->stop();
-    }
+    PlaylistModel::instance()->togglePlay();
 }
 
 void MainWindow::on_playmodeButton_clicked()
@@ -183,7 +171,6 @@ void MainWindow::on_rc_volumeChanged()
 void MainWindow::on_connectButton_clicked()
 {
     auto directory = Directory::instance();
-    deviceModel->clear();
 
     if (directory->getInited())
         directory->discover();
@@ -514,8 +501,7 @@ void MainWindow::play(int idx)
                 if (!playing)
                     togglePlay();
             } else {
-                playlist->setToBeActiveIndex(idx);
-                av->setLocalContent(item->id(),"");
+                playlist->play(item->id());
             }
         }
     }
@@ -550,7 +536,7 @@ void MainWindow::on_progressSlider_actionTriggered(int action)
     int pos = ui->progressSlider->sliderPosition();
     int max = av->getCurrentTrackDuration();
     ui->progressLabel->setText(utils->secToStr(pos) + "/" + utils->secToStr(max));
-    av->seek(pos);
+    PlaylistModel::instance()->seek(pos);
 }
 
 void MainWindow::on_playlistView_customContextMenuRequested(const QPoint &pos)
@@ -601,9 +587,14 @@ void MainWindow::on_deviceList_customContextMenuRequested(const QPoint &pos)
         if (idx >= 0) {
             auto item = dynamic_cast<DeviceItem*>(deviceModel->readRow(idx));
             if (item) {
+                auto av = Services::instance()->avTransport;
                 ui->actionConnect->setEnabled(!item->active());
+                ui->actionGroup->setEnabled(item->supported() &&
+                                            !item->active() &&
+                                            av->getInited());
+                ui->actionGroup->setChecked(item->isGrouped());
                 QList<QAction*> actions;
-                actions << ui->actionConnect;
+                actions << ui->actionConnect << ui->actionGroup;
                 QMenu::exec(actions, ui->deviceList->mapToGlobal(pos),
                             nullptr, ui->deviceList);
             }
@@ -623,6 +614,18 @@ void MainWindow::on_actionConnect_triggered()
     }
 }
 
+void MainWindow::on_actionGroup_triggered(bool checked)
+{
+    if (deviceModel) {
+        auto indexes = ui->deviceList->selectionModel()->selectedIndexes();
+        if (indexes.length() > 0) {
+            deviceModel->setGrouped(indexes.first().row(), checked);
+        } else {
+            qWarning() << "No items selected";
+        }
+    }
+}
+
 void MainWindow::on_actionFiles_triggered()
 {
     auto cserver = ContentServer::instance();
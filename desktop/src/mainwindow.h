@@ -69,6 +69,7 @@ private slots:
     void on_actionPauseItem_triggered();
     void on_deviceList_customContextMenuRequested(const QPoint &pos);
     void on_actionConnect_triggered();
+    void on_actionGroup_triggered(bool checked);
     void on_actionFiles_triggered();
     void on_actionURL_triggered();
     void on_actionClear_triggered();
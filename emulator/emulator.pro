@@ -0,0 +1,31 @@
+TARGET = jupii-renderer-emu
+
+TEMPLATE = app
+
+CONFIG += c++11 console no_lflags_merge object_parallel_to_source
+CONFIG -= qt app_bundle
+
+PROJECTDIR = $$PWD/..
+
+include($$PROJECTDIR/libs/libupnp/libupnp.pri)
+include($$PROJECTDIR/libs/libupnpp/libupnpp.pri)
+
+INCLUDEPATH += src
+
+HEADERS += \
+    src/options.h \
+    src/actionlog.h \
+    src/scpd.h \
+    src/emuservice.h \
+    src/avtransportservice.h \
+    src/renderingcontrolservice.h \
+    src/connectionmanagerservice.h
+
+SOURCES += \
+    src/main.cpp \
+    src/actionlog.cpp \
+    src/scpd.cpp \
+    src/emuservice.cpp \
+    src/avtransportservice.cpp \
+    src/renderingcontrolservice.cpp \
+    src/connectionmanagerservice.cpp
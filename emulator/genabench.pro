@@ -0,0 +1,13 @@
+TARGET = jupii-gena-bench
+
+TEMPLATE = app
+
+CONFIG += c++11 console no_lflags_merge object_parallel_to_source
+CONFIG -= qt app_bundle
+
+PROJECTDIR = $$PWD/..
+
+include($$PROJECTDIR/libs/libupnp/libupnp.pri)
+
+SOURCES += \
+    src/genabench.cpp
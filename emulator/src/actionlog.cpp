@@ -0,0 +1,84 @@
+/* Copyright (C) 2017 Michal Kosciesza <michal@mkiol.net>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <iostream>
+
+#include "actionlog.h"
+
+ActionLog* ActionLog::m_instance = nullptr;
+
+ActionLog::ActionLog() :
+    m_start(std::chrono::steady_clock::now())
+{
+}
+
+ActionLog* ActionLog::instance()
+{
+    if (ActionLog::m_instance == nullptr) {
+        ActionLog::m_instance = new ActionLog();
+    }
+
+    return ActionLog::m_instance;
+}
+
+bool ActionLog::open(const std::string &path)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_file.open(path, std::ios::out | std::ios::trunc);
+    return m_file.is_open();
+}
+
+long long ActionLog::now() const
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - m_start).count();
+}
+
+std::ostream& ActionLog::out()
+{
+    return m_file.is_open() ? static_cast<std::ostream&>(m_file) : std::cout;
+}
+
+void ActionLog::action(const std::string &service, const std::string &name,
+                       int ret, int ms, const std::string &args)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    out() << now() << " action " << service << " " << name << " "
+          << ret << " " << ms;
+    if (!args.empty())
+        out() << " " << args;
+    out() << std::endl;
+
+    auto &stats = m_stats[service + "." + name];
+    ++stats.count;
+    if (ret != 0)
+        ++stats.errors;
+    stats.totalMs += ms;
+}
+
+void ActionLog::note(const std::string &text)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    out() << now() << " note " << text << std::endl;
+}
+
+void ActionLog::summary()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    int total = 0;
+    for (const auto &s : m_stats) {
+        out() << now() << " summary " << s.first << " calls=" << s.second.count
+              << " errors=" << s.second.errors << " avg_ms="
+              << (s.second.count > 0 ? s.second.totalMs / s.second.count : 0)
+              << std::endl;
+        total += s.second.count;
+    }
+
+    out() << now() << " summary total calls=" << total << std::endl;
+}
@@ -0,0 +1,52 @@
+/* Copyright (C) 2017 Michal Kosciesza <michal@mkiol.net>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef ACTIONLOG_H
+#define ACTIONLOG_H
+
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+
+// Log of everything that control point did to the renderer. Every line
+// starts with milliseconds since start, so the log of a benchmark run can
+// be diffed and summed up without extra parsing:
+//   <ms> action <service> <name> <ret> <duration ms> [args]
+//   <ms> note <text>
+class ActionLog
+{
+public:
+    static ActionLog* instance();
+
+    bool open(const std::string &path);
+    void action(const std::string &service, const std::string &name,
+                int ret, int ms, const std::string &args);
+    void note(const std::string &text);
+    // Number of calls per action, printed on exit
+    void summary();
+
+private:
+    struct Stats {
+        int count = 0;
+        int errors = 0;
+        long long totalMs = 0;
+    };
+
+    static ActionLog* m_instance;
+    std::chrono::steady_clock::time_point m_start;
+    std::ofstream m_file;
+    std::mutex m_mutex;
+    std::map<std::string, Stats> m_stats;
+
+    ActionLog();
+    long long now() const;
+    std::ostream& out();
+};
+
+#endif // ACTIONLOG_H
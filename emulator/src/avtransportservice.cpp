@@ -0,0 +1,539 @@
+/* Copyright (C) 2017 Michal Kosciesza <michal@mkiol.net>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <algorithm>
+#include <cstdlib>
+#include <functional>
+#include <sstream>
+#include <vector>
+
+#include <upnp/upnp.h>
+
+#include <libupnpp/upnpavutils.hxx>
+
+#include "avtransportservice.h"
+#include "actionlog.h"
+#include "scpd.h"
+
+using namespace std::placeholders;
+
+AVTransportService::AVTransportService(UPnPProvider::UpnpDevice *dev,
+                                       const Options &opts) :
+    EmuService(Scpd::avtType, Scpd::avtId, "AVTransport",
+               "urn:schemas-upnp-org:metadata-1-0/AVT/", dev, opts)
+{
+    map("SetAVTransportURI", std::bind(&AVTransportService::setURI, this, _1, _2));
+    map("SetNextAVTransportURI", std::bind(&AVTransportService::setNextURI, this, _1, _2));
+    map("GetMediaInfo", std::bind(&AVTransportService::getMediaInfo, this, _1, _2));
+    map("GetTransportInfo", std::bind(&AVTransportService::getTransportInfo, this, _1, _2));
+    map("GetPositionInfo", std::bind(&AVTransportService::getPositionInfo, this, _1, _2));
+    map("GetDeviceCapabilities", std::bind(&AVTransportService::getDeviceCapabilities, this, _1, _2));
+    map("GetTransportSettings", std::bind(&AVTransportService::getTransportSettings, this, _1, _2));
+    map("GetCurrentTransportActions", std::bind(&AVTransportService::getCurrentTransportActions, this, _1, _2));
+    map("Stop", std::bind(&AVTransportService::stop, this, _1, _2));
+    map("Play", std::bind(&AVTransportService::play, this, _1, _2));
+    map("Pause", std::bind(&AVTransportService::pause, this, _1, _2));
+    map("Seek", std::bind(&AVTransportService::seek, this, _1, _2));
+    map("Next", std::bind(&AVTransportService::next, this, _1, _2));
+    map("Previous", std::bind(&AVTransportService::previous, this, _1, _2));
+
+    m_ticker = std::thread(&AVTransportService::tick, this);
+}
+
+AVTransportService::~AVTransportService()
+{
+    std::vector<std::thread> threads;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_exit = true;
+        stopFetch();
+        threads.swap(m_fetchThreads);
+    }
+
+    // Fetch blocked in read quits after httpTimeout at most
+    for (auto &t : threads)
+        t.join();
+
+    m_ticker.join();
+}
+
+const std::string AVTransportService::serviceErrString(int error) const
+{
+    switch (error) {
+    case E_TransitionNotAvailable:
+        return "Transition not available";
+    case E_SeekModeNotSupported:
+        return "Seek mode not supported";
+    case E_IllegalSeekTarget:
+        return "Illegal seek target";
+    case E_ResourceNotFound:
+        return "Resource not found";
+    default:
+        return "Unknown error";
+    }
+}
+
+int AVTransportService::durationFromMeta(const std::string &meta)
+{
+    // DIDL-Lite res element has duration="H:MM:SS[.F]" attribute
+    auto pos = meta.find("duration=\"");
+    if (pos == std::string::npos)
+        pos = meta.find("duration=&quot;");
+    if (pos == std::string::npos)
+        return m_opts.duration * 1000;
+
+    pos = meta.find_first_of("0123456789", pos);
+    if (pos == std::string::npos)
+        return m_opts.duration * 1000;
+
+    return UPnPP::upnpdurationtos(meta.substr(pos, 16)) * 1000;
+}
+
+int AVTransportService::position()
+{
+    int pos = m_position;
+    if (m_state == "PLAYING")
+        pos += static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                                    Clock::now() - m_playStart).count());
+
+    return m_duration > 0 ? std::min(pos, m_duration) : pos;
+}
+
+std::string AVTransportService::actions()
+{
+    if (m_state == "PLAYING")
+        return m_nextUri.empty() ? "Pause,Stop,Seek,Previous" :
+                                   "Pause,Stop,Seek,Next,Previous";
+    if (m_state == "PAUSED_PLAYBACK")
+        return "Play,Stop,Seek";
+    if (m_state == "STOPPED")
+        return "Play,Seek";
+    return std::string();
+}
+
+AVTransportService::Vars AVTransportService::lastChangeVars()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    return {
+        {"TransportState", m_state},
+        {"TransportStatus", m_status},
+        {"TransportPlaySpeed", "1"},
+        {"CurrentPlayMode", "NORMAL"},
+        {"NumberOfTracks", m_uri.empty() ? "0" : "1"},
+        {"CurrentTrack", m_uri.empty() ? "0" : "1"},
+        {"AVTransportURI", m_uri},
+        {"AVTransportURIMetaData", m_meta},
+        {"CurrentTrackURI", m_uri},
+        {"CurrentTrackMetaData", m_meta},
+        {"NextAVTransportURI", m_nextUri},
+        {"NextAVTransportURIMetaData", m_nextMeta},
+        {"CurrentTrackDuration", UPnPP::upnpduration(m_duration)},
+        {"CurrentMediaDuration", UPnPP::upnpduration(m_duration)},
+        {"CurrentTransportActions", actions()}
+    };
+}
+
+void AVTransportService::startFetch()
+{
+    stopFetch();
+    if (m_exit)
+        return;
+
+    m_fetchDone = false;
+    m_fetchFailed = false;
+    reapFetches();
+    m_fetchThreads.emplace_back(&AVTransportService::fetch, this, m_fetchGen,
+                                m_uri);
+}
+
+void AVTransportService::stopFetch()
+{
+    ++m_fetchGen;
+    m_cond.notify_all();
+}
+
+void AVTransportService::reapFetches()
+{
+    // Finished fetch only returns after releasing m_mutex, so join is short
+    for (const auto &id : m_fetchFinished) {
+        auto it = std::find_if(m_fetchThreads.begin(), m_fetchThreads.end(),
+                               [&id](const std::thread &t) {
+            return t.get_id() == id;
+        });
+        if (it != m_fetchThreads.end()) {
+            it->join();
+            m_fetchThreads.erase(it);
+        }
+    }
+    m_fetchFinished.clear();
+}
+
+void AVTransportService::switchToNext()
+{
+    m_uri = m_nextUri;
+    m_meta = m_nextMeta;
+    m_nextUri.clear();
+    m_nextMeta.clear();
+    m_duration = durationFromMeta(m_meta);
+    m_position = 0;
+    m_playStart = Clock::now();
+    startFetch();
+}
+
+void AVTransportService::fetch(int gen, const std::string &uri)
+{
+    void *handle = nullptr;
+    // Points into response owned by handle, so it's not freed
+    char *type = nullptr;
+    int length = 0, status = 0;
+    long long total = 0;
+    bool ok = false;
+
+    int ret = UpnpOpenHttpGet(uri.c_str(), &handle, &type, &length, &status,
+                              httpTimeout);
+    if (ret != UPNP_E_SUCCESS || status != 200) {
+        std::ostringstream s;
+        s << "fetch failed ret=" << ret << " status=" << status << " " << uri;
+        ActionLog::instance()->note(s.str());
+    } else {
+        std::ostringstream s;
+        s << "fetch started type=" << (type ? type : "") << " length="
+          << length << " " << uri;
+        ActionLog::instance()->note(s.str());
+
+        std::vector<char> buf(fetchChunk);
+        auto start = Clock::now();
+
+        for (;;) {
+            {
+                // Paused renderer stops reading, so server sees stalled
+                // connection like with real device
+                std::unique_lock<std::mutex> lock(m_mutex);
+                auto pauseStart = Clock::now();
+                m_cond.wait(lock, [this, gen] {
+                    return gen != m_fetchGen || m_state != "PAUSED_PLAYBACK";
+                });
+                start += Clock::now() - pauseStart;
+                if (gen != m_fetchGen)
+                    break;
+            }
+
+            size_t size = buf.size();
+            ret = UpnpReadHttpGet(handle, buf.data(), &size, httpTimeout);
+            if (ret != UPNP_E_SUCCESS || size == 0) {
+                ok = ret == UPNP_E_SUCCESS;
+                break;
+            }
+
+            total += size;
+
+            if (m_opts.bitrate > 0) {
+                // kbit/s equals bits per ms
+                std::this_thread::sleep_until(
+                            start + std::chrono::milliseconds(
+                                total * 8 / m_opts.bitrate));
+            }
+        }
+
+        UpnpCloseHttpGet(handle);
+
+        std::ostringstream e;
+        e << "fetch " << (ok ? "done" : "interrupted") << " bytes=" << total
+          << " ms=" << std::chrono::duration_cast<std::chrono::milliseconds>(
+                 Clock::now() - start).count();
+        ActionLog::instance()->note(e.str());
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (gen == m_fetchGen) {
+        m_fetchDone = true;
+        m_fetchFailed = !ok && total == 0;
+    }
+    m_fetchFinished.push_back(std::this_thread::get_id());
+    m_cond.notify_all();
+}
+
+void AVTransportService::tick()
+{
+    for (;;) {
+        bool notify = false;
+
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cond.wait_for(lock, std::chrono::milliseconds(tickInterval));
+            if (m_exit)
+                return;
+
+            if (m_state == "PLAYING" && m_fetchDone) {
+                if (m_fetchFailed) {
+                    ActionLog::instance()->note("playback error");
+                    m_state = "STOPPED";
+                    m_status = "ERROR_OCCURRED";
+                    m_position = 0;
+                    notify = true;
+                } else if (m_duration <= 0 || position() >= m_duration) {
+                    ActionLog::instance()->note("track ended " + m_uri);
+                    if (!m_nextUri.empty()) {
+                        switchToNext();
+                        ActionLog::instance()->note("track started " + m_uri);
+                    } else {
+                        m_state = "STOPPED";
+                        m_position = 0;
+                    }
+                    notify = true;
+                }
+            }
+        }
+
+        if (notify)
+            changed();
+    }
+}
+
+int AVTransportService::setURI(const UPnPP::SoapIncoming &sc, UPnPP::SoapOutgoing&)
+{
+    std::string uri, meta;
+    if (!sc.get("CurrentURI", &uri))
+        return UPNP_INVALID_ARGS;
+    sc.get("CurrentURIMetaData", &meta);
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_uri = uri;
+        m_meta = meta;
+        m_duration = durationFromMeta(meta);
+        m_position = 0;
+        m_status = "OK";
+        m_uriSet = Clock::now();
+
+        if (uri.empty()) {
+            stopFetch();
+            m_state = "NO_MEDIA_PRESENT";
+        } else if (m_state == "PLAYING") {
+            // Renderers keep playing state and switch to new track
+            m_playStart = m_uriSet;
+            startFetch();
+        } else {
+            stopFetch();
+            m_state = "STOPPED";
+        }
+    }
+
+    changed();
+    return UPNP_E_SUCCESS;
+}
+
+int AVTransportService::setNextURI(const UPnPP::SoapIncoming &sc, UPnPP::SoapOutgoing&)
+{
+    if (m_opts.quirk("nonext"))
+        return UPNP_INVALID_ACTION;
+
+    std::string uri, meta;
+    if (!sc.get("NextURI", &uri))
+        return UPNP_INVALID_ARGS;
+    sc.get("NextURIMetaData", &meta);
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_nextUri = uri;
+        m_nextMeta = meta;
+    }
+
+    changed();
+    return UPNP_E_SUCCESS;
+}
+
+int AVTransportService::getMediaInfo(const UPnPP::SoapIncoming&, UPnPP::SoapOutgoing &data)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    data("NrTracks", m_uri.empty() ? "0" : "1")
+            ("MediaDuration", UPnPP::upnpduration(m_duration))
+            ("CurrentURI", m_uri)
+            ("CurrentURIMetaData", m_meta)
+            ("NextURI", m_nextUri)
+            ("NextURIMetaData", m_nextMeta)
+            ("PlayMedium", "NETWORK")
+            ("RecordMedium", "NOT_IMPLEMENTED")
+            ("WriteStatus", "NOT_IMPLEMENTED");
+    return UPNP_E_SUCCESS;
+}
+
+int AVTransportService::getTransportInfo(const UPnPP::SoapIncoming&, UPnPP::SoapOutgoing &data)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    data("CurrentTransportState", m_state)
+            ("CurrentTransportStatus", m_status)
+            ("CurrentSpeed", "1");
+    return UPNP_E_SUCCESS;
+}
+
+int AVTransportService::getPositionInfo(const UPnPP::SoapIncoming&, UPnPP::SoapOutgoing &data)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const auto pos = UPnPP::upnpduration(position());
+    data("Track", m_uri.empty() ? "0" : "1")
+            ("TrackDuration", UPnPP::upnpduration(m_duration))
+            ("TrackMetaData", m_meta)
+            ("TrackURI", m_uri)
+            ("RelTime", pos)
+            ("AbsTime", pos)
+            ("RelCount", "2147483647")
+            ("AbsCount", "2147483647");
+    return UPNP_E_SUCCESS;
+}
+
+int AVTransportService::getDeviceCapabilities(const UPnPP::SoapIncoming&, UPnPP::SoapOutgoing &data)
+{
+    data("PlayMedia", "NETWORK")
+            ("RecMedia", "NOT_IMPLEMENTED")
+            ("RecQualityModes", "NOT_IMPLEMENTED");
+    return UPNP_E_SUCCESS;
+}
+
+int AVTransportService::getTransportSettings(const UPnPP::SoapIncoming&, UPnPP::SoapOutgoing &data)
+{
+    data("PlayMode", "NORMAL")
+            ("RecQualityMode", "NOT_IMPLEMENTED");
+    return UPNP_E_SUCCESS;
+}
+
+int AVTransportService::getCurrentTransportActions(const UPnPP::SoapIncoming&, UPnPP::SoapOutgoing &data)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    data("Actions", actions());
+    return UPNP_E_SUCCESS;
+}
+
+int AVTransportService::stop(const UPnPP::SoapIncoming&, UPnPP::SoapOutgoing&)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        stopFetch();
+        m_state = m_uri.empty() ? "NO_MEDIA_PRESENT" : "STOPPED";
+        m_position = 0;
+    }
+
+    changed();
+    return UPNP_E_SUCCESS;
+}
+
+int AVTransportService::play(const UPnPP::SoapIncoming&, UPnPP::SoapOutgoing&)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (m_uri.empty())
+            return E_TransitionNotAvailable;
+
+        if (m_opts.quirk("settle") &&
+                Clock::now() - m_uriSet < std::chrono::milliseconds(settleTime))
+            return E_TransitionNotAvailable;
+
+        if (m_state == "PLAYING")
+            return UPNP_E_SUCCESS;
+
+        bool resume = m_state == "PAUSED_PLAYBACK";
+        m_state = "PLAYING";
+        m_status = "OK";
+        m_playStart = Clock::now();
+
+        if (resume)
+            m_cond.notify_all();
+        else
+            startFetch();
+    }
+
+    changed();
+    return UPNP_E_SUCCESS;
+}
+
+int AVTransportService::pause(const UPnPP::SoapIncoming&, UPnPP::SoapOutgoing&)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (m_state != "PLAYING")
+            return E_TransitionNotAvailable;
+
+        m_position = position();
+        m_state = "PAUSED_PLAYBACK";
+    }
+
+    changed();
+    return UPNP_E_SUCCESS;
+}
+
+int AVTransportService::seek(const UPnPP::SoapIncoming &sc, UPnPP::SoapOutgoing&)
+{
+    std::string unit, target;
+    if (!sc.get("Unit", &unit) || !sc.get("Target", &target))
+        return UPNP_INVALID_ARGS;
+
+    int pos = 0;
+    if (unit == "REL_TIME" || unit == "ABS_TIME") {
+        if (unit == "REL_TIME" && m_opts.quirk("norel"))
+            return E_SeekModeNotSupported;
+        pos = UPnPP::upnpdurationtos(target) * 1000;
+    } else if (unit == "TRACK_NR") {
+        if (target != "1")
+            return E_IllegalSeekTarget;
+    } else {
+        return E_SeekModeNotSupported;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (m_uri.empty())
+            return E_TransitionNotAvailable;
+        if (m_duration > 0 && pos > m_duration)
+            return E_IllegalSeekTarget;
+
+        m_position = pos;
+        m_playStart = Clock::now();
+    }
+
+    changed();
+    return UPNP_E_SUCCESS;
+}
+
+int AVTransportService::next(const UPnPP::SoapIncoming&, UPnPP::SoapOutgoing&)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (m_nextUri.empty())
+            return E_TransitionNotAvailable;
+
+        bool playing = m_state == "PLAYING";
+        switchToNext();
+        if (!playing) {
+            stopFetch();
+            m_state = "STOPPED";
+        }
+    }
+
+    changed();
+    return UPNP_E_SUCCESS;
+}
+
+int AVTransportService::previous(const UPnPP::SoapIncoming&, UPnPP::SoapOutgoing&)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (m_uri.empty())
+            return E_TransitionNotAvailable;
+
+        m_position = 0;
+        m_playStart = Clock::now();
+    }
+
+    changed();
+    return UPNP_E_SUCCESS;
+}
@@ -0,0 +1,102 @@
+/* Copyright (C) 2017 Michal Kosciesza <michal@mkiol.net>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef AVTRANSPORTSERVICE_H
+#define AVTRANSPORTSERVICE_H
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "emuservice.h"
+
+// AVTransport that plays nothing. Current URI is fetched (at configured
+// rate) and playback position runs on a clock, so track ends when both
+// content is fetched and its duration elapsed. Next URI is switched to
+// without a gap.
+class AVTransportService : public EmuService
+{
+public:
+    AVTransportService(UPnPProvider::UpnpDevice *dev, const Options &opts);
+    ~AVTransportService();
+
+    const std::string serviceErrString(int error) const;
+
+protected:
+    Vars lastChangeVars();
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    enum Error {
+        E_TransitionNotAvailable = 701,
+        E_SeekModeNotSupported = 710,
+        E_IllegalSeekTarget = 711,
+        E_ResourceNotFound = 716
+    };
+
+    // Play right after SetAVTransportURI fails with "settle" quirk
+    static const int settleTime = 1000;
+    static const int tickInterval = 100;
+    static const int httpTimeout = 10;
+    static const int fetchChunk = 16384;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::string m_state = "NO_MEDIA_PRESENT";
+    std::string m_status = "OK";
+    std::string m_uri;
+    std::string m_meta;
+    std::string m_nextUri;
+    std::string m_nextMeta;
+    int m_duration = 0;
+    int m_position = 0;
+    Clock::time_point m_playStart;
+    Clock::time_point m_uriSet;
+    // Every started fetch has new generation, older fetches quit
+    int m_fetchGen = 0;
+    bool m_fetchDone = false;
+    bool m_fetchFailed = false;
+    // Fetch threads are joined, finished ones when next fetch starts and
+    // the rest on destruction, so none outlives the service
+    std::vector<std::thread> m_fetchThreads;
+    std::vector<std::thread::id> m_fetchFinished;
+    bool m_exit = false;
+    std::thread m_ticker;
+
+    int setURI(const UPnPP::SoapIncoming &sc, UPnPP::SoapOutgoing &data);
+    int setNextURI(const UPnPP::SoapIncoming &sc, UPnPP::SoapOutgoing &data);
+    int getMediaInfo(const UPnPP::SoapIncoming &sc, UPnPP::SoapOutgoing &data);
+    int getTransportInfo(const UPnPP::SoapIncoming &sc, UPnPP::SoapOutgoing &data);
+    int getPositionInfo(const UPnPP::SoapIncoming &sc, UPnPP::SoapOutgoing &data);
+    int getDeviceCapabilities(const UPnPP::SoapIncoming &sc, UPnPP::SoapOutgoing &data);
+    int getTransportSettings(const UPnPP::SoapIncoming &sc, UPnPP::SoapOutgoing &data);
+    int getCurrentTransportActions(const UPnPP::SoapIncoming &sc, UPnPP::SoapOutgoing &data);
+    int stop(const UPnPP::SoapIncoming &sc, UPnPP::SoapOutgoing &data);
+    int play(const UPnPP::SoapIncoming &sc, UPnPP::SoapOutgoing &data);
+    int pause(const UPnPP::SoapIncoming &sc, UPnPP::SoapOutgoing &data);
+    int seek(const UPnPP::SoapIncoming &sc, UPnPP::SoapOutgoing &data);
+    int next(const UPnPP::SoapIncoming &sc, UPnPP::SoapOutgoing &data);
+    int previous(const UPnPP::SoapIncoming &sc, UPnPP::SoapOutgoing &data);
+
+    // Following require locked m_mutex
+    int position();
+    std::string actions();
+    void startFetch();
+    void stopFetch();
+    void reapFetches();
+    void switchToNext();
+
+    void fetch(int gen, const std::string &uri);
+    void tick();
+    int durationFromMeta(const std::string &meta);
+};
+
+#endif // AVTRANSPORTSERVICE_H
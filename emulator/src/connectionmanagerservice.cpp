@@ -0,0 +1,88 @@
+/* Copyright (C) 2017 Michal Kosciesza <michal@mkiol.net>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <functional>
+
+#include <upnp/upnp.h>
+
+#include "connectionmanagerservice.h"
+#include "scpd.h"
+
+using namespace std::placeholders;
+
+namespace {
+const char* sinkMimes[] = {
+    "audio/mpeg", "audio/mp4", "audio/x-m4a", "audio/aac", "audio/flac",
+    "audio/x-flac", "audio/ogg", "audio/wav", "audio/x-wav", "audio/L16",
+    "video/mp4", "video/x-matroska", "video/x-msvideo", "video/mpeg",
+    "image/jpeg", "image/png"
+};
+}
+
+ConnectionManagerService::ConnectionManagerService(UPnPProvider::UpnpDevice *dev,
+                                                   const Options &opts) :
+    EmuService(Scpd::cmType, Scpd::cmId, "ConnectionManager", std::string(),
+               dev, opts)
+{
+    for (const char *mime : sinkMimes) {
+        if (!m_sink.empty())
+            m_sink += ",";
+        m_sink += std::string("http-get:*:") + mime + ":*";
+    }
+
+    map("GetProtocolInfo", std::bind(&ConnectionManagerService::getProtocolInfo, this, _1, _2));
+    map("GetCurrentConnectionIDs", std::bind(&ConnectionManagerService::getCurrentConnectionIDs, this, _1, _2));
+    map("GetCurrentConnectionInfo", std::bind(&ConnectionManagerService::getCurrentConnectionInfo, this, _1, _2));
+}
+
+ConnectionManagerService::Vars ConnectionManagerService::lastChangeVars()
+{
+    return Vars();
+}
+
+bool ConnectionManagerService::getEventData(bool all, std::vector<std::string> &names,
+                                            std::vector<std::string> &values)
+{
+    // State never changes, so it is sent only on subscription
+    if (!all && m_evented)
+        return true;
+
+    m_evented = true;
+    names = {"SourceProtocolInfo", "SinkProtocolInfo", "CurrentConnectionIDs"};
+    values = {std::string(), m_sink, "0"};
+    return true;
+}
+
+int ConnectionManagerService::getProtocolInfo(const UPnPP::SoapIncoming&, UPnPP::SoapOutgoing &data)
+{
+    data("Source", "")("Sink", m_sink);
+    return UPNP_E_SUCCESS;
+}
+
+int ConnectionManagerService::getCurrentConnectionIDs(const UPnPP::SoapIncoming&, UPnPP::SoapOutgoing &data)
+{
+    data("ConnectionIDs", "0");
+    return UPNP_E_SUCCESS;
+}
+
+int ConnectionManagerService::getCurrentConnectionInfo(const UPnPP::SoapIncoming &sc, UPnPP::SoapOutgoing &data)
+{
+    int id;
+    if (!sc.get("ConnectionID", &id))
+        return UPNP_INVALID_ARGS;
+    if (id != 0)
+        return UPNP_ARG_VALUE_INVALID;
+
+    data("RcsID", "0")
+            ("AVTransportID", "0")
+            ("ProtocolInfo", "")
+            ("PeerConnectionManager", "")
+            ("PeerConnectionID", "-1")
+            ("Direction", "Input")
+            ("Status", "OK");
+    return UPNP_E_SUCCESS;
+}
@@ -0,0 +1,35 @@
+/* Copyright (C) 2017 Michal Kosciesza <michal@mkiol.net>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef CONNECTIONMANAGERSERVICE_H
+#define CONNECTIONMANAGERSERVICE_H
+
+#include <string>
+
+#include "emuservice.h"
+
+class ConnectionManagerService : public EmuService
+{
+public:
+    ConnectionManagerService(UPnPProvider::UpnpDevice *dev, const Options &opts);
+
+    bool getEventData(bool all, std::vector<std::string> &names,
+                      std::vector<std::string> &values);
+
+protected:
+    Vars lastChangeVars();
+
+private:
+    std::string m_sink;
+    bool m_evented = false;
+
+    int getProtocolInfo(const UPnPP::SoapIncoming &sc, UPnPP::SoapOutgoing &data);
+    int getCurrentConnectionIDs(const UPnPP::SoapIncoming &sc, UPnPP::SoapOutgoing &data);
+    int getCurrentConnectionInfo(const UPnPP::SoapIncoming &sc, UPnPP::SoapOutgoing &data);
+};
+
+#endif // CONNECTIONMANAGERSERVICE_H
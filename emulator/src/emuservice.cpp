@@ -0,0 +1,100 @@
+/* Copyright (C) 2017 Michal Kosciesza <michal@mkiol.net>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <chrono>
+#include <thread>
+
+#include "emuservice.h"
+#include "actionlog.h"
+
+EmuService::EmuService(const std::string &type, const std::string &id,
+                       const std::string &name, const std::string &lastChangeNs,
+                       UPnPProvider::UpnpDevice *dev, const Options &opts) :
+    UPnPProvider::UpnpService(type, id, dev, opts.quirk("noevents")),
+    m_opts(opts),
+    m_name(name),
+    m_lastChangeNs(lastChangeNs),
+    m_changed(false),
+    m_rand(std::random_device()())
+{
+}
+
+int EmuService::delay()
+{
+    if (m_opts.jitter <= 0)
+        return m_opts.latency;
+
+    std::uniform_int_distribution<int> dist(0, m_opts.jitter);
+    return m_opts.latency + dist(m_rand);
+}
+
+std::string EmuService::logArgs(const UPnPP::SoapIncoming &sc)
+{
+    // Only arguments that matter for benchmarks are logged
+    static const char* names[] = {"CurrentURI", "NextURI", "Speed", "Unit",
+                                  "Target", "DesiredVolume", "DesiredMute"};
+    std::string args;
+    for (const char *name : names) {
+        std::string value;
+        if (sc.get(name, &value)) {
+            if (!args.empty())
+                args += " ";
+            args += std::string(name) + "=" + value;
+        }
+    }
+    return args;
+}
+
+void EmuService::map(const std::string &action, const UPnPProvider::soapfun &fn)
+{
+    getDevice()->addActionMapping(this, action,
+            [this, action, fn](const UPnPP::SoapIncoming &sc,
+                               UPnPP::SoapOutgoing &data) {
+        auto start = std::chrono::steady_clock::now();
+
+        int ms = delay();
+        if (ms > 0)
+            std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+
+        int ret = fn(sc, data);
+
+        int duration = static_cast<int>(
+                    std::chrono::duration_cast<std::chrono::milliseconds>(
+                        std::chrono::steady_clock::now() - start).count());
+        ActionLog::instance()->action(m_name, action, ret, duration,
+                                      logArgs(sc));
+        return ret;
+    });
+}
+
+void EmuService::changed()
+{
+    m_changed = true;
+    getDevice()->loopWakeup();
+}
+
+bool EmuService::getEventData(bool all, std::vector<std::string> &names,
+                              std::vector<std::string> &values)
+{
+    if (!m_changed.exchange(false) && !all)
+        return true;
+
+    std::string lc = "<Event xmlns=\"" + m_lastChangeNs + "\">"
+                     "<InstanceID val=\"0\">";
+    for (const auto &var : lastChangeVars()) {
+        lc += "<" + var.first;
+        // RenderingControl variables are per channel
+        if (var.first == "Volume" || var.first == "Mute")
+            lc += " channel=\"Master\"";
+        lc += " val=\"" + UPnPP::SoapHelp::xmlQuote(var.second) + "\"/>";
+    }
+    lc += "</InstanceID></Event>";
+
+    names.push_back("LastChange");
+    values.push_back(lc);
+    return true;
+}
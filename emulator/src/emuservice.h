@@ -0,0 +1,56 @@
+/* Copyright (C) 2017 Michal Kosciesza <michal@mkiol.net>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef EMUSERVICE_H
+#define EMUSERVICE_H
+
+#include <atomic>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <libupnpp/device/device.hxx>
+#include <libupnpp/soaphelp.hxx>
+
+#include "options.h"
+
+// Base of emulated services. Every action is delayed by configured
+// latency and logged. libupnpp runs actions under one device lock, so
+// like on most cheap renderers they are handled one at a time.
+class EmuService : public UPnPProvider::UpnpService
+{
+public:
+    typedef std::vector<std::pair<std::string, std::string>> Vars;
+
+    EmuService(const std::string &type, const std::string &id,
+               const std::string &name, const std::string &lastChangeNs,
+               UPnPProvider::UpnpDevice *dev, const Options &opts);
+
+    bool getEventData(bool all, std::vector<std::string> &names,
+                      std::vector<std::string> &values);
+
+protected:
+    const Options &m_opts;
+    const std::string m_name;
+
+    void map(const std::string &action, const UPnPProvider::soapfun &fn);
+    // Marks evented state as changed, so LastChange is sent soon
+    void changed();
+    // Values of variables that are evented with LastChange
+    virtual Vars lastChangeVars() = 0;
+
+private:
+    const std::string m_lastChangeNs;
+    std::atomic<bool> m_changed;
+    std::minstd_rand m_rand;
+
+    int delay();
+    static std::string logArgs(const UPnPP::SoapIncoming &sc);
+};
+
+#endif // EMUSERVICE_H
@@ -0,0 +1,320 @@
+/* Copyright (C) 2017 Michal Kosciesza <michal@mkiol.net>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <arpa/inet.h>
+#include <getopt.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <upnp/upnp.h>
+
+namespace {
+const char* usage =
+        "Usage: jupii-gena-bench [options]\n"
+        "Measures how fast libupnp control point delivers GENA events to its\n"
+        "callback. Events are sent as NOTIFY requests from many connections at\n"
+        "once, every request over new connection like devices do.\n\n"
+        "  -a, --ip ADDR         IPv4 address (default 127.0.0.1)\n"
+        "  -n, --events N        number of events (default 10000)\n"
+        "  -c, --connections N   concurrent connections (default 32)\n"
+        "  -s, --size BYTES      size of variable value (default 64)\n"
+        "  -h, --help            this help\n";
+
+struct Options {
+    std::string ip = "127.0.0.1";
+    int events = 10000;
+    int connections = 32;
+    int size = 64;
+};
+
+const char* sid = "uuid:jupii-gena-bench";
+const int waitTimeout = 30;
+
+std::atomic<int> received(0);
+std::mutex mutex;
+std::condition_variable cond;
+
+bool parse(int argc, char *argv[], Options &opts)
+{
+    static const struct option longOpts[] = {
+        {"ip", required_argument, nullptr, 'a'},
+        {"events", required_argument, nullptr, 'n'},
+        {"connections", required_argument, nullptr, 'c'},
+        {"size", required_argument, nullptr, 's'},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0}
+    };
+
+    int c;
+    while ((c = getopt_long(argc, argv, "a:n:c:s:h",
+                            longOpts, nullptr)) != -1) {
+        switch (c) {
+        case 'a': opts.ip = optarg; break;
+        case 'n': opts.events = atoi(optarg); break;
+        case 'c': opts.connections = atoi(optarg); break;
+        case 's': opts.size = atoi(optarg); break;
+        case 'h':
+            std::cout << usage;
+            exit(0);
+        default:
+            return false;
+        }
+    }
+
+    return optind == argc && opts.events > 0 && opts.connections > 0 &&
+            opts.size >= 0;
+}
+
+int callback(Upnp_EventType type, void *event, void *cookie)
+{
+    (void) event; (void) cookie;
+
+    if (type == UPNP_EVENT_RECEIVED) {
+        ++received;
+        cond.notify_all();
+    }
+
+    return 0;
+}
+
+int connectTo(const std::string &ip, unsigned short port)
+{
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0)
+        return -1;
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    inet_pton(AF_INET, ip.c_str(), &addr.sin_addr);
+    if (connect(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+        close(sock);
+        return -1;
+    }
+
+    return sock;
+}
+
+bool writeAll(int sock, const std::string &data)
+{
+    size_t done = 0;
+    while (done < data.size()) {
+        ssize_t n = write(sock, data.data() + done, data.size() - done);
+        if (n <= 0)
+            return false;
+        done += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// Reads until end of headers, which is enough for both SUBSCRIBE and
+// NOTIFY responses without body
+std::string readHeaders(int sock)
+{
+    std::string data;
+    char buf[1024];
+    while (data.find("\r\n\r\n") == std::string::npos) {
+        ssize_t n = read(sock, buf, sizeof(buf));
+        if (n <= 0)
+            break;
+        data.append(buf, static_cast<size_t>(n));
+    }
+    return data;
+}
+
+// Publisher that accepts one SUBSCRIBE, so libupnp knows SID of the
+// NOTIFYs sent later
+void publish(int lsock)
+{
+    int sock = accept(lsock, nullptr, nullptr);
+    if (sock < 0)
+        return;
+
+    readHeaders(sock);
+    writeAll(sock, std::string("HTTP/1.1 200 OK\r\n"
+                               "SID: ") + sid + "\r\n"
+                               "TIMEOUT: Second-1800\r\n"
+                               "Content-Length: 0\r\n\r\n");
+    close(sock);
+}
+
+int listenOn(const std::string &ip, unsigned short *port)
+{
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0)
+        return -1;
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    inet_pton(AF_INET, ip.c_str(), &addr.sin_addr);
+    socklen_t len = sizeof(addr);
+    if (bind(sock, reinterpret_cast<sockaddr*>(&addr), len) < 0 ||
+        listen(sock, 1) < 0 ||
+        getsockname(sock, reinterpret_cast<sockaddr*>(&addr), &len) < 0) {
+        close(sock);
+        return -1;
+    }
+
+    *port = ntohs(addr.sin_port);
+    return sock;
+}
+
+bool notify(const std::string &ip, unsigned short port, int seq,
+            const std::string &body)
+{
+    int sock = connectTo(ip, port);
+    if (sock < 0)
+        return false;
+
+    std::string req = "NOTIFY / HTTP/1.1\r\n"
+                      "HOST: " + ip + ":" + std::to_string(port) + "\r\n"
+                      "CONTENT-TYPE: text/xml; charset=\"utf-8\"\r\n"
+                      "CONTENT-LENGTH: " + std::to_string(body.size()) + "\r\n"
+                      "NT: upnp:event\r\n"
+                      "NTS: upnp:propchange\r\n"
+                      "SID: " + sid + "\r\n"
+                      "SEQ: " + std::to_string(seq) + "\r\n\r\n" + body;
+
+    bool ok = writeAll(sock, req) &&
+            readHeaders(sock).compare(0, 12, "HTTP/1.1 200") == 0;
+    close(sock);
+
+    return ok;
+}
+}
+
+int main(int argc, char *argv[])
+{
+    Options opts;
+    if (!parse(argc, argv, opts)) {
+        std::cerr << usage;
+        return 1;
+    }
+
+    if (UpnpInit(opts.ip.c_str(), 0) != UPNP_E_SUCCESS) {
+        std::cerr << "Can't initialize libupnp" << std::endl;
+        return 1;
+    }
+
+    UpnpClient_Handle handle;
+    if (UpnpRegisterClient(callback, nullptr, &handle) != UPNP_E_SUCCESS) {
+        std::cerr << "Can't register client" << std::endl;
+        UpnpFinish();
+        return 1;
+    }
+
+    unsigned short pubPort = 0;
+    int lsock = listenOn(opts.ip, &pubPort);
+    if (lsock < 0) {
+        std::cerr << "Can't listen on " << opts.ip << std::endl;
+        UpnpFinish();
+        return 1;
+    }
+    std::thread pubThread(publish, lsock);
+
+    std::string url = "http://" + opts.ip + ":" + std::to_string(pubPort) +
+            "/event";
+    int timeout = 1800;
+    Upnp_SID subSid;
+    int ret = UpnpSubscribe(handle, url.c_str(), &timeout, subSid);
+    pubThread.join();
+    close(lsock);
+    if (ret != UPNP_E_SUCCESS) {
+        std::cerr << "Can't subscribe, error " << ret
+                  << std::endl;
+        UpnpFinish();
+        return 1;
+    }
+
+    std::string body = "<?xml version=\"1.0\"?>\n"
+            "<e:propertyset xmlns:e=\"urn:schemas-upnp-org:event-1-0\">"
+            "<e:property><LastChange>" + std::string(opts.size, 'x') +
+            "</LastChange></e:property></e:propertyset>";
+
+    std::string ip = UpnpGetServerIpAddress();
+    unsigned short port = UpnpGetServerPort();
+
+    std::atomic<int> next(1);
+    std::atomic<int> sent(0);
+    std::atomic<int> errors(0);
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> senders;
+    for (int i = 0; i < opts.connections; ++i) {
+        senders.emplace_back([&]() {
+            int seq;
+            while ((seq = next++) <= opts.events) {
+                if (notify(ip, port, seq, body))
+                    ++sent;
+                else
+                    ++errors;
+            }
+        });
+    }
+    for (auto &t : senders)
+        t.join();
+
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        cond.wait_for(lock, std::chrono::seconds(waitTimeout), [&sent]() {
+            return received >= sent;
+        });
+    }
+
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "events=" << opts.events
+              << " connections=" << opts.connections
+              << " size=" << opts.size
+              << " sent=" << sent
+              << " errors=" << errors
+              << " received=" << received
+              << " time=" << ms << "ms"
+              << " rate=" << (ms > 0 ? received * 1000 / ms : 0) << "/s"
+              << std::endl;
+
+    static const struct {
+        const char *name;
+        Upnp_ThreadPool pool;
+    } pools[] = {
+        {"recv", UPNP_RECV_THREADPOOL},
+        {"miniserver", UPNP_MINISERVER_THREADPOOL}
+    };
+    for (const auto &p : pools) {
+        unsigned long queued, rejected, depth, maxDepth, avgWait, avgRun;
+        if (UpnpGetThreadPoolStats(p.pool, &queued, &rejected, &depth,
+                                   &maxDepth, &avgWait, &avgRun) != UPNP_E_SUCCESS)
+            continue;
+        std::cout << "pool=" << p.name
+                  << " jobs=" << queued
+                  << " rejected=" << rejected
+                  << " maxqueued=" << maxDepth
+                  << " avgwait=" << avgWait << "us"
+                  << " avgrun=" << avgRun << "us"
+                  << std::endl;
+    }
+
+    UpnpFinish();
+
+    return received == opts.events ? 0 : 1;
+}
@@ -0,0 +1,168 @@
+/* Copyright (C) 2017 Michal Kosciesza <michal@mkiol.net>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <getopt.h>
+#include <signal.h>
+
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include <libupnpp/log.hxx>
+#include <libupnpp/upnpplib.hxx>
+#include <libupnpp/device/device.hxx>
+
+#include "options.h"
+#include "actionlog.h"
+#include "scpd.h"
+#include "avtransportservice.h"
+#include "renderingcontrolservice.h"
+#include "connectionmanagerservice.h"
+
+namespace {
+const char* usage =
+        "Usage: jupii-renderer-emu [options]\n"
+        "Headless UPnP MediaRenderer that plays nothing. Every action is logged\n"
+        "with a timestamp, so it can be used to benchmark control points.\n\n"
+        "  -n, --name NAME       friendly name\n"
+        "  -u, --uuid UUID       device UUID (default is derived from name)\n"
+        "  -i, --iface IFACE     network interface, e.g. eth0\n"
+        "  -a, --ip ADDR         IPv4 address, used if interface is not set,\n"
+        "                        e.g. 127.0.0.1 for loopback\n"
+        "  -p, --port PORT       HTTP port (default is chosen by libupnp)\n"
+        "  -b, --bitrate KBPS    rate of fetching content (default unlimited)\n"
+        "  -l, --latency MS      delay of every action response\n"
+        "  -j, --jitter MS       max random addition to latency\n"
+        "  -d, --duration SEC    track length when metadata has none\n"
+        "  -q, --quirks LIST     comma separated quirks:\n"
+        "                          nonext   no SetNextAVTransportURI\n"
+        "                          norel    no REL_TIME seek mode\n"
+        "                          settle   Play fails shortly after SetAVTransportURI\n"
+        "                          noevents no GENA events\n"
+        "  -o, --log FILE        action log file (default stdout)\n"
+        "  -h, --help            this help\n";
+
+bool parse(int argc, char *argv[], Options &opts)
+{
+    static const struct option longOpts[] = {
+        {"name", required_argument, nullptr, 'n'},
+        {"uuid", required_argument, nullptr, 'u'},
+        {"iface", required_argument, nullptr, 'i'},
+        {"ip", required_argument, nullptr, 'a'},
+        {"port", required_argument, nullptr, 'p'},
+        {"bitrate", required_argument, nullptr, 'b'},
+        {"latency", required_argument, nullptr, 'l'},
+        {"jitter", required_argument, nullptr, 'j'},
+        {"duration", required_argument, nullptr, 'd'},
+        {"quirks", required_argument, nullptr, 'q'},
+        {"log", required_argument, nullptr, 'o'},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0}
+    };
+
+    int c;
+    while ((c = getopt_long(argc, argv, "n:u:i:a:p:b:l:j:d:q:o:h",
+                            longOpts, nullptr)) != -1) {
+        switch (c) {
+        case 'n': opts.name = optarg; break;
+        case 'u': opts.uuid = optarg; break;
+        case 'i': opts.ifname = optarg; break;
+        case 'a': opts.ip = optarg; break;
+        case 'p': opts.port = static_cast<unsigned short>(atoi(optarg)); break;
+        case 'b': opts.bitrate = atoi(optarg); break;
+        case 'l': opts.latency = atoi(optarg); break;
+        case 'j': opts.jitter = atoi(optarg); break;
+        case 'd': opts.duration = atoi(optarg); break;
+        case 'q': {
+            std::istringstream s(optarg);
+            std::string quirk;
+            while (std::getline(s, quirk, ','))
+                if (!quirk.empty())
+                    opts.quirks.insert(quirk);
+            break;
+        }
+        case 'o': opts.logFile = optarg; break;
+        case 'h':
+            std::cout << usage;
+            exit(0);
+        default:
+            return false;
+        }
+    }
+
+    return optind == argc;
+}
+}
+
+int main(int argc, char *argv[])
+{
+    Options opts;
+    if (!parse(argc, argv, opts)) {
+        std::cerr << usage;
+        return 1;
+    }
+
+    // Signals are handled by one thread, so other threads (also libupnp
+    // ones) are not interrupted
+    sigset_t sigs;
+    sigemptyset(&sigs);
+    sigaddset(&sigs, SIGINT);
+    sigaddset(&sigs, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &sigs, nullptr);
+
+    if (auto log = Logger::getTheLog("stderr"))
+        log->setLogLevel(Logger::LLERR);
+
+    if (!opts.logFile.empty() && !ActionLog::instance()->open(opts.logFile)) {
+        std::cerr << "Can't open log file " << opts.logFile << std::endl;
+        return 1;
+    }
+
+    std::string hwaddr;
+    auto lib = UPnPP::LibUPnP::getLibUPnP(true, &hwaddr, opts.ifname,
+                                          opts.ip, opts.port);
+    if (!lib || !lib->ok()) {
+        std::cerr << "Can't initialize libupnp" << std::endl;
+        return 1;
+    }
+
+    std::string udn = "uuid:" + (opts.uuid.empty() ?
+                                     UPnPP::LibUPnP::makeDevUUID(opts.name, hwaddr) :
+                                     opts.uuid);
+
+    UPnPProvider::UpnpDevice dev(udn, Scpd::files(opts, udn));
+    AVTransportService avt(&dev, opts);
+    RenderingControlService rc(&dev, opts);
+    ConnectionManagerService cm(&dev, opts);
+
+    std::thread sigThread([&dev, sigs]() {
+        int sig;
+        sigwait(&sigs, &sig);
+        dev.shouldExit();
+    });
+    sigThread.detach();
+
+    std::string host;
+    unsigned short port = 0;
+    dev.ipv4(&host, &port);
+
+    std::ostringstream s;
+    s << "started " << udn << " http://" << host << ":" << port
+      << "/ bitrate=" << opts.bitrate << " latency=" << opts.latency
+      << " jitter=" << opts.jitter << " quirks=";
+    for (const auto &q : opts.quirks)
+        s << q << ";";
+    ActionLog::instance()->note(s.str());
+
+    dev.eventloop();
+
+    ActionLog::instance()->summary();
+
+    return 0;
+}
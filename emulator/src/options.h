@@ -0,0 +1,36 @@
+/* Copyright (C) 2017 Michal Kosciesza <michal@mkiol.net>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include <set>
+#include <string>
+
+struct Options {
+    std::string name = "Jupii Test Renderer";
+    std::string uuid;
+    std::string ifname;
+    std::string ip;
+    unsigned short port = 0;
+    // Rate (kbit/s) at which content is fetched, 0 means unlimited
+    int bitrate = 0;
+    // Delay (ms) of every action response and its random addition
+    int latency = 0;
+    int jitter = 0;
+    // Track length (s) used when metadata has no duration
+    int duration = 0;
+    std::set<std::string> quirks;
+    std::string logFile;
+
+    bool quirk(const std::string &name) const
+    {
+        return quirks.count(name) > 0;
+    }
+};
+
+#endif // OPTIONS_H
@@ -0,0 +1,82 @@
+/* Copyright (C) 2017 Michal Kosciesza <michal@mkiol.net>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <functional>
+#include <string>
+
+#include <upnp/upnp.h>
+
+#include "renderingcontrolservice.h"
+#include "scpd.h"
+
+using namespace std::placeholders;
+
+RenderingControlService::RenderingControlService(UPnPProvider::UpnpDevice *dev,
+                                                 const Options &opts) :
+    EmuService(Scpd::rcType, Scpd::rcId, "RenderingControl",
+               "urn:schemas-upnp-org:metadata-1-0/RCS/", dev, opts)
+{
+    map("GetVolume", std::bind(&RenderingControlService::getVolume, this, _1, _2));
+    map("SetVolume", std::bind(&RenderingControlService::setVolume, this, _1, _2));
+    map("GetMute", std::bind(&RenderingControlService::getMute, this, _1, _2));
+    map("SetMute", std::bind(&RenderingControlService::setMute, this, _1, _2));
+}
+
+RenderingControlService::Vars RenderingControlService::lastChangeVars()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return {
+        {"Volume", std::to_string(m_volume)},
+        {"Mute", m_mute ? "1" : "0"}
+    };
+}
+
+int RenderingControlService::getVolume(const UPnPP::SoapIncoming&, UPnPP::SoapOutgoing &data)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    data("CurrentVolume", std::to_string(m_volume));
+    return UPNP_E_SUCCESS;
+}
+
+int RenderingControlService::setVolume(const UPnPP::SoapIncoming &sc, UPnPP::SoapOutgoing&)
+{
+    int volume;
+    if (!sc.get("DesiredVolume", &volume))
+        return UPNP_INVALID_ARGS;
+    if (volume < 0 || volume > 100)
+        return UPNP_ARG_VALUE_OUT_OF_RANGE;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_volume = volume;
+    }
+
+    changed();
+    return UPNP_E_SUCCESS;
+}
+
+int RenderingControlService::getMute(const UPnPP::SoapIncoming&, UPnPP::SoapOutgoing &data)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    data("CurrentMute", m_mute ? "1" : "0");
+    return UPNP_E_SUCCESS;
+}
+
+int RenderingControlService::setMute(const UPnPP::SoapIncoming &sc, UPnPP::SoapOutgoing&)
+{
+    bool mute;
+    if (!sc.get("DesiredMute", &mute))
+        return UPNP_INVALID_ARGS;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_mute = mute;
+    }
+
+    changed();
+    return UPNP_E_SUCCESS;
+}
@@ -0,0 +1,34 @@
+/* Copyright (C) 2017 Michal Kosciesza <michal@mkiol.net>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef RENDERINGCONTROLSERVICE_H
+#define RENDERINGCONTROLSERVICE_H
+
+#include <mutex>
+
+#include "emuservice.h"
+
+class RenderingControlService : public EmuService
+{
+public:
+    RenderingControlService(UPnPProvider::UpnpDevice *dev, const Options &opts);
+
+protected:
+    Vars lastChangeVars();
+
+private:
+    std::mutex m_mutex;
+    int m_volume = 50;
+    bool m_mute = false;
+
+    int getVolume(const UPnPP::SoapIncoming &sc, UPnPP::SoapOutgoing &data);
+    int setVolume(const UPnPP::SoapIncoming &sc, UPnPP::SoapOutgoing &data);
+    int getMute(const UPnPP::SoapIncoming &sc, UPnPP::SoapOutgoing &data);
+    int setMute(const UPnPP::SoapIncoming &sc, UPnPP::SoapOutgoing &data);
+};
+
+#endif // RENDERINGCONTROLSERVICE_H
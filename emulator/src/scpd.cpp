@@ -0,0 +1,281 @@
+/* Copyright (C) 2017 Michal Kosciesza <michal@mkiol.net>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <sstream>
+#include <vector>
+
+#include <libupnpp/soaphelp.hxx>
+
+#include "scpd.h"
+
+namespace Scpd {
+const std::string avtType = "urn:schemas-upnp-org:service:AVTransport:1";
+const std::string avtId = "urn:upnp-org:serviceId:AVTransport";
+const std::string rcType = "urn:schemas-upnp-org:service:RenderingControl:1";
+const std::string rcId = "urn:upnp-org:serviceId:RenderingControl";
+const std::string cmType = "urn:schemas-upnp-org:service:ConnectionManager:1";
+const std::string cmId = "urn:upnp-org:serviceId:ConnectionManager";
+}
+
+namespace {
+const std::string dir = "/emu";
+
+struct Arg {
+    std::string name;
+    bool out;
+    std::string var;
+};
+
+struct Action {
+    std::string name;
+    std::vector<Arg> args;
+};
+
+struct Var {
+    std::string name;
+    std::string type;
+    bool evented;
+    std::vector<std::string> allowed;
+};
+
+const Arg instanceArg = {"InstanceID", false, "A_ARG_TYPE_InstanceID"};
+
+std::string build(const std::vector<Action> &actions,
+                  const std::vector<Var> &vars)
+{
+    std::ostringstream s;
+    s << "<?xml version=\"1.0\"?>\n"
+         "<scpd xmlns=\"urn:schemas-upnp-org:service-1-0\">\n"
+         "<specVersion><major>1</major><minor>0</minor></specVersion>\n"
+         "<actionList>\n";
+    for (const auto &a : actions) {
+        s << "<action><name>" << a.name << "</name><argumentList>\n";
+        for (const auto &arg : a.args) {
+            s << "<argument><name>" << arg.name << "</name><direction>"
+              << (arg.out ? "out" : "in") << "</direction>"
+              << "<relatedStateVariable>" << arg.var
+              << "</relatedStateVariable></argument>\n";
+        }
+        s << "</argumentList></action>\n";
+    }
+    s << "</actionList>\n<serviceStateTable>\n";
+    for (const auto &v : vars) {
+        s << "<stateVariable sendEvents=\"" << (v.evented ? "yes" : "no")
+          << "\"><name>" << v.name << "</name><dataType>" << v.type
+          << "</dataType>";
+        if (!v.allowed.empty()) {
+            s << "<allowedValueList>";
+            for (const auto &value : v.allowed)
+                s << "<allowedValue>" << value << "</allowedValue>";
+            s << "</allowedValueList>";
+        }
+        s << "</stateVariable>\n";
+    }
+    s << "</serviceStateTable>\n</scpd>\n";
+    return s.str();
+}
+
+std::string avTransport(const Options &opts)
+{
+    std::vector<Action> actions = {
+        {"SetAVTransportURI", {instanceArg,
+                               {"CurrentURI", false, "AVTransportURI"},
+                               {"CurrentURIMetaData", false, "AVTransportURIMetaData"}}},
+        {"GetMediaInfo", {instanceArg,
+                          {"NrTracks", true, "NumberOfTracks"},
+                          {"MediaDuration", true, "CurrentMediaDuration"},
+                          {"CurrentURI", true, "AVTransportURI"},
+                          {"CurrentURIMetaData", true, "AVTransportURIMetaData"},
+                          {"NextURI", true, "NextAVTransportURI"},
+                          {"NextURIMetaData", true, "NextAVTransportURIMetaData"},
+                          {"PlayMedium", true, "PlaybackStorageMedium"},
+                          {"RecordMedium", true, "RecordStorageMedium"},
+                          {"WriteStatus", true, "RecordMediumWriteStatus"}}},
+        {"GetTransportInfo", {instanceArg,
+                              {"CurrentTransportState", true, "TransportState"},
+                              {"CurrentTransportStatus", true, "TransportStatus"},
+                              {"CurrentSpeed", true, "TransportPlaySpeed"}}},
+        {"GetPositionInfo", {instanceArg,
+                             {"Track", true, "CurrentTrack"},
+                             {"TrackDuration", true, "CurrentTrackDuration"},
+                             {"TrackMetaData", true, "CurrentTrackMetaData"},
+                             {"TrackURI", true, "CurrentTrackURI"},
+                             {"RelTime", true, "RelativeTimePosition"},
+                             {"AbsTime", true, "AbsoluteTimePosition"},
+                             {"RelCount", true, "RelativeCounterPosition"},
+                             {"AbsCount", true, "AbsoluteCounterPosition"}}},
+        {"GetDeviceCapabilities", {instanceArg,
+                                   {"PlayMedia", true, "PossiblePlaybackStorageMedia"},
+                                   {"RecMedia", true, "PossibleRecordStorageMedia"},
+                                   {"RecQualityModes", true, "PossibleRecordQualityModes"}}},
+        {"GetTransportSettings", {instanceArg,
+                                  {"PlayMode", true, "CurrentPlayMode"},
+                                  {"RecQualityMode", true, "CurrentRecordQualityMode"}}},
+        {"GetCurrentTransportActions", {instanceArg,
+                                        {"Actions", true, "CurrentTransportActions"}}},
+        {"Stop", {instanceArg}},
+        {"Play", {instanceArg, {"Speed", false, "TransportPlaySpeed"}}},
+        {"Pause", {instanceArg}},
+        {"Seek", {instanceArg,
+                  {"Unit", false, "A_ARG_TYPE_SeekMode"},
+                  {"Target", false, "A_ARG_TYPE_SeekTarget"}}},
+        {"Next", {instanceArg}},
+        {"Previous", {instanceArg}}
+    };
+
+    if (!opts.quirk("nonext")) {
+        actions.push_back({"SetNextAVTransportURI", {instanceArg,
+                           {"NextURI", false, "NextAVTransportURI"},
+                           {"NextURIMetaData", false, "NextAVTransportURIMetaData"}}});
+    }
+
+    std::vector<std::string> seekModes = {"ABS_TIME", "TRACK_NR"};
+    if (!opts.quirk("norel"))
+        seekModes.insert(seekModes.begin(), "REL_TIME");
+
+    std::vector<Var> vars = {
+        {"LastChange", "string", true, {}},
+        {"TransportState", "string", false,
+         {"STOPPED", "PLAYING", "PAUSED_PLAYBACK", "TRANSITIONING",
+          "NO_MEDIA_PRESENT"}},
+        {"TransportStatus", "string", false, {"OK", "ERROR_OCCURRED"}},
+        {"TransportPlaySpeed", "string", false, {"1"}},
+        {"NumberOfTracks", "ui4", false, {}},
+        {"CurrentMediaDuration", "string", false, {}},
+        {"AVTransportURI", "string", false, {}},
+        {"AVTransportURIMetaData", "string", false, {}},
+        {"NextAVTransportURI", "string", false, {}},
+        {"NextAVTransportURIMetaData", "string", false, {}},
+        {"PlaybackStorageMedium", "string", false, {}},
+        {"RecordStorageMedium", "string", false, {}},
+        {"RecordMediumWriteStatus", "string", false, {}},
+        {"CurrentTrack", "ui4", false, {}},
+        {"CurrentTrackDuration", "string", false, {}},
+        {"CurrentTrackMetaData", "string", false, {}},
+        {"CurrentTrackURI", "string", false, {}},
+        {"RelativeTimePosition", "string", false, {}},
+        {"AbsoluteTimePosition", "string", false, {}},
+        {"RelativeCounterPosition", "i4", false, {}},
+        {"AbsoluteCounterPosition", "i4", false, {}},
+        {"PossiblePlaybackStorageMedia", "string", false, {}},
+        {"PossibleRecordStorageMedia", "string", false, {}},
+        {"PossibleRecordQualityModes", "string", false, {}},
+        {"CurrentPlayMode", "string", false, {"NORMAL"}},
+        {"CurrentRecordQualityMode", "string", false, {}},
+        {"CurrentTransportActions", "string", false, {}},
+        {"A_ARG_TYPE_SeekMode", "string", false, seekModes},
+        {"A_ARG_TYPE_SeekTarget", "string", false, {}},
+        {"A_ARG_TYPE_InstanceID", "ui4", false, {}}
+    };
+
+    return build(actions, vars);
+}
+
+std::string renderingControl()
+{
+    const Arg channelArg = {"Channel", false, "A_ARG_TYPE_Channel"};
+
+    std::vector<Action> actions = {
+        {"GetMute", {instanceArg, channelArg, {"CurrentMute", true, "Mute"}}},
+        {"SetMute", {instanceArg, channelArg, {"DesiredMute", false, "Mute"}}},
+        {"GetVolume", {instanceArg, channelArg, {"CurrentVolume", true, "Volume"}}},
+        {"SetVolume", {instanceArg, channelArg, {"DesiredVolume", false, "Volume"}}}
+    };
+
+    std::vector<Var> vars = {
+        {"LastChange", "string", true, {}},
+        {"Mute", "boolean", false, {}},
+        {"Volume", "ui2", false, {}},
+        {"A_ARG_TYPE_Channel", "string", false, {"Master"}},
+        {"A_ARG_TYPE_InstanceID", "ui4", false, {}}
+    };
+
+    return build(actions, vars);
+}
+
+std::string connectionManager()
+{
+    std::vector<Action> actions = {
+        {"GetProtocolInfo", {{"Source", true, "SourceProtocolInfo"},
+                             {"Sink", true, "SinkProtocolInfo"}}},
+        {"GetCurrentConnectionIDs", {{"ConnectionIDs", true, "CurrentConnectionIDs"}}},
+        {"GetCurrentConnectionInfo", {{"ConnectionID", false, "A_ARG_TYPE_ConnectionID"},
+                                      {"RcsID", true, "A_ARG_TYPE_RcsID"},
+                                      {"AVTransportID", true, "A_ARG_TYPE_AVTransportID"},
+                                      {"ProtocolInfo", true, "A_ARG_TYPE_ProtocolInfo"},
+                                      {"PeerConnectionManager", true, "A_ARG_TYPE_ConnectionManager"},
+                                      {"PeerConnectionID", true, "A_ARG_TYPE_ConnectionID"},
+                                      {"Direction", true, "A_ARG_TYPE_Direction"},
+                                      {"Status", true, "A_ARG_TYPE_ConnectionStatus"}}}
+    };
+
+    std::vector<Var> vars = {
+        {"SourceProtocolInfo", "string", true, {}},
+        {"SinkProtocolInfo", "string", true, {}},
+        {"CurrentConnectionIDs", "string", true, {}},
+        {"A_ARG_TYPE_ConnectionStatus", "string", false,
+         {"OK", "ContentFormatMismatch", "InsufficientBandwidth",
+          "UnreliableChannel", "Unknown"}},
+        {"A_ARG_TYPE_ConnectionManager", "string", false, {}},
+        {"A_ARG_TYPE_Direction", "string", false, {"Input", "Output"}},
+        {"A_ARG_TYPE_ProtocolInfo", "string", false, {}},
+        {"A_ARG_TYPE_ConnectionID", "i4", false, {}},
+        {"A_ARG_TYPE_AVTransportID", "i4", false, {}},
+        {"A_ARG_TYPE_RcsID", "i4", false, {}}
+    };
+
+    return build(actions, vars);
+}
+
+std::string service(const std::string &type, const std::string &id,
+                    const std::string &name)
+{
+    return "<service><serviceType>" + type + "</serviceType>"
+           "<serviceId>" + id + "</serviceId>"
+           "<SCPDURL>" + dir + "/" + name + ".xml</SCPDURL>"
+           "<controlURL>/ctl/" + name + "</controlURL>"
+           "<eventSubURL>/evt/" + name + "</eventSubURL></service>\n";
+}
+
+std::string description(const Options &opts, const std::string &udn)
+{
+    return "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
+           "<root xmlns=\"urn:schemas-upnp-org:device-1-0\">\n"
+           "<specVersion><major>1</major><minor>0</minor></specVersion>\n"
+           "<device>\n"
+           "<deviceType>urn:schemas-upnp-org:device:MediaRenderer:1</deviceType>\n"
+           "<friendlyName>" + UPnPP::SoapHelp::xmlQuote(opts.name) + "</friendlyName>\n"
+           "<manufacturer>Jupii</manufacturer>\n"
+           "<modelName>Renderer Emulator</modelName>\n"
+           "<UDN>" + udn + "</UDN>\n"
+           "<serviceList>\n" +
+           service(Scpd::avtType, Scpd::avtId, "AVTransport") +
+           service(Scpd::rcType, Scpd::rcId, "RenderingControl") +
+           service(Scpd::cmType, Scpd::cmId, "ConnectionManager") +
+           "</serviceList>\n"
+           "</device>\n"
+           "</root>\n";
+}
+}
+
+namespace Scpd {
+std::unordered_map<std::string, UPnPProvider::VDirContent>
+files(const Options &opts, const std::string &udn)
+{
+    const std::string xml = "application/xml";
+    std::unordered_map<std::string, UPnPProvider::VDirContent> f;
+    f.emplace(dir + "/description.xml",
+              UPnPProvider::VDirContent(description(opts, udn), xml));
+    f.emplace(dir + "/AVTransport.xml",
+              UPnPProvider::VDirContent(avTransport(opts), xml));
+    f.emplace(dir + "/RenderingControl.xml",
+              UPnPProvider::VDirContent(renderingControl(), xml));
+    f.emplace(dir + "/ConnectionManager.xml",
+              UPnPProvider::VDirContent(connectionManager(), xml));
+    return f;
+}
+}
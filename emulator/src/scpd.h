@@ -0,0 +1,32 @@
+/* Copyright (C) 2017 Michal Kosciesza <michal@mkiol.net>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef SCPD_H
+#define SCPD_H
+
+#include <string>
+#include <unordered_map>
+
+#include <libupnpp/device/device.hxx>
+
+#include "options.h"
+
+// Description documents served by the emulator. Service descriptions are
+// built from tables, so quirks can drop actions or allowed values.
+namespace Scpd {
+extern const std::string avtType;
+extern const std::string avtId;
+extern const std::string rcType;
+extern const std::string rcId;
+extern const std::string cmType;
+extern const std::string cmId;
+
+std::unordered_map<std::string, UPnPProvider::VDirContent>
+files(const Options &opts, const std::string &udn);
+}
+
+#endif // SCPD_H
@@ -116,6 +116,10 @@ typedef enum priority {
 /*! default max jobs used TPAttrInit */
 #define DEFAULT_MAX_JOBS_TOTAL 100
 
+/*! default number of yields an idle worker spins before sleeping, used by
+ * TPAttrInit */
+#define DEFAULT_SPIN_COUNT 50
+
 /*!
  * \brief Statistics.
  *
@@ -157,6 +161,9 @@ typedef struct THREADPOOLATTR
 	int starvationTime;
 	/*! scheduling policy to use. */
 	PolicyType schedPolicy;
+	/*! number of times an idle worker yields, checking the queues, before
+	 * it waits on the condition variable. Only one worker spins at a time. */
+	int spinCount;
 } ThreadPoolAttr;
 
 /*! Internal ThreadPool Job. */
@@ -194,6 +201,36 @@ typedef struct TPOOLSTATS
 	int currentJobsMQ;
 } ThreadPoolStats;
 
+/*!
+ * \brief Counters that are always kept, independently of STATS.
+ *
+ * They are updated while the pool mutex is held anyway, so keeping them
+ * costs a few additions per job.
+ */
+typedef struct TPOOLCOUNTERS
+{
+	/*! jobs accepted by ThreadPoolAdd. */
+	unsigned long jobsQueued;
+	/*! jobs rejected because maxJobsTotal was reached. */
+	unsigned long jobsRejected;
+	/*! jobs taken from the queues by workers. */
+	unsigned long jobsStarted;
+	/*! jobs finished by workers (persistent jobs are not counted). */
+	unsigned long jobsRun;
+	/*! jobs waiting in the queues now. */
+	int depth;
+	/*! highest number of jobs waiting in the queues. */
+	int maxDepth;
+	/*! total time jobs waited in the queues, in microseconds. */
+	double totalWaitTime;
+	/*! total time jobs were running, in microseconds. */
+	double totalRunTime;
+	/*! condition variable signals sent to wake up idle workers. */
+	unsigned long wakeups;
+	/*! jobs picked up by a spinning worker, without sleeping. */
+	unsigned long spinHits;
+} ThreadPoolCounters;
+
 /*!
  * \brief A thread pool similar to the thread pool in the UPnP SDK.
  *
@@ -229,6 +266,12 @@ typedef struct THREADPOOL
 	int busyThreads;
 	/*! number of persistent threads */
 	int persistentThreads;
+	/*! number of idle threads waiting on condition */
+	int waitingThreads;
+	/*! number of idle threads spinning before they wait */
+	int spinningThreads;
+	/*! number of signals sent to waiting threads that have not woken up yet */
+	int pendingWakeups;
 	/*! free list of jobs */
 	FreeList jobFreeList;
 	/*! low priority job Q */
@@ -243,6 +286,8 @@ typedef struct THREADPOOL
 	ThreadPoolAttr attr;
 	/*! statistics */
 	ThreadPoolStats stats;
+	/*! always kept counters */
+	ThreadPoolCounters counters;
 } ThreadPool;
 
 /*!
@@ -494,6 +539,29 @@ int TPAttrSetMaxJobsTotal(
 	/*! maximum number of jobs. */
 	int maxJobsTotal);
 
+/*!
+ * \brief Sets the number of yields an idle worker spins before sleeping.
+ *
+ * \return Always returns 0.
+ */
+int TPAttrSetSpinCount(
+	/*! must be valid thread pool attributes. */
+	ThreadPoolAttr *attr,
+	/*! 0 disables spinning. */
+	int spinCount);
+
+/*!
+ * \brief Returns counters of the thread pool. Unlike ThreadPoolGetStats it
+ * doesn't depend on STATS.
+ *
+ * \return 0 on success, EINVAL if a parameter is NULL.
+ */
+EXPORT_SPEC int ThreadPoolGetCounters(
+	/*! Valid initialized threadpool. */
+	ThreadPool *tp,
+	/*! Valid counters, out parameter. */
+	ThreadPoolCounters *counters);
+
 /*!
  * \brief Returns various statistics about the thread pool.
  *
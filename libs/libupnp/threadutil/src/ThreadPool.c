@@ -43,6 +43,7 @@
 #include "FreeList.h"
 
 #include <assert.h>
+#include <sched.h>	/* for sched_yield() */
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>	/* for memset()*/
@@ -73,6 +74,23 @@ static long DiffMillis(
 	return (long)temp;
 }
 
+/*!
+ * \brief Returns the difference in microseconds between two timeval structures.
+ *
+ * \internal
+ *
+ * \return The difference in microseconds, time1-time2.
+ */
+static double DiffMicros(
+	/*! . */
+	struct timeval *time1,
+	/*! . */
+	struct timeval *time2)
+{
+	return ((double)time1->tv_sec - (double)time2->tv_sec) * 1000000.0 +
+		((double)time1->tv_usec - (double)time2->tv_usec);
+}
+
 #ifdef STATS
 /*!
  * \brief Initializes the statistics structure.
@@ -434,6 +452,65 @@ static void SetSeed(void)
 #endif
 }
 
+/*!
+ * \brief Wakes up one waiting worker, unless the queued jobs are already
+ * covered by spinning workers and by signals sent earlier.
+ *
+ * Waking a worker for every added job makes all of them contend for the
+ * mutex during bursts, while only a few find a job to run.
+ *
+ * tp->mutex must be locked.
+ *
+ * \internal
+ */
+static void SignalWorker(
+	/*! . */
+	ThreadPool *tp)
+{
+	if (tp->waitingThreads > tp->pendingWakeups &&
+	    tp->counters.depth > tp->spinningThreads + tp->pendingWakeups) {
+		tp->pendingWakeups++;
+		tp->counters.wakeups++;
+		ithread_cond_signal(&tp->condition);
+	}
+}
+
+/*!
+ * \brief Lets an idle worker yield the CPU for a while, checking the queues
+ * without the mutex, before it goes to sleep on the condition variable.
+ *
+ * tp->mutex must be locked. It is released while spinning and locked again
+ * before return.
+ *
+ * \internal
+ *
+ * \return 1 if a job or shutdown was noticed, 0 otherwise.
+ */
+static int SpinForJob(
+	/*! . */
+	ThreadPool *tp)
+{
+	int spinCount = tp->attr.spinCount;
+	int found = 0;
+	int i;
+
+	tp->spinningThreads++;
+	ithread_mutex_unlock(&tp->mutex);
+	for (i = 0; i < spinCount; ++i) {
+		/* Racy read is fine, the queues are checked again under mutex */
+		if (*(volatile int *)&tp->counters.depth > 0 ||
+		    *(volatile int *)&tp->shutdown) {
+			found = 1;
+			break;
+		}
+		sched_yield();
+	}
+	ithread_mutex_lock(&tp->mutex);
+	tp->spinningThreads--;
+
+	return found;
+}
+
 /*!
  * \brief Implements a thread pool worker. Worker waits for a job to become
  * available. Worker picks up persistent jobs first, high priority,
@@ -453,8 +530,11 @@ static void *WorkerThread(
 	ListNode *head = NULL;
 
 	struct timespec timeout;
+	struct timeval jobStart;
+	struct timeval jobEnd;
 	int retCode = 0;
 	int persistent = -1;
+	int spin = 0;
 	ThreadPool *tp = (ThreadPool *) arg;
 
 	ithread_initialize_thread();
@@ -472,10 +552,16 @@ static void *WorkerThread(
 		ithread_mutex_lock(&tp->mutex);
 		if (job) {
 			tp->busyThreads--;
+			if (persistent == 0) {
+				tp->counters.jobsRun++;
+				tp->counters.totalRunTime +=
+					DiffMicros(&jobEnd, &jobStart);
+			}
 			FreeThreadPoolJob(tp, job);
 			job = NULL;
 		}
 		retCode = 0;
+		spin = 1;
 		tp->stats.idleThreads++;
 		tp->stats.totalWorkTime += (double)StatsTime(NULL) - (double)start;
 		StatsTime(&start);
@@ -502,11 +588,23 @@ static void *WorkerThread(
 				tp->stats.idleThreads--;
 				goto exit_function;
 			}
+			/* Jobs often come in bursts, so spin once before sleeping */
+			if (spin && tp->attr.spinCount > 0 &&
+			    tp->spinningThreads == 0) {
+				spin = 0;
+				if (SpinForJob(tp))
+					tp->counters.spinHits++;
+				continue;
+			}
 			SetRelTimeout(&timeout, tp->attr.maxIdleTime);
 
 			/* wait for a job up to the specified max time */
+			tp->waitingThreads++;
 			retCode = ithread_cond_timedwait(
 				&tp->condition, &tp->mutex, &timeout);
+			tp->waitingThreads--;
+			if (tp->pendingWakeups > 0)
+				tp->pendingWakeups--;
 		}
 		tp->stats.idleThreads--;
 		/* idle time */
@@ -562,6 +660,13 @@ static void *WorkerThread(
 					tp->stats.workerThreads--;
 					goto exit_function;
 				}
+				tp->counters.depth--;
+				tp->counters.jobsStarted++;
+				gettimeofday(&jobStart, NULL);
+				tp->counters.totalWaitTime +=
+					DiffMicros(&jobStart, &job->requestTime);
+				/* more jobs may be left than workers on the way */
+				SignalWorker(tp);
 			}
 		}
 
@@ -574,6 +679,7 @@ static void *WorkerThread(
 		}
 		/* run the job */
 		job->func(job->arg);
+		gettimeofday(&jobEnd, NULL);
 		/* return to Normal */
 		SetPriority(DEFAULT_PRIORITY);
 	}
@@ -734,6 +840,7 @@ int ThreadPoolInit(ThreadPool *tp, ThreadPoolAttr *attr)
 	retCode += FreeListInit(
 		&tp->jobFreeList, sizeof(ThreadPoolJob), JOBFREELISTSIZE);
 	StatsInit(&tp->stats);
+	memset(&tp->counters, 0, sizeof(tp->counters));
 	retCode += ListInit(&tp->highJobQ, CmpThreadPoolJob, NULL);
 	retCode += ListInit(&tp->medJobQ, CmpThreadPoolJob, NULL);
 	retCode += ListInit(&tp->lowJobQ, CmpThreadPoolJob, NULL);
@@ -746,6 +853,9 @@ int ThreadPoolInit(ThreadPool *tp, ThreadPoolAttr *attr)
 		tp->totalThreads = 0;
 		tp->busyThreads = 0;
 		tp->persistentThreads = 0;
+		tp->waitingThreads = 0;
+		tp->spinningThreads = 0;
+		tp->pendingWakeups = 0;
 		tp->pendingWorkerThreadStart = 0;
 		for (i = 0; i < tp->attr.minThreads; ++i) {
 			retCode = CreateWorker(tp);
@@ -828,6 +938,7 @@ int ThreadPoolAdd(ThreadPool *tp, ThreadPoolJob *job, int *jobId)
 	totalJobs = tp->highJobQ.size + tp->lowJobQ.size + tp->medJobQ.size;
 	if (totalJobs >= tp->attr.maxJobsTotal) {
 		fprintf(stderr, "total jobs = %ld, too many jobs", totalJobs);
+		tp->counters.jobsRejected++;
 		goto exit_function;
 	}
 	if (!jobId)
@@ -849,11 +960,17 @@ int ThreadPoolAdd(ThreadPool *tp, ThreadPoolJob *job, int *jobId)
 		if (ListAddTail(&tp->lowJobQ, temp))
 			rc = 0;
 	}
+	if (rc == 0) {
+		tp->counters.jobsQueued++;
+		tp->counters.depth++;
+		if (tp->counters.depth > tp->counters.maxDepth)
+			tp->counters.maxDepth = tp->counters.depth;
+	}
 	/* AddWorker if appropriate */
 	AddWorker(tp);
 	/* Notify a waiting thread */
 	if (rc == 0)
-		ithread_cond_signal(&tp->condition);
+		SignalWorker(tp);
 	else
 		FreeThreadPoolJob(tp, temp);
 	*jobId = tp->lastJobId++;
@@ -885,6 +1002,7 @@ int ThreadPoolRemove(ThreadPool *tp, int jobId, ThreadPoolJob *out)
 		*out = *temp;
 		ListDelNode(&tp->highJobQ, tempNode, 0);
 		FreeThreadPoolJob(tp, temp);
+		tp->counters.depth--;
 		ret = 0;
 		goto exit_function;
 	}
@@ -895,6 +1013,7 @@ int ThreadPoolRemove(ThreadPool *tp, int jobId, ThreadPoolJob *out)
 		*out = *temp;
 		ListDelNode(&tp->medJobQ, tempNode, 0);
 		FreeThreadPoolJob(tp, temp);
+		tp->counters.depth--;
 		ret = 0;
 		goto exit_function;
 	}
@@ -904,6 +1023,7 @@ int ThreadPoolRemove(ThreadPool *tp, int jobId, ThreadPoolJob *out)
 		*out = *temp;
 		ListDelNode(&tp->lowJobQ, tempNode, 0);
 		FreeThreadPoolJob(tp, temp);
+		tp->counters.depth--;
 		ret = 0;
 		goto exit_function;
 	}
@@ -1064,6 +1184,7 @@ int TPAttrInit(ThreadPoolAttr *attr)
 	attr->schedPolicy    = DEFAULT_POLICY;
 	attr->starvationTime = DEFAULT_STARVATION_TIME;
 	attr->maxJobsTotal   = DEFAULT_MAX_JOBS_TOTAL;
+	attr->spinCount      = DEFAULT_SPIN_COUNT;
 
 	return 0;
 }
@@ -1176,6 +1297,32 @@ int TPAttrSetMaxJobsTotal(ThreadPoolAttr *attr, int maxJobsTotal)
 	return 0;
 }
 
+int TPAttrSetSpinCount(ThreadPoolAttr *attr, int spinCount)
+{
+	if (!attr)
+		return EINVAL;
+	attr->spinCount = spinCount;
+
+	return 0;
+}
+
+int ThreadPoolGetCounters(ThreadPool *tp, ThreadPoolCounters *counters)
+{
+	if (tp == NULL || counters == NULL)
+		return EINVAL;
+	/* if not shutdown then acquire mutex */
+	if (!tp->shutdown)
+		ithread_mutex_lock(&tp->mutex);
+
+	*counters = tp->counters;
+
+	/* if not shutdown then release mutex */
+	if (!tp->shutdown)
+		ithread_mutex_unlock(&tp->mutex);
+
+	return 0;
+}
+
 #ifdef STATS
 void ThreadPoolPrintStats(ThreadPoolStats *stats)
 {
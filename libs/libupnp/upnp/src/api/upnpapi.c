@@ -643,6 +643,7 @@ int UpnpFinish(void)
 	}
 #endif
 	TimerThreadShutdown(&gTimerThread);
+	http_CloseKeepAliveConnections();
 #if EXCLUDE_MINISERVER == 0
 	StopMiniServer();
 #endif
@@ -1843,6 +1844,31 @@ int UpnpSearchAsyncWithSsdpIP(
     return UPNP_E_SUCCESS;
 
 }
+
+int UpnpSetSsdpFilter(
+	const char **Targets,
+	int Count,
+	int MaxRate,
+	int Dedupe)
+{
+	if (UpnpSdkInit != 1)
+		return UPNP_E_FINISH;
+
+	if (Count < 0 || (Count > 0 && Targets == NULL) || MaxRate < 0)
+		return UPNP_E_INVALID_PARAM;
+
+	return ssdp_SetFilter(Targets, Count, MaxRate, Dedupe);
+}
+
+void UpnpGetSsdpFilterStats(
+	unsigned long *Processed,
+	unsigned long *DroppedType,
+	unsigned long *DroppedRate,
+	unsigned long *DroppedDuplicate)
+{
+	ssdp_GetFilterStats(Processed, DroppedType, DroppedRate,
+		DroppedDuplicate);
+}
 #endif /* INCLUDE_CLIENT_APIS */
 #endif
 
@@ -2783,7 +2809,10 @@ int UpnpSendActionAsync(
 
     TPJobSetPriority( &job, MED_PRIORITY );
     if (ThreadPoolAdd( &gSendThreadPool, &job, NULL ) != 0) {
+	/* The callback won't ever run, tell the caller */
+	ixmlDocument_free(Param->Act);
 	free(Param);
+	return UPNP_E_OUTOF_MEMORY;
     }
 
     UpnpPrintf(UPNP_ALL, API, __FILE__, __LINE__,
@@ -4353,4 +4382,83 @@ int UpnpSetMaxContentLength(size_t contentLength)
 	return errCode;
 }
 
+int UpnpSetSoapKeepAlive(const char *Url, int Enable)
+{
+	uri_type url;
+
+	if (UpnpSdkInit != 1)
+		return UPNP_E_FINISH;
+
+	if (Url == NULL) {
+		http_SetKeepAlive(NULL, Enable);
+		return UPNP_E_SUCCESS;
+	}
+
+	if (http_FixStrUrl(Url, strlen(Url), &url) != 0)
+		return UPNP_E_INVALID_URL;
+
+	http_SetKeepAlive(&url.hostport.IPaddress, Enable);
+
+	return UPNP_E_SUCCESS;
+}
+
+void UpnpGetSoapKeepAliveStats(
+	unsigned long *Opened,
+	unsigned long *Reused,
+	unsigned long *Retried)
+{
+	http_GetKeepAliveStats(Opened, Reused, Retried);
+}
+
+int UpnpGetThreadPoolStats(
+	Upnp_ThreadPool Pool,
+	unsigned long *Queued,
+	unsigned long *Rejected,
+	unsigned long *Depth,
+	unsigned long *MaxDepth,
+	unsigned long *AvgWait,
+	unsigned long *AvgRun)
+{
+	ThreadPool *tp = NULL;
+	ThreadPoolCounters counters;
+
+	if (UpnpSdkInit != 1)
+		return UPNP_E_FINISH;
+
+	switch (Pool) {
+	case UPNP_RECV_THREADPOOL:
+		tp = &gRecvThreadPool;
+		break;
+	case UPNP_SEND_THREADPOOL:
+		tp = &gSendThreadPool;
+		break;
+	case UPNP_MINISERVER_THREADPOOL:
+		tp = &gMiniServerThreadPool;
+		break;
+	default:
+		return UPNP_E_INVALID_PARAM;
+	}
+
+	if (ThreadPoolGetCounters(tp, &counters) != 0)
+		return UPNP_E_INVALID_PARAM;
+
+	if (Queued)
+		*Queued = counters.jobsQueued;
+	if (Rejected)
+		*Rejected = counters.jobsRejected;
+	if (Depth)
+		*Depth = (unsigned long)counters.depth;
+	if (MaxDepth)
+		*MaxDepth = (unsigned long)counters.maxDepth;
+	if (AvgWait)
+		*AvgWait = counters.jobsStarted > 0 ? (unsigned long)
+			(counters.totalWaitTime /
+			 (double)counters.jobsStarted) : 0;
+	if (AvgRun)
+		*AvgRun = counters.jobsRun > 0 ? (unsigned long)
+			(counters.totalRunTime / (double)counters.jobsRun) : 0;
+
+	return UPNP_E_SUCCESS;
+}
+
 /* @} UPnPAPI */
@@ -65,6 +65,14 @@
 #include <string.h>
 #include <sys/types.h>
 
+#ifdef MINISERVER_USE_EPOLL
+	#include <fcntl.h>
+	#include <sys/epoll.h>
+
+	/*! Max number of events returned by one epoll_wait(). */
+	#define MINISERVER_EPOLL_EVENTS 16
+#endif /* MINISERVER_USE_EPOLL */
+
 /*! . */
 #define APPLICATION_LISTENING_PORT 49152
 
@@ -328,7 +336,13 @@ static void ssdp_read(SOCKET rsock, fd_set *set)
 	}
 }
 
-static int receive_from_stopSock(SOCKET ssock, fd_set *set)
+/*!
+ * \brief Reads one datagram from the stop socket.
+ *
+ * \return 1 if it was shutdown request, 0 if it was something else, -1 if
+ * nothing was read.
+ */
+static int read_stopSock(SOCKET ssock, int flags)
 {
 	ssize_t byteReceived;
 	socklen_t clientLen;
@@ -336,39 +350,45 @@ static int receive_from_stopSock(SOCKET ssock, fd_set *set)
 	char requestBuf[256];
 	char buf_ntop[INET6_ADDRSTRLEN];
 
-	if (FD_ISSET(ssock, set)) {
-		clientLen = sizeof(clientAddr);
-		memset((char *)&clientAddr, 0, sizeof(clientAddr));
-		byteReceived = recvfrom(ssock, requestBuf,
-			(size_t)25, 0, (struct sockaddr *)&clientAddr, &clientLen);
-		if (byteReceived > 0) {
-			requestBuf[byteReceived] = '\0';
-			inet_ntop(AF_INET,
-				&((struct sockaddr_in*)&clientAddr)->sin_addr,
-				buf_ntop, sizeof(buf_ntop));
-			UpnpPrintf( UPNP_INFO, MSERV, __FILE__, __LINE__,
-				"Received response: %s From host %s \n",
-				requestBuf, buf_ntop );
-			UpnpPrintf( UPNP_PACKET, MSERV, __FILE__, __LINE__,
-				"Received multicast packet: \n %s\n",
-				requestBuf);
-			if (NULL != strstr(requestBuf, "ShutDown")) {
-				return 1;
-			}
+	clientLen = sizeof(clientAddr);
+	memset((char *)&clientAddr, 0, sizeof(clientAddr));
+	byteReceived = recvfrom(ssock, requestBuf,
+		(size_t)25, flags, (struct sockaddr *)&clientAddr, &clientLen);
+	if (byteReceived < 0)
+		return -1;
+	if (byteReceived > 0) {
+		requestBuf[byteReceived] = '\0';
+		inet_ntop(AF_INET,
+			&((struct sockaddr_in*)&clientAddr)->sin_addr,
+			buf_ntop, sizeof(buf_ntop));
+		UpnpPrintf( UPNP_INFO, MSERV, __FILE__, __LINE__,
+			"Received response: %s From host %s \n",
+			requestBuf, buf_ntop );
+		UpnpPrintf( UPNP_PACKET, MSERV, __FILE__, __LINE__,
+			"Received multicast packet: \n %s\n",
+			requestBuf);
+		if (NULL != strstr(requestBuf, "ShutDown")) {
+			return 1;
 		}
 	}
 
 	return 0;
 }
 
+static int receive_from_stopSock(SOCKET ssock, fd_set *set)
+{
+	if (FD_ISSET(ssock, set)) {
+		return read_stopSock(ssock, 0) == 1;
+	}
+
+	return 0;
+}
+
 /*!
- * \brief Run the miniserver.
- *
- * The MiniServer accepts a new request and schedules a thread to handle the
- * new request. Checks for socket state and invokes appropriate read and
- * shutdown actions for the Miniserver and SSDP sockets.
+ * \brief Waits for sockets with select() until shutdown request is received
+ * on the stop socket.
  */
-static void RunMiniServer(
+static void RunMiniServerSelect(
 	/*! [in] Socket Array. */
 	MiniServerSockArray *miniSock)
 {
@@ -392,7 +412,6 @@ static void RunMiniServer(
 #endif /* INCLUDE_CLIENT_APIS */
 	++maxMiniSock;
 
-	gMServState = MSERV_RUNNING;
 	while (!stopSock) {
 		FD_ZERO(&rdSet);
 		FD_ZERO(&expSet);
@@ -432,6 +451,191 @@ static void RunMiniServer(
 				miniSock->miniServerStopSock, &rdSet);
 		}
 	}
+}
+
+#ifdef MINISERVER_USE_EPOLL
+/*!
+ * \brief Registers socket for read events.
+ *
+ * \return 0 on success or if socket is not valid, -1 on error.
+ */
+static int epoll_add_if_valid(
+	/*! [in] epoll instance. */
+	int epfd,
+	/*! [in] Socket to register. */
+	SOCKET sock,
+	/*! [in] EPOLLET for edge-triggered events, 0 for level-triggered. */
+	uint32_t trigger)
+{
+	struct epoll_event ev;
+	char errorBuffer[ERROR_BUFFER_LEN];
+
+	if (sock == INVALID_SOCKET)
+		return 0;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN | trigger;
+	ev.data.fd = sock;
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, sock, &ev) == -1) {
+		strerror_r(errno, errorBuffer, ERROR_BUFFER_LEN);
+		UpnpPrintf(UPNP_CRITICAL, MSERV, __FILE__, __LINE__,
+			"Error in epoll_ctl(): %s\n", errorBuffer);
+		return -1;
+	}
+
+	return 0;
+}
+
+/*!
+ * \brief Accepts all pending connections of non-blocking listening socket.
+ */
+static void web_server_accept_all(SOCKET lsock)
+{
+#ifdef INTERNAL_WEB_SERVER
+	SOCKET asock;
+	socklen_t clientLen;
+	struct sockaddr_storage clientAddr;
+	char errorBuffer[ERROR_BUFFER_LEN];
+
+	for (;;) {
+		clientLen = sizeof(clientAddr);
+		asock = accept(lsock, (struct sockaddr *)&clientAddr,
+			&clientLen);
+		if (asock != INVALID_SOCKET) {
+			/* accepted socket doesn't inherit O_NONBLOCK on Linux */
+			schedule_request_job(asock,
+				(struct sockaddr *)&clientAddr);
+			continue;
+		}
+		if (errno == EINTR || errno == ECONNABORTED)
+			continue;
+		if (errno != EAGAIN && errno != EWOULDBLOCK) {
+			strerror_r(errno, errorBuffer, ERROR_BUFFER_LEN);
+			UpnpPrintf(UPNP_INFO, MSERV, __FILE__, __LINE__,
+				"miniserver: Error in accept(): %s\n",
+				errorBuffer);
+		}
+		break;
+	}
+#endif /* INTERNAL_WEB_SERVER */
+}
+
+/*!
+ * \brief Waits for sockets with epoll until shutdown request is received on
+ * the stop socket.
+ *
+ * Readiness of datagram sockets is edge-triggered, so every event drains its
+ * socket with MSG_DONTWAIT. Listening sockets are non-blocking and drained
+ * too, but level-triggered: accept() failing with EMFILE or ENFILE leaves
+ * connections in the backlog, and they are reported again.
+ *
+ * \return 0 after shutdown, -1 if epoll couldn't be set up.
+ */
+static int RunMiniServerEpoll(
+	/*! [in] Socket Array. */
+	MiniServerSockArray *miniSock)
+{
+	char errorBuffer[ERROR_BUFFER_LEN];
+	struct epoll_event events[MINISERVER_EPOLL_EVENTS];
+	SOCKET lsocks[2];
+	int epfd;
+	int ret;
+	int i;
+	int stopSock = 0;
+
+	epfd = epoll_create(MINISERVER_EPOLL_EVENTS);
+	if (epfd == -1) {
+		strerror_r(errno, errorBuffer, ERROR_BUFFER_LEN);
+		UpnpPrintf(UPNP_CRITICAL, MSERV, __FILE__, __LINE__,
+			"Error in epoll_create(): %s\n", errorBuffer);
+		return -1;
+	}
+
+	lsocks[0] = miniSock->miniServerSock4;
+	lsocks[1] = miniSock->miniServerSock6;
+	for (i = 0; i < 2; ++i) {
+		if (lsocks[i] != INVALID_SOCKET &&
+		    fcntl(lsocks[i], F_SETFL,
+			  fcntl(lsocks[i], F_GETFL, 0) | O_NONBLOCK) == -1) {
+			close(epfd);
+			return -1;
+		}
+	}
+
+	if (epoll_add_if_valid(epfd, miniSock->miniServerStopSock, EPOLLET) != 0 ||
+	    epoll_add_if_valid(epfd, miniSock->miniServerSock4, 0) != 0 ||
+	    epoll_add_if_valid(epfd, miniSock->miniServerSock6, 0) != 0 ||
+	    epoll_add_if_valid(epfd, miniSock->ssdpSock4, EPOLLET) != 0 ||
+	    epoll_add_if_valid(epfd, miniSock->ssdpSock6, EPOLLET) != 0 ||
+	    epoll_add_if_valid(epfd, miniSock->ssdpSock6UlaGua, EPOLLET) != 0
+#ifdef INCLUDE_CLIENT_APIS
+	    || epoll_add_if_valid(epfd, miniSock->ssdpReqSock4, EPOLLET) != 0
+	    || epoll_add_if_valid(epfd, miniSock->ssdpReqSock6, EPOLLET) != 0
+#endif /* INCLUDE_CLIENT_APIS */
+	    ) {
+		/* select() loop expects blocking listening sockets */
+		for (i = 0; i < 2; ++i) {
+			if (lsocks[i] != INVALID_SOCKET)
+				fcntl(lsocks[i], F_SETFL,
+				      fcntl(lsocks[i], F_GETFL, 0) &
+				      ~O_NONBLOCK);
+		}
+		close(epfd);
+		return -1;
+	}
+
+	while (!stopSock) {
+		ret = epoll_wait(epfd, events, MINISERVER_EPOLL_EVENTS, -1);
+		if (ret == -1) {
+			if (errno != EINTR) {
+				strerror_r(errno, errorBuffer,
+					ERROR_BUFFER_LEN);
+				UpnpPrintf(UPNP_CRITICAL, MSERV, __FILE__,
+					__LINE__, "Error in epoll_wait(): %s\n",
+					errorBuffer);
+			}
+			continue;
+		}
+		for (i = 0; i < ret; ++i) {
+			SOCKET sock = events[i].data.fd;
+			if (sock == miniSock->miniServerSock4 ||
+			    sock == miniSock->miniServerSock6) {
+				web_server_accept_all(sock);
+			} else if (sock == miniSock->miniServerStopSock) {
+				int r;
+				while ((r = read_stopSock(sock,
+						MSG_DONTWAIT)) >= 0) {
+					if (r == 1)
+						stopSock = 1;
+				}
+			} else {
+				drainSSDPSocket(sock);
+			}
+		}
+	}
+
+	close(epfd);
+
+	return 0;
+}
+#endif /* MINISERVER_USE_EPOLL */
+
+/*!
+ * \brief Run the miniserver.
+ *
+ * The MiniServer accepts a new request and schedules a thread to handle the
+ * new request. Checks for socket state and invokes appropriate read and
+ * shutdown actions for the Miniserver and SSDP sockets.
+ */
+static void RunMiniServer(
+	/*! [in] Socket Array. */
+	MiniServerSockArray *miniSock)
+{
+	gMServState = MSERV_RUNNING;
+#ifdef MINISERVER_USE_EPOLL
+	if (RunMiniServerEpoll(miniSock) != 0)
+#endif /* MINISERVER_USE_EPOLL */
+		RunMiniServerSelect(miniSock);
 	/* Close all sockets. */
 	sock_close(miniSock->miniServerSock4);
 	sock_close(miniSock->miniServerSock6);
@@ -55,6 +55,8 @@
 
 #include <assert.h>
 #include <stdarg.h>
+#include <string.h>
+#include <time.h>
 
 #ifdef WIN32
 	#include <malloc.h>
@@ -62,6 +64,10 @@
 	#define snprintf _snprintf
 #else
 	#include <arpa/inet.h>
+	#include <netinet/in.h>
+	#include <netinet/tcp.h>
+	#include <poll.h>
+	#include <strings.h>
 	#include <sys/types.h>
 	#include <sys/time.h>
 	#include <sys/wait.h>
@@ -629,6 +635,416 @@ end_function:
 	return ret_code;
 }
 
+/*
+ * Persistent connections for SOAP control requests.
+ *
+ * Idle connections are kept per device address (IP and port) and reused by
+ * the next request to the same device. A connection idle for longer than
+ * HTTP_CONN_IDLE_TIMEOUT is closed instead of reused.
+ */
+#define HTTP_CONN_POOL_SIZE 16
+#define HTTP_CONN_IDLE_TIMEOUT 15
+#define HTTP_KEEPALIVE_OFF_SIZE 16
+
+typedef struct {
+	int used;
+	SOCKET sock;
+	struct sockaddr_storage addr;
+	time_t last_used;
+} http_conn_t;
+
+static http_conn_t gConnPool[HTTP_CONN_POOL_SIZE];
+static struct sockaddr_storage gKeepAliveOff[HTTP_KEEPALIVE_OFF_SIZE];
+static int gKeepAliveOffCount = 0;
+static int gKeepAliveEnabled = 1;
+static unsigned long gConnOpened = 0;
+static unsigned long gConnReused = 0;
+static unsigned long gConnRetried = 0;
+static ithread_mutex_t gConnPoolMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static int sockaddr_equal(
+	const struct sockaddr_storage *a,
+	const struct sockaddr_storage *b)
+{
+	if (a->ss_family != b->ss_family)
+		return FALSE;
+
+	if (a->ss_family == AF_INET6) {
+		const struct sockaddr_in6 *a6 = (const struct sockaddr_in6 *)a;
+		const struct sockaddr_in6 *b6 = (const struct sockaddr_in6 *)b;
+		return a6->sin6_port == b6->sin6_port &&
+			memcmp(&a6->sin6_addr, &b6->sin6_addr,
+				sizeof(a6->sin6_addr)) == 0;
+	} else {
+		const struct sockaddr_in *a4 = (const struct sockaddr_in *)a;
+		const struct sockaddr_in *b4 = (const struct sockaddr_in *)b;
+		return a4->sin_port == b4->sin_port &&
+			a4->sin_addr.s_addr == b4->sin_addr.s_addr;
+	}
+}
+
+/* Must be called with gConnPoolMutex locked. */
+static void conn_pool_release(http_conn_t *conn)
+{
+	SOCKINFO info;
+
+	sock_init(&info, conn->sock);
+	sock_destroy(&info, SD_BOTH);
+	conn->used = FALSE;
+	conn->sock = INVALID_SOCKET;
+}
+
+/*
+ * Waits until socket is readable, closed or failed. Negative timeout_ms
+ * waits forever. Returns 1 if so, 0 on timeout and -1 on error.
+ */
+static int conn_wait_readable(SOCKET sock, int timeout_ms)
+{
+#ifdef WIN32
+	/* fd_set of winsock is an array of sockets, not a bitmap */
+	fd_set readSet;
+	struct timeval timeout;
+
+	FD_ZERO(&readSet);
+	FD_SET(sock, &readSet);
+	timeout.tv_sec = timeout_ms / 1000;
+	timeout.tv_usec = (timeout_ms % 1000) * 1000;
+
+	return select((int)sock + 1, &readSet, NULL, NULL,
+		      timeout_ms < 0 ? NULL : &timeout);
+#else
+	struct pollfd pfd;
+	int rc;
+
+	pfd.fd = sock;
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+	do {
+		rc = poll(&pfd, 1, timeout_ms);
+	} while (rc == -1 && errno == EINTR);
+
+	return rc;
+#endif
+}
+
+/* Returns TRUE if idle connection was closed or got unexpected data. */
+static int conn_is_stale(SOCKET sock)
+{
+	return conn_wait_readable(sock, 0) != 0;
+}
+
+/*
+ * Waits for the response on a reused connection without consuming it.
+ *
+ * Returns 1 when response data arrived, 0 when the device closed or reset
+ * the connection without sending anything, UPNP_E_TIMEDOUT or
+ * UPNP_E_SOCKET_ERROR otherwise.
+ */
+static int conn_wait_response(SOCKET sock, int *timeout_secs)
+{
+	time_t start_time = time(NULL);
+	char c;
+	int rc;
+
+	if (*timeout_secs < 0)
+		return UPNP_E_TIMEDOUT;
+	/* 0 means no timeout, as in sock_read() */
+	rc = conn_wait_readable(sock,
+		*timeout_secs == 0 ? -1 : *timeout_secs * 1000);
+	if (rc == 0)
+		return UPNP_E_TIMEDOUT;
+	if (rc < 0)
+		return UPNP_E_SOCKET_ERROR;
+	if (*timeout_secs > 0) {
+		*timeout_secs -= (int)(time(NULL) - start_time);
+		/* data is already there, so don't turn it into no timeout */
+		if (*timeout_secs <= 0)
+			*timeout_secs = 1;
+	}
+
+	rc = (int)recv(sock, &c, 1, MSG_PEEK);
+	if (rc > 0)
+		return 1;
+	if (rc == 0)
+		return 0;
+#ifdef WIN32
+	if (WSAGetLastError() == WSAECONNRESET)
+		return 0;
+#else
+	if (errno == ECONNRESET)
+		return 0;
+#endif
+
+	return UPNP_E_SOCKET_ERROR;
+}
+
+static SOCKET conn_pool_take(const struct sockaddr_storage *addr)
+{
+	SOCKET sock = INVALID_SOCKET;
+	time_t now = time(NULL);
+	int i;
+
+	ithread_mutex_lock(&gConnPoolMutex);
+	for (i = 0; i < HTTP_CONN_POOL_SIZE; ++i) {
+		http_conn_t *conn = &gConnPool[i];
+		if (!conn->used)
+			continue;
+		if (now - conn->last_used > HTTP_CONN_IDLE_TIMEOUT ||
+		    now < conn->last_used) {
+			conn_pool_release(conn);
+			continue;
+		}
+		if (sock == INVALID_SOCKET && sockaddr_equal(&conn->addr, addr)) {
+			if (conn_is_stale(conn->sock)) {
+				conn_pool_release(conn);
+				continue;
+			}
+			sock = conn->sock;
+			conn->used = FALSE;
+			conn->sock = INVALID_SOCKET;
+			++gConnReused;
+		}
+	}
+	ithread_mutex_unlock(&gConnPoolMutex);
+
+	return sock;
+}
+
+static void conn_pool_put(const struct sockaddr_storage *addr, SOCKET sock)
+{
+	http_conn_t *slot = NULL;
+	int i;
+
+	ithread_mutex_lock(&gConnPoolMutex);
+	for (i = 0; i < HTTP_CONN_POOL_SIZE; ++i) {
+		http_conn_t *conn = &gConnPool[i];
+		if (!conn->used) {
+			slot = conn;
+			break;
+		}
+		if (slot == NULL || conn->last_used < slot->last_used)
+			slot = conn;
+	}
+	/* pool is full, so the least recently used connection is dropped */
+	if (slot->used)
+		conn_pool_release(slot);
+	slot->used = TRUE;
+	slot->sock = sock;
+	memcpy(&slot->addr, addr, sizeof(slot->addr));
+	slot->last_used = time(NULL);
+	ithread_mutex_unlock(&gConnPoolMutex);
+}
+
+static int keepalive_enabled(const struct sockaddr_storage *addr)
+{
+	int enabled;
+	int i;
+
+	ithread_mutex_lock(&gConnPoolMutex);
+	enabled = gKeepAliveEnabled;
+	for (i = 0; enabled && i < gKeepAliveOffCount; ++i) {
+		if (sockaddr_equal(&gKeepAliveOff[i], addr))
+			enabled = FALSE;
+	}
+	ithread_mutex_unlock(&gConnPoolMutex);
+
+	return enabled;
+}
+
+/* Connection can be reused only if response was delimited by its length. */
+static int response_keeps_alive(http_parser_t *response)
+{
+	http_header_t *hdr;
+
+	if (response->msg.major_version != 1 ||
+	    response->msg.minor_version < 1 ||
+	    response->ent_position == ENTREAD_UNTIL_CLOSE)
+		return FALSE;
+
+	hdr = httpmsg_find_hdr_str(&response->msg, "CONNECTION");
+	if (hdr != NULL && hdr->value.length >= strlen("close") &&
+	    strncasecmp(hdr->value.buf, "close", strlen("close")) == 0)
+		return FALSE;
+
+	return TRUE;
+}
+
+static int conn_open(const struct sockaddr_storage *addr, SOCKET *sock)
+{
+	size_t sockaddr_len;
+	int nodelay = 1;
+
+	*sock = socket((int)addr->ss_family, SOCK_STREAM, 0);
+	if (*sock == INVALID_SOCKET)
+		return UPNP_E_SOCKET_ERROR;
+	/* Header and body are written separately; on a persistent connection
+	 * Nagle would hold the body until the peer's delayed ACK. */
+	setsockopt(*sock, IPPROTO_TCP, TCP_NODELAY, (char *)&nodelay,
+		   sizeof(nodelay));
+
+	sockaddr_len = addr->ss_family == AF_INET6 ?
+		sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in);
+	if (private_connect(*sock, (struct sockaddr *)addr,
+			    (socklen_t)sockaddr_len) == -1) {
+		sock_close(*sock);
+		*sock = INVALID_SOCKET;
+		return UPNP_E_SOCKET_CONNECT;
+	}
+
+	ithread_mutex_lock(&gConnPoolMutex);
+	++gConnOpened;
+	ithread_mutex_unlock(&gConnPoolMutex);
+
+	return UPNP_E_SUCCESS;
+}
+
+int http_RequestAndResponseKeepAlive(
+	IN uri_type *destination,
+	IN const char *request,
+	IN size_t request_length,
+	IN http_method_t req_method,
+	IN int timeout_secs,
+	OUT http_parser_t *response)
+{
+	const struct sockaddr_storage *addr = &destination->hostport.IPaddress;
+	SOCKINFO info;
+	SOCKET sock;
+	int ret_code = UPNP_E_SOCKET_ERROR;
+	int http_error_code;
+	int timeout;
+	int reused;
+	int closed;
+	int attempt;
+
+	if (!keepalive_enabled(addr))
+		return http_RequestAndResponse(destination, request,
+			request_length, req_method, timeout_secs, response);
+
+	for (attempt = 0; attempt < 2; ++attempt) {
+		timeout = timeout_secs;
+		sock = attempt == 0 ? conn_pool_take(addr) : INVALID_SOCKET;
+		reused = sock != INVALID_SOCKET;
+		if (!reused) {
+			ret_code = conn_open(addr, &sock);
+			if (ret_code != UPNP_E_SUCCESS) {
+				parser_response_init(response, req_method);
+				return ret_code;
+			}
+		}
+		sock_init(&info, sock);
+
+		ret_code = http_SendMessage(&info, &timeout, "b",
+			request, request_length);
+#ifdef TCP_QUICKACK
+		if (ret_code == 0) {
+			/* Many devices write response header and body
+			 * separately, which would otherwise stall on our
+			 * delayed ACK for every request on a reused socket. */
+			int quickack = 1;
+			setsockopt(sock, IPPROTO_TCP, TCP_QUICKACK,
+				   (char *)&quickack, sizeof(quickack));
+		}
+#endif
+		/* Write to a connection that device has already reset
+		 * fails, so the request was not delivered. */
+		closed = ret_code != 0 && ret_code != UPNP_E_TIMEDOUT;
+		if (ret_code == 0 && reused) {
+			/* The request may have been delivered and be executed
+			 * by now, so it is sent again only if device closed
+			 * connection without any response. Never after
+			 * timeout, because actions like Play or Seek are
+			 * not idempotent. */
+			ret_code = conn_wait_response(sock, &timeout);
+			closed = ret_code == 0;
+			if (ret_code == 1)
+				ret_code = 0;
+			else if (ret_code == 0)
+				ret_code = UPNP_E_SOCKET_ERROR;
+		}
+		if (ret_code == 0)
+			ret_code = http_RecvMessage(&info, response, req_method,
+				&timeout, &http_error_code);
+		else
+			parser_response_init(response, req_method);
+
+		if (reused && closed) {
+			/* Device closed idle connection before getting the
+			 * request, so it is safe to send it once more. */
+			UpnpPrintf(UPNP_INFO, HTTP, __FILE__, __LINE__,
+				"Stale keep-alive connection, retrying\n");
+			sock_destroy(&info, SD_BOTH);
+			httpmsg_destroy(&response->msg);
+			ithread_mutex_lock(&gConnPoolMutex);
+			++gConnRetried;
+			ithread_mutex_unlock(&gConnPoolMutex);
+			continue;
+		}
+
+		if (ret_code == 0 && response_keeps_alive(response))
+			conn_pool_put(addr, info.socket);
+		else
+			sock_destroy(&info, SD_BOTH);
+
+		break;
+	}
+
+	return ret_code;
+}
+
+void http_SetKeepAlive(const struct sockaddr_storage *addr, int enable)
+{
+	int i;
+
+	ithread_mutex_lock(&gConnPoolMutex);
+	if (addr == NULL) {
+		gKeepAliveEnabled = enable;
+	} else {
+		for (i = 0; i < gKeepAliveOffCount; ++i) {
+			if (sockaddr_equal(&gKeepAliveOff[i], addr))
+				break;
+		}
+		if (enable && i < gKeepAliveOffCount) {
+			gKeepAliveOff[i] = gKeepAliveOff[--gKeepAliveOffCount];
+		} else if (!enable && i == gKeepAliveOffCount &&
+			   gKeepAliveOffCount < HTTP_KEEPALIVE_OFF_SIZE) {
+			memcpy(&gKeepAliveOff[gKeepAliveOffCount++], addr,
+				sizeof(*addr));
+		}
+	}
+	if (!enable) {
+		for (i = 0; i < HTTP_CONN_POOL_SIZE; ++i) {
+			if (gConnPool[i].used && (addr == NULL ||
+			    sockaddr_equal(&gConnPool[i].addr, addr)))
+				conn_pool_release(&gConnPool[i]);
+		}
+	}
+	ithread_mutex_unlock(&gConnPoolMutex);
+}
+
+void http_CloseKeepAliveConnections(void)
+{
+	int i;
+
+	ithread_mutex_lock(&gConnPoolMutex);
+	for (i = 0; i < HTTP_CONN_POOL_SIZE; ++i) {
+		if (gConnPool[i].used)
+			conn_pool_release(&gConnPool[i]);
+	}
+	ithread_mutex_unlock(&gConnPoolMutex);
+}
+
+void http_GetKeepAliveStats(
+	unsigned long *opened,
+	unsigned long *reused,
+	unsigned long *retried)
+{
+	ithread_mutex_lock(&gConnPoolMutex);
+	*opened = gConnOpened;
+	*reused = gConnReused;
+	*retried = gConnRetried;
+	ithread_mutex_unlock(&gConnPoolMutex);
+}
+
 
 /************************************************************************
  * Function: http_Download
@@ -188,6 +188,55 @@ int http_RequestAndResponse(
 	IN int timeout_secs, 
 	OUT http_parser_t* response );
 
+/************************************************************************
+ * Function: http_RequestAndResponseKeepAlive
+ *
+ * Description:
+ *	Same as http_RequestAndResponse but the connection is kept open
+ *	after the response and reused for the next request to the same
+ *	device. A request sent over a connection that turns out to be
+ *	closed by the device is retried once over a new connection. Falls
+ *	back to http_RequestAndResponse when keep-alive is switched off.
+ ************************************************************************/
+int http_RequestAndResponseKeepAlive(
+	IN uri_type* destination,
+	IN const char* request,
+	IN size_t request_length,
+	IN http_method_t req_method,
+	IN int timeout_secs,
+	OUT http_parser_t* response );
+
+/************************************************************************
+ * Function: http_SetKeepAlive
+ *
+ * Description:
+ *	Enables or disables keep-alive globally (addr is NULL) or for one
+ *	device address. Disabling closes matching idle connections.
+ ************************************************************************/
+void http_SetKeepAlive(
+	IN const struct sockaddr_storage *addr,
+	IN int enable);
+
+/************************************************************************
+ * Function: http_CloseKeepAliveConnections
+ *
+ * Description:
+ *	Closes all idle keep-alive connections.
+ ************************************************************************/
+void http_CloseKeepAliveConnections(void);
+
+/************************************************************************
+ * Function: http_GetKeepAliveStats
+ *
+ * Description:
+ *	Returns number of opened connections, requests sent over reused
+ *	connections and retries caused by stale connections.
+ ************************************************************************/
+void http_GetKeepAliveStats(
+	OUT unsigned long *opened,
+	OUT unsigned long *reused,
+	OUT unsigned long *retried);
+
 
 /************************************************************************
  * return codes:
@@ -36,10 +36,17 @@
  * \file
  */
 
+#include "config.h"
 #include "sock.h"
 #include "httpparser.h"
 #include "UpnpStdInt.h"
 
+#if defined(HAVE_SYS_EPOLL_H) && !defined(WIN32) && !defined(UPNP_DISABLE_EPOLL)
+	/*! Miniserver waits for its sockets with epoll instead
+	 * of select(). Define UPNP_DISABLE_EPOLL to build the select() loop. */
+	#define MINISERVER_USE_EPOLL 1
+#endif
+
 extern SOCKET gMiniServerStopSock;
 
 typedef struct MServerSockArray {
@@ -237,6 +237,16 @@ void readFromSSDPSocket(
 	/* [in] SSDP socket. */
 	SOCKET socket);
 
+#ifdef MINISERVER_USE_EPOLL
+/*!
+ * \brief Reads all packets queued on the ssdp socket without blocking, as
+ * needed with edge-triggered notification.
+ */
+void drainSSDPSocket(
+	/* [in] SSDP socket. */
+	SOCKET socket);
+#endif /* MINISERVER_USE_EPOLL */
+
 /*!
  * \brief Creates the IPv4 and IPv6 ssdp sockets required by the
  *  control point and device operation.
@@ -273,6 +283,34 @@ void ssdp_handle_ctrlpt_msg(
 	 * Only in search reply. */
 	void *cookie);
 
+/*!
+ * \brief Sets filter of messages handled by ssdp_handle_ctrlpt_msg.
+ *
+ * \return UPNP_E_SUCCESS or UPNP_E_INVALID_PARAM.
+ */
+int ssdp_SetFilter(
+	/* [in] Prefixes of accepted NT/ST or NULL. */
+	const char **targets,
+	/* [in] Number of targets. */
+	int count,
+	/* [in] Max messages per second from one address, 0 is no limit. */
+	int maxRate,
+	/* [in] Non-zero to drop repeated advertisements. */
+	int dedupe);
+
+/*!
+ * \brief Returns counters of processed and dropped messages.
+ */
+void ssdp_GetFilterStats(
+	/* [out] Number of processed messages. */
+	unsigned long *processed,
+	/* [out] Number of messages with not matching target. */
+	unsigned long *droppedType,
+	/* [out] Number of messages over rate limit. */
+	unsigned long *droppedRate,
+	/* [out] Number of repeated advertisements. */
+	unsigned long *droppedDuplicate);
+
 /*!
  * \brief Creates and send the search request for a specific URL.
  *
@@ -310,7 +310,7 @@ soap_request_and_response( IN membuffer * request,
 {
     int ret_code;
 
-    ret_code = http_RequestAndResponse( destination_url, request->buf,
+    ret_code = http_RequestAndResponseKeepAlive( destination_url, request->buf,
                                         request->length,
                                         SOAPMETHOD_POST,
                                         UPNP_TIMEOUT, response );
@@ -328,7 +328,7 @@ soap_request_and_response( IN membuffer * request,
         httpmsg_destroy( &response->msg );  /* about to reuse response */
 
         /* try again */
-        ret_code = http_RequestAndResponse( destination_url, request->buf,
+        ret_code = http_RequestAndResponseKeepAlive( destination_url, request->buf,
                                             request->length,
                                             HTTPMETHOD_MPOST,
                                             UPNP_TIMEOUT,
@@ -55,7 +55,11 @@
 #include "UpnpInet.h"
 #include "ThreadPool.h"
 
+#include <limits.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
 #ifdef WIN32
 #include <string.h>
@@ -77,6 +81,272 @@ static void send_search_result(
 	free(temp);
 }
 
+/*!
+ * \brief Returns value of numeric header which has no header id, e.g.
+ * BOOTID.UPNP.ORG, or -1 if header is missing or invalid.
+ */
+static int ssdp_find_int_hdr(
+	/* [in] SSDP message. */
+	http_message_t *hmsg,
+	/* [in] Header name. */
+	const char *name)
+{
+	http_header_t *header;
+	char *end = NULL;
+	long value;
+
+	header = httpmsg_find_hdr_str(hmsg, name);
+	if (header == NULL || header->value.length == 0)
+		return -1;
+	value = strtol(header->value.buf, &end, 10);
+	if (end == header->value.buf || value < 0 || value > INT_MAX)
+		return -1;
+
+	return (int)value;
+}
+
+/*
+ * Early filtering of SSDP messages.
+ *
+ * On crowded networks most messages come from devices the control point is
+ * not interested in. They are dropped right after parsing, before
+ * Upnp_Discovery is filled and the callback or a search result job is
+ * scheduled. Tables are fixed size and indexed by hash, so a collision
+ * only makes a message pass that could be dropped.
+ */
+#define SSDP_FILTER_MAX_TARGETS 8
+#define SSDP_FILTER_RATE_SIZE 64
+#define SSDP_FILTER_SEEN_SIZE 256
+
+typedef struct {
+	struct sockaddr_storage addr;
+	time_t second;
+	int count;
+} ssdp_rate_t;
+
+typedef struct {
+	unsigned long usn;
+	unsigned long location;
+	time_t expires;
+} ssdp_seen_t;
+
+static char gSsdpTargets[SSDP_FILTER_MAX_TARGETS][LINE_SIZE];
+static size_t gSsdpTargetLens[SSDP_FILTER_MAX_TARGETS];
+static int gSsdpTargetCount = 0;
+static int gSsdpMaxRate = 0;
+static int gSsdpDedupe = FALSE;
+static ssdp_rate_t gSsdpRate[SSDP_FILTER_RATE_SIZE];
+static ssdp_seen_t gSsdpSeen[SSDP_FILTER_SEEN_SIZE];
+static unsigned long gSsdpProcessed = 0;
+static unsigned long gSsdpDroppedType = 0;
+static unsigned long gSsdpDroppedRate = 0;
+static unsigned long gSsdpDroppedDuplicate = 0;
+static ithread_mutex_t gSsdpFilterMutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* FNV-1a */
+static unsigned long ssdp_hash(unsigned long hash, const char *buf, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; ++i) {
+		hash ^= (unsigned char)buf[i];
+		hash *= 16777619UL;
+	}
+
+	return hash;
+}
+
+static unsigned long ssdp_hash_hdr(unsigned long hash, http_message_t *hmsg,
+				   int id)
+{
+	memptr value;
+
+	if (httpmsg_find_hdr(hmsg, id, &value) == NULL)
+		return hash;
+
+	return ssdp_hash(hash, value.buf, value.length);
+}
+
+static const void *ssdp_host_addr(const struct sockaddr_storage *addr,
+				  size_t *len)
+{
+	if (addr->ss_family == AF_INET6) {
+		*len = sizeof(struct in6_addr);
+		return &((const struct sockaddr_in6 *)addr)->sin6_addr;
+	}
+
+	*len = sizeof(struct in_addr);
+	return &((const struct sockaddr_in *)addr)->sin_addr;
+}
+
+/* Must be called with gSsdpFilterMutex locked. */
+static int ssdp_filter_target(memptr *target)
+{
+	int i;
+
+	if (gSsdpTargetCount == 0)
+		return TRUE;
+
+	for (i = 0; i < gSsdpTargetCount; ++i) {
+		if (target->length >= gSsdpTargetLens[i] &&
+		    strncmp(target->buf, gSsdpTargets[i],
+			    gSsdpTargetLens[i]) == 0)
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+/* Must be called with gSsdpFilterMutex locked. Returns TRUE if the same
+ * advertisement was already passed recently. */
+static int ssdp_filter_duplicate(http_message_t *hmsg, time_t now)
+{
+	memptr value;
+	http_header_t *bootId;
+	unsigned long usn;
+	unsigned long location;
+	ssdp_seen_t *seen;
+	int maxAge;
+
+	if (httpmsg_find_hdr(hmsg, HDR_USN, &value) == NULL)
+		return FALSE;
+	usn = ssdp_hash(2166136261UL, value.buf, value.length);
+	seen = &gSsdpSeen[usn % SSDP_FILTER_SEEN_SIZE];
+
+	if (httpmsg_find_hdr(hmsg, HDR_NTS, &value) == NULL ||
+	    memptr_cmp(&value, "ssdp:alive") != 0) {
+		/* byebye, next alive is passed */
+		if (seen->usn == usn)
+			seen->expires = 0;
+		return FALSE;
+	}
+
+	location = ssdp_hash_hdr(2166136261UL, hmsg, HDR_LOCATION);
+	bootId = httpmsg_find_hdr_str(hmsg, "BOOTID.UPNP.ORG");
+	if (bootId != NULL)
+		location = ssdp_hash(location, bootId->value.buf,
+				     bootId->value.length);
+
+	if (seen->usn == usn && seen->location == location &&
+	    now < seen->expires)
+		return TRUE;
+
+	if (httpmsg_find_hdr(hmsg, HDR_CACHE_CONTROL, &value) == NULL ||
+	    matchstr(value.buf, value.length, "%imax-age = %d%0",
+		     &maxAge) != PARSE_OK || maxAge <= 0)
+		return FALSE;
+
+	seen->usn = usn;
+	seen->location = location;
+	seen->expires = now + maxAge / 4;
+
+	return FALSE;
+}
+
+/* Must be called with gSsdpFilterMutex locked. Returns TRUE if source sent
+ * more than gSsdpMaxRate messages in current second. */
+static int ssdp_filter_rate(const struct sockaddr_storage *addr, time_t now)
+{
+	const void *host;
+	size_t len;
+	ssdp_rate_t *rate;
+
+	host = ssdp_host_addr(addr, &len);
+	rate = &gSsdpRate[ssdp_hash(2166136261UL, (const char *)host, len) %
+			  SSDP_FILTER_RATE_SIZE];
+
+	if (rate->addr.ss_family != addr->ss_family ||
+	    memcmp(ssdp_host_addr(&rate->addr, &len), host, len) != 0) {
+		memcpy(&rate->addr, addr, sizeof(rate->addr));
+		rate->second = now;
+		rate->count = 0;
+	} else if (rate->second != now) {
+		rate->second = now;
+		rate->count = 0;
+	}
+
+	return ++rate->count > gSsdpMaxRate;
+}
+
+/*!
+ * \brief Returns FALSE if message should be dropped.
+ */
+static int ssdp_filter_msg(
+	/* [in] SSDP message. */
+	http_message_t *hmsg,
+	/* [in] Address of the device. */
+	const struct sockaddr_storage *addr)
+{
+	memptr target;
+	time_t now = time(NULL);
+	int pass = TRUE;
+
+	ithread_mutex_lock(&gSsdpFilterMutex);
+	/* NT of advertisement, ST of search reply. Messages without them are
+	 * rejected later anyway. */
+	if (httpmsg_find_hdr(hmsg, hmsg->is_request ? HDR_NT : HDR_ST,
+			     &target) != NULL && !ssdp_filter_target(&target)) {
+		++gSsdpDroppedType;
+		pass = FALSE;
+	} else if (gSsdpMaxRate > 0 && ssdp_filter_rate(addr, now)) {
+		/* before dedupe, so a dropped message is not remembered */
+		++gSsdpDroppedRate;
+		pass = FALSE;
+	} else if (gSsdpDedupe && hmsg->is_request &&
+		   ssdp_filter_duplicate(hmsg, now)) {
+		++gSsdpDroppedDuplicate;
+		pass = FALSE;
+	} else {
+		++gSsdpProcessed;
+	}
+	ithread_mutex_unlock(&gSsdpFilterMutex);
+
+	return pass;
+}
+
+int ssdp_SetFilter(const char **targets, int count, int maxRate, int dedupe)
+{
+	int i;
+
+	if (count > SSDP_FILTER_MAX_TARGETS)
+		return UPNP_E_INVALID_PARAM;
+	for (i = 0; i < count; ++i) {
+		if (targets[i] == NULL || strlen(targets[i]) >= LINE_SIZE)
+			return UPNP_E_INVALID_PARAM;
+	}
+
+	ithread_mutex_lock(&gSsdpFilterMutex);
+	for (i = 0; i < count; ++i) {
+		strncpy(gSsdpTargets[i], targets[i], LINE_SIZE - 1);
+		gSsdpTargets[i][LINE_SIZE - 1] = '\0';
+		gSsdpTargetLens[i] = strlen(gSsdpTargets[i]);
+	}
+	gSsdpTargetCount = count;
+	gSsdpMaxRate = maxRate;
+	gSsdpDedupe = dedupe;
+	memset(gSsdpRate, 0, sizeof(gSsdpRate));
+	memset(gSsdpSeen, 0, sizeof(gSsdpSeen));
+	ithread_mutex_unlock(&gSsdpFilterMutex);
+
+	return UPNP_E_SUCCESS;
+}
+
+void ssdp_GetFilterStats(unsigned long *processed, unsigned long *droppedType,
+			 unsigned long *droppedRate,
+			 unsigned long *droppedDuplicate)
+{
+	ithread_mutex_lock(&gSsdpFilterMutex);
+	if (processed)
+		*processed = gSsdpProcessed;
+	if (droppedType)
+		*droppedType = gSsdpDroppedType;
+	if (droppedRate)
+		*droppedRate = gSsdpDroppedRate;
+	if (droppedDuplicate)
+		*droppedDuplicate = gSsdpDroppedDuplicate;
+	ithread_mutex_unlock(&gSsdpFilterMutex);
+}
+
 void ssdp_handle_ctrlpt_msg(http_message_t *hmsg, struct sockaddr_storage *dest_addr,
 			    int timeout, void *cookie)
 {
@@ -102,6 +372,9 @@ void ssdp_handle_ctrlpt_msg(http_message_t *hmsg, struct sockaddr_storage *dest_
 
 	memset(&job, 0, sizeof(job));
 
+	if (!timeout && !ssdp_filter_msg(hmsg, dest_addr))
+		return;
+
 	/* we are assuming that there can be only one client supported at a time */
 	HandleReadLock();
 
@@ -143,6 +416,9 @@ void ssdp_handle_ctrlpt_msg(http_message_t *hmsg, struct sockaddr_storage *dest_
 	if (httpmsg_find_hdr(hmsg, HDR_LOCATION, &hdr_value) != NULL) {
 		linecopylen(param.Location, hdr_value.buf, hdr_value.length);
 	}
+	/* BOOTID.UPNP.ORG, CONFIGID.UPNP.ORG */
+	param.BootId = ssdp_find_int_hdr(hmsg, "BOOTID.UPNP.ORG");
+	param.ConfigId = ssdp_find_int_hdr(hmsg, "CONFIGID.UPNP.ORG");
 	/* SERVER / USER-AGENT */
 	param.Os[0] = '\0';
 	if (httpmsg_find_hdr(hmsg, HDR_SERVER, &hdr_value) != NULL ||
@@ -694,7 +694,16 @@ static void ssdp_event_handler_thread(
 	free_ssdp_event_handler_data(data);
 }
 
-void readFromSSDPSocket(SOCKET socket)
+/*!
+ * \brief Reads one packet from the SSDP socket and schedules its handling.
+ *
+ * \return Result of recvfrom(), errno is kept on error.
+ */
+static ssize_t ssdp_read_packet(
+	/*! [in] SSDP socket. */
+	SOCKET socket,
+	/*! [in] Flags for recvfrom(). */
+	int flags)
 {
 	char *requestBuf = NULL;
 	char staticBuf[BUFSIZE];
@@ -703,6 +712,7 @@ void readFromSSDPSocket(SOCKET socket)
 	ssdp_thread_data *data = NULL;
 	socklen_t socklen = sizeof(__ss);
 	ssize_t byteReceived = 0;
+	int err;
 	char ntop_buf[INET6_ADDRSTRLEN];
 
 	memset(&job, 0, sizeof(job));
@@ -734,8 +744,9 @@ void readFromSSDPSocket(SOCKET socket)
 			data = NULL;
 		}
 	}
-	byteReceived = recvfrom(socket, requestBuf, BUFSIZE - (size_t)1, 0,
+	byteReceived = recvfrom(socket, requestBuf, BUFSIZE - (size_t)1, flags,
 				(struct sockaddr *)&__ss, &socklen);
+	err = errno;
 	if (byteReceived > 0) {
 		requestBuf[byteReceived] = '\0';
 		switch (__ss.ss_family) {
@@ -777,7 +788,26 @@ void readFromSSDPSocket(SOCKET socket)
 		}
 	} else
 		free_ssdp_event_handler_data(data);
+
+	errno = err;
+	return byteReceived;
+}
+
+void readFromSSDPSocket(SOCKET socket)
+{
+	ssdp_read_packet(socket, 0);
+}
+
+#ifdef MINISERVER_USE_EPOLL
+void drainSSDPSocket(SOCKET socket)
+{
+	for (;;) {
+		if (ssdp_read_packet(socket, MSG_DONTWAIT) < 0 &&
+		    errno != EINTR)
+			break;
+	}
 }
+#endif /* MINISERVER_USE_EPOLL */
 
 /*!
  * \brief
@@ -599,6 +599,22 @@ enum Upnp_DescType_e {
 
 typedef enum Upnp_DescType_e Upnp_DescType;
 
+/*!
+ * \brief Specifies the thread pool in \b UpnpGetThreadPoolStats.
+ */
+enum Upnp_ThreadPool_e {
+	/*! Pool running callbacks and handling of received messages. */
+	UPNP_RECV_THREADPOOL,
+
+	/*! Pool sending requests and notifications. */
+	UPNP_SEND_THREADPOOL,
+
+	/*! Pool of the mini server, accepting HTTP connections. */
+	UPNP_MINISERVER_THREADPOOL
+};
+
+typedef enum Upnp_ThreadPool_e Upnp_ThreadPool;
+
 #if UPNP_VERSION < 10800
 /** Returned as part of a {\bf UPNP_CONTROL_ACTION_COMPLETE} callback.  */
 
@@ -757,6 +773,12 @@ struct Upnp_Discovery
 				     
 	/** The host address of the device responding to the search. */
 	struct sockaddr_storage DestAddr;
+
+	/** Value of BOOTID.UPNP.ORG header (UDA 1.1) or -1 if not sent. */
+	int BootId;
+
+	/** Value of CONFIGID.UPNP.ORG header (UDA 1.1) or -1 if not sent. */
+	int ConfigId;
 };
 
 /** Returned along with a {\bf UPNP_EVENT_SUBSCRIBE_COMPLETE} or {\bf
@@ -1397,6 +1419,65 @@ EXPORT_SPEC int UpnpSetMaxContentLength(
 	 * in bytes. */
 	size_t contentLength);
 
+/*!
+ * \brief Enables or disables persistent (keep-alive) connections for SOAP
+ * control requests.
+ *
+ * Keep-alive is enabled by default. When \b Url is NULL the setting is
+ * global, otherwise it applies only to the device at host and port of
+ * \b Url, which allows switching it off for devices that mishandle it.
+ *
+ * \return An integer representing one of the following:
+ *     \li \c UPNP_E_SUCCESS: The operation completed successfully.
+ *     \li \c UPNP_E_FINISH: The SDK is not initialized.
+ *     \li \c UPNP_E_INVALID_URL: \b Url is not valid.
+ */
+EXPORT_SPEC int UpnpSetSoapKeepAlive(
+	/*! [in] Control URL of the device or NULL. */
+	const char *Url,
+	/*! [in] Non-zero to enable keep-alive. */
+	int Enable);
+
+/*!
+ * \brief Returns counters of SOAP client connections: connections opened,
+ * requests sent over reused connections and requests retried because
+ * reused connection was closed by the device.
+ */
+EXPORT_SPEC void UpnpGetSoapKeepAliveStats(
+	/*! [out] Number of opened connections. */
+	unsigned long *Opened,
+	/*! [out] Number of reused connections. */
+	unsigned long *Reused,
+	/*! [out] Number of retries on stale connections. */
+	unsigned long *Retried);
+
+/*!
+ * \brief Returns counters of one of the SDK thread pools.
+ *
+ * The counters are kept regardless of the \c STATS build option. Any of the
+ * out parameters may be NULL.
+ *
+ * \return An integer representing one of the following:
+ *     \li \c UPNP_E_SUCCESS: The operation completed successfully.
+ *     \li \c UPNP_E_FINISH: The SDK is not initialized.
+ *     \li \c UPNP_E_INVALID_PARAM: \b Pool is not valid.
+ */
+EXPORT_SPEC int UpnpGetThreadPoolStats(
+	/*! [in] The thread pool. */
+	Upnp_ThreadPool Pool,
+	/*! [out] Number of jobs queued. */
+	unsigned long *Queued,
+	/*! [out] Number of jobs rejected because the queue was full. */
+	unsigned long *Rejected,
+	/*! [out] Number of jobs waiting in the queue now. */
+	unsigned long *Depth,
+	/*! [out] Highest number of jobs waiting in the queue. */
+	unsigned long *MaxDepth,
+	/*! [out] Average time a job waited in the queue, in microseconds. */
+	unsigned long *AvgWait,
+	/*! [out] Average time a job was running, in microseconds. */
+	unsigned long *AvgRun);
+
 /* @} Initialization and Registration */
 
 /******************************************************************************
@@ -1464,6 +1545,52 @@ EXPORT_SPEC int UpnpSearchAsyncWithSsdpIP(
         const void *Cookie_const,
         const char *SsdpIP);
 
+/*!
+ * \brief Sets early filtering of SSDP messages received by the control point.
+ *
+ * Advertisements and search replies are checked right after they are parsed,
+ * before the callback is called:
+ *     \li Messages whose NT (advertisements) or ST (search replies) doesn't
+ *             start with one of \b Targets are dropped. When \b Count is 0
+ *             messages are not filtered by target.
+ *     \li Messages from one source address above \b MaxRate per second are
+ *             dropped. 0 means no limit.
+ *     \li If \b Dedupe is non-zero, repeated alive advertisements with the
+ *             same USN, LOCATION and BOOTID.UPNP.ORG are dropped for a quarter
+ *             of their max-age, which is still well before the device would
+ *             expire. Byebye ends it.
+ *
+ * \return An integer representing one of the following:
+ *     \li \c UPNP_E_SUCCESS: The operation completed successfully.
+ *     \li \c UPNP_E_FINISH: The SDK is not initialized.
+ *     \li \c UPNP_E_INVALID_PARAM: Too many or too long targets.
+ */
+EXPORT_SPEC int UpnpSetSsdpFilter(
+	/*! [in] Prefixes of accepted search targets, e.g.
+	 * "urn:schemas-upnp-org:device:MediaRenderer:". */
+	const char **Targets,
+	/*! [in] Number of targets. */
+	int Count,
+	/*! [in] Max number of messages per second from one address. */
+	int MaxRate,
+	/*! [in] Non-zero to drop repeated advertisements. */
+	int Dedupe);
+
+/*!
+ * \brief Returns counters of SSDP messages received by the control point:
+ * messages passed to the callback and messages dropped by the filter set
+ * with \b UpnpSetSsdpFilter.
+ */
+EXPORT_SPEC void UpnpGetSsdpFilterStats(
+	/*! [out] Number of processed messages. */
+	unsigned long *Processed,
+	/*! [out] Number of messages with not matching target. */
+	unsigned long *DroppedType,
+	/*! [out] Number of messages over rate limit. */
+	unsigned long *DroppedRate,
+	/*! [out] Number of repeated advertisements. */
+	unsigned long *DroppedDuplicate);
+
 /*!
  * \brief Sends out the discovery announcements for all devices and services
  * for a device.
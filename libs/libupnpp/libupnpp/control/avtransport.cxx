@@ -20,6 +20,8 @@
 #include <stdlib.h>                     // for atoi
 #include <upnp/upnp.h>                  // for UPNP_E_SUCCESS, etc
 
+#include <functional>                   // for hash
+#include <mutex>
 #include <ostream>                      // for basic_ostream, endl, etc
 #include <string>                       // for string, basic_string, etc
 #include <utility>                      // for pair
@@ -117,6 +119,63 @@ static AVTransport::PlayMode stringToPlayMode(const string& s)
     }
 }
 
+/* Track metadata is sent again with every position poll and with most
+ * LastChange events, but only changes with the track. Parse results are
+ * memoized by the raw DIDL text, so unchanged metadata is not re-parsed.
+ * Returns false if didl is not valid DIDL; found tells if it had an item.
+ */
+static bool parseDidlItem(const string& didl, UPnPDirObject& obj, bool& found)
+{
+    struct Entry {
+        size_t hash;
+        string didl;
+        bool ok;
+        bool found;
+        UPnPDirObject obj;
+    };
+    static const size_t cacheSize = 16;
+    static std::mutex cacheMutex;
+    static vector<Entry> cache;
+    static size_t cacheNext = 0;
+
+    size_t hash = std::hash<string>()(didl);
+
+    {
+        std::unique_lock<std::mutex> lock(cacheMutex);
+        for (const auto& entry : cache) {
+            if (entry.hash == hash && entry.didl == didl) {
+                found = entry.found;
+                if (found)
+                    obj = entry.obj;
+                return entry.ok;
+            }
+        }
+    }
+
+    Entry entry;
+    entry.hash = hash;
+    entry.didl = didl;
+    UPnPDirContent meta;
+    entry.ok = meta.parse(didl);
+    entry.found = entry.ok && meta.m_items.size() > 0;
+    if (entry.found)
+        entry.obj = meta.m_items[0];
+
+    found = entry.found;
+    if (found)
+        obj = entry.obj;
+
+    std::unique_lock<std::mutex> lock(cacheMutex);
+    if (cache.size() < cacheSize) {
+        cache.push_back(entry);
+    } else {
+        cache[cacheNext] = entry;
+        cacheNext = (cacheNext + 1) % cacheSize;
+    }
+
+    return entry.ok;
+}
+
 void AVTransport::evtCallback(
     const std::unordered_map<std::string, std::string>& props)
 {
@@ -187,16 +246,16 @@ void AVTransport::evtCallback(
             } else if (!it1->first.compare("AVTransportURIMetaData") ||
                        !it1->first.compare("NextAVTransportURIMetaData") ||
                        !it1->first.compare("CurrentTrackMetaData")) {
-                UPnPDirContent meta;
-                if (!meta.parse(it1->second)) {
+                UPnPDirObject meta;
+                bool found;
+                if (!parseDidlItem(it1->second, meta, found)) {
                     LOGERR("AVTransport event: bad metadata: [" <<
                            it1->second << "]" << endl);
                 } else {
                     LOGDEB1("AVTransport event: good metadata: [" <<
                             it1->second << "]" << endl);
-                    if (meta.m_items.size() > 0) {
-                        getReporter()->changed(it1->first.c_str(),
-                                               meta.m_items[0]);
+                    if (found) {
+                        getReporter()->changed(it1->first.c_str(), meta);
                     }
                 }
             } else if (!it1->first.compare("PlaybackStorageMedium") ||
@@ -231,6 +290,36 @@ int AVTransport::setURI(const string& uri, const string& metadata,
     return runAction(args, data);
 }
 
+int AVTransport::setURIAsync(const string& uri, const string& metadata,
+                             int instanceID, bool next, StatusCB cb,
+                             int timeoutms)
+{
+    SoapOutgoing args(getServiceType(), next ? "SetNextAVTransportURI" :
+                      "SetAVTransportURI");
+    args("InstanceID", SoapHelp::i2s(instanceID))
+    (next ? "NextURI" : "CurrentURI", uri)
+    (next ? "NextURIMetaData" : "CurrentURIMetaData", metadata);
+
+    return runActionAsync(args, [cb](int ret, const SoapIncoming&) {
+        cb(ret);
+    }, timeoutms);
+}
+
+int AVTransport::setAVTransportURIAsync(const string& uri,
+                                        const string& metadata, StatusCB cb,
+                                        int timeoutms, int instanceID)
+{
+    return setURIAsync(uri, metadata, instanceID, false, cb, timeoutms);
+}
+
+int AVTransport::setNextAVTransportURIAsync(const string& uri,
+                                            const string& metadata,
+                                            StatusCB cb, int timeoutms,
+                                            int instanceID)
+{
+    return setURIAsync(uri, metadata, instanceID, true, cb, timeoutms);
+}
+
 int AVTransport::setPlayMode(PlayMode pm, int instanceID)
 {
     SoapOutgoing args(getServiceType(), "SetPlayMode");
@@ -266,75 +355,101 @@ int AVTransport::setPlayMode(PlayMode pm, int instanceID)
     return runAction(args, data);
 }
 
-int AVTransport::getMediaInfo(MediaInfo& info, int instanceID)
+static void decodeMediaInfo(const SoapIncoming& data,
+                            AVTransport::MediaInfo& info)
 {
-    SoapOutgoing args(getServiceType(), "GetMediaInfo");
-    args("InstanceID", SoapHelp::i2s(instanceID));
-    SoapIncoming data;
-    int ret = runAction(args, data);
-    if (ret != UPNP_E_SUCCESS) {
-        return ret;
-    }
     string s;
     data.get("NrTracks", &info.nrtracks);
     data.get("MediaDuration", &s);
     info.mduration = upnpdurationtos(s);
     data.get("CurrentURI", &info.cururi);
+    bool found;
     data.get("CurrentURIMetaData", &s);
-    UPnPDirContent meta;
-    meta.parse(s);
-    if (meta.m_items.size() > 0)
-        info.curmeta = meta.m_items[0];
-    meta.clear();
+    parseDidlItem(s, info.curmeta, found);
     data.get("NextURI", &info.nexturi);
+    s.clear();
     data.get("NextURIMetaData", &s);
-    if (meta.m_items.size() > 0)
-        info.nextmeta = meta.m_items[0];
+    parseDidlItem(s, info.nextmeta, found);
     data.get("PlayMedium", &info.pbstoragemed);
     data.get("RecordMedium", &info.pbstoragemed);
     data.get("WriteStatus", &info.ws);
-    return 0;
 }
 
-int AVTransport::getTransportInfo(TransportInfo& info, int instanceID)
+int AVTransport::getMediaInfo(MediaInfo& info, int instanceID)
 {
-    SoapOutgoing args(getServiceType(), "GetTransportInfo");
+    SoapOutgoing args(getServiceType(), "GetMediaInfo");
     args("InstanceID", SoapHelp::i2s(instanceID));
     SoapIncoming data;
     int ret = runAction(args, data);
     if (ret != UPNP_E_SUCCESS) {
         return ret;
     }
+    decodeMediaInfo(data, info);
+    return 0;
+}
+
+int AVTransport::getMediaInfoAsync(MediaInfoCB cb, int timeoutms,
+                                   int instanceID)
+{
+    SoapOutgoing args(getServiceType(), "GetMediaInfo");
+    args("InstanceID", SoapHelp::i2s(instanceID));
+    return runActionAsync(args, [cb](int ret, const SoapIncoming& data) {
+        MediaInfo info = MediaInfo();
+        if (ret == UPNP_E_SUCCESS)
+            decodeMediaInfo(data, info);
+        cb(ret, info);
+    }, timeoutms);
+}
+
+static void decodeTransportInfo(const SoapIncoming& data,
+                                AVTransport::TransportInfo& info)
+{
     string s;
     data.get("CurrentTransportState", &s);
     info.tpstate = stringToTpState(s);
     data.get("CurrentTransportStatus", &s);
     info.tpstatus = stringToTpStatus(s);
     data.get("CurrentSpeed", &info.curspeed);
-    return 0;
 }
 
-int AVTransport::getPositionInfo(PositionInfo& info, int instanceID)
+int AVTransport::getTransportInfo(TransportInfo& info, int instanceID)
 {
-    SoapOutgoing args(getServiceType(), "GetPositionInfo");
+    SoapOutgoing args(getServiceType(), "GetTransportInfo");
     args("InstanceID", SoapHelp::i2s(instanceID));
     SoapIncoming data;
     int ret = runAction(args, data);
     if (ret != UPNP_E_SUCCESS) {
         return ret;
     }
+    decodeTransportInfo(data, info);
+    return 0;
+}
+
+int AVTransport::getTransportInfoAsync(TransportInfoCB cb, int timeoutms,
+                                       int instanceID)
+{
+    SoapOutgoing args(getServiceType(), "GetTransportInfo");
+    args("InstanceID", SoapHelp::i2s(instanceID));
+    return runActionAsync(args, [cb](int ret, const SoapIncoming& data) {
+        TransportInfo info = TransportInfo();
+        if (ret == UPNP_E_SUCCESS)
+            decodeTransportInfo(data, info);
+        cb(ret, info);
+    }, timeoutms);
+}
+
+static void decodePositionInfo(const SoapIncoming& data,
+                               AVTransport::PositionInfo& info)
+{
     string s;
     data.get("Track", &info.track);
     data.get("TrackDuration", &s);
     info.trackduration = upnpdurationtos(s);
     data.get("TrackMetaData", &s);
-    UPnPDirContent meta;
-    meta.parse(s);
-    if (meta.m_items.size() > 0) {
-        info.trackmeta = meta.m_items[0];
-        LOGDEB1("AVTransport::getPositionInfo: size " <<
-                meta.m_items.size() << " current title: "
-                << meta.m_items[0].m_title << endl);
+    bool found;
+    if (parseDidlItem(s, info.trackmeta, found) && found) {
+        LOGDEB1("AVTransport::getPositionInfo: current title: "
+                << info.trackmeta.m_title << endl);
     }
     data.get("TrackURI", &info.trackuri);
     data.get("RelTime", &s);
@@ -343,9 +458,34 @@ int AVTransport::getPositionInfo(PositionInfo& info, int instanceID)
     info.abstime = upnpdurationtos(s);
     data.get("RelCount", &info.relcount);
     data.get("AbsCount", &info.abscount);
+}
+
+int AVTransport::getPositionInfo(PositionInfo& info, int instanceID)
+{
+    SoapOutgoing args(getServiceType(), "GetPositionInfo");
+    args("InstanceID", SoapHelp::i2s(instanceID));
+    SoapIncoming data;
+    int ret = runAction(args, data);
+    if (ret != UPNP_E_SUCCESS) {
+        return ret;
+    }
+    decodePositionInfo(data, info);
     return 0;
 }
 
+int AVTransport::getPositionInfoAsync(PositionInfoCB cb, int timeoutms,
+                                      int instanceID)
+{
+    SoapOutgoing args(getServiceType(), "GetPositionInfo");
+    args("InstanceID", SoapHelp::i2s(instanceID));
+    return runActionAsync(args, [cb](int ret, const SoapIncoming& data) {
+        PositionInfo info = PositionInfo();
+        if (ret == UPNP_E_SUCCESS)
+            decodePositionInfo(data, info);
+        cb(ret, info);
+    }, timeoutms);
+}
+
 int AVTransport::getDeviceCapabilities(DeviceCapabilities& info, int iID)
 {
     SoapOutgoing args(getServiceType(), "GetDeviceCapabilities");
@@ -395,6 +535,27 @@ int AVTransport::getCurrentTransportActions(int& iacts, int iID)
     return CTAStringToBits(actions, iacts);
 }
 
+int AVTransport::getCurrentTransportActionsAsync(TransportActionsCB cb,
+                                                 int timeoutms, int iID)
+{
+    SoapOutgoing args(getServiceType(), "GetCurrentTransportActions");
+    args("InstanceID", SoapHelp::i2s(iID));
+    return runActionAsync(args, [this, cb](int ret, const SoapIncoming& data) {
+        int iacts = 0;
+        if (ret == UPNP_E_SUCCESS) {
+            string actions;
+            if (data.get("Actions", &actions)) {
+                ret = CTAStringToBits(actions, iacts);
+            } else {
+                LOGERR("AVTransport:getCurrentTransportActionsAsync: "
+                       "no actions in answer" << endl);
+                ret = UPNP_E_BAD_RESPONSE;
+            }
+        }
+        cb(ret, iacts);
+    }, timeoutms);
+}
+
 int AVTransport::CTAStringToBits(const string& actions, int& iacts)
 {
     vector<string> sacts;
@@ -444,6 +605,26 @@ int AVTransport::pause(int instanceID)
     return runAction(args, data);
 }
 
+int AVTransport::simpleActionAsync(const string& name, int instanceID,
+                                   StatusCB cb, int timeoutms)
+{
+    SoapOutgoing args(getServiceType(), name);
+    args("InstanceID", SoapHelp::i2s(instanceID));
+    return runActionAsync(args, [cb](int ret, const SoapIncoming&) {
+        cb(ret);
+    }, timeoutms);
+}
+
+int AVTransport::stopAsync(StatusCB cb, int timeoutms, int instanceID)
+{
+    return simpleActionAsync("Stop", instanceID, cb, timeoutms);
+}
+
+int AVTransport::pauseAsync(StatusCB cb, int timeoutms, int instanceID)
+{
+    return simpleActionAsync("Pause", instanceID, cb, timeoutms);
+}
+
 int AVTransport::play(int speed, int instanceID)
 {
     SoapOutgoing args(getServiceType(), "Play");
@@ -453,40 +634,60 @@ int AVTransport::play(int speed, int instanceID)
     return runAction(args, data);
 }
 
-int AVTransport::seek(SeekMode mode, int target, int instanceID)
+static int seekArgs(AVTransport::SeekMode mode, int target, string& sm,
+                    string& value)
 {
-    string sm;
-    string value = SoapHelp::i2s(target);
+    value = SoapHelp::i2s(target);
     switch (mode) {
-    case SEEK_TRACK_NR:
+    case AVTransport::SEEK_TRACK_NR:
         sm = "TRACK_NR";
         break;
-    case SEEK_ABS_TIME:
+    case AVTransport::SEEK_ABS_TIME:
         sm = "ABS_TIME";
         value = upnpduration(target*1000);
         break;
-    case SEEK_REL_TIME:
+    case AVTransport::SEEK_REL_TIME:
         sm = "REL_TIME";
         value = upnpduration(target*1000);
         break;
-    case SEEK_ABS_COUNT:
+    case AVTransport::SEEK_ABS_COUNT:
         sm = "ABS_COUNT";
         break;
-    case SEEK_REL_COUNT:
+    case AVTransport::SEEK_REL_COUNT:
         sm = "REL_COUNT";
         break;
-    case SEEK_CHANNEL_FREQ:
+    case AVTransport::SEEK_CHANNEL_FREQ:
         sm = "CHANNEL_FREQ";
         break;
-    case SEEK_TAPE_INDEX:
+    case AVTransport::SEEK_TAPE_INDEX:
         sm = "TAPE-INDEX";
         break;
-    case SEEK_FRAME:
+    case AVTransport::SEEK_FRAME:
         sm = "FRAME";
         break;
     default:
         return UPNP_E_INVALID_PARAM;
     }
+    return UPNP_E_SUCCESS;
+}
+
+int AVTransport::playAsync(StatusCB cb, int timeoutms, int speed,
+                           int instanceID)
+{
+    SoapOutgoing args(getServiceType(), "Play");
+    args("InstanceID", SoapHelp::i2s(instanceID))
+    ("Speed", SoapHelp::i2s(speed));
+    return runActionAsync(args, [cb](int ret, const SoapIncoming&) {
+        cb(ret);
+    }, timeoutms);
+}
+
+int AVTransport::seek(SeekMode mode, int target, int instanceID)
+{
+    string sm, value;
+    int ret = seekArgs(mode, target, sm, value);
+    if (ret != UPNP_E_SUCCESS)
+        return ret;
 
     SoapOutgoing args(getServiceType(), "Seek");
     args("InstanceID", SoapHelp::i2s(instanceID))
@@ -496,6 +697,23 @@ int AVTransport::seek(SeekMode mode, int target, int instanceID)
     return runAction(args, data);
 }
 
+int AVTransport::seekAsync(SeekMode mode, int target, StatusCB cb,
+                           int timeoutms, int instanceID)
+{
+    string sm, value;
+    int ret = seekArgs(mode, target, sm, value);
+    if (ret != UPNP_E_SUCCESS)
+        return ret;
+
+    SoapOutgoing args(getServiceType(), "Seek");
+    args("InstanceID", SoapHelp::i2s(instanceID))
+    ("Unit", sm)
+    ("Target", value);
+    return runActionAsync(args, [cb](int ret, const SoapIncoming&) {
+        cb(ret);
+    }, timeoutms);
+}
+
 int AVTransport::next(int instanceID)
 {
     SoapOutgoing args(getServiceType(), "Next");
@@ -151,6 +151,37 @@ public:
                           };
     int getCurrentTransportActions(int& actions, int instanceID=0);
 
+    /* Asynchronous forms of the above, see Service::runActionAsync() for
+     * return values, threading and timeouts. Result data passed to a
+     * callback is only valid if the status is UPNP_E_SUCCESS. */
+    typedef std::function<void (int)> StatusCB;
+    typedef std::function<void (int, const MediaInfo&)> MediaInfoCB;
+    typedef std::function<void (int, const TransportInfo&)> TransportInfoCB;
+    typedef std::function<void (int, const PositionInfo&)> PositionInfoCB;
+    typedef std::function<void (int, int)> TransportActionsCB;
+
+    int setAVTransportURIAsync(const std::string& uri,
+                               const std::string& metadata, StatusCB cb,
+                               int timeoutms = 0, int instanceID = 0);
+    int setNextAVTransportURIAsync(const std::string& uri,
+                                   const std::string& metadata, StatusCB cb,
+                                   int timeoutms = 0, int instanceID = 0);
+    int getMediaInfoAsync(MediaInfoCB cb, int timeoutms = 0,
+                          int instanceID = 0);
+    int getTransportInfoAsync(TransportInfoCB cb, int timeoutms = 0,
+                              int instanceID = 0);
+    int getPositionInfoAsync(PositionInfoCB cb, int timeoutms = 0,
+                             int instanceID = 0);
+    int getCurrentTransportActionsAsync(TransportActionsCB cb,
+                                        int timeoutms = 0,
+                                        int instanceID = 0);
+    int stopAsync(StatusCB cb, int timeoutms = 0, int instanceID = 0);
+    int pauseAsync(StatusCB cb, int timeoutms = 0, int instanceID = 0);
+    int playAsync(StatusCB cb, int timeoutms = 0, int speed = 1,
+                  int instanceID = 0);
+    int seekAsync(SeekMode mode, int target, StatusCB cb, int timeoutms = 0,
+                  int instanceID = 0);
+
     /** Test service type from discovery message */
     static bool isAVTService(const std::string& st);
 
@@ -160,6 +191,10 @@ protected:
 
     int setURI(const std::string& uri, const std::string& metadata,
                int instanceID, bool next);
+    int setURIAsync(const std::string& uri, const std::string& metadata,
+                    int instanceID, bool next, StatusCB cb, int timeoutms);
+    int simpleActionAsync(const std::string& name, int instanceID,
+                          StatusCB cb, int timeoutms);
     int CTAStringToBits(const std::string& actions, int& iacts);
 
 private:
@@ -155,9 +155,11 @@ UPnPDeviceDesc::UPnPDeviceDesc(const string& url, const string& description)
     }
     for (auto& dev: embedded) {
         dev.URLBase = URLBase;
+        dev.location = url;
     }
 
     XMLText = description;
+    location = url;
     
     ok = true;
     //cerr << "URLBase: [" << URLBase << "]" << endl;
@@ -239,6 +241,11 @@ protected:
                 m_parsed.actionList[m_tact.name] = m_tact;
             } else if (!strcmp(name, "argument")) {
                 m_tact.argList.push_back(m_targ);
+            } else if (!strcmp(name, "allowedValue") &&
+                       !parentname.compare("allowedValueList")) {
+                string value = lastelt.data;
+                trimstring(value);
+                m_tvar.allowedValues.push_back(value);
             }
             break;
         case 'd':
@@ -93,11 +93,14 @@ public:
         int minimum;
         int maximum;
         int step;
+        // Values from allowedValueList, empty if not restricted
+        std::vector<std::string> allowedValues;
         void clear() {
             name.clear();
             sendEvents = false;
             dataType.clear();
             hasValueRange = false;
+            allowedValues.clear();
         }
     };
     struct Parsed {
@@ -147,6 +150,8 @@ public:
     std::string modelName;
     // Raw downloaded document
     std::string XMLText;
+    // URL the document was downloaded from (LOCATION of advertisement)
+    std::string location;
 
     // Services provided by this device.
     std::vector<UPnPServiceDesc> services;
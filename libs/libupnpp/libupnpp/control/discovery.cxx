@@ -20,11 +20,13 @@
 #include <stdlib.h>
 #include <time.h>
 #include <stdio.h>
+#include <string.h>
 
 #include <upnp/upnp.h>
 
-#include <unordered_set>
+#include <unordered_map>
 #include <map>
+#include <set>
 #include <utility>
 #include <vector>
 #include <chrono>
@@ -88,15 +90,127 @@ public:
     int expires; // Seconds valid
 };
 
+// Description documents already downloaded, by location. Chatty devices
+// repeat their advertisements every few seconds, so a document is reused
+// while BOOTID.UPNP.ORG and CONFIGID.UPNP.ORG of advertisements stay the
+// same or, for devices which don't send them, until max-age of the
+// advertisement which caused the download elapsed. Root device and its
+// embedded devices share the location, so one document serves all of
+// them.
+class CachedDescription {
+public:
+    std::set<string> deviceIds;
+    string description;
+    int bootId;
+    int configId;
+    std::chrono::steady_clock::time_point fetched;
+    std::chrono::steady_clock::time_point last_seen;
+    std::chrono::seconds expires;
+};
+static std::unordered_map<string, CachedDescription> o_desccache;
+static std::mutex o_desccache_mutex;
+
+static bool cachedDescription(const struct Upnp_Discovery *disco,
+                              string& description)
+{
+    std::unique_lock<std::mutex> lock(o_desccache_mutex);
+    auto it = o_desccache.find(disco->Location);
+    if (it == o_desccache.end())
+        return false;
+
+    auto& c = it->second;
+    auto now = std::chrono::steady_clock::now();
+    bool valid;
+    if (disco->BootId >= 0 || disco->ConfigId >= 0) {
+        valid = c.bootId == disco->BootId && c.configId == disco->ConfigId;
+    } else {
+        valid = now - c.fetched < c.expires;
+    }
+    if (!valid) {
+        o_desccache.erase(it);
+        return false;
+    }
+
+    c.deviceIds.insert(disco->DeviceId);
+    c.last_seen = now;
+    if (disco->Expires > 0)
+        c.expires = std::chrono::seconds(disco->Expires);
+    description = c.description;
+    return true;
+}
+
+static void cacheDescription(const struct Upnp_Discovery *disco,
+                             const string& description)
+{
+    std::unique_lock<std::mutex> lock(o_desccache_mutex);
+    auto now = std::chrono::steady_clock::now();
+
+    // Devices which disappeared without byebye
+    for (auto it = o_desccache.begin(); it != o_desccache.end();) {
+        if (now - it->second.last_seen > it->second.expires) {
+            it = o_desccache.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    CachedDescription& c = o_desccache[disco->Location];
+    c.deviceIds.clear();
+    c.deviceIds.insert(disco->DeviceId);
+    c.description = description;
+    c.bootId = disco->BootId;
+    c.configId = disco->ConfigId;
+    c.fetched = now;
+    c.last_seen = now;
+    c.expires = std::chrono::seconds(disco->Expires > 0 ? disco->Expires : 0);
+}
+
+static void uncacheDevice(const string& deviceId)
+{
+    std::unique_lock<std::mutex> lock(o_desccache_mutex);
+    for (auto it = o_desccache.begin(); it != o_desccache.end();) {
+        if (it->second.deviceIds.count(deviceId)) {
+            it = o_desccache.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+// Device types set with setDeviceTypes(): full types to search for and
+// prefixes without version to match messages against
+static vector<string> o_searchtypes;
+static vector<string> o_devtypes;
+static std::mutex o_devtypes_mutex;
+
+// Devices send multiple messages for themselves, their subdevices and
+// services. AFAIK they all point to the same description.xml document,
+// which has all the interesting data. So let's try to only process
+// one message per device: the one which probably correspond to the
+// upnp "root device" message and has empty service and device types.
+// When device types are set, libupnp passes only messages for these types
+// and the device type message is used instead.
+static bool wantedMessage(const struct Upnp_Discovery *disco)
+{
+    if (disco->ServiceType[0])
+        return false;
+
+    std::unique_lock<std::mutex> lock(o_devtypes_mutex);
+    if (o_devtypes.empty())
+        return !disco->DeviceType[0];
+
+    for (const auto& type : o_devtypes) {
+        if (strncmp(disco->DeviceType, type.c_str(), type.size()) == 0)
+            return true;
+    }
+    return false;
+}
+
 // The workqueue on which callbacks from libupnp (cluCallBack()) queue
 // discovered object descriptors for processing by our dedicated
 // thread.
 static WorkQueue<DiscoveredTask*> discoveredQueue("DiscoveredQueue");
 
-// Set of currently downloading URIs (for avoiding multiple downloads)
-static std::unordered_set<string> o_downloading;
-static std::mutex o_downloading_mutex;
-
 // This gets called in a libupnp thread context for all asynchronous
 // events which we asked for.
 // Example: ContentDirectories appearing and disappearing from the network
@@ -110,12 +224,7 @@ static int cluCallBack(Upnp_EventType et, void* evp, void*)
     {
         struct Upnp_Discovery *disco = (struct Upnp_Discovery *)evp;
 
-        // Devices send multiple messages for themselves, their subdevices and
-        // services. AFAIK they all point to the same description.xml document,
-        // which has all the interesting data. So let's try to only process
-        // one message per device: the one which probably correspond to the
-        // upnp "root device" message and has empty service and device types:
-        if (disco->DeviceType[0] || disco->ServiceType[0]) {
+        if (!wantedMessage(disco)) {
             LOGDEB1("discovery:cllb:SearchRes/Alive: ignoring message with "
                     "device/service type\n");
             return UPNP_E_SUCCESS;
@@ -132,41 +241,38 @@ static int cluCallBack(Upnp_EventType et, void* evp, void*)
 
         DiscoveredTask *tp = new DiscoveredTask(1, disco);
 
-        {
-            // Note that this does not prevent multiple successive
-            // downloads of a normal url, just multiple
-            // simultaneous downloads of a slow one, to avoid
-            // tying up threads.
-            std::unique_lock<std::mutex> lock(o_downloading_mutex);
-            pair<std::unordered_set<string>::iterator,bool> res =
-                o_downloading.insert(tp->url);
-            if (!res.second) {
-                LOGDEB1("discovery:cllb: already downloading " <<
-                        tp->url << endl);
-                delete tp;
-                return UPNP_E_SUCCESS;
+        if (cachedDescription(disco, tp->description)) {
+            LOGDEB1("discovery:cllb: cached description for " <<
+                    tp->url << endl);
+            if (!discoveredQueue.put(tp)) {
+                LOGERR("discovery:cllb: queue.put failed\n");
             }
+            break;
         }
 
-        LOGDEB1("discoExplorer: downloading " << tp->url << endl);
-        if (!downloadUrlWithCurl(tp->url, tp->description, 5)) {
-            LOGERR("discovery:cllb: downloadUrlWithCurl error for: " <<
-                   tp->url << endl);
-            {   std::unique_lock<std::mutex> lock(o_downloading_mutex);
-                o_downloading.erase(tp->url);
-            }
+        // Download is run by the fetcher thread, so a slow or dead
+        // device doesn't hold this libupnp thread and delay other results
+        LOGDEB1("discovery:cllb: downloading " << tp->url << endl);
+        struct Upnp_Discovery d = *disco;
+        bool queued = HttpFetcher::getFetcher()->fetch(tp->url, 5,
+            [tp, d](bool ok, const string& data) {
+                if (!ok) {
+                    LOGERR("discovery:cllb: download error for: " <<
+                           tp->url << endl);
+                    delete tp;
+                    return;
+                }
+                LOGDEB1("discovery:cllb: downloaded description document "
+                        "of " << data.size() << " bytes" << endl);
+                tp->description = data;
+                cacheDescription(&d, tp->description);
+                if (!discoveredQueue.put(tp)) {
+                    LOGERR("discovery:cllb: queue.put failed\n");
+                }
+            });
+        if (!queued) {
+            LOGDEB1("discovery:cllb: not downloading " << tp->url << endl);
             delete tp;
-            return UPNP_E_SUCCESS;
-        }
-        LOGDEB1("discovery:cllb: downloaded description document of " <<
-                tp->description.size() << " bytes" << endl);
-
-        {   std::unique_lock<std::mutex> lock(o_downloading_mutex);
-            o_downloading.erase(tp->url);
-        }
-
-        if (!discoveredQueue.put(tp)) {
-            LOGERR("discovery:cllb: queue.put failed\n");
         }
         break;
     }
@@ -174,6 +280,7 @@ static int cluCallBack(Upnp_EventType et, void* evp, void*)
     {
         struct Upnp_Discovery *disco = (struct Upnp_Discovery *)evp;
         LOGDEB1("discovery:cllB:BYEBYE: " << cluDiscoveryToStr(disco) << endl);
+        uncacheDevice(disco->DeviceId);
         DiscoveredTask *tp = new DiscoveredTask(0, disco);
         if (!discoveredQueue.put(tp)) {
             LOGERR("discovery:cllb: queue.put failed\n");
@@ -211,16 +318,75 @@ void UPnPDeviceDirectory::delCallback(unsigned int idx)
     o_callbacks.erase(o_callbacks.begin() + idx);
 }
 
+static vector<UPnPDeviceDirectory::LostVisitor> o_lostcallbacks;
+
+unsigned int UPnPDeviceDirectory::addLostCallback(
+    UPnPDeviceDirectory::LostVisitor v)
+{
+    std::unique_lock<std::mutex> lock(o_callbacks_mutex);
+    o_lostcallbacks.push_back(v);
+    return o_lostcallbacks.size() - 1;
+}
+
+void UPnPDeviceDirectory::delLostCallback(unsigned int idx)
+{
+    std::unique_lock<std::mutex> lock(o_callbacks_mutex);
+    if (idx >= o_lostcallbacks.size())
+        return;
+    o_lostcallbacks.erase(o_lostcallbacks.begin() + idx);
+}
+
+bool UPnPDeviceDirectory::setDeviceTypes(const vector<string>& types,
+                                         int maxRate)
+{
+    vector<string> prefixes;
+    for (const auto& type : types) {
+        auto pos = type.rfind(':');
+        prefixes.push_back(pos == string::npos ? type : type.substr(0, pos + 1));
+    }
+
+    vector<const char *> targets;
+    for (const auto& prefix : prefixes)
+        targets.push_back(prefix.c_str());
+
+    int code = UpnpSetSsdpFilter(targets.empty() ? nullptr : &targets[0],
+                                 int(targets.size()), maxRate, 1);
+    if (code != UPNP_E_SUCCESS) {
+        LOGERR("UPnPDeviceDirectory::setDeviceTypes: " <<
+               LibUPnP::errAsString("UpnpSetSsdpFilter", code) << endl);
+        return false;
+    }
+
+    std::unique_lock<std::mutex> lock(o_devtypes_mutex);
+    o_searchtypes = types;
+    o_devtypes = prefixes;
+    return true;
+}
+
+// Called without the pool lock held, with the UDNs of removed devices
+static void notifyLost(const vector<string>& udns)
+{
+    if (udns.empty())
+        return;
+    std::unique_lock<std::mutex> lock(o_callbacks_mutex);
+    for (auto& cbp : o_lostcallbacks) {
+        for (const auto& udn : udns) {
+            (cbp)(udn);
+        }
+    }
+}
+
 // Descriptor kept in the device pool for each device found on the network.
 class DeviceDescriptor {
 public:
     DeviceDescriptor(const string& url, const string& description,
                      std::chrono::steady_clock::time_point last, int exp)
-        : device(url, description), last_seen(last),
+        : location(url), device(url, description), last_seen(last),
           expires(std::chrono::seconds(exp))
     {}
     DeviceDescriptor()
     {}
+    string location;
     UPnPDeviceDesc device;
     std::chrono::steady_clock::time_point last_seen;
     std::chrono::seconds expires; // seconds valid
@@ -256,14 +422,41 @@ void *UPnPDeviceDirectory::discoExplorer(void *)
 
         if (!tsk->alive) {
             // Device signals it is going off.
-            std::unique_lock<std::mutex> lock(o_pool.m_mutex);
-            auto it = o_pool.m_devices.find(tsk->deviceId);
-            if (it != o_pool.m_devices.end()) {
-                o_pool.m_devices.erase(it);
-                //LOGDEB("discoExplorer: delete " << tsk->deviceId.c_str() <<
-                // endl);
+            vector<string> lost;
+            {
+                std::unique_lock<std::mutex> lock(o_pool.m_mutex);
+                auto it = o_pool.m_devices.find(tsk->deviceId);
+                if (it != o_pool.m_devices.end()) {
+                    lost.push_back(it->second.device.UDN);
+                    for (const auto& it1 : it->second.device.embedded) {
+                        lost.push_back(it1.UDN);
+                    }
+                    o_pool.m_devices.erase(it);
+                    //LOGDEB("discoExplorer: delete " << tsk->deviceId.c_str() <<
+                    // endl);
+                }
             }
+            notifyLost(lost);
         } else {
+            // Unchanged description of known device only refreshes its
+            // timestamp, without parsing and calling the callbacks
+            bool refreshed = false;
+            {
+                std::unique_lock<std::mutex> lock(o_pool.m_mutex);
+                auto it = o_pool.m_devices.find(tsk->deviceId);
+                if (it != o_pool.m_devices.end() &&
+                    it->second.location == tsk->url &&
+                    it->second.device.XMLText == tsk->description) {
+                    it->second.last_seen = std::chrono::steady_clock::now();
+                    it->second.expires = std::chrono::seconds(tsk->expires);
+                    refreshed = true;
+                }
+            }
+            if (refreshed) {
+                delete tsk;
+                continue;
+            }
+
             // Update or insert the device
             DeviceDescriptor d(tsk->url, tsk->description,
                                std::chrono::steady_clock::now(),
@@ -299,26 +492,46 @@ void *UPnPDeviceDirectory::discoExplorer(void *)
 }
 
 // Look at the devices and get rid of those which have not been seen
-// for too long. We do this when listing the top directory
-void UPnPDeviceDirectory::expireDevices()
+// for too long. Returns true if some device was dropped.
+bool UPnPDeviceDirectory::dropExpired()
 {
-    LOGDEB1("discovery: expireDevices:" << endl);
-    std::unique_lock<std::mutex> lock(o_pool.m_mutex);
+    LOGDEB1("discovery: dropExpired:" << endl);
     auto now = std::chrono::steady_clock::now();
     bool didsomething = false;
+    vector<string> lost;
 
-    for (auto it = o_pool.m_devices.begin(); it != o_pool.m_devices.end();) {
-        LOGDEB1("Dev in pool: type: " << it->second.device.deviceType <<
-                " friendlyName " << it->second.device.friendlyName << endl);
-        if (now - it->second.last_seen > it->second.expires) {
-            LOGDEB1("expireDevices: deleting " <<  it->first.c_str() << " " <<
-                    it->second.device.friendlyName.c_str() << endl);
-            it = o_pool.m_devices.erase(it);
-            didsomething = true;
-        } else {
-            ++it;
+    {
+        std::unique_lock<std::mutex> lock(o_pool.m_mutex);
+        for (auto it = o_pool.m_devices.begin();
+             it != o_pool.m_devices.end();) {
+            LOGDEB1("Dev in pool: type: " << it->second.device.deviceType <<
+                    " friendlyName " << it->second.device.friendlyName << endl);
+            if (now - it->second.last_seen > it->second.expires) {
+                LOGDEB1("dropExpired: deleting " <<  it->first.c_str() <<
+                        " " << it->second.device.friendlyName.c_str() << endl);
+                lost.push_back(it->second.device.UDN);
+                for (const auto& it1 : it->second.device.embedded) {
+                    lost.push_back(it1.UDN);
+                }
+                it = o_pool.m_devices.erase(it);
+                didsomething = true;
+            } else {
+                ++it;
+            }
         }
     }
+
+    notifyLost(lost);
+
+    return didsomething;
+}
+
+// Drop expired devices and search again. We do this when listing the top
+// directory
+void UPnPDeviceDirectory::expireDevices()
+{
+    bool didsomething = dropExpired();
+
     // start a search if something changed or 5 S
     // elapsed. upnp-inspector uses a 2 S permanent loop (in
     // msearch.py, __init__()). This ought not to be necessary of
@@ -375,7 +588,14 @@ bool UPnPDeviceDirectory::search()
     }
 
     //const char *cp = "ssdp:all";
-    const char *cp = "upnp:rootdevice";
+    vector<string> targets;
+    {
+        std::unique_lock<std::mutex> lock(o_devtypes_mutex);
+        targets = o_searchtypes;
+    }
+    if (targets.empty())
+        targets.push_back("upnp:rootdevice");
+
     // We send the search message twice, like upnp-inspector does. This
     // definitely improves the reliability of the results (not to 100%
     // though).
@@ -383,14 +603,17 @@ bool UPnPDeviceDirectory::search()
         if (i != 0) {
             std::this_thread::sleep_for(std::chrono::milliseconds(100));
         }
-        LOGDEB1("UPnPDeviceDirectory::search: calling upnpsearchasync" << endl);
-        int code1 = m_ssdp_ip.empty() ?
-                    UpnpSearchAsync(lib->getclh(), m_searchTimeout, cp, lib) :
-                    UpnpSearchAsyncWithSsdpIP(lib->getclh(), m_searchTimeout, cp, lib, m_ssdp_ip.c_str());
-        if (code1 != UPNP_E_SUCCESS) {
-            m_reason = LibUPnP::errAsString("UpnpSearchAsync", code1);
-            LOGERR("UPnPDeviceDirectory::search: UpnpSearchAsync failed: " <<
-                   m_reason << endl);
+        for (const auto& target : targets) {
+            const char *cp = target.c_str();
+            LOGDEB1("UPnPDeviceDirectory::search: calling upnpsearchasync" << endl);
+            int code1 = m_ssdp_ip.empty() ?
+                        UpnpSearchAsync(lib->getclh(), m_searchTimeout, cp, lib) :
+                        UpnpSearchAsyncWithSsdpIP(lib->getclh(), m_searchTimeout, cp, lib, m_ssdp_ip.c_str());
+            if (code1 != UPNP_E_SUCCESS) {
+                m_reason = LibUPnP::errAsString("UpnpSearchAsync", code1);
+                LOGERR("UPnPDeviceDirectory::search: UpnpSearchAsync failed: " <<
+                       m_reason << endl);
+            }
         }
     }
     o_lastSearch = std::chrono::steady_clock::now();
@@ -406,6 +629,20 @@ UPnPDeviceDirectory *UPnPDeviceDirectory::getTheDir(time_t search_window)
     return theDevDir;
 }
 
+void UPnPDeviceDirectory::reset()
+{
+    {
+        std::unique_lock<std::mutex> lock(o_pool.m_mutex);
+        o_pool.m_devices.clear();
+    }
+    {
+        std::unique_lock<std::mutex> lock(o_desccache_mutex);
+        o_desccache.clear();
+    }
+    // Next search is not throttled
+    o_lastSearch = std::chrono::steady_clock::time_point();
+}
+
 void UPnPDeviceDirectory::terminate()
 {
     discoveredQueue.setTerminateAndWait();
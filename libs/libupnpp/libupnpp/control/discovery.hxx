@@ -22,6 +22,7 @@
 #include <time.h>
 
 #include <string>
+#include <vector>
 #include <functional>
 
 namespace UPnPClient {
@@ -65,6 +66,11 @@ public:
      */
     static UPnPDeviceDirectory *getTheDir(time_t search_window = 3);
 
+    /** Forget all known devices, without calling lost callbacks, e.g.
+     * when devices from previous network are not reachable anymore.
+     */
+    static void reset();
+
     /** Clean up before exit. Do call this.*/
     static void terminate();
 
@@ -75,6 +81,14 @@ public:
        the directory and call Visitor for each device/service pair */
     bool traverse(Visitor);
 
+    /** Drop devices which max-age elapsed and call lost callbacks for
+     * them. Unlike traverse(), this never waits and never sends search,
+     * so it can be called periodically without network traffic.
+     *
+     * @return true if some device was dropped.
+     */
+    bool dropExpired();
+
     /** Remaining time until current search complete */
     time_t getRemainingDelayMs();
     time_t getRemainingDelay();
@@ -85,6 +99,26 @@ public:
     static unsigned int addCallback(Visitor v);
     static void delCallback(unsigned int idx);
 
+    typedef std::function<void (const std::string& UDN)> LostVisitor;
+
+    /** Set a callback to be called when a device is removed from the
+     *  pool, either after byebye or when its max-age expired.
+     *  The visitor will be called for the root and every embedded device.
+     */
+    static unsigned int addLostCallback(LostVisitor v);
+    static void delLostCallback(unsigned int idx);
+
+    /** Limit discovery to devices of given types, e.g.
+     *  "urn:schemas-upnp-org:device:MediaRenderer:1" (any version matches).
+     *  Search is sent for every type and libupnp drops SSDP messages
+     *  of other devices before they reach us. Repeated advertisements and
+     *  messages above maxRate per second from one address (0 is no limit)
+     *  are dropped as well. Empty list restores discovery of all root
+     *  devices. Needs initialized LibUPnP.
+     */
+    static bool setDeviceTypes(const std::vector<std::string>& types,
+                               int maxRate = 0);
+
     /** Find device by 'friendly name'.
      *
      * This will wait for the remaining duration of the search window if the 
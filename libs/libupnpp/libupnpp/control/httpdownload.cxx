@@ -22,9 +22,19 @@
 #include "libupnpp/config.h"
 
 #include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <string>
 #include <sys/types.h>
 
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
 #include <curl/curl.h>
 
 #include "libupnpp/log.hxx"
@@ -71,3 +81,222 @@ bool downloadUrlWithCurl(const string& url, string& out, long timeoutsecs)
 
     return ret;
 }
+
+namespace {
+const long maxHostConnections = 2;
+const long maxTotalConnections = 16;
+const long connectTimeoutSecs = 3;
+// Location which failed is not retried for this long
+const std::chrono::seconds negativeTtl(60);
+const int waitMs = 1000;
+}
+
+class HttpFetcher::Internal {
+public:
+    struct Request {
+        string url;
+        long timeoutsecs;
+        Callback cb;
+        string data;
+        CURL *curl;
+    };
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::deque<Request*> pending;
+    // Urls queued or in transfer
+    std::unordered_set<string> active;
+    std::unordered_map<string, std::chrono::steady_clock::time_point> failed;
+    CURLM *multi;
+    // Wakes up curl_multi_wait when new request is queued
+    int wakefds[2];
+
+    Internal();
+    void run();
+    bool start(Request *req);
+    void finish(CURL *curl, CURLcode res);
+};
+
+HttpFetcher::Internal::Internal()
+{
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+
+    multi = curl_multi_init();
+    if (!multi) {
+        LOGERR("HttpFetcher: curl_multi_init failed" << endl);
+        return;
+    }
+    curl_multi_setopt(multi, CURLMOPT_MAX_HOST_CONNECTIONS,
+                      maxHostConnections);
+    curl_multi_setopt(multi, CURLMOPT_MAX_TOTAL_CONNECTIONS,
+                      maxTotalConnections);
+
+    if (pipe(wakefds) < 0) {
+        LOGERR("HttpFetcher: pipe failed" << endl);
+        wakefds[0] = wakefds[1] = -1;
+    } else {
+        fcntl(wakefds[0], F_SETFL, O_NONBLOCK);
+        fcntl(wakefds[1], F_SETFL, O_NONBLOCK);
+    }
+
+    std::thread(&HttpFetcher::Internal::run, this).detach();
+}
+
+bool HttpFetcher::Internal::start(Request *req)
+{
+    req->curl = curl_easy_init();
+    if (!req->curl) {
+        LOGERR("HttpFetcher: curl_easy_init failed" << endl);
+        return false;
+    }
+
+    curl_easy_setopt(req->curl, CURLOPT_URL, req->url.c_str());
+    curl_easy_setopt(req->curl, CURLOPT_TIMEOUT, req->timeoutsecs);
+    curl_easy_setopt(req->curl, CURLOPT_CONNECTTIMEOUT,
+                     req->timeoutsecs < connectTimeoutSecs ?
+                     req->timeoutsecs : connectTimeoutSecs);
+    curl_easy_setopt(req->curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(req->curl, CURLOPT_WRITEFUNCTION, write_callback);
+    curl_easy_setopt(req->curl, CURLOPT_WRITEDATA, &req->data);
+    curl_easy_setopt(req->curl, CURLOPT_PRIVATE, req);
+
+    if (curl_multi_add_handle(multi, req->curl) != CURLM_OK) {
+        LOGERR("HttpFetcher: curl_multi_add_handle failed" << endl);
+        curl_easy_cleanup(req->curl);
+        return false;
+    }
+
+    return true;
+}
+
+void HttpFetcher::Internal::finish(CURL *curl, CURLcode res)
+{
+    Request *req = nullptr;
+    curl_easy_getinfo(curl, CURLINFO_PRIVATE, &req);
+
+    long code = 0;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &code);
+    bool ok = res == CURLE_OK && code >= 200 && code < 300;
+    if (!ok) {
+        LOGERR("HttpFetcher: " << req->url << ": " <<
+               (res != CURLE_OK ? curl_easy_strerror(res) : "http error") <<
+               " " << code << endl);
+    }
+
+    curl_multi_remove_handle(multi, curl);
+    curl_easy_cleanup(curl);
+
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        active.erase(req->url);
+        if (!ok) {
+            auto now = std::chrono::steady_clock::now();
+            for (auto it = failed.begin(); it != failed.end();) {
+                if (now - it->second >= negativeTtl) {
+                    it = failed.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+            failed[req->url] = now;
+        }
+    }
+
+    req->cb(ok, ok ? req->data : string());
+    delete req;
+}
+
+void HttpFetcher::Internal::run()
+{
+    int running = 0;
+
+    for (;;) {
+        std::deque<Request*> reqs;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (running == 0)
+                cond.wait(lock, [this] { return !pending.empty(); });
+            reqs.swap(pending);
+        }
+
+        for (auto req : reqs) {
+            if (!start(req)) {
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    active.erase(req->url);
+                }
+                req->cb(false, string());
+                delete req;
+            }
+        }
+
+        curl_multi_perform(multi, &running);
+
+        CURLMsg *msg;
+        int left;
+        while ((msg = curl_multi_info_read(multi, &left))) {
+            if (msg->msg == CURLMSG_DONE)
+                finish(msg->easy_handle, msg->data.result);
+        }
+
+        if (running > 0) {
+            struct curl_waitfd wfd;
+            wfd.fd = wakefds[0];
+            wfd.events = CURL_WAIT_POLLIN;
+            wfd.revents = 0;
+            curl_multi_wait(multi, &wfd, wakefds[0] < 0 ? 0 : 1, waitMs,
+                            nullptr);
+            if (wfd.revents) {
+                char buf[64];
+                while (read(wakefds[0], buf, sizeof(buf)) > 0)
+                    ;
+            }
+        }
+    }
+}
+
+HttpFetcher::HttpFetcher()
+    : m(new Internal())
+{
+}
+
+HttpFetcher *HttpFetcher::getFetcher()
+{
+    static HttpFetcher *fetcher = new HttpFetcher();
+    return fetcher;
+}
+
+bool HttpFetcher::fetch(const string& url, long timeoutsecs, Callback cb)
+{
+    if (!m->multi)
+        return false;
+
+    {
+        std::unique_lock<std::mutex> lock(m->mutex);
+
+        auto it = m->failed.find(url);
+        if (it != m->failed.end()) {
+            if (std::chrono::steady_clock::now() - it->second < negativeTtl) {
+                LOGDEB1("HttpFetcher: recently failed: " << url << endl);
+                return false;
+            }
+            m->failed.erase(it);
+        }
+
+        if (!m->active.insert(url).second)
+            return false;
+
+        m->pending.push_back(new Internal::Request{url, timeoutsecs, cb,
+                                                   string(), nullptr});
+    }
+
+    m->cond.notify_one();
+    if (m->wakefds[1] >= 0) {
+        char c = 0;
+        if (write(m->wakefds[1], &c, 1) < 0) {
+            // Pipe is full, so the thread is going to wake up anyway
+        }
+    }
+
+    return true;
+}
@@ -19,8 +19,35 @@
 #define _HTTPDOWNLOAD_H_X_INCLUDED_
 
 #include <string>
+#include <functional>
 
 extern bool downloadUrlWithCurl(const std::string& url,
                                 std::string& out, long timeoutsecs);
 
+/** Asynchronous downloader of small documents (device descriptions).
+ *
+ * All transfers are run by one thread with curl_multi, so a slow or dead
+ * host delays only its own requests. Connections per host are limited and
+ * locations which failed are not retried for a while.
+ */
+class HttpFetcher {
+public:
+    /** Called from the fetcher thread, data is empty on failure */
+    typedef std::function<void (bool ok, const std::string& data)> Callback;
+
+    static HttpFetcher *getFetcher();
+
+    /** Queue download of url. Returns false, without calling cb, if url
+     *  is being fetched already or it failed recently. */
+    bool fetch(const std::string& url, long timeoutsecs, Callback cb);
+
+private:
+    class Internal;
+    Internal *m;
+
+    HttpFetcher();
+    HttpFetcher(const HttpFetcher&) = delete;
+    HttpFetcher& operator=(const HttpFetcher&) = delete;
+};
+
 #endif /* _HTTPDOWNLOAD.H_X_INCLUDED_ */
@@ -256,4 +256,80 @@ bool RenderingControl::getMute(const string& channel)
     return mute;
 }
 
+int RenderingControl::setVolumeAsync(int ivol, StatusCB cb, int timeoutms,
+                                     const string& channel)
+{
+    if (ivol < 0)
+        ivol = 0;
+    if (ivol > 100)
+        ivol = 100;
+    int desiredVolume = ivol;
+    if (m_volmin != 0 || m_volmax != 100) {
+        double fact = double(m_volmax - m_volmin) / 100.0;
+        desiredVolume = m_volmin + int(floor(ivol * fact + 0.5));
+    }
+    int remainder = (desiredVolume - m_volmin) % m_volstep;
+    if (remainder) {
+        if (2 * remainder >= m_volstep)
+            desiredVolume += m_volstep - remainder;
+        else
+            desiredVolume -= remainder;
+    }
+
+    SoapOutgoing args(getServiceType(), "SetVolume");
+    args("InstanceID", "0")("Channel", channel)
+    ("DesiredVolume", SoapHelp::i2s(desiredVolume));
+    return runActionAsync(args, [cb](int ret, const SoapIncoming&) {
+        cb(ret);
+    }, timeoutms);
+}
+
+int RenderingControl::getVolumeAsync(VolumeCB cb, int timeoutms,
+                                     const string& channel)
+{
+    SoapOutgoing args(getServiceType(), "GetVolume");
+    args("InstanceID", "0")("Channel", channel);
+    return runActionAsync(args, [this, cb](int ret, const SoapIncoming& data) {
+        int volume = 0;
+        if (ret == UPNP_E_SUCCESS) {
+            int dev_volume;
+            if (data.get("CurrentVolume", &dev_volume)) {
+                volume = devVolTo0100(dev_volume);
+            } else {
+                LOGERR("RenderingControl:getVolumeAsync: missing "
+                       "CurrentVolume in response" << endl);
+                ret = UPNP_E_BAD_RESPONSE;
+            }
+        }
+        cb(ret, volume);
+    }, timeoutms);
+}
+
+int RenderingControl::setMuteAsync(bool mute, StatusCB cb, int timeoutms,
+                                   const string& channel)
+{
+    SoapOutgoing args(getServiceType(), "SetMute");
+    args("InstanceID", "0")("Channel", channel)
+    ("DesiredMute", SoapHelp::i2s(mute?1:0));
+    return runActionAsync(args, [cb](int ret, const SoapIncoming&) {
+        cb(ret);
+    }, timeoutms);
+}
+
+int RenderingControl::getMuteAsync(MuteCB cb, int timeoutms,
+                                   const string& channel)
+{
+    SoapOutgoing args(getServiceType(), "GetMute");
+    args("InstanceID", "0")("Channel", channel);
+    return runActionAsync(args, [cb](int ret, const SoapIncoming& data) {
+        bool mute = false;
+        if (ret == UPNP_E_SUCCESS && !data.get("CurrentMute", &mute)) {
+            LOGERR("RenderingControl:getMuteAsync: missing CurrentMute "
+                   "in response" << endl);
+            ret = UPNP_E_BAD_RESPONSE;
+        }
+        cb(ret, mute);
+    }, timeoutms);
+}
+
 } // End namespace UPnPClient
@@ -66,6 +66,23 @@ public:
     int setMute(bool mute, const std::string& channel = "Master");
     bool getMute(const std::string& channel = "Master");
 
+    /* Asynchronous forms of the above, see Service::runActionAsync() for
+     * return values, threading and timeouts. setVolumeAsync() doesn't
+     * read the current volume first, so it rounds to the nearest device
+     * step. */
+    typedef std::function<void (int)> StatusCB;
+    typedef std::function<void (int, int)> VolumeCB;
+    typedef std::function<void (int, bool)> MuteCB;
+
+    int setVolumeAsync(int volume, StatusCB cb, int timeoutms = 0,
+                       const std::string& channel = "Master");
+    int getVolumeAsync(VolumeCB cb, int timeoutms = 0,
+                       const std::string& channel = "Master");
+    int setMuteAsync(bool mute, StatusCB cb, int timeoutms = 0,
+                     const std::string& channel = "Master");
+    int getMuteAsync(MuteCB cb, int timeoutms = 0,
+                     const std::string& channel = "Master");
+
 protected:
     /* My service type string */
     static const std::string SType;
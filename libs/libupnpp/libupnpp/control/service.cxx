@@ -22,8 +22,17 @@
 #include <upnp/upnp.h>                  // for Upnp_Event, UPNP_E_SUCCESS, etc
 #include <upnp/upnptools.h>             // for UpnpGetErrorMessage
 
+#include <stdint.h>                     // for intptr_t
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
 #include <string>                       // for string, char_traits, etc
+#include <thread>
+#include <unordered_map>
 #include <utility>                      // for pair
+#include <vector>
 
 #include "libupnpp/control/description.hxx"  // for UPnPDeviceDesc, etc
 #include "libupnpp/ixmlwrap.hxx"
@@ -56,6 +65,7 @@ public:
     /** Upper level client code event callbacks. To be called by derived class
      * for reporting events. */
     VarEventReporter *reporter;
+    ActionObserver *observer;
     std::string actionURL;
     std::string eventURL;
     std::string serviceType;
@@ -74,6 +84,131 @@ public:
  * an event. */
 static std::unordered_map<std::string, evtCBFunc> o_calls;
 
+/** Asynchronous actions waiting for completion. The libupnp cookie is
+ * the action id, never a pointer, so a response arriving after
+ * cancelation, timeout or destruction of the service just finds
+ * nothing to complete. */
+class PendingActions {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Action {
+        actCBFunc cb;
+        std::string name;
+        const Service *owner;
+        ActionObserver *observer;
+        bool timed;
+        Clock::time_point start;
+        Clock::time_point deadline;
+
+        // Completion of the exchange, canceled actions are not reported
+        void done(int ret, const SoapIncoming& data) {
+            if (observer && ret != UPNP_E_CANCELED) {
+                auto ms = std::chrono::duration_cast<
+                    std::chrono::milliseconds>(Clock::now() - start);
+                observer->actionDone(name, ret, int(ms.count()));
+            }
+            cb(ret, data);
+        }
+    };
+
+    static PendingActions *get() {
+        // Never deleted: libupnp threads may still be completing actions
+        // while static objects are destroyed at exit
+        static PendingActions *pa = new PendingActions;
+        return pa;
+    }
+
+    int add(const Action& act) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        do {
+            m_nextid = m_nextid == INT32_MAX ? 1 : m_nextid + 1;
+        } while (m_actions.find(m_nextid) != m_actions.end());
+        m_actions[m_nextid] = act;
+        if (act.timed) {
+            if (!m_watching) {
+                m_watching = true;
+                std::thread(&PendingActions::watch, this).detach();
+            }
+            m_cond.notify_one();
+        }
+        return m_nextid;
+    }
+
+    bool take(int id, Action& act) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        auto it = m_actions.find(id);
+        if (it == m_actions.end())
+            return false;
+        act = it->second;
+        m_actions.erase(it);
+        return true;
+    }
+
+    std::vector<Action> takeAll(const Service *owner) {
+        std::vector<Action> acts;
+        std::unique_lock<std::mutex> lock(m_mutex);
+        for (auto it = m_actions.begin(); it != m_actions.end();) {
+            if (it->second.owner == owner) {
+                acts.push_back(it->second);
+                it = m_actions.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        return acts;
+    }
+
+    int count() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        return int(m_actions.size());
+    }
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::unordered_map<int, Action> m_actions;
+    int m_nextid = 0;
+    bool m_watching = false;
+
+    // Completes timed out actions. One thread serves all services.
+    void watch() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        for (;;) {
+            Clock::time_point now = Clock::now();
+            Clock::time_point next = Clock::time_point::max();
+            std::vector<Action> expired;
+            for (auto it = m_actions.begin(); it != m_actions.end();) {
+                if (it->second.timed && it->second.deadline <= now) {
+                    expired.push_back(it->second);
+                    it = m_actions.erase(it);
+                    continue;
+                }
+                if (it->second.timed && it->second.deadline < next)
+                    next = it->second.deadline;
+                ++it;
+            }
+
+            if (!expired.empty()) {
+                lock.unlock();
+                SoapIncoming nodata;
+                for (auto& act : expired) {
+                    LOGINF("Service::runActionAsync: " << act.name <<
+                           " timed out" << endl);
+                    act.done(UPNP_E_TIMEDOUT, nodata);
+                }
+                lock.lock();
+                continue;
+            }
+
+            if (next == Clock::time_point::max())
+                m_cond.wait(lock);
+            else
+                m_cond.wait_until(lock, next);
+        }
+    }
+};
+
 
 Service::Service(const UPnPDeviceDesc& devdesc,
                  const UPnPServiceDesc& servdesc)
@@ -84,6 +219,7 @@ Service::Service(const UPnPDeviceDesc& devdesc,
     }
 
     m->reporter = 0;
+    m->observer = 0;
     m->actionURL = caturl(devdesc.URLBase, servdesc.controlURL);
     m->eventURL = caturl(devdesc.URLBase, servdesc.eventSubURL);
     m->serviceType = servdesc.serviceType;
@@ -104,6 +240,7 @@ Service::Service()
         return;
     }
     m->reporter = 0;
+    m->observer = 0;
 }
 
 Service::~Service()
@@ -111,6 +248,9 @@ Service::~Service()
     //LOGDEB("Service::~Service: " << m->serviceType << " SID " <<
     // m->SID << endl);
     unregisterCallback();
+    // Callbacks may refer to the derived object which is gone already,
+    // so pending actions are dropped without completion
+    PendingActions::get()->takeAll(this);
     delete m;
     m = 0;
 }
@@ -129,6 +269,7 @@ bool Service::reInit(const UPnPDeviceDesc& devdesc,
     }
 
     m->reporter = 0;
+    m->observer = old_m->observer;
     m->actionURL = caturl(devdesc.URLBase, servdesc.controlURL);
     m->eventURL = caturl(devdesc.URLBase, servdesc.eventSubURL);
     m->serviceType = servdesc.serviceType;
@@ -198,31 +339,16 @@ void Service::installReporter(VarEventReporter* reporter)
     m->reporter = reporter;
 }
 
-int Service::runAction(const SoapOutgoing& args, SoapIncoming& data)
+void Service::installObserver(ActionObserver* observer)
 {
-    LibUPnP* lib = LibUPnP::getLibUPnP();
-    if (lib == 0) {
-        LOGINF("Service::runAction: no lib" << endl);
-        return UPNP_E_OUTOF_MEMORY;
-    }
-    UpnpClient_Handle hdl = lib->getclh();
-
-    IXML_Document *request(0);
-    IXML_Document *response(0);
-    IxmlCleaner cleaner(&request, &response);
-
-    if ((request = args.buildSoapBody(false)) == 0) {
-        LOGINF("Service::runAction: buildSoapBody failed" << endl);
-        return  UPNP_E_OUTOF_MEMORY;
-    }
-
-    LOGDEB1("Service::runAction: url [" << m->actionURL <<
-           " serviceType " << m->serviceType <<
-           " rqst: [" << ixmlwPrintDoc(request) << "]" << endl);
-
-    int ret = UpnpSendAction(hdl, m->actionURL.c_str(), m->serviceType.c_str(),
-                             0 /*devUDN*/, request, &response);
+    m->observer = observer;
+}
 
+// Common result processing for the synchronous and asynchronous actions
+static int decodeActionResult(const string& actName, int ret,
+                              IXML_Document *request,
+                              IXML_Document *response, SoapIncoming& data)
+{
     if (ret != UPNP_E_SUCCESS) {
         if (ret < 0) {
             LOGINF("Service::runAction: UpnpSendAction failed: " << ret <<
@@ -245,7 +371,7 @@ int Service::runAction(const SoapOutgoing& args, SoapIncoming& data)
     LOGDEB1("Service::runAction: rslt: [" <<
             ixmlwPrintDoc(response) << "]" << endl);
 
-    if (!data.decode(args.getName().c_str(), response)) {
+    if (!data.decode(actName.c_str(), response)) {
         LOGERR("Service::runAction: Could not decode response: " <<
                ixmlwPrintDoc(response) << endl);
         return UPNP_E_BAD_RESPONSE;
@@ -256,6 +382,166 @@ int Service::runAction(const SoapOutgoing& args, SoapIncoming& data)
     return UPNP_E_SUCCESS;
 }
 
+int Service::runAction(const SoapOutgoing& args, SoapIncoming& data)
+{
+    int timeoutms = m->observer ?
+        m->observer->actionTimeout(args.getName()) : 0;
+    if (timeoutms > 0) {
+        // libupnp has no timeout for synchronous actions, so the
+        // asynchronous path with its timeout is used and waited for
+        struct Reply {
+            std::mutex mutex;
+            std::condition_variable cond;
+            bool done = false;
+            int ret = 0;
+            SoapIncoming data;
+        };
+        auto reply = std::make_shared<Reply>();
+        int id = runActionAsync(args, [reply](int ret,
+                                              const SoapIncoming& data) {
+            std::unique_lock<std::mutex> lock(reply->mutex);
+            reply->ret = ret;
+            reply->data = data;
+            reply->done = true;
+            reply->cond.notify_all();
+        }, timeoutms);
+        if (id < 0)
+            return id;
+        std::unique_lock<std::mutex> lock(reply->mutex);
+        reply->cond.wait(lock, [reply] { return reply->done; });
+        data = reply->data;
+        return reply->ret;
+    }
+
+    PendingActions::Clock::time_point start = PendingActions::Clock::now();
+
+    LibUPnP* lib = LibUPnP::getLibUPnP();
+    if (lib == 0) {
+        LOGINF("Service::runAction: no lib" << endl);
+        return UPNP_E_OUTOF_MEMORY;
+    }
+    UpnpClient_Handle hdl = lib->getclh();
+
+    IXML_Document *request(0);
+    IXML_Document *response(0);
+    IxmlCleaner cleaner(&request, &response);
+
+    if ((request = args.buildSoapBody(false)) == 0) {
+        LOGINF("Service::runAction: buildSoapBody failed" << endl);
+        return  UPNP_E_OUTOF_MEMORY;
+    }
+
+    LOGDEB1("Service::runAction: url [" << m->actionURL <<
+           " serviceType " << m->serviceType <<
+           " rqst: [" << ixmlwPrintDoc(request) << "]" << endl);
+
+    int ret = UpnpSendAction(hdl, m->actionURL.c_str(), m->serviceType.c_str(),
+                             0 /*devUDN*/, request, &response);
+
+    ret = decodeActionResult(args.getName(), ret, request, response, data);
+
+    if (m->observer) {
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+            PendingActions::Clock::now() - start);
+        m->observer->actionDone(args.getName(), ret, int(ms.count()));
+    }
+
+    return ret;
+}
+
+int Service::runActionAsync(const SoapOutgoing& args, actCBFunc cb,
+                            int timeoutms)
+{
+    LibUPnP* lib = LibUPnP::getLibUPnP();
+    if (lib == 0) {
+        LOGINF("Service::runActionAsync: no lib" << endl);
+        return UPNP_E_OUTOF_MEMORY;
+    }
+    UpnpClient_Handle hdl = lib->getclh();
+
+    IXML_Document *request(0);
+    IXML_Document *response(0);
+    IxmlCleaner cleaner(&request, &response);
+
+    if ((request = args.buildSoapBody(false)) == 0) {
+        LOGINF("Service::runActionAsync: buildSoapBody failed" << endl);
+        return  UPNP_E_OUTOF_MEMORY;
+    }
+
+    if (timeoutms <= 0 && m->observer)
+        timeoutms = m->observer->actionTimeout(args.getName());
+
+    PendingActions::Action act;
+    act.cb = cb;
+    act.name = args.getName();
+    act.owner = this;
+    act.observer = m->observer;
+    act.start = PendingActions::Clock::now();
+    act.timed = timeoutms > 0;
+    if (act.timed)
+        act.deadline = PendingActions::Clock::now() +
+            std::chrono::milliseconds(timeoutms);
+
+    auto pending = PendingActions::get();
+    int id = pending->add(act);
+
+    // libupnp copies the request document
+    int ret = UpnpSendActionAsync(hdl, m->actionURL.c_str(),
+                                  m->serviceType.c_str(), 0 /*devUDN*/,
+                                  request, actCB, (void *)(intptr_t)id);
+    if (ret != UPNP_E_SUCCESS) {
+        LOGINF("Service::runActionAsync: UpnpSendActionAsync failed: " <<
+               ret << " : " << UpnpGetErrorMessage(ret) << endl);
+        // Timeout watcher or cancel may have completed the action
+        // already, then the failure was reported through the callback
+        if (pending->take(id, act))
+            return ret;
+    }
+
+    return id;
+}
+
+bool Service::cancelAction(int id)
+{
+    PendingActions::Action act;
+    if (!PendingActions::get()->take(id, act))
+        return false;
+    SoapIncoming nodata;
+    act.cb(UPNP_E_CANCELED, nodata);
+    return true;
+}
+
+void Service::cancelActions()
+{
+    SoapIncoming nodata;
+    for (auto& act : PendingActions::get()->takeAll(this))
+        act.cb(UPNP_E_CANCELED, nodata);
+}
+
+int Service::pendingActions()
+{
+    return PendingActions::get()->count();
+}
+
+int Service::actCB(Upnp_EventType et, void* vevp, void* cookie)
+{
+    if (et != UPNP_CONTROL_ACTION_COMPLETE)
+        return UPNP_E_SUCCESS;
+
+    PendingActions::Action act;
+    if (!PendingActions::get()->take(int(intptr_t(cookie)), act)) {
+        LOGDEB1("Service::actCB: action not pending anymore" << endl);
+        return UPNP_E_SUCCESS;
+    }
+
+    struct Upnp_Action_Complete *evp = (struct Upnp_Action_Complete *)vevp;
+    SoapIncoming data;
+    int ret = decodeActionResult(act.name, evp->ErrCode, evp->ActionRequest,
+                                 evp->ActionResult, data);
+    act.done(ret, data);
+    return UPNP_E_SUCCESS;
+}
+
 int Service::runTrivialAction(const std::string& actionName)
 {
     SoapOutgoing args(m->serviceType, actionName);
@@ -66,6 +66,33 @@ typedef
 std::function<void (const std::unordered_map<std::string, std::string>&)>
 evtCBFunc;
 
+/** Completion callback for asynchronous actions. Receives the action
+ * status (UPNP_E_SUCCESS, a libupnp error, or a positive UPnP error
+ * code returned by the device) and the decoded response data. It is
+ * called exactly once, from a libupnp worker thread, the timeout
+ * thread or the thread doing the cancelation, so it must not block
+ * for long.
+ */
+typedef std::function<void (int, const UPnPP::SoapIncoming&)> actCBFunc;
+
+/** Watches the action exchanges of a service, e.g. to keep latency
+ * statistics and to derive timeouts from them. The methods are called
+ * from the thread running the action, a libupnp worker or the timeout
+ * thread, so they must be thread-safe and must not block.
+ */
+class ActionObserver {
+public:
+    virtual ~ActionObserver() {}
+    /** Action finished with status ret (including UPNP_E_TIMEDOUT)
+     * after ms milliseconds. Canceled actions are not reported. */
+    virtual void actionDone(const std::string& name, int ret, int ms) = 0;
+    /** Timeout in ms for an action which is run without an explicit
+     * one. 0 means the libupnp default. */
+    virtual int actionTimeout(const std::string& /*name*/) {
+        return 0;
+    }
+};
+
 class Service {
 public:
     /** Construct by copying data from device and service objects.
@@ -99,6 +126,34 @@ public:
     virtual int runAction(const UPnPP::SoapOutgoing& args,
                           UPnPP::SoapIncoming& data);
 
+    /** Send action without waiting for the response.
+     *
+     * The SOAP exchange runs in the libupnp client thread pool and the
+     * result is delivered to cb. If timeoutms is positive and there is
+     * no response by then, cb gets UPNP_E_TIMEDOUT and the late
+     * response is discarded.
+     *
+     * @return an action id (> 0) for cancelAction(), or a negative
+     *   libupnp error if the action could not be sent, in which case cb
+     *   is not called. cb is called at most once: if it already got
+     *   the failure (timeout or cancel raced with the send), the id is
+     *   returned.
+     */
+    int runActionAsync(const UPnPP::SoapOutgoing& args, actCBFunc cb,
+                       int timeoutms = 0);
+
+    /** Complete a pending action with UPNP_E_CANCELED. The request
+     * already on the wire is not aborted, but its response is
+     * discarded. Returns false if the action was not pending anymore. */
+    bool cancelAction(int id);
+
+    /** Cancel all pending actions of this service */
+    void cancelActions();
+
+    /** Number of asynchronous actions still waiting for completion,
+     * for all services */
+    static int pendingActions();
+
     /** Run trivial action where there are neither input parameters
        nor return data (beyond the status) */
     int runTrivialAction(const std::string& actionName);
@@ -118,6 +173,10 @@ public:
 
     virtual void installReporter(VarEventReporter* reporter);
 
+    /** Observer for all actions of this service, nullptr to remove.
+     * With an observer giving a timeout, runAction() is executed
+     * asynchronously and gives up after that time. */
+    void installObserver(ActionObserver* observer);
 
 protected:
 
@@ -142,6 +201,8 @@ private:
     static bool initEvents();
     /* The static event callback given to libupnp */
     static int srvCB(Upnp_EventType et, void* vevp, void*);
+    /* The static action completion callback given to libupnp */
+    static int actCB(Upnp_EventType et, void* vevp, void* cookie);
     /* Tell the UPnP device (through libupnp) that we want to receive
        its events. This is called by registerCallback() and sets m_SID */
     virtual bool subscribe();
@@ -45,6 +45,21 @@ SoapIncoming::SoapIncoming()
     }
 }
 
+SoapIncoming::SoapIncoming(const SoapIncoming& other)
+{
+    if ((m = new Internal(*other.m)) == 0) {
+        LOGERR("SoapIncoming::SoapIncoming: out of memory" << endl);
+        return;
+    }
+}
+
+SoapIncoming& SoapIncoming::operator=(const SoapIncoming& other)
+{
+    if (this != &other)
+        *m = *other.m;
+    return *this;
+}
+
 SoapIncoming::~SoapIncoming()
 {
     delete m;
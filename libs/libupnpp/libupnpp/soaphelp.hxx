@@ -36,6 +36,8 @@ namespace UPnPP {
 class SoapIncoming {
 public:
     SoapIncoming();
+    SoapIncoming(const SoapIncoming& other);
+    SoapIncoming& operator=(const SoapIncoming& other);
     ~SoapIncoming();
 
     /** Construct by decoding the XML passed from libupnp. Call ok() to check
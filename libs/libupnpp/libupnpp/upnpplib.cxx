@@ -67,6 +67,8 @@ public:
 
     bool ok;
     int  init_error;
+    bool serveronly;
+    unsigned short port;
     UpnpClient_Handle clh;
     std::mutex mutex;
     std::map<Upnp_EventType, Handler> handlers;
@@ -76,18 +78,15 @@ LibUPnP *LibUPnP::getLibUPnP(bool serveronly, string* hwaddr,
                              const string ifname, const string ip,
                              unsigned short port)
 {
-    if (theLib && !theLib->ok()) {
-        delete theLib;
-        theLib = 0;
-    }
+    // Failed library is initialized again instead of being replaced, so
+    // handlers registered by upper layers (e.g. discovery) are kept
+    if (theLib && !theLib->ok())
+        theLib->reinit(ifname, ip, hwaddr);
 
     if (theLib == 0)
         theLib = new LibUPnP(serveronly, hwaddr, ifname, ip, port);
-    if (theLib && !theLib->ok()) {
-        delete theLib;
-        theLib = 0;
+    if (theLib && !theLib->ok())
         return 0;
-    }
     return theLib;
 }
 
@@ -125,6 +124,30 @@ LibUPnP::LibUPnP(bool serveronly, string* hwaddr,
         return;
     }
 
+    m->serveronly = serveronly;
+    m->port = port;
+
+    init(hwaddr, ifname, inip);
+}
+
+bool LibUPnP::reinit(const string& ifname, const string& ip, string* hwaddr)
+{
+    LOGDEB("LibUPnP::reinit: ifname [" << ifname << "] ip [" << ip << "]"
+           << endl);
+
+    // Handlers are kept, so upper layers don't need to register again
+    int error = UpnpFinish();
+    if (error != UPNP_E_SUCCESS) {
+        LOGINF("LibUPnP::reinit: " << errAsString("UpnpFinish", error)
+               << endl);
+    }
+
+    init(hwaddr, ifname, ip);
+    return m->ok;
+}
+
+void LibUPnP::init(string* hwaddr, const string& ifname, const string& inip)
+{
     m->ok = false;
 
     // If our caller wants to retrieve an ethernet address (typically
@@ -149,7 +172,7 @@ LibUPnP::LibUPnP(bool serveronly, string* hwaddr,
     if (ifname.empty())
         strncpy(ip_address, inip.c_str(), ipalen);
 
-    m->init_error = UpnpInit(ip_address[0] ? ip_address : 0, port);
+    m->init_error = UpnpInit(ip_address[0] ? ip_address : 0, m->port);
 
     if (m->init_error != UPNP_E_SUCCESS) {
         LOGERR(errAsString("UpnpInit", m->init_error) << endl);
@@ -166,7 +189,7 @@ LibUPnP::LibUPnP(bool serveronly, string* hwaddr,
 
     // Client initialization is simple, just do it. Defer device
     // initialization because it's more complicated.
-    if (serveronly) {
+    if (m->serveronly) {
         m->ok = true;
     } else {
         m->init_error = UpnpRegisterClient(o_callback, (void *)this, &m->clh);
@@ -62,6 +62,15 @@ public:
                                const std::string ip = std::string(),
                                unsigned short port = 0);
 
+    /** Restart libupnp on other interface or address, e.g. after network
+     * change. Registered handlers are kept, but subscriptions and the
+     * client handle are not. Parameters are like in getLibUPnP().
+     *
+     * @return false if the library could not be initialized again.
+     */
+    bool reinit(const std::string& ifname, const std::string& ip,
+                std::string* hwaddr = 0);
+
     /// Return the IP v4 address as dotted notation
     std::string host();
     
@@ -138,6 +147,8 @@ private:
             const std::string ifname, const std::string ip,
             unsigned short port);
     LibUPnP(const LibUPnP &);
+    void init(std::string *hwaddr, const std::string& ifname,
+              const std::string& ip);
     LibUPnP& operator=(const LibUPnP &);
 
     static int o_callback(Upnp_EventType, void *, void *);
@@ -19,15 +19,7 @@ CoverBackground {
     property string author: app.streamTitle.length === 0 ? av.currentAuthor : app.streamTitle
 
     function togglePlay() {
-        if (av.transportState !== AVTransport.Playing) {
-            av.speed = 1
-            av.play()
-        } else {
-            if (av.pauseSupported)
-                av.pause()
-            else
-                av.stop()
-        }
+        playlist.togglePlay()
     }
 
     Image {
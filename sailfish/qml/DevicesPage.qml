@@ -89,6 +89,7 @@ Page {
 
         delegate: SimpleListItem {
             title.text: model.title
+            title.font.italic: model.grouped
             icon.source: model.icon
             defaultIcon.source: "image://icons/icon-m-device?" + (highlighted ?
                                     Theme.highlightColor : Theme.primaryColor)
@@ -104,6 +105,14 @@ Page {
                     }
                 }
 
+                MenuItem {
+                    text: model.grouped ? qsTr("Remove from group") :
+                                          qsTr("Play in group")
+                    visible: model.supported && av.inited &&
+                             model.id !== av.deviceId
+                    onClicked: listView.model.setGrouped(index, !model.grouped)
+                }
+
                 MenuItem {
                     text: qsTr("Show description")
                     onClicked: {
@@ -40,15 +40,7 @@ Page {
     }
 
     function togglePlay() {
-        if (av.transportState !== AVTransport.Playing) {
-            av.speed = 1
-            av.play()
-        } else {
-            if (av.pauseSupported)
-                av.pause()
-            else
-                av.stop()
-        }
+        playlist.togglePlay()
     }
 
     function doPop() {
@@ -83,10 +75,7 @@ Page {
 
         if (count > 0) {
             console.log("Play: index = " + index)
-            playlist.setToBeActiveIndex(index)
-
-            var nid = playlist.nextId(id)
-            av.setLocalContent(id,nid)
+            playlist.play(id)
         }
     }
 
@@ -584,12 +573,12 @@ Page {
         onForwardClicked: {
             var pos = av.relativeTimePosition + settings.forwardTime
             var max = av.currentTrackDuration
-            av.seek(pos > max ? max : pos)
+            playlist.seek(pos > max ? max : pos)
         }
 
         onBackwardClicked: {
             var pos = av.relativeTimePosition - settings.forwardTime
-            av.seek(pos < 0 ? 0 : pos)
+            playlist.seek(pos < 0 ? 0 : pos)
         }
 
         onRepeatClicked: {
@@ -96,7 +96,7 @@ DockedPanel_ {
 
                 onValueChanged: {
                     if (!blockValueChangedSignal)
-                        av.seek(value)
+                        playlist.seek(value)
                 }
 
                 Component.onCompleted: {